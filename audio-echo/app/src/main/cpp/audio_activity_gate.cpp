@@ -0,0 +1,154 @@
+/*
+ * Copyright 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "audio_activity_gate.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include "audio_common.h"
+
+static inline float DbToLinear(float db) { return powf(10.0f, db / 20.0f); }
+
+// only the audio thread writes the counters, see AudioEffectChain::process()
+static inline void Bump(std::atomic<uint32_t> &counter) {
+  counter.store(counter.load(std::memory_order_relaxed) + 1,
+                std::memory_order_relaxed);
+}
+
+static const char *GetActivityName(AudioActivity activity) {
+  switch (activity) {
+    case AudioActivity::Active:
+      return "active";
+    case AudioActivity::Draining:
+      return "draining";
+    case AudioActivity::Idle:
+      break;
+  }
+  return "idle";
+}
+
+AudioActivityGate::AudioActivityGate(int32_t sampleRate, int32_t channelCount,
+                                     SLuint32 format, float openDb,
+                                     float closeDb, uint32_t holdMs)
+    : AudioFormat(sampleRate, channelCount, format),
+      kernels_(GetPeakKernels()) {
+  setParams(openDb, closeDb, holdMs);
+}
+
+/**
+ * closeDb is clamped to openDb: no hysteresis, rather than a gate that
+ * never closes
+ */
+void AudioActivityGate::setParams(float openDb, float closeDb,
+                                  uint32_t holdMs) {
+  openThreshold_.store(DbToLinear(openDb), std::memory_order_relaxed);
+  closeThreshold_.store(DbToLinear(std::min(closeDb, openDb)),
+                        std::memory_order_relaxed);
+  holdFrames_.store(static_cast<uint32_t>(static_cast<uint64_t>(holdMs) *
+                                          sampleRate_ / 1000000),
+                    std::memory_order_relaxed);
+}
+
+/*
+ * Buffer peak, full scale ( 1.0 )
+ */
+float AudioActivityGate::measurePeak(const void *audio,
+                                     int32_t numFrames) const {
+  int32_t samples = numFrames * channelCount_;
+  switch (encoding_) {
+    case SampleEncoding::Int16:
+      return kernels_.int16_(static_cast<const int16_t *>(audio), samples) *
+             (1.0f / 32768.0f);
+    case SampleEncoding::Int24Packed: {
+      // no SIMD for the packed samples, they are rare
+      const uint8_t *buf = static_cast<const uint8_t *>(audio);
+      int32_t peak = 0;
+      for (int32_t idx = 0; idx < samples; idx++) {
+        peak = std::max(peak, std::abs(Int24Sample::readInt(buf, idx)));
+      }
+      return peak * (1.0f / 8388608.0f);
+    }
+    case SampleEncoding::Float32:
+      return kernels_.float_(static_cast<const float *>(audio), samples);
+  }
+  return 0.0f;
+}
+
+bool AudioActivityGate::onInput(const void *audio, int32_t numFrames) {
+  Bump(buffers_);
+  float peak = measurePeak(audio, numFrames);
+  if (state_ == AudioActivity::Idle) {
+    if (peak < openThreshold_.load(std::memory_order_relaxed)) {
+      Bump(skipped_);
+      return false;
+    }
+    Bump(activations_);
+    state_ = AudioActivity::Active;
+    quietFrames_ = 0;
+  } else if (peak >= closeThreshold_.load(std::memory_order_relaxed)) {
+    state_ = AudioActivity::Active;
+    quietFrames_ = 0;
+  } else if (state_ == AudioActivity::Active) {
+    quietFrames_ += numFrames;
+    if (quietFrames_ >= holdFrames_.load(std::memory_order_relaxed)) {
+      state_ = AudioActivity::Draining;
+      drainedFrames_ = 0;
+    }
+  }
+  published_.store(state_, std::memory_order_relaxed);
+  return true;
+}
+
+/*
+ * One quiet buffer out is not enough: an echo a second long can be quiet
+ * in between its repeats. Idle only once the output stayed quiet for the
+ * longest tail, so no effect still holds anything to play back later.
+ */
+void AudioActivityGate::onOutput(const void *audio, int32_t numFrames,
+                                 uint32_t tailFrames) {
+  if (state_ != AudioActivity::Draining) return;
+  if (measurePeak(audio, numFrames) >=
+      closeThreshold_.load(std::memory_order_relaxed)) {
+    drainedFrames_ = 0;
+    return;
+  }
+  drainedFrames_ += numFrames;
+  if (drainedFrames_ >= tailFrames) {
+    state_ = AudioActivity::Idle;
+    published_.store(state_, std::memory_order_relaxed);
+  }
+}
+
+void AudioActivityGate::getStats(AudioActivityStats *stats) const {
+  stats->buffers_ = buffers_.load(std::memory_order_relaxed);
+  stats->skipped_ = skipped_.load(std::memory_order_relaxed);
+  stats->activations_ = activations_.load(std::memory_order_relaxed);
+  stats->state_ = published_.load(std::memory_order_relaxed);
+}
+
+void AudioActivityGate::resetStats(void) {
+  buffers_.store(0, std::memory_order_relaxed);
+  skipped_.store(0, std::memory_order_relaxed);
+  activations_.store(0, std::memory_order_relaxed);
+}
+
+void AudioActivityGate::dumpStats(void) const {
+  AudioActivityStats stats;
+  getStats(&stats);
+  LOGI("ActivityGate(%s): skipped %d of %d buffers, %d activations, %s",
+       kernels_.name_, stats.skipped_, stats.buffers_, stats.activations_,
+       GetActivityName(stats.state_));
+}
@@ -0,0 +1,94 @@
+/*
+ * Copyright 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef NATIVE_AUDIO_AUDIO_ACTIVITY_GATE_H
+#define NATIVE_AUDIO_AUDIO_ACTIVITY_GATE_H
+
+#include <atomic>
+#include <cstdint>
+
+#include "audio_effect.h"
+#include "audio_effect_simd.h"
+
+enum class AudioActivity {
+  Active,    // the effects run
+  Draining,  // input quiet for the hold time, the effects' tails ring out
+  Idle,      // input and tails quiet: the effects are skipped
+};
+
+/*
+ * What the gate did since the last resetStats()
+ */
+struct AudioActivityStats {
+  uint32_t buffers_;
+  uint32_t skipped_;      // buffers the effects did not run on
+  uint32_t activations_;  // Idle -> Active
+  AudioActivity state_;
+};
+
+/**
+ * Peak detector with hysteresis deciding when AudioEffectChain may skip
+ * its effects, for the ( many ) buffers that are nothing but silence.
+ *   - the buffer peak comes from the SIMD kernels of audio_effect_simd.h,
+ *     a few hundred ns for a buffer
+ *   - above openDb the gate is Active; once the input stayed under closeDb
+ *     for holdMs it is Draining: the effects still run and the output is
+ *     checked too, so echoes and reverb tails are not cut off; when that
+ *     stayed under closeDb for the chain's longest tail
+ *     ( AudioEffect::getTailFrames() ) as well the gate goes Idle, with
+ *     nothing louder than closeDb left inside the effects
+ *   - Idle stays until the input goes over openDb again
+ */
+class AudioActivityGate : public AudioFormat {
+ public:
+  explicit AudioActivityGate(int32_t sampleRate, int32_t channelCount,
+                             SLuint32 format, float openDb, float closeDb,
+                             uint32_t holdMs);
+  void setParams(float openDb, float closeDb, uint32_t holdMs);
+
+  /*
+   * Audio thread, before the effects: false when they can be skipped
+   */
+  bool onInput(const void *audio, int32_t numFrames);
+  /*
+   * Audio thread, after the effects ran on the buffer; tailFrames is the
+   * longest getTailFrames() of the effects that ran
+   */
+  void onOutput(const void *audio, int32_t numFrames, uint32_t tailFrames);
+
+  void getStats(AudioActivityStats *stats) const;
+  void resetStats(void);
+  void dumpStats(void) const;
+
+ private:
+  float measurePeak(const void *audio, int32_t numFrames) const;
+
+  PeakKernels kernels_;
+  std::atomic<float> openThreshold_{1.0f};
+  std::atomic<float> closeThreshold_{1.0f};
+  std::atomic<uint32_t> holdFrames_{0};
+
+  // audio thread only; starts Active, the effects run until proven idle
+  AudioActivity state_ = AudioActivity::Active;
+  uint32_t quietFrames_ = 0;    // input under closeDb, Active
+  uint32_t drainedFrames_ = 0;  // output under closeDb, Draining
+
+  std::atomic<AudioActivity> published_{AudioActivity::Active};
+  std::atomic<uint32_t> buffers_{0};
+  std::atomic<uint32_t> skipped_{0};
+  std::atomic<uint32_t> activations_{0};
+};
+
+#endif  // NATIVE_AUDIO_AUDIO_ACTIVITY_GATE_H
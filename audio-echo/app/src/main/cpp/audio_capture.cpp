@@ -0,0 +1,362 @@
+/*
+ * Copyright 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "audio_capture.h"
+
+#include <fcntl.h>
+#include <sys/uio.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+
+#include "audio_common.h"
+#include "audio_sample.h"
+#include "audio_thread.h"
+
+// slots gathered into one writev()
+static const uint32_t kMaxIov = 64;
+// the RIFF sizes are 32 bit
+static const uint64_t kMaxWavDataBytes = 0xFFFFFFFFull - 64;
+
+static const char *kTapNames[CAPTURE_TAP_COUNT] = {"pre", "post"};
+
+/*
+ * The canonical 44 byte header: RIFF chunk, fmt chunk, data chunk header.
+ * Android is little endian, like the format.
+ */
+struct WavHeader {
+  char riff_[4];
+  uint32_t riffBytes_;  // everything after this field
+  char wave_[4];
+  char fmt_[4];
+  uint32_t fmtBytes_;
+  uint16_t formatTag_;  // 1: integer PCM, 3: IEEE float
+  uint16_t channels_;
+  uint32_t sampleRate_;
+  uint32_t byteRate_;
+  uint16_t blockAlign_;
+  uint16_t bitsPerSample_;
+  char data_[4];
+  uint32_t dataBytes_;
+};
+static_assert(sizeof(WavHeader) == 44, "WAV header is 44 bytes");
+
+static const uint16_t kWavFormatPcm = 1;
+static const uint16_t kWavFormatFloat = 3;
+
+AudioCapture::CaptureSlot *AudioCapture::Stream::MakeSlots(uint32_t slotCount,
+                                                           uint8_t *arena,
+                                                           uint32_t slotBytes) {
+  CaptureSlot *slots = new CaptureSlot[slotCount];
+  for (uint32_t idx = 0; idx < slotCount; idx++) {
+    slots[idx].data_ = arena + static_cast<size_t>(idx) * slotBytes;
+    slots[idx].size_ = 0;
+  }
+  return slots;
+}
+
+AudioCapture::Stream::Stream(uint32_t slotCount, uint32_t slotBytes)
+    : slotBytes_(slotBytes),
+      arena_(new uint8_t[static_cast<size_t>(slotCount) * slotBytes]),
+      ring_(slotCount, MakeSlots(slotCount, arena_.get(), slotBytes)) {
+  // touch every page now, tap() should never fault them in
+  memset(arena_.get(), 0, static_cast<size_t>(slotCount) * slotBytes);
+}
+
+/*
+ * Audio thread: the only copy of the buffer on its way to the file
+ */
+void AudioCapture::Stream::push(const void *audio, uint32_t bytes) {
+  CaptureSlot *slot = ring_.getWriteablePtr();
+  if (!slot || bytes > slotBytes_) {
+    droppedBufs_.fetch_add(1, std::memory_order_relaxed);
+    return;
+  }
+  memcpy(slot->data_, audio, bytes);
+  slot->size_ = bytes;
+  ring_.commitWriteablePtr(slot);
+}
+
+AudioCapture::AudioCapture(int32_t sampleRate, int32_t channelCount,
+                           SLuint32 format, uint32_t maxBufBytes,
+                           uint32_t ringMs)
+    : sampleRate_(sampleRate), channelCount_(channelCount), format_(format) {
+  frameBytes_ = channelCount * (format / 8);
+  uint32_t bufFrames = std::max(maxBufBytes / frameBytes_, 1u);
+  // ringMs of buffers, at least two; the queue rounds up to a power of 2
+  uint64_t bufs = static_cast<uint64_t>(ringMs) * sampleRate_ /
+                  (1000000ull * bufFrames);
+  uint32_t slotCount = 2;
+  while (slotCount < bufs) slotCount <<= 1;
+  for (auto &stream : streams_) {
+    stream.reset(new Stream(slotCount, maxBufBytes));
+  }
+  LOGI("AudioCapture: %d slots of %d bytes per tap ( %d ms )", slotCount,
+       maxBufBytes,
+       static_cast<int32_t>(static_cast<uint64_t>(slotCount) * bufFrames *
+                            1000000 / sampleRate_));
+}
+
+AudioCapture::~AudioCapture() { stop(); }
+
+bool AudioCapture::start(const char *directory, uint32_t fileSeconds,
+                         uint32_t maxFiles) {
+  if (writer_.joinable() || !directory || !fileSeconds || !maxFiles) {
+    return false;
+  }
+
+  directory_ = directory;
+  time_t now = time(nullptr);
+  tm local;
+  localtime_r(&now, &local);
+  char session[32];
+  strftime(session, sizeof(session), "capture_%Y%m%d_%H%M%S", &local);
+  session_ = session;
+  uint64_t byteRate =
+      static_cast<uint64_t>(sampleRate_) / 1000 * frameBytes_;
+  uint64_t maxBytes = std::min(fileSeconds * byteRate, kMaxWavDataBytes);
+  maxDataBytes_ = static_cast<uint32_t>(maxBytes - maxBytes % frameBytes_);
+  maxFiles_ = maxFiles;
+
+  for (auto &stream : streams_) {
+    // nobody writes the rings now: empty what was left after the last stop()
+    CaptureSlot *slots;
+    uint32_t count;
+    while ((count = stream->ring_.getReadableSpan(&slots, UINT32_MAX)) > 0) {
+      stream->ring_.consume(count);
+    }
+    stream->failed_ = false;
+    stream->fileIdx_ = 0;
+    stream->paths_.clear();
+    stream->bytesWritten_.store(0, std::memory_order_relaxed);
+    stream->files_.store(0, std::memory_order_relaxed);
+    stream->deletedFiles_.store(0, std::memory_order_relaxed);
+    stream->droppedBufs_.store(0, std::memory_order_relaxed);
+  }
+
+  quit_ = false;
+  writer_ = std::thread(&AudioCapture::runWriter, this);
+  enabled_.store(true, std::memory_order_release);
+  LOGI("AudioCapture: %s/%s_*.wav, %d s per file, %d files per tap",
+       directory_.c_str(), session_.c_str(), fileSeconds, maxFiles);
+  return true;
+}
+
+/*
+ * The writer empties the rings once more before it quits; a tap() racing
+ * with stop() may leave its buffer behind, start() drops it.
+ */
+void AudioCapture::stop(void) {
+  if (!writer_.joinable()) return;
+  enabled_.store(false, std::memory_order_relaxed);
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    quit_ = true;
+  }
+  wake_.notify_one();
+  writer_.join();
+  dumpStats();
+}
+
+void AudioCapture::runWriter(void) {
+  SetAudioThreadPriority(AudioThreadPriority::Background, 0);
+  std::unique_lock<std::mutex> lock(mutex_);
+  while (!quit_) {
+    wake_.wait_for(lock, std::chrono::milliseconds(kDrainPeriodMs));
+    for (uint32_t tap = 0; tap < CAPTURE_TAP_COUNT; tap++) {
+      drain(tap);
+    }
+  }
+  for (uint32_t tap = 0; tap < CAPTURE_TAP_COUNT; tap++) {
+    drain(tap);
+    closeFile(tap);
+  }
+}
+
+static bool WriteAll(int fd, iovec *iov, int count) {
+  while (count) {
+    ssize_t written = writev(fd, iov, count);
+    if (written < 0 && errno == EINTR) continue;
+    if (written <= 0) return false;
+    // a short write: skip what went out, go on with the rest
+    size_t done = static_cast<size_t>(written);
+    while (count && done >= iov->iov_len) {
+      done -= iov->iov_len;
+      iov++;
+      count--;
+    }
+    if (count) {
+      iov->iov_base = static_cast<uint8_t *>(iov->iov_base) + done;
+      iov->iov_len -= done;
+    }
+  }
+  return true;
+}
+
+/*
+ * Consumer side of the tap's ring: slots that sit next to each other in
+ * the arena go out as one iovec, a file is closed before the slot that
+ * would take it over maxDataBytes_.
+ */
+void AudioCapture::drain(uint32_t tap) {
+  Stream *stream = streams_[tap].get();
+  CaptureSlot *slots;
+  uint32_t count;
+  while ((count = stream->ring_.getReadableSpan(&slots, kMaxIov)) > 0) {
+    iovec iov[kMaxIov];
+    int iovCount = 0;
+    uint64_t bytes = 0;
+    uint32_t idx = 0;
+    for (; idx < count && !stream->failed_; idx++) {
+      const CaptureSlot &slot = slots[idx];
+      if (stream->fd_ >= 0 &&
+          stream->dataBytes_ + slot.size_ > maxDataBytes_) {
+        if (iovCount && !WriteAll(stream->fd_, iov, iovCount)) {
+          LOGE("AudioCapture: write failed ( errno %d )", errno);
+        }
+        iovCount = 0;
+        closeFile(tap);
+      }
+      if (stream->fd_ < 0 && !openFile(tap)) break;
+
+      if (iovCount && static_cast<uint8_t *>(iov[iovCount - 1].iov_base) +
+                              iov[iovCount - 1].iov_len ==
+                          slot.data_) {
+        iov[iovCount - 1].iov_len += slot.size_;
+      } else {
+        iov[iovCount].iov_base = slot.data_;
+        iov[iovCount].iov_len = slot.size_;
+        iovCount++;
+      }
+      stream->dataBytes_ += slot.size_;
+      bytes += slot.size_;
+    }
+    if (iovCount && !WriteAll(stream->fd_, iov, iovCount)) {
+      LOGE("AudioCapture: write failed ( errno %d )", errno);
+    }
+    if (idx < count) {
+      stream->droppedBufs_.fetch_add(count - idx, std::memory_order_relaxed);
+    }
+    stream->bytesWritten_.fetch_add(bytes, std::memory_order_relaxed);
+    stream->ring_.consume(count);
+  }
+  if (stream->fd_ >= 0) updateHeader(stream);
+}
+
+bool AudioCapture::openFile(uint32_t tap) {
+  Stream *stream = streams_[tap].get();
+  while (stream->paths_.size() >= maxFiles_) {
+    if (unlink(stream->paths_.front().c_str())) {
+      LOGW("AudioCapture: cannot delete %s ( errno %d )",
+           stream->paths_.front().c_str(), errno);
+    }
+    stream->paths_.pop_front();
+    stream->deletedFiles_.fetch_add(1, std::memory_order_relaxed);
+  }
+
+  char name[64];
+  snprintf(name, sizeof(name), "/%s_%s_%d.wav", session_.c_str(),
+           kTapNames[tap], stream->fileIdx_++);
+  std::string path = directory_ + name;
+  stream->fd_ = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC,
+                     0644);
+  if (stream->fd_ < 0) {
+    LOGE("AudioCapture: cannot open %s ( errno %d ), %s capture stopped",
+         path.c_str(), errno, kTapNames[tap]);
+    stream->failed_ = true;
+    return false;
+  }
+
+  WavHeader header;
+  memcpy(header.riff_, "RIFF", 4);
+  header.riffBytes_ = sizeof(header) - 8;
+  memcpy(header.wave_, "WAVE", 4);
+  memcpy(header.fmt_, "fmt ", 4);
+  header.fmtBytes_ = 16;
+  header.formatTag_ =
+      GetSampleEncoding(format_) == SampleEncoding::Float32 ? kWavFormatFloat
+                                                            : kWavFormatPcm;
+  header.channels_ = static_cast<uint16_t>(channelCount_);
+  header.sampleRate_ = static_cast<uint32_t>(sampleRate_ / 1000);
+  header.byteRate_ = header.sampleRate_ * frameBytes_;
+  header.blockAlign_ = static_cast<uint16_t>(frameBytes_);
+  header.bitsPerSample_ = static_cast<uint16_t>(format_);
+  memcpy(header.data_, "data", 4);
+  header.dataBytes_ = 0;
+  if (write(stream->fd_, &header, sizeof(header)) != sizeof(header)) {
+    LOGE("AudioCapture: cannot write %s ( errno %d )", path.c_str(), errno);
+  }
+  stream->dataBytes_ = 0;
+  stream->paths_.push_back(path);
+  stream->files_.fetch_add(1, std::memory_order_relaxed);
+  return true;
+}
+
+void AudioCapture::closeFile(uint32_t tap) {
+  Stream *stream = streams_[tap].get();
+  if (stream->fd_ < 0) return;
+  // RIFF chunks are padded to an even size
+  if (stream->dataBytes_ & 1) {
+    uint8_t pad = 0;
+    if (write(stream->fd_, &pad, 1) != 1) {
+      LOGE("AudioCapture: cannot pad %s", stream->paths_.back().c_str());
+    }
+  }
+  updateHeader(stream);
+  close(stream->fd_);
+  stream->fd_ = -1;
+  stream->dataBytes_ = 0;
+}
+
+/*
+ * Sizes for what is in the file so far
+ */
+void AudioCapture::updateHeader(Stream *stream) {
+  uint32_t dataBytes = stream->dataBytes_;
+  uint32_t riffBytes =
+      sizeof(WavHeader) - 8 + dataBytes + (dataBytes & 1);
+  if (pwrite(stream->fd_, &riffBytes, sizeof(riffBytes),
+             offsetof(WavHeader, riffBytes_)) != sizeof(riffBytes) ||
+      pwrite(stream->fd_, &dataBytes, sizeof(dataBytes),
+             offsetof(WavHeader, dataBytes_)) != sizeof(dataBytes)) {
+    LOGE("AudioCapture: cannot update the header of %s",
+         stream->paths_.back().c_str());
+  }
+}
+
+void AudioCapture::getStats(CaptureTap tap, AudioCaptureStats *stats) const {
+  const Stream *stream = streams_[static_cast<uint32_t>(tap)].get();
+  stats->bytesWritten_ = stream->bytesWritten_.load(std::memory_order_relaxed);
+  stats->files_ = stream->files_.load(std::memory_order_relaxed);
+  stats->deletedFiles_ = stream->deletedFiles_.load(std::memory_order_relaxed);
+  stats->droppedBufs_ = stream->droppedBufs_.load(std::memory_order_relaxed);
+}
+
+void AudioCapture::dumpStats(void) const {
+  for (uint32_t tap = 0; tap < CAPTURE_TAP_COUNT; tap++) {
+    AudioCaptureStats stats;
+    getStats(static_cast<CaptureTap>(tap), &stats);
+    LOGI("AudioCapture: %s: %lld bytes in %d files ( %d deleted ), %d "
+         "buffers dropped",
+         kTapNames[tap], static_cast<long long>(stats.bytesWritten_),
+         stats.files_, stats.deletedFiles_, stats.droppedBufs_);
+  }
+}
@@ -0,0 +1,149 @@
+/*
+ * Copyright 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef NATIVE_AUDIO_AUDIO_CAPTURE_H
+#define NATIVE_AUDIO_AUDIO_CAPTURE_H
+
+#include <SLES/OpenSLES.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include "buf_manager.h"
+
+/*
+ * Where in the pipeline a buffer is captured
+ */
+enum class CaptureTap : uint32_t {
+  PreEffect,   // as recorded
+  PostEffect,  // what goes to the player
+};
+#define CAPTURE_TAP_COUNT 2
+
+/*
+ * What one tap did since start()
+ */
+struct AudioCaptureStats {
+  uint64_t bytesWritten_;  // audio bytes, headers not counted
+  uint32_t files_;         // files opened
+  uint32_t deletedFiles_;  // oldest files removed to stay under maxFiles
+  uint32_t droppedBufs_;   // the ring was full, or the buffer too large
+};
+
+/**
+ * Streams the audio at the taps to WAV files, for sessions of any length:
+ *   - tap() runs on the audio thread: when capture is off it is one relaxed
+ *     load; when on, one memcpy of the buffer into a free slot of a ring
+ *     allocated ( and touched ) up front. No lock, no allocation, no I/O;
+ *     a full ring drops the buffer
+ *   - a background thread empties the rings every kDrainPeriodMs with one
+ *     writev() per run of slots, and keeps the WAV header of the open file
+ *     current, so a file cut short by a crash still plays
+ *   - files hold at most fileSeconds of audio; past maxFiles per tap the
+ *     oldest one is deleted, which bounds the disk space a session takes
+ * Every tap must be fed by a single thread.
+ */
+class AudioCapture {
+ public:
+  // how often the writer thread empties the rings
+  static constexpr uint32_t kDrainPeriodMs = 50;
+
+  /*
+   * maxBufBytes: the largest buffer tap() is given
+   * ringMs: audio each ring holds, what the writer may fall behind by
+   */
+  AudioCapture(int32_t sampleRate, int32_t channelCount, SLuint32 format,
+               uint32_t maxBufBytes, uint32_t ringMs);
+  ~AudioCapture();
+
+  /*
+   * Capture into directory, which must exist; the files are named
+   * <session time>_<tap>_<n>.wav. Not for the audio thread.
+   */
+  bool start(const char *directory, uint32_t fileSeconds, uint32_t maxFiles);
+  void stop(void);
+  bool isRunning(void) const {
+    return enabled_.load(std::memory_order_relaxed);
+  }
+
+  void tap(CaptureTap tap, const void *audio, uint32_t bytes) {
+    if (!enabled_.load(std::memory_order_relaxed)) return;
+    streams_[static_cast<uint32_t>(tap)]->push(audio, bytes);
+  }
+
+  void getStats(CaptureTap tap, AudioCaptureStats *stats) const;
+  void dumpStats(void) const;
+
+ private:
+  struct CaptureSlot {
+    uint8_t *data_;  // slotBytes_ of the arena, fixed
+    uint32_t size_;
+  };
+
+  struct Stream {
+    Stream(uint32_t slotCount, uint32_t slotBytes);
+    void push(const void *audio, uint32_t bytes);
+    static CaptureSlot *MakeSlots(uint32_t slotCount, uint8_t *arena,
+                                  uint32_t slotBytes);
+
+    uint32_t slotBytes_;
+    std::unique_ptr<uint8_t[]> arena_;
+    ProducerConsumerQueue<CaptureSlot> ring_;
+
+    // writer thread only
+    int fd_ = -1;
+    bool failed_ = false;  // could not open a file: drop the audio
+    uint32_t dataBytes_ = 0;
+    uint32_t fileIdx_ = 0;
+    std::deque<std::string> paths_;  // oldest first
+
+    std::atomic<uint64_t> bytesWritten_{0};
+    std::atomic<uint32_t> files_{0};
+    std::atomic<uint32_t> deletedFiles_{0};
+    std::atomic<uint32_t> droppedBufs_{0};
+  };
+
+  void runWriter(void);
+  void drain(uint32_t tap);
+  bool openFile(uint32_t tap);
+  void closeFile(uint32_t tap);
+  void updateHeader(Stream *stream);
+
+  int32_t sampleRate_;
+  int32_t channelCount_;
+  SLuint32 format_;
+  uint32_t frameBytes_;
+  std::unique_ptr<Stream> streams_[CAPTURE_TAP_COUNT];
+  std::atomic<bool> enabled_{false};
+
+  // set by start()
+  std::string directory_;
+  std::string session_;
+  uint32_t maxDataBytes_ = 0;
+  uint32_t maxFiles_ = 0;
+
+  std::mutex mutex_;
+  std::condition_variable wake_;
+  std::thread writer_;
+  bool quit_ = false;
+};
+
+#endif  // NATIVE_AUDIO_AUDIO_CAPTURE_H
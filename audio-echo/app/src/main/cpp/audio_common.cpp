@@ -48,9 +48,13 @@ void ConvertToSLSampleFormat(SLAndroidDataFormat_PCM_EX* pFormat,
       pFormat->formatType = SL_ANDROID_DATAFORMAT_PCM_EX;
       break;
     case SL_ANDROID_PCM_REPRESENTATION_SIGNED_INT:
+      // device supports 16, 24, and 32; the echo pipeline runs 16 and packed
+      // 24 bit integers, 32 bit containers are reserved for float
       pFormat->bitsPerSample =
-          SL_PCMSAMPLEFORMAT_FIXED_16;  // supports 16, 24, and 32
-      pFormat->containerSize = SL_PCMSAMPLEFORMAT_FIXED_16;
+          pSampleInfo_->pcmFormat_ == SL_PCMSAMPLEFORMAT_FIXED_24
+              ? SL_PCMSAMPLEFORMAT_FIXED_24
+              : SL_PCMSAMPLEFORMAT_FIXED_16;
+      pFormat->containerSize = pFormat->bitsPerSample;
       pFormat->formatType = SL_ANDROID_DATAFORMAT_PCM_EX;
       break;
     case SL_ANDROID_PCM_REPRESENTATION_FLOAT:
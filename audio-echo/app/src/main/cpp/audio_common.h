@@ -19,6 +19,7 @@
 
 #include <SLES/OpenSLES.h>
 #include <SLES/OpenSLES_Android.h>
+#include <time.h>
 
 #include "android_debug.h"
 #include "buf_manager.h"
@@ -29,14 +30,31 @@
  */
 #define AUDIO_SAMPLE_CHANNELS 1
 
+/*
+ * Sample format of the whole echo pipeline, negotiated with
+ * ConvertToSLSampleFormat():
+ *   representation 0:  legacy 16 bit PCM
+ *   SL_ANDROID_PCM_REPRESENTATION_SIGNED_INT: 16 or 24 bit AUDIO_SAMPLE_BITS
+ *   SL_ANDROID_PCM_REPRESENTATION_FLOAT: 32 bit float
+ * Player, recorder and effects all run natively in it, no conversions.
+ */
+#define AUDIO_SAMPLE_REPRESENTATION 0
+#define AUDIO_SAMPLE_BITS SL_PCMSAMPLEFORMAT_FIXED_16
+
 /*
  * Sample Buffer Controls...
  */
 #define RECORD_DEVICE_KICKSTART_BUF_COUNT 2
+// where the player's adaptive jitter buffer starts ( AudioJitterBuffer )
 #define PLAY_KICKSTART_BUFFER_COUNT 3
 #define DEVICE_SHADOW_BUFFER_QUEUE_LEN 4
 #define BUF_COUNT 16
 
+/*
+ * Longest echo delay the UI could ask for; the delay line is sized for it
+ */
+#define ECHO_MAX_DELAY_IN_MS 1000
+
 struct SampleFormat {
   uint32_t sampleRate_;
   uint32_t framesPerBuf_;
@@ -48,15 +66,20 @@ extern void ConvertToSLSampleFormat(SLAndroidDataFormat_PCM_EX* pFormat,
                                     SampleFormat* format);
 
 /*
- * GetSystemTicks(void):  return the time in micro sec
+ * GetMonotonicNs(void): CLOCK_MONOTONIC time in nano sec; unlike the wall
+ * clock it never jumps, so it is safe for intervals
  */
-__inline__ uint64_t GetSystemTicks(void) {
-  struct timeval Time;
-  gettimeofday(&Time, NULL);
-
-  return (static_cast<uint64_t>(1000000) * Time.tv_sec + Time.tv_usec);
+__inline__ uint64_t GetMonotonicNs(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return static_cast<uint64_t>(ts.tv_sec) * 1000000000ULL + ts.tv_nsec;
 }
 
+/*
+ * GetSystemTicks(void):  return the time in micro sec
+ */
+__inline__ uint64_t GetSystemTicks(void) { return GetMonotonicNs() / 1000; }
+
 #define SLASSERT(x)                   \
   do {                                \
     assert(SL_RESULT_SUCCESS == (x)); \
@@ -69,6 +92,7 @@ __inline__ uint64_t GetSystemTicks(void) {
 #define ENGINE_SERVICE_MSG_KICKSTART_PLAYER 1
 #define ENGINE_SERVICE_MSG_RETRIEVE_DUMP_BUFS 2
 #define ENGINE_SERVICE_MSG_RECORDED_AUDIO_AVAILABLE 3
+#define ENGINE_SERVICE_MSG_PLAY_AUDIO_QUEUED 4
 typedef bool (*ENGINE_CALLBACK)(void* pCTX, uint32_t msg, void* pData);
 
 /*
@@ -0,0 +1,472 @@
+/*
+ * Copyright 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "audio_echo_canceller.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#include "audio_common.h"
+#include "audio_format_convert.h"
+
+// reference ring, in mono samples: a bit over 300 ms at 48 kHz
+static const int32_t kRefQueueSize = 16384;
+// how far ahead of the mic the reference usually is: the peak over this
+static const uint32_t kBacklogWindowMs = 1000;
+// NLMS step for the whole filter, shared by the partitions
+static const float kStepSize = 0.8f;
+// per bin reference power smoothing, per block
+static const float kPowerSmoothing = 0.9f;
+// the step is regularized as if the reference never went below -60 dBFS
+static const float kRegularizationLevel = 1e-3f;
+// no adaptation while the reference is quieter than about -66 dBFS
+static const float kFarEndLevel = 5e-4f;
+// Geigel: near end talk when the mic peak reaches this times the
+// reference peak over the tail; the echo path is assumed to attenuate
+static const float kGeigelThreshold = 1.0f;
+static const uint32_t kHangoverMs = 40;
+// the filter is trusted by the detector once it cancels 6 dB
+static const float kConvergedErle = 4.0f;
+// longest the detector may keep adaptation frozen while the far end talks
+static const uint32_t kMaxFreezeMs = 2000;
+// the error this many times the mic power for that long: the filter may
+// have diverged
+static const float kDivergenceRatio = 4.0f;
+static const uint32_t kDivergenceMs = 50;
+static const float kErleSmoothing = 0.98f;
+
+/*
+ * AudioFormat keeps the sample rate in milli Hz ( SLmilliHertz )
+ */
+static inline uint32_t MsToFrames(uint32_t ms, int32_t sampleRate) {
+  return static_cast<uint32_t>(static_cast<uint64_t>(ms) * sampleRate /
+                               1000000);
+}
+
+// only process() writes the counters, see AudioEffectChain::process()
+static inline void Bump(std::atomic<uint32_t> &counter) {
+  counter.store(counter.load(std::memory_order_relaxed) + 1,
+                std::memory_order_relaxed);
+}
+
+AudioEchoCanceller::AudioEchoCanceller(int32_t sampleRate,
+                                       int32_t channelCount, SLuint32 format,
+                                       uint32_t tailMs)
+    : AudioEffect(sampleRate, channelCount, format),
+      kernels_(GetSpectrumKernels()),
+      fft_(kFftSize),
+      refQueue_(kRefQueueSize) {
+  uint32_t tailFrames =
+      std::max(MsToFrames(tailMs, sampleRate_), kBlockSize);
+  partitions_ = (tailFrames + kBlockSize - 1) / kBlockSize;
+  maxBacklog_ = refQueue_.capacity() / 2;
+  backlogWindow_ = std::max<uint32_t>(
+      MsToFrames(kBacklogWindowMs, sampleRate_) / kBlockSize, 1);
+  hangoverLimit_ =
+      std::max<uint32_t>(MsToFrames(kHangoverMs, sampleRate_) / kBlockSize, 1);
+  freezeLimit_ = std::max<uint32_t>(
+      MsToFrames(kMaxFreezeMs, sampleRate_) / kBlockSize, 1);
+  divergenceLimit_ = std::max<uint32_t>(
+      MsToFrames(kDivergenceMs, sampleRate_) / kBlockSize, 1);
+  stepSize_ = kStepSize / partitions_;
+  regularization_ = kFftSize * kRegularizationLevel * kRegularizationLevel;
+
+  uint32_t channels = static_cast<uint32_t>(std::max(channelCount_, 1));
+  inFifo_.reset(new float[kBlockSize * channels]());
+  outFifo_.reset(new float[kBlockSize * channels]());
+  near_.reset(new float[kBlockSize]());
+  xTime_.reset(new float[kFftSize]());
+  work_.reset(new float[kFftSize]());
+  xPeak_.reset(new float[partitions_]());
+
+  uint32_t spectra = 4 * partitions_ + 6;
+  spectra_.reset(new float[spectra * kBinStride]());
+  float *spectrum = spectra_.get();
+  auto take = [&](uint32_t count) {
+    float *first = spectrum;
+    spectrum += count * kBinStride;
+    return first;
+  };
+  xRe_ = take(partitions_);
+  xIm_ = take(partitions_);
+  wRe_ = take(partitions_);
+  wIm_ = take(partitions_);
+  yRe_ = take(1);
+  yIm_ = take(1);
+  eRe_ = take(1);
+  eIm_ = take(1);
+  power_ = take(1);
+  step_ = take(1);
+
+  LOGI("EchoCanceller: tail %d ms, %d partitions of %d frames, %s kernels",
+       tailMs, partitions_, kBlockSize, kernels_.name_);
+}
+
+/*
+ * Start over with an empty filter: the echo path or the reference
+ * alignment changed.
+ */
+void AudioEchoCanceller::resetFilter(void) {
+  uint32_t spectra = 4 * partitions_ + 6;
+  memset(spectra_.get(), 0, spectra * kBinStride * sizeof(float));
+  memset(xTime_.get(), 0, kFftSize * sizeof(float));
+  memset(xPeak_.get(), 0, partitions_ * sizeof(float));
+  xHead_ = 0;
+  constrainNext_ = 0;
+  hangover_ = 0;
+  frozenBlocks_ = 0;
+  divergedBlocks_ = 0;
+  nearPower_ = 0.0f;
+  errorPower_ = 0.0f;
+}
+
+/**
+ * Player thread: audio just queued to the device, in the effect's format.
+ * Only the producer side of refQueue_ is touched here.
+ */
+void AudioEchoCanceller::pushReference(const void *playAudio,
+                                       int32_t numFrames) {
+  const uint8_t *audio = static_cast<const uint8_t *>(playAudio);
+  switch (encoding_) {
+    case SampleEncoding::Int16:
+      pushSamples<Int16Sample>(audio, numFrames);
+      break;
+    case SampleEncoding::Int24Packed:
+      pushSamples<Int24Sample>(audio, numFrames);
+      break;
+    case SampleEncoding::Float32:
+      pushSamples<Float32Sample>(audio, numFrames);
+      break;
+  }
+}
+
+template <typename Sample>
+void AudioEchoCanceller::pushSamples(const uint8_t *audio,
+                                     int32_t numFrames) {
+  float gain = 1.0f / channelCount_;
+  int32_t frame = 0;
+  while (frame < numFrames) {
+    float *span;
+    uint32_t count = refQueue_.getWriteableSpan(
+        &span, static_cast<uint32_t>(numFrames - frame));
+    if (!count) {
+      // process() is not running ( bypassed ): it realigns when it is back
+      if (!refOverflow_.exchange(true, std::memory_order_relaxed)) {
+        refOverruns_.fetch_add(1, std::memory_order_relaxed);
+      }
+      return;
+    }
+    for (uint32_t idx = 0; idx < count; idx++, frame++) {
+      float sum = 0.0f;
+      for (int32_t ch = 0; ch < channelCount_; ch++) {
+        sum += Sample::read(audio, frame * channelCount_ + ch);
+      }
+      span[idx] = sum * gain;
+    }
+    refQueue_.commitWriteableSpan(count);
+  }
+}
+
+/**
+ * Take the reference matching the next mic block: the next kBlockSize
+ * samples, as the player and the recorder run off the same clock. Short
+ * of them, the rest is padded with silence, which only makes the echo
+ * look later.
+ * @return false while resyncing, the mic block has no reference
+ */
+bool AudioEchoCanceller::readReference(float *ref) {
+  uint32_t backlog = refQueue_.size();
+  bool overflow = refOverflow_.load(std::memory_order_relaxed);
+  if (overflow || backlog > maxBacklog_) {
+    // the reference ran away from the mic ( bypassed, or the recorder
+    // stalled ): drop the stale part and go on as far ahead of the mic as
+    // the reference used to be, so the echo keeps its delay
+    if (overflow) {
+      refQueue_.consume(backlog);
+      refOverflow_.store(false, std::memory_order_relaxed);
+      resyncing_ = true;
+    } else {
+      refQueue_.consume(backlog - steadyBacklog_);
+      backlog = steadyBacklog_;
+    }
+    resetFilter();
+    Bump(realigns_);
+  }
+  if (resyncing_) {
+    if (backlog < std::max(steadyBacklog_, kBlockSize)) return false;
+    resyncing_ = false;
+  }
+
+  backlogPeak_ = std::max(backlogPeak_, backlog);
+  if (++backlogBlocks_ == backlogWindow_) {
+    steadyBacklog_ = backlogPeak_;
+    backlogPeak_ = 0;
+    backlogBlocks_ = 0;
+  }
+
+  uint32_t got = 0;
+  while (got < kBlockSize) {
+    float *span;
+    uint32_t count = refQueue_.getReadableSpan(&span, kBlockSize - got);
+    if (!count) break;
+    memcpy(ref + got, span, count * sizeof(float));
+    refQueue_.consume(count);
+    got += count;
+  }
+  if (got < kBlockSize) {
+    memset(ref + got, 0, (kBlockSize - got) * sizeof(float));
+    Bump(refUnderruns_);
+  }
+  return true;
+}
+
+void AudioEchoCanceller::process(void *liveAudio, int32_t numFrames) {
+  uint8_t *audio = static_cast<uint8_t *>(liveAudio);
+  switch (encoding_) {
+    case SampleEncoding::Int16:
+      processSamples<Int16Sample>(audio, numFrames);
+      break;
+    case SampleEncoding::Int24Packed:
+      processSamples<Int24Sample>(audio, numFrames);
+      break;
+    case SampleEncoding::Float32:
+      processSamples<Float32Sample>(audio, numFrames);
+      break;
+  }
+}
+
+/*
+ * Nothing recorded to clean: drop the reference of those frames, so the
+ * reference stays as far ahead of the mic as it was and the filter keeps
+ * its delay.
+ */
+void AudioEchoCanceller::skip(int32_t numFrames) {
+  refQueue_.consume(
+      std::min(refQueue_.size(), static_cast<uint32_t>(numFrames)));
+}
+
+/*
+ * Swap the recorded frames with the cleaned ones of the previous block,
+ * running the filter every time a block is complete.
+ */
+template <typename Sample>
+void AudioEchoCanceller::processSamples(uint8_t *liveAudio,
+                                        int32_t numFrames) {
+  int32_t frame = 0;
+  while (frame < numFrames) {
+    uint32_t count = std::min(static_cast<uint32_t>(numFrames - frame),
+                              kBlockSize - fifoPos_);
+    int32_t first = frame * channelCount_;
+    int32_t fifoFirst = fifoPos_ * channelCount_;
+    uint8_t *audio = liveAudio + first * Sample::kBytes;
+    int32_t samples = static_cast<int32_t>(count) * channelCount_;
+    ConvertSamples(audio, Sample::kEncoding, &inFifo_[fifoFirst],
+                   SampleEncoding::Float32, samples, nullptr);
+    ConvertSamples(&outFifo_[fifoFirst], SampleEncoding::Float32, audio,
+                   Sample::kEncoding, samples,
+                   outChanged_ ? &dither_ : nullptr);
+    frame += count;
+    fifoPos_ += count;
+    if (fifoPos_ == kBlockSize) {
+      processBlock();
+      fifoPos_ = 0;
+    }
+  }
+}
+
+/*
+ * One kBlockSize block: inFifo_ -> outFifo_
+ */
+void AudioEchoCanceller::processBlock(void) {
+  uint32_t samples = kBlockSize * channelCount_;
+  float *x = xTime_.get() + kBlockSize;
+  memmove(xTime_.get(), x, kBlockSize * sizeof(float));
+  if (!readReference(x)) {
+    memcpy(outFifo_.get(), inFifo_.get(), samples * sizeof(float));
+    outChanged_ = false;
+    return;
+  }
+  Bump(blocks_);
+
+  float *d = near_.get();
+  float gain = 1.0f / channelCount_;
+  float nearPeak = 0.0f, nearEnergy = 0.0f, farEnergy = 0.0f, farPeak = 0.0f;
+  for (uint32_t n = 0; n < kBlockSize; n++) {
+    float sum = 0.0f;
+    for (int32_t ch = 0; ch < channelCount_; ch++) {
+      sum += inFifo_[n * channelCount_ + ch];
+    }
+    d[n] = sum * gain;
+    nearPeak = std::max(nearPeak, fabsf(d[n]));
+    nearEnergy += d[n] * d[n];
+    farPeak = std::max(farPeak, fabsf(x[n]));
+    farEnergy += x[n] * x[n];
+  }
+
+  // the newest reference block goes in front of the partitions
+  xHead_ = (xHead_ ? xHead_ : partitions_) - 1;
+  float *xRe = xRe_ + xHead_ * kBinStride;
+  float *xIm = xIm_ + xHead_ * kBinStride;
+  fft_.forward(xTime_.get(), xRe, xIm);
+  xPeak_[xHead_] = farPeak;
+  for (uint32_t k = 0; k < kBinCount; k++) {
+    float power = xRe[k] * xRe[k] + xIm[k] * xIm[k];
+    power_[k] = kPowerSmoothing * power_[k] + (1.0f - kPowerSmoothing) * power;
+  }
+
+  // echo estimate: sum of partition p's filter times the reference p
+  // blocks back, the last kBlockSize samples of the overlap-save output
+  memset(yRe_, 0, kBinStride * sizeof(float));
+  memset(yIm_, 0, kBinStride * sizeof(float));
+  for (uint32_t p = 0, slot = xHead_; p < partitions_; p++) {
+    kernels_.mac_(yRe_, yIm_, wRe_ + p * kBinStride, wIm_ + p * kBinStride,
+                  xRe_ + slot * kBinStride, xIm_ + slot * kBinStride,
+                  kBinCount);
+    if (++slot == partitions_) slot = 0;
+  }
+  float *work = work_.get();
+  fft_.inverse(yRe_, yIm_, work);
+  const float *y = work + kBlockSize;
+
+  float errorEnergy = 0.0f, echoEnergy = 0.0f, echoPeak = 0.0f;
+  for (uint32_t n = 0; n < kBlockSize; n++) {
+    float e = d[n] - y[n];
+    errorEnergy += e * e;
+    echoEnergy += y[n] * y[n];
+    echoPeak = std::max(echoPeak, fabsf(y[n]));
+  }
+  float tailPeak = 0.0f;
+  for (uint32_t p = 0; p < partitions_; p++) {
+    tailPeak = std::max(tailPeak, xPeak_[p]);
+  }
+
+  // the filter adds echo instead of removing it: pass the mic through,
+  // and start over if it is way off. 3 dB of margin, as near end talk
+  // and echo do not add up to the sum of their energies in one block
+  bool bypass = errorEnergy > 2.0f * nearEnergy;
+  // nothing subtracted ( bypassed, or no echo yet ) leaves the mic exact
+  outChanged_ = !bypass && echoPeak > 0.0f;
+  for (uint32_t n = 0; n < kBlockSize; n++) {
+    float echo = bypass ? 0.0f : y[n];
+    for (int32_t ch = 0; ch < channelCount_; ch++) {
+      uint32_t idx = n * channelCount_ + ch;
+      outFifo_[idx] = inFifo_[idx] - echo;
+    }
+  }
+  float floor = kBlockSize * kFarEndLevel * kFarEndLevel;
+  // diverged: the error well above the mic, from an echo estimate louder
+  // than anything played over the tail
+  if (errorEnergy <= kDivergenceRatio * nearEnergy + floor ||
+      echoPeak <= tailPeak) {
+    divergedBlocks_ = 0;
+  } else if (++divergedBlocks_ >= divergenceLimit_) {
+    memset(wRe_, 0, partitions_ * kBinStride * sizeof(float));
+    memset(wIm_, 0, partitions_ * kBinStride * sizeof(float));
+    divergedBlocks_ = 0;
+    nearPower_ = 0.0f;
+    errorPower_ = 0.0f;
+    Bump(resets_);
+    return;
+  }
+
+  // near end talk: louder than the echo could be, or, once the filter
+  // models the echo, more left after cancelling than the echo it found
+  bool converged = nearPower_ > kConvergedErle * errorPower_;
+  if ((nearPeak >= kGeigelThreshold * tailPeak && nearEnergy > floor) ||
+      (converged && errorEnergy > echoEnergy + floor)) {
+    hangover_ = hangoverLimit_;
+  }
+  if (hangover_) {
+    hangover_--;
+    Bump(doubleTalkBlocks_);
+    // frozen that long while the far end talks: more likely the echo path
+    // changed, go back to trusting the Geigel test alone
+    if (farEnergy > floor && ++frozenBlocks_ >= freezeLimit_) {
+      errorPower_ = nearPower_;
+      frozenBlocks_ = 0;
+    }
+    return;
+  }
+  if (farEnergy <= floor) return;
+  frozenBlocks_ = 0;
+
+  nearPower_ = kErleSmoothing * nearPower_ + (1.0f - kErleSmoothing) *
+                                                  nearEnergy;
+  errorPower_ = kErleSmoothing * errorPower_ +
+                (1.0f - kErleSmoothing) * std::min(errorEnergy, nearEnergy);
+  if (errorPower_ > 0.0f) {
+    erleDb_.store(10.0f * log10f(nearPower_ / errorPower_),
+                  std::memory_order_relaxed);
+  }
+
+  // NLMS: W_p += mu / P_k * conj(X_p) * E, E the spectrum of [ 0, e ]
+  memset(work, 0, kBlockSize * sizeof(float));
+  for (uint32_t n = 0; n < kBlockSize; n++) {
+    work[kBlockSize + n] = d[n] - y[n];
+  }
+  fft_.forward(work, eRe_, eIm_);
+  for (uint32_t k = 0; k < kBinCount; k++) {
+    step_[k] = stepSize_ / (power_[k] + regularization_);
+  }
+  for (uint32_t p = 0, slot = xHead_; p < partitions_; p++) {
+    kernels_.conjMac_(wRe_ + p * kBinStride, wIm_ + p * kBinStride,
+                      xRe_ + slot * kBinStride, xIm_ + slot * kBinStride,
+                      eRe_, eIm_, step_, kBinCount);
+    if (++slot == partitions_) slot = 0;
+  }
+
+  // keep one partition a linear ( not circular ) filter per block:
+  // its impulse response must fit in the first kBlockSize taps
+  float *wRe = wRe_ + constrainNext_ * kBinStride;
+  float *wIm = wIm_ + constrainNext_ * kBinStride;
+  fft_.inverse(wRe, wIm, work);
+  memset(work + kBlockSize, 0, kBlockSize * sizeof(float));
+  fft_.forward(work, wRe, wIm);
+  if (++constrainNext_ == partitions_) constrainNext_ = 0;
+  Bump(adaptedBlocks_);
+}
+
+void AudioEchoCanceller::getStats(AudioEchoCancellerStats *stats) const {
+  stats->erleDb_ = erleDb_.load(std::memory_order_relaxed);
+  stats->blocks_ = blocks_.load(std::memory_order_relaxed);
+  stats->adaptedBlocks_ = adaptedBlocks_.load(std::memory_order_relaxed);
+  stats->doubleTalkBlocks_ = doubleTalkBlocks_.load(std::memory_order_relaxed);
+  stats->resets_ = resets_.load(std::memory_order_relaxed);
+  stats->realigns_ = realigns_.load(std::memory_order_relaxed);
+  stats->refUnderruns_ = refUnderruns_.load(std::memory_order_relaxed);
+  stats->refOverruns_ = refOverruns_.load(std::memory_order_relaxed);
+}
+
+void AudioEchoCanceller::resetStats(void) {
+  blocks_.store(0, std::memory_order_relaxed);
+  adaptedBlocks_.store(0, std::memory_order_relaxed);
+  doubleTalkBlocks_.store(0, std::memory_order_relaxed);
+  resets_.store(0, std::memory_order_relaxed);
+  realigns_.store(0, std::memory_order_relaxed);
+  refUnderruns_.store(0, std::memory_order_relaxed);
+  refOverruns_.store(0, std::memory_order_relaxed);
+}
+
+void AudioEchoCanceller::dumpStats(void) const {
+  AudioEchoCancellerStats stats;
+  getStats(&stats);
+  LOGI("EchoCanceller: ERLE=%.1f dB, blocks=%d, adapted=%d, double talk=%d, "
+       "resets=%d",
+       stats.erleDb_, stats.blocks_, stats.adaptedBlocks_,
+       stats.doubleTalkBlocks_, stats.resets_);
+  LOGI("EchoCanceller: reference realigns=%d, underruns=%d, overruns=%d",
+       stats.realigns_, stats.refUnderruns_, stats.refOverruns_);
+}
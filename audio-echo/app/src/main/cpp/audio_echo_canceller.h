@@ -0,0 +1,148 @@
+/*
+ * Copyright 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef NATIVE_AUDIO_AUDIO_ECHO_CANCELLER_H
+#define NATIVE_AUDIO_AUDIO_ECHO_CANCELLER_H
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+
+#include "audio_effect.h"
+#include "audio_fft.h"
+#include "buf_manager.h"
+
+/*
+ * What the echo canceller did since the last resetStats()
+ */
+struct AudioEchoCancellerStats {
+  float erleDb_;               // smoothed, over blocks with far end only
+  uint32_t blocks_;
+  uint32_t adaptedBlocks_;
+  uint32_t doubleTalkBlocks_;  // adaptation frozen by the detector
+  uint32_t resets_;            // filter diverged and was cleared
+  uint32_t realigns_;          // reference backlog dropped and resynced
+  uint32_t refUnderruns_;      // blocks short of reference, padded with 0
+  uint32_t refOverruns_;       // pushReference() found the ring full
+};
+
+/**
+ * Acoustic echo canceller: removes what the player sent to the speaker
+ * from the recorded audio.
+ *   - block frequency domain NLMS ( MDF ): the tailMs long filter is cut
+ *     into kBlockSize long partitions, filtered and adapted per FFT bin
+ *     with the SIMD kernels of audio_effect_simd.h
+ *   - per block cost is fixed: one reference FFT, one inverse FFT for the
+ *     echo estimate, one error FFT and a gradient constraint on a single
+ *     partition ( round robin ), so a callback costs the same whether the
+ *     filter is converging or not
+ *   - a double talk detector freezes adaptation while the near end talks:
+ *     Geigel test, plus the residual against the echo estimate once the
+ *     filter has converged; a divergence check clears the filter when it
+ *     makes things worse
+ *   - the output is kBlockSize frames late ( getLatencyFrames() )
+ * pushReference() is called by the player thread with every buffer it
+ * queues to the device; the reference is downmixed to mono and handed to
+ * process() through a lock free ring, and read in step with the mic.
+ * The device queue and the round trip latency become a bulk delay in the
+ * echo path: that, plus the room's echo, has to fit in the tail.
+ * All channels of the recorded audio get the same echo estimate removed.
+ */
+class AudioEchoCanceller : public AudioEffect {
+ public:
+  static constexpr uint32_t kBlockSize = 128;
+  static constexpr uint32_t kDefaultTailMs = 128;
+
+  explicit AudioEchoCanceller(int32_t sampleRate, int32_t channelCount,
+                              SLuint32 format, uint32_t tailMs);
+  void pushReference(const void *playAudio, int32_t numFrames);
+  void process(void *liveAudio, int32_t numFrames) override;
+  void skip(int32_t numFrames) override;
+  const char *name(void) const override { return "echo-canceller"; }
+  uint32_t getLatencyFrames(void) const { return kBlockSize; }
+  uint32_t getTailFrames(void) const override { return kBlockSize; }
+
+  void getStats(AudioEchoCancellerStats *stats) const;
+  void resetStats(void);
+  void dumpStats(void) const;
+
+ private:
+  static constexpr uint32_t kFftSize = 2 * kBlockSize;
+  static constexpr uint32_t kBinCount = kBlockSize + 1;
+  // spectra are padded to a multiple of 8 bins, the widest SIMD step
+  static constexpr uint32_t kBinStride = (kBinCount + 7) & ~7u;
+
+  template <typename Sample>
+  void pushSamples(const uint8_t *audio, int32_t numFrames);
+  template <typename Sample>
+  void processSamples(uint8_t *liveAudio, int32_t numFrames);
+  bool readReference(float *ref);
+  void processBlock(void);
+  void resetFilter(void);
+
+  SpectrumKernels kernels_;
+  AudioFft fft_;
+  uint32_t partitions_;
+  uint32_t maxBacklog_;     // more than this, and the mic fell behind
+  uint32_t backlogWindow_;  // in blocks
+
+  // player thread -> process()
+  ProducerConsumerQueue<float> refQueue_;
+  std::atomic<bool> refOverflow_{false};
+
+  // process() only
+  bool resyncing_ = false;
+  uint32_t steadyBacklog_ = 0;  // reference usually queued at a block
+  uint32_t backlogPeak_ = 0;
+  uint32_t backlogBlocks_ = 0;
+  uint32_t fifoPos_ = 0;  // frames in inFifo_ / left to read in outFifo_
+  std::unique_ptr<float[]> inFifo_;   // kBlockSize interleaved frames
+  std::unique_ptr<float[]> outFifo_;  // the previous block, cleaned
+  bool outChanged_ = false;  // outFifo_ is not just the mic: dither it
+  std::unique_ptr<float[]> near_;     // kBlockSize mono mic samples
+  std::unique_ptr<float[]> xTime_;    // last kFftSize reference samples
+  std::unique_ptr<float[]> work_;     // kFftSize scratch
+  std::unique_ptr<float[]> spectra_;  // everything below, one allocation
+  float *xRe_, *xIm_;                 // partitions_ reference spectra
+  float *wRe_, *wIm_;                 // partitions_ filter spectra
+  float *yRe_, *yIm_;                 // echo estimate
+  float *eRe_, *eIm_;                 // error
+  float *power_;                      // smoothed reference power per bin
+  float *step_;                       // per bin step size
+  std::unique_ptr<float[]> xPeak_;    // per partition reference peak
+  uint32_t xHead_ = 0;                // newest partition
+  uint32_t constrainNext_ = 0;
+  uint32_t hangover_ = 0;  // blocks adaptation stays frozen
+  uint32_t hangoverLimit_;
+  uint32_t frozenBlocks_ = 0;
+  uint32_t freezeLimit_;
+  uint32_t divergedBlocks_ = 0;
+  uint32_t divergenceLimit_;
+  float stepSize_;
+  float regularization_;
+  float nearPower_ = 0.0f;  // smoothed, for the ERLE
+  float errorPower_ = 0.0f;
+
+  std::atomic<float> erleDb_{0.0f};
+  std::atomic<uint32_t> blocks_{0};
+  std::atomic<uint32_t> adaptedBlocks_{0};
+  std::atomic<uint32_t> doubleTalkBlocks_{0};
+  std::atomic<uint32_t> resets_{0};
+  std::atomic<uint32_t> realigns_{0};
+  std::atomic<uint32_t> refUnderruns_{0};
+  std::atomic<uint32_t> refOverruns_{0};
+};
+
+#endif  // NATIVE_AUDIO_AUDIO_ECHO_CANCELLER_H
@@ -15,90 +15,128 @@
  */
 #include "audio_effect.h"
 
-#include <climits>
+#include <algorithm>
 #include <cstring>
 
 #include "audio_common.h"
 
+static const uint32_t kMsPerSec = 1000;
 /*
- * Mixing Audio in integer domain to avoid FP calculation
- *   (FG * ( MixFactor * 16 ) + BG * ( (1.0f-MixFactor) * 16 )) / 16
+ * Length of the crossfade between the old and the new delay tap when the
+ * delay time changes, and the largest feedbackFactor_ step taken per
+ * process() call when the decay weight changes.
  */
-static const int32_t kFloatToIntMapFactor = 128;
-static const uint32_t kMsPerSec = 1000;
+static const uint32_t kDelayCrossfadeMs = 20;
+static const int32_t kDecayRampStep = 4;
+
+/*
+ * delay frames and feedback factor are published together in one atomic
+ * word, so the audio thread always sees a consistent pair.
+ */
+static inline uint64_t PackParams(uint32_t delayFrames,
+                                  int32_t feedbackFactor) {
+  return (static_cast<uint64_t>(delayFrames) << 32) |
+         static_cast<uint32_t>(feedbackFactor);
+}
+static inline uint32_t UnpackDelayFrames(uint64_t params) {
+  return static_cast<uint32_t>(params >> 32);
+}
+static inline int32_t UnpackFeedbackFactor(uint64_t params) {
+  return static_cast<int32_t>(static_cast<uint32_t>(params));
+}
+
+/*
+ * decay weight 0.0 -- 1.0 to the integer feedback factor, rounded to the
+ * nearest step of 1 / kFloatToIntMapFactor
+ */
+static inline int32_t DecayToFeedbackFactor(float decayWeight) {
+  return static_cast<int32_t>(decayWeight * kFloatToIntMapFactor + 0.5f);
+}
+
 /**
  * Constructor for AudioDelay
  * @param sampleRate
  * @param channelCount
  * @param format
  * @param delayTimeInMs
+ * @param decayWeight
+ * @param maxDelayTimeInMs is the longest delay setDelayTime() accepts; the
+ *        delay line is allocated for it once, here.
  */
 AudioDelay::AudioDelay(int32_t sampleRate, int32_t channelCount,
-                       SLuint32 format, size_t delayTimeInMs, float decayWeight)
-    : AudioFormat(sampleRate, channelCount, format),
+                       SLuint32 format, size_t delayTimeInMs, float decayWeight,
+                       size_t maxDelayTimeInMs)
+    : AudioEffect(sampleRate, channelCount, format),
       delayTime_(delayTimeInMs),
-      decayWeight_(decayWeight) {
-  feedbackFactor_ = static_cast<int32_t>(decayWeight_ * kFloatToIntMapFactor);
+      decayWeight_(decayWeight),
+      maxDelayTime_(std::max(maxDelayTimeInMs, delayTimeInMs)),
+      mixKernel_(GetDelayMixKernel()) {
+  bufSize_ = std::max(msToFrames(maxDelayTime_), 1u);
+  size_t lineSamples = static_cast<size_t>(bufSize_) * channelCount_;
+  if (encoding_ == SampleEncoding::Int16) {
+    buffer_ = new int16_t[lineSamples];
+    memset(buffer_, 0, sizeof(int16_t) * lineSamples);
+  } else {
+    buffer_ = new float[lineSamples];
+    memset(buffer_, 0, sizeof(float) * lineSamples);
+  }
+  assert(buffer_);
+
+  delayFrames_ = msToFrames(delayTime_);
+  targetFeedbackFactor_ = DecayToFeedbackFactor(decayWeight_);
+  publishParams();
+
+  curDelayFrames_ = delayFrames_;
+  feedbackFactor_ = targetFeedbackFactor_;
   liveAudioFactor_ = kFloatToIntMapFactor - feedbackFactor_;
-  allocateBuffer();
+  fadeLen_ = std::max(msToFrames(kDelayCrossfadeMs), 1u);
+  fadePos_ = fadeLen_;
+
+  LOGI("AudioDelay uses %s mixing kernel", GetDelayMixKernelName());
 }
 
 /**
  * Destructor
  */
 AudioDelay::~AudioDelay() {
-  if (buffer_) delete static_cast<uint8_t*>(buffer_);
+  if (encoding_ == SampleEncoding::Int16) {
+    delete[] static_cast<int16_t*>(buffer_);
+  } else {
+    delete[] static_cast<float*>(buffer_);
+  }
 }
 
 /**
- * Configure for delay time ( in miliseconds ), dynamically adjustable
- * @param delayTimeInMS in miliseconds
- * @return true if delay time is set successfully
+ * Convert delay time in miliseconds to audio frames
  */
-bool AudioDelay::setDelayTime(size_t delayTimeInMS) {
-  if (delayTimeInMS == delayTime_) return true;
-
-  std::lock_guard<std::mutex> lock(lock_);
-
-  if (buffer_) {
-    delete static_cast<uint8_t*>(buffer_);
-    buffer_ = nullptr;
-  }
-
-  delayTime_ = delayTimeInMS;
-  allocateBuffer();
-  return buffer_ != nullptr;
+uint32_t AudioDelay::msToFrames(size_t ms) const {
+  float floatDelayTime = (float)ms / kMsPerSec;
+  float fNumFrames = floatDelayTime * (float)sampleRate_ / kMsPerSec;
+  return static_cast<uint32_t>(fNumFrames + 0.5f);
 }
 
 /**
- * Internal helper function to allocate buffer for the delay
- *  - calculate the buffer size for the delay time
- *  - allocate and zero out buffer (0 means silent audio)
- *  - configure bufSize_ to be size of audioFrames
+ * Hand the current delay/decay pair over to the audio thread
  */
-void AudioDelay::allocateBuffer(void) {
-  float floatDelayTime = (float)delayTime_ / kMsPerSec;
-  float fNumFrames = floatDelayTime * (float)sampleRate_ / kMsPerSec;
-  size_t sampleCount = static_cast<uint32_t>(fNumFrames + 0.5f) * channelCount_;
-
-  uint32_t bytePerSample = format_ / 8;
-  assert(bytePerSample <= 4 && bytePerSample);
-
-  uint32_t bytePerFrame = channelCount_ * bytePerSample;
-
-  // get bufCapacity in bytes
-  bufCapacity_ = sampleCount * bytePerSample;
-  bufCapacity_ =
-      ((bufCapacity_ + bytePerFrame - 1) / bytePerFrame) * bytePerFrame;
-
-  buffer_ = new uint8_t[bufCapacity_];
-  assert(buffer_);
+void AudioDelay::publishParams(void) {
+  params_.store(PackParams(delayFrames_, targetFeedbackFactor_),
+                std::memory_order_release);
+}
 
-  memset(buffer_, 0, bufCapacity_);
-  curPos_ = 0;
+/**
+ * Configure for delay time ( in miliseconds ), dynamically adjustable
+ * @param delayTimeInMS in miliseconds
+ * @return true if delay time is set successfully, false if it is longer
+ *         than the maxDelayTimeInMs given to the constructor
+ */
+bool AudioDelay::setDelayTime(size_t delayTimeInMS) {
+  if (delayTimeInMS == delayTime_) return true;
+  if (delayTimeInMS > maxDelayTime_) return false;
 
-  // bufSize_ is in Frames ( not samples, not bytes )
-  bufSize_ = bufCapacity_ / bytePerFrame;
+  delayTime_ = delayTimeInMS;
+  delayFrames_ = msToFrames(delayTime_);
+  publishParams();
+  return true;
 }
 
 size_t AudioDelay::getDelayTime(void) const { return delayTime_; }
@@ -112,60 +150,190 @@ size_t AudioDelay::getDelayTime(void) const { return delayTime_; }
  */
 void AudioDelay::setDecayWeight(float weight) {
   if (weight > 0.0f && weight < 1.0f) {
-    float feedback = (weight * kFloatToIntMapFactor + 0.5f);
-    feedbackFactor_ = static_cast<int32_t>(feedback);
-    liveAudioFactor_ = kFloatToIntMapFactor - feedbackFactor_;
+    decayWeight_ = weight;
+    targetFeedbackFactor_ = DecayToFeedbackFactor(weight);
+    publishParams();
   }
 }
 
 float AudioDelay::getDecayWeight(void) const { return decayWeight_; }
 
+/**
+ * skip(): the chain is idle, its input silent. Keep the write position
+ * moving with time and write that silence, so the delay line never holds
+ * echoes from before the idle stretch at the wrong distance: they would
+ * play back, late, as soon as the chain runs again.
+ */
+void AudioDelay::skip(int32_t numFrames) {
+  size_t sampleBytes =
+      encoding_ == SampleEncoding::Int16 ? sizeof(int16_t) : sizeof(float);
+  uint8_t* line = static_cast<uint8_t*>(buffer_);
+  // past a whole line it is all silence, where writePos_ ends up no longer
+  // matters
+  uint32_t frames = std::min(static_cast<uint32_t>(std::max(numFrames, 0)),
+                             bufSize_);
+  while (frames) {
+    uint32_t count = std::min(frames, bufSize_ - writePos_);
+    memset(line + writePos_ * channelCount_ * sampleBytes, 0,
+           count * channelCount_ * sampleBytes);
+    writePos_ = (writePos_ + count) % bufSize_;
+    frames -= count;
+  }
+}
+
+/**
+ * Once the output was quiet for as long as the delay, so is everything in
+ * the line that is still to be played; during a crossfade both taps count.
+ */
+uint32_t AudioDelay::getTailFrames(void) const {
+  if (fadePos_ < fadeLen_) return std::max(curDelayFrames_, fadeFromFrames_);
+  return curDelayFrames_;
+}
+
+/**
+ * mixSteady(): run the mixing kernel over the delay line at a fixed delay,
+ * split wherever the read or the write position wraps around.
+ */
+void AudioDelay::mixSteady(int16_t* liveAudio, uint32_t numFrames) {
+  int16_t* line = static_cast<int16_t*>(buffer_);
+  uint32_t done = 0;
+  while (done < numFrames) {
+    uint32_t readPos = (writePos_ + bufSize_ - curDelayFrames_) % bufSize_;
+    uint32_t frames = std::min(numFrames - done, bufSize_ - writePos_);
+    frames = std::min(frames, bufSize_ - readPos);
+
+    // a tap closer than the block reads what this block writes: only the
+    // sequential kernel gets that right
+    DelayMixKernel kernel =
+        curDelayFrames_ < frames ? DelayMixScalar : mixKernel_;
+    kernel(&liveAudio[done * channelCount_], &line[readPos * channelCount_],
+           &line[writePos_ * channelCount_], frames * channelCount_,
+           feedbackFactor_, liveAudioFactor_);
+
+    done += frames;
+    writePos_ = (writePos_ + frames) % bufSize_;
+  }
+}
+
+/**
+ * mixCrossfade(): while the delay time changes, the delayed audio is a
+ * linear crossfade from the old tap to the new one.
+ */
+void AudioDelay::mixCrossfade(int16_t* liveAudio, uint32_t numFrames) {
+  int16_t* line = static_cast<int16_t*>(buffer_);
+  for (uint32_t frame = 0; frame < numFrames; frame++) {
+    uint32_t fromPos = (writePos_ + bufSize_ - fadeFromFrames_) % bufSize_;
+    uint32_t toPos = (writePos_ + bufSize_ - curDelayFrames_) % bufSize_;
+    int32_t toGain = static_cast<int32_t>(fadePos_);
+    int32_t fromGain = static_cast<int32_t>(fadeLen_) - toGain;
+
+    for (int32_t ch = 0; ch < channelCount_; ch++) {
+      int32_t delayed = (line[fromPos * channelCount_ + ch] * fromGain +
+                         line[toPos * channelCount_ + ch] * toGain) /
+                        static_cast<int32_t>(fadeLen_);
+      int16_t out = static_cast<int16_t>(delayed);
+      DelayMixScalar(&liveAudio[frame * channelCount_ + ch], &out,
+                     &line[writePos_ * channelCount_ + ch], 1,
+                     feedbackFactor_, liveAudioFactor_);
+    }
+    writePos_ = (writePos_ + 1) % bufSize_;
+    fadePos_++;
+  }
+}
+
+/**
+ * mixGeneric(): the delay for 24 bit and float audio, instantiated per
+ * sample encoding. The delay line is float, the mix weights are the same
+ * ramped integer factors the 16 bit kernels use; the crossfade is folded
+ * into the same loop.
+ */
+template <typename Sample>
+void AudioDelay::mixGeneric(uint8_t* liveAudio, uint32_t numFrames) {
+  float* line = static_cast<float*>(buffer_);
+  const float feedback = feedbackFactor_ * (1.0f / kFloatToIntMapFactor);
+  const float live = liveAudioFactor_ * (1.0f / kFloatToIntMapFactor);
+
+  uint32_t fromPos = (writePos_ + bufSize_ - fadeFromFrames_) % bufSize_;
+  uint32_t toPos = (writePos_ + bufSize_ - curDelayFrames_) % bufSize_;
+  for (uint32_t frame = 0; frame < numFrames; frame++) {
+    bool fading = fadePos_ < fadeLen_;
+    float toGain = fading ? static_cast<float>(fadePos_) / fadeLen_ : 1.0f;
+
+    for (int32_t ch = 0; ch < channelCount_; ch++) {
+      int32_t idx = frame * channelCount_ + ch;
+      float delayed = line[toPos * channelCount_ + ch];
+      if (fading) {
+        float from = line[fromPos * channelCount_ + ch];
+        delayed = from + (delayed - from) * toGain;
+      }
+      line[writePos_ * channelCount_ + ch] =
+          delayed * feedback + Sample::read(liveAudio, idx) * live;
+      Sample::write(liveAudio, idx, delayed, &dither_);
+    }
+
+    if (++writePos_ == bufSize_) writePos_ = 0;
+    if (++fromPos == bufSize_) fromPos = 0;
+    if (++toPos == bufSize_) toPos = 0;
+    if (fading) fadePos_++;
+  }
+}
+
 /**
  * process() filter live audio with "echo" effect:
  *   delay time is run-time adjustable
  *   decay time could also be adjustable, but not used
  *   in this sample, hardcoded to .5
  *
+ * Runs on the audio thread: it picks up parameter changes published by
+ * setDelayTime()/setDecayWeight() without blocking.
+ *
  * @param liveAudio is recorded audio stream
  * @param channelCount for liveAudio, must be 2 for stereo
  * @param numFrames is length of liveAudio in Frames ( not in byte )
  */
-void AudioDelay::process(int16_t* liveAudio, int32_t numFrames) {
-  if (feedbackFactor_ == 0 || bufSize_ < numFrames) {
-    return;
+void AudioDelay::process(void* liveAudio, int32_t numFrames) {
+  uint64_t params = params_.load(std::memory_order_acquire);
+  uint32_t targetDelayFrames = UnpackDelayFrames(params);
+  int32_t targetFeedbackFactor = UnpackFeedbackFactor(params);
+
+  if (feedbackFactor_ != targetFeedbackFactor) {
+    int32_t step = targetFeedbackFactor - feedbackFactor_;
+    step = std::max(-kDecayRampStep, std::min(step, kDecayRampStep));
+    feedbackFactor_ += step;
+    liveAudioFactor_ = kFloatToIntMapFactor - feedbackFactor_;
   }
 
-  if (!lock_.try_lock()) {
-    return;
+  // start a new crossfade only after the current one completes; a zero
+  // delay is a bypass, switch to and from it right away
+  if (fadePos_ >= fadeLen_ && targetDelayFrames != curDelayFrames_) {
+    fadeFromFrames_ = curDelayFrames_;
+    curDelayFrames_ = targetDelayFrames;
+    fadePos_ = (fadeFromFrames_ && curDelayFrames_) ? 0 : fadeLen_;
   }
 
-  if (numFrames + curPos_ > bufSize_) {
-    curPos_ = 0;
+  if (feedbackFactor_ == 0 || curDelayFrames_ == 0 || numFrames <= 0) {
+    return;
   }
 
-  // process every sample
-  int32_t sampleCount = channelCount_ * numFrames;
-  int16_t* samples = &static_cast<int16_t*>(buffer_)[curPos_ * channelCount_];
-  for (size_t idx = 0; idx < sampleCount; idx++) {
-#if 1
-    int32_t curSample =
-        (samples[idx] * feedbackFactor_ + liveAudio[idx] * liveAudioFactor_) /
-        kFloatToIntMapFactor;
-    if (curSample > SHRT_MAX)
-      curSample = SHRT_MAX;
-    else if (curSample < SHRT_MIN)
-      curSample = SHRT_MIN;
-
-    liveAudio[idx] = samples[idx];
-    samples[idx] = static_cast<int16_t>(curSample);
-#else
-    // Pure delay
-    int16_t tmp = liveAudio[idx];
-    liveAudio[idx] = samples[idx];
-    samples[idx] = tmp;
-#endif
+  uint32_t frames = static_cast<uint32_t>(numFrames);
+  uint8_t* audio = static_cast<uint8_t*>(liveAudio);
+  switch (encoding_) {
+    case SampleEncoding::Int24Packed:
+      mixGeneric<Int24Sample>(audio, frames);
+      return;
+    case SampleEncoding::Float32:
+      mixGeneric<Float32Sample>(audio, frames);
+      return;
+    case SampleEncoding::Int16:
+      break;
   }
 
-  curPos_ += numFrames;
-  lock_.unlock();
+  int16_t* samples = reinterpret_cast<int16_t*>(audio);
+  if (fadePos_ < fadeLen_) {
+    uint32_t fadeFrames = std::min(frames, fadeLen_ - fadePos_);
+    mixCrossfade(samples, fadeFrames);
+    samples += fadeFrames * channelCount_;
+    frames -= fadeFrames;
+  }
+  mixSteady(samples, frames);
 }
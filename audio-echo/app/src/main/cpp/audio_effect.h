@@ -21,47 +21,119 @@
 
 #include <atomic>
 #include <cstdint>
-#include <mutex>
+
+#include "audio_effect_simd.h"
+#include "audio_sample.h"
 
 class AudioFormat {
  protected:
   int32_t sampleRate_ = SL_SAMPLINGRATE_48;
   int32_t channelCount_ = 2;
   SLuint32 format_ = SL_PCMSAMPLEFORMAT_FIXED_16;
+  SampleEncoding encoding_ = SampleEncoding::Int16;
 
   AudioFormat(int32_t sampleRate, int32_t channelCount, SLuint32 format)
-      : sampleRate_(sampleRate), channelCount_(channelCount), format_(format){};
+      : sampleRate_(sampleRate),
+        channelCount_(channelCount),
+        format_(format),
+        encoding_(GetSampleEncoding(format)){};
 
   virtual ~AudioFormat() {}
 };
 
+/**
+ * Interface for in-place, real-time audio effects that AudioEffectChain
+ * runs on the recorded buffers. process() is called on the audio thread:
+ * it must not allocate, lock or block.
+ * liveAudio holds numFrames interleaved frames in the effect's encoding_;
+ * implementations dispatch to a loop templated on the sample traits.
+ */
+class AudioEffect : public AudioFormat {
+ public:
+  virtual void process(void *liveAudio, int32_t numFrames) = 0;
+  virtual const char *name(void) const = 0;
+  /*
+   * The chain's activity gate skipped process() for numFrames of silence;
+   * effects kept in step with another stream catch up here, the others
+   * just resume where they were.
+   */
+  virtual void skip(int32_t numFrames) {}
+  /*
+   * Audio thread: how long the effect keeps sounding after its input went
+   * quiet, in frames; the activity gate drains the chain for the longest
+   * of these before it starts skipping it.
+   */
+  virtual uint32_t getTailFrames(void) const { return 0; }
+  /*
+   * Control thread: the effect is about to be run ( true ) or will not be
+   * for a while ( false ). AudioEffectChain calls it when a stage is added
+   * and when its bypass changes; effects keeping a helper thread start and
+   * stop it here. A process() call already under way may still finish
+   * after setActive(false).
+   */
+  virtual void setActive(bool active) {}
+
+ protected:
+  AudioEffect(int32_t sampleRate, int32_t channelCount, SLuint32 format)
+      : AudioFormat(sampleRate, channelCount, format) {}
+
+  // for the float to 16/24 bit narrowing in process(), audio thread only
+  AudioDither dither_;
+};
+
 /**
  * An audio delay effect:
  *   - decay is for feedback(echo)weight
- *   - delay time is adjustable
+ *   - delay time is adjustable up to maxDelayTimeInMs
+ *
+ * The delay line is allocated once for the maximum delay time. Parameter
+ * changes are published to the audio thread through one atomic word, and
+ * applied there as a short crossfade ( delay ) or a ramp ( decay ), so
+ * process() never allocates, never locks and never skips a buffer.
  */
-class AudioDelay : public AudioFormat {
+class AudioDelay : public AudioEffect {
  public:
   ~AudioDelay();
 
   explicit AudioDelay(int32_t sampleRate, int32_t channelCount, SLuint32 format,
-                      size_t delayTimeInMs, float Weight);
+                      size_t delayTimeInMs, float Weight,
+                      size_t maxDelayTimeInMs);
   bool setDelayTime(size_t delayTimeInMiliSec);
   size_t getDelayTime(void) const;
   void setDecayWeight(float weight);
   float getDecayWeight(void) const;
-  void process(int16_t *liveAudio, int32_t numFrames);
+  void process(void *liveAudio, int32_t numFrames) override;
+  void skip(int32_t numFrames) override;
+  uint32_t getTailFrames(void) const override;
+  const char *name(void) const override { return "delay"; }
 
  private:
+  // Control side, owned by the thread calling the setters
   size_t delayTime_ = 0;
   float decayWeight_ = 0.5;
+  size_t maxDelayTime_ = 0;
+  uint32_t delayFrames_ = 0;
+  int32_t targetFeedbackFactor_ = 0;
+  std::atomic<uint64_t> params_{0};
+
+  // Audio side, only touched inside process()
+  // delay line: int16_t for Int16 audio ( SIMD kernels ), float otherwise
   void *buffer_ = nullptr;
-  size_t bufCapacity_ = 0;
-  size_t bufSize_ = 0;
-  size_t curPos_ = 0;
-  std::mutex lock_;
+  uint32_t bufSize_ = 0;  // in frames
+  uint32_t writePos_ = 0;
+  uint32_t curDelayFrames_ = 0;
+  uint32_t fadeFromFrames_ = 0;
+  uint32_t fadePos_ = 0;
+  uint32_t fadeLen_ = 0;
   int32_t feedbackFactor_;
   int32_t liveAudioFactor_;
-  void allocateBuffer(void);
+  DelayMixKernel mixKernel_;
+
+  uint32_t msToFrames(size_t ms) const;
+  void publishParams(void);
+  void mixSteady(int16_t *liveAudio, uint32_t numFrames);
+  void mixCrossfade(int16_t *liveAudio, uint32_t numFrames);
+  template <typename Sample>
+  void mixGeneric(uint8_t *liveAudio, uint32_t numFrames);
 };
 #endif  // EFFECT_PROCESSOR_H
@@ -0,0 +1,149 @@
+/*
+ * Copyright 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "audio_effect_chain.h"
+
+#include <algorithm>
+
+#include "audio_common.h"
+
+AudioEffectChain::~AudioEffectChain() {
+  int32_t count = count_.load(std::memory_order_acquire);
+  for (int32_t idx = 0; idx < count; idx++) {
+    delete stages_[idx].effect_;
+    stages_[idx].effect_ = nullptr;
+  }
+  delete gate_;
+}
+
+/**
+ * Append an effect to the end of the chain, the chain takes the ownership.
+ * @param bypass the stage starts bypassed: the effect is not made active
+ * @return the index of its stage, for setBypass() and getStats(); -1 if
+ *         the chain is already full ( the caller keeps the effect )
+ */
+int32_t AudioEffectChain::addEffect(AudioEffect *effect, bool bypass) {
+  int32_t count = count_.load(std::memory_order_relaxed);
+  if (!effect || count >= kMaxEffects) {
+    return -1;
+  }
+  if (!bypass) effect->setActive(true);
+  stages_[count].effect_ = effect;
+  stages_[count].bypass_.store(bypass, std::memory_order_relaxed);
+  count_.store(count + 1, std::memory_order_release);
+  return count;
+}
+
+void AudioEffectChain::setActivityGate(AudioActivityGate *gate) {
+  delete gate_;
+  gate_ = gate;
+}
+
+int32_t AudioEffectChain::getEffectCount(void) const {
+  return count_.load(std::memory_order_acquire);
+}
+
+void AudioEffectChain::setBypass(int32_t index, bool bypass) {
+  if (index < 0 || index >= getEffectCount()) return;
+  Stage &stage = stages_[index];
+  if (stage.bypass_.load(std::memory_order_relaxed) == bypass) return;
+  // active before the audio thread runs it again
+  if (!bypass) stage.effect_->setActive(true);
+  stage.bypass_.store(bypass, std::memory_order_relaxed);
+  if (bypass) stage.effect_->setActive(false);
+}
+
+bool AudioEffectChain::getStats(int32_t index, AudioEffectStats *stats) const {
+  if (!stats || index < 0 || index >= getEffectCount()) {
+    return false;
+  }
+  const Stage &stage = stages_[index];
+  stats->name_ = stage.effect_->name();
+  stats->bypassed_ = stage.bypass_.load(std::memory_order_relaxed);
+  stats->callCount_ = stage.callCount_.load(std::memory_order_relaxed);
+  stats->lastNs_ = stage.lastNs_.load(std::memory_order_relaxed);
+  stats->maxNs_ = stage.maxNs_.load(std::memory_order_relaxed);
+  stats->totalNs_ = stage.totalNs_.load(std::memory_order_relaxed);
+  return true;
+}
+
+void AudioEffectChain::resetStats(void) {
+  int32_t count = getEffectCount();
+  for (int32_t idx = 0; idx < count; idx++) {
+    stages_[idx].callCount_.store(0, std::memory_order_relaxed);
+    stages_[idx].lastNs_.store(0, std::memory_order_relaxed);
+    stages_[idx].maxNs_.store(0, std::memory_order_relaxed);
+    stages_[idx].totalNs_.store(0, std::memory_order_relaxed);
+  }
+  if (gate_) gate_->resetStats();
+}
+
+void AudioEffectChain::dumpStats(void) const {
+  AudioEffectStats stats;
+  for (int32_t idx = 0; idx < getEffectCount(); idx++) {
+    getStats(idx, &stats);
+    uint64_t avgNs = stats.callCount_ ? stats.totalNs_ / stats.callCount_ : 0;
+    LOGI("Effect[%d] %s%s: calls=%llu, avg=%llu ns, max=%llu ns", idx,
+         stats.name_, stats.bypassed_ ? "(bypassed)" : "",
+         static_cast<unsigned long long>(stats.callCount_),
+         static_cast<unsigned long long>(avgNs),
+         static_cast<unsigned long long>(stats.maxNs_));
+  }
+  if (gate_) gate_->dumpStats();
+}
+
+/**
+ * Run every non-bypassed effect, in order, on the same buffer.
+ * The stats are updated with separate load and store, not fetch_add: a
+ * resetStats() from another thread can land in between and be lost.
+ */
+void AudioEffectChain::process(void *liveAudio, int32_t numFrames) {
+  int32_t count = count_.load(std::memory_order_acquire);
+  if (gate_ && !gate_->onInput(liveAudio, numFrames)) {
+    for (int32_t idx = 0; idx < count; idx++) {
+      if (!stages_[idx].bypass_.load(std::memory_order_relaxed)) {
+        stages_[idx].effect_->skip(numFrames);
+      }
+    }
+    return;
+  }
+
+  uint64_t start = GetMonotonicNs();
+  uint32_t tailFrames = 0;
+  for (int32_t idx = 0; idx < count; idx++) {
+    Stage &stage = stages_[idx];
+    if (stage.bypass_.load(std::memory_order_relaxed)) {
+      continue;
+    }
+    stage.effect_->process(liveAudio, numFrames);
+    tailFrames = std::max(tailFrames, stage.effect_->getTailFrames());
+
+    uint64_t end = GetMonotonicNs();
+    uint64_t elapsed = end - start;
+    start = end;
+
+    stage.lastNs_.store(elapsed, std::memory_order_relaxed);
+    stage.totalNs_.store(
+        stage.totalNs_.load(std::memory_order_relaxed) + elapsed,
+        std::memory_order_relaxed);
+    stage.callCount_.store(
+        stage.callCount_.load(std::memory_order_relaxed) + 1,
+        std::memory_order_relaxed);
+    if (elapsed > stage.maxNs_.load(std::memory_order_relaxed)) {
+      stage.maxNs_.store(elapsed, std::memory_order_relaxed);
+    }
+  }
+  if (gate_) gate_->onOutput(liveAudio, numFrames, tailFrames);
+}
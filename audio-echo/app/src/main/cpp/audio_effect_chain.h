@@ -0,0 +1,82 @@
+/*
+ * Copyright 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef NATIVE_AUDIO_AUDIO_EFFECT_CHAIN_H
+#define NATIVE_AUDIO_AUDIO_EFFECT_CHAIN_H
+
+#include <atomic>
+#include <cstdint>
+
+#include "audio_activity_gate.h"
+#include "audio_effect.h"
+
+/*
+ * CPU time spent by one effect of the chain, in nano seconds
+ */
+struct AudioEffectStats {
+  const char *name_;
+  bool bypassed_;
+  uint64_t callCount_;
+  uint64_t lastNs_;
+  uint64_t maxNs_;
+  uint64_t totalNs_;
+};
+
+/**
+ * Ordered chain of AudioEffects processing the same buffer in place.
+ *   - effects are added before audio starts; the chain owns them
+ *   - process() runs on the audio thread, every stage is timed on every
+ *     call and the numbers can be read from any thread with getStats()
+ *   - with an activity gate, silent buffers skip the effects ( see
+ *     AudioActivityGate ): they leave the chain as they came in, and every
+ *     stage that is not bypassed gets skip() instead of process()
+ */
+class AudioEffectChain {
+ public:
+  static constexpr int32_t kMaxEffects = 8;
+
+  AudioEffectChain() = default;
+  ~AudioEffectChain();
+
+  int32_t addEffect(AudioEffect *effect, bool bypass = false);
+  // before audio starts too; the chain owns the gate, nullptr removes it
+  void setActivityGate(AudioActivityGate *gate);
+  AudioActivityGate *getActivityGate(void) const { return gate_; }
+  int32_t getEffectCount(void) const;
+  // tells the effect through AudioEffect::setActive() when it changes
+  void setBypass(int32_t index, bool bypass);
+  bool getStats(int32_t index, AudioEffectStats *stats) const;
+  // any thread, best effort: a stage timed meanwhile may keep its numbers
+  void resetStats(void);
+  void dumpStats(void) const;
+
+  void process(void *liveAudio, int32_t numFrames);
+
+ private:
+  struct Stage {
+    AudioEffect *effect_ = nullptr;
+    std::atomic<bool> bypass_{false};
+    std::atomic<uint64_t> callCount_{0};
+    std::atomic<uint64_t> lastNs_{0};
+    std::atomic<uint64_t> maxNs_{0};
+    std::atomic<uint64_t> totalNs_{0};
+  };
+  Stage stages_[kMaxEffects];
+  std::atomic<int32_t> count_{0};
+  AudioActivityGate *gate_ = nullptr;
+};
+
+#endif  // NATIVE_AUDIO_AUDIO_EFFECT_CHAIN_H
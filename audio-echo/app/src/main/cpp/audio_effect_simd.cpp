@@ -0,0 +1,528 @@
+/*
+ * Copyright 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "audio_effect_simd.h"
+
+#include <algorithm>
+#include <climits>
+#include <cmath>
+#include <cstring>
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define DELAY_MIX_HAVE_NEON 1
+#elif defined(__i386__) || defined(__x86_64__)
+#include <immintrin.h>
+#define DELAY_MIX_HAVE_X86 1
+#endif
+
+/*
+ * kFloatToIntMapFactor is 2^7: the vector kernels shift instead of divide,
+ * after biasing negative sums so the result still rounds toward zero.
+ */
+static const int kMapFactorShift = 7;
+static_assert((1 << kMapFactorShift) == kFloatToIntMapFactor,
+              "vector kernels assume kFloatToIntMapFactor is 2^7");
+
+void DelayMixScalar(int16_t *live, const int16_t *delayed, int16_t *feedback,
+                    int32_t sampleCount, int32_t feedbackFactor,
+                    int32_t liveAudioFactor) {
+  for (int32_t idx = 0; idx < sampleCount; idx++) {
+    int16_t out = delayed[idx];
+    int32_t curSample = (out * feedbackFactor + live[idx] * liveAudioFactor) /
+                        kFloatToIntMapFactor;
+    if (curSample > SHRT_MAX)
+      curSample = SHRT_MAX;
+    else if (curSample < SHRT_MIN)
+      curSample = SHRT_MIN;
+
+    live[idx] = out;
+    feedback[idx] = static_cast<int16_t>(curSample);
+  }
+}
+
+/*
+ * The vector kernels hold the mix factors in 16 bit lanes; anything outside
+ * of that ( never the case for a decay weight in 0.0 -- 1.0 ) goes scalar.
+ */
+static bool FactorsFitInt16(int32_t feedbackFactor, int32_t liveAudioFactor) {
+  return feedbackFactor > SHRT_MIN && feedbackFactor <= SHRT_MAX &&
+         liveAudioFactor > SHRT_MIN && liveAudioFactor <= SHRT_MAX;
+}
+
+#ifdef DELAY_MIX_HAVE_NEON
+static inline int32x4_t DivideByMapFactor(int32x4_t sum) {
+  int32x4_t bias =
+      vandq_s32(vshrq_n_s32(sum, 31), vdupq_n_s32(kFloatToIntMapFactor - 1));
+  return vshrq_n_s32(vaddq_s32(sum, bias), kMapFactorShift);
+}
+
+static void DelayMixNeon(int16_t *live, const int16_t *delayed,
+                         int16_t *feedback, int32_t sampleCount,
+                         int32_t feedbackFactor, int32_t liveAudioFactor) {
+  if (!FactorsFitInt16(feedbackFactor, liveAudioFactor)) {
+    DelayMixScalar(live, delayed, feedback, sampleCount, feedbackFactor,
+                   liveAudioFactor);
+    return;
+  }
+  const int16_t fb = static_cast<int16_t>(feedbackFactor);
+  const int16_t lf = static_cast<int16_t>(liveAudioFactor);
+
+  int32_t idx = 0;
+  for (; idx + 8 <= sampleCount; idx += 8) {
+    int16x8_t h = vld1q_s16(delayed + idx);
+    int16x8_t l = vld1q_s16(live + idx);
+
+    int32x4_t lo = vmull_n_s16(vget_low_s16(h), fb);
+    lo = vmlal_n_s16(lo, vget_low_s16(l), lf);
+    int32x4_t hi = vmull_n_s16(vget_high_s16(h), fb);
+    hi = vmlal_n_s16(hi, vget_high_s16(l), lf);
+
+    int16x8_t mixed = vcombine_s16(vqmovn_s32(DivideByMapFactor(lo)),
+                                   vqmovn_s32(DivideByMapFactor(hi)));
+    vst1q_s16(live + idx, h);
+    vst1q_s16(feedback + idx, mixed);
+  }
+  DelayMixScalar(live + idx, delayed + idx, feedback + idx, sampleCount - idx,
+                 feedbackFactor, liveAudioFactor);
+}
+#endif  // DELAY_MIX_HAVE_NEON
+
+#ifdef DELAY_MIX_HAVE_X86
+/*
+ * x86 kernels interleave (delayed, live) pairs so one pmaddwd computes
+ *   delayed * feedbackFactor + live * liveAudioFactor
+ * and packssdw does the saturating narrow back to 16 bit.
+ */
+__attribute__((target("sse2"))) static inline __m128i DivideByMapFactor(
+    __m128i sum) {
+  __m128i bias = _mm_and_si128(_mm_srai_epi32(sum, 31),
+                               _mm_set1_epi32(kFloatToIntMapFactor - 1));
+  return _mm_srai_epi32(_mm_add_epi32(sum, bias), kMapFactorShift);
+}
+
+__attribute__((target("sse2"))) static void DelayMixSse2(
+    int16_t *live, const int16_t *delayed, int16_t *feedback,
+    int32_t sampleCount, int32_t feedbackFactor, int32_t liveAudioFactor) {
+  if (!FactorsFitInt16(feedbackFactor, liveAudioFactor)) {
+    DelayMixScalar(live, delayed, feedback, sampleCount, feedbackFactor,
+                   liveAudioFactor);
+    return;
+  }
+  const __m128i factors = _mm_set1_epi32(
+      static_cast<int32_t>((static_cast<uint32_t>(liveAudioFactor) << 16) |
+                           (static_cast<uint32_t>(feedbackFactor) & 0xFFFF)));
+
+  int32_t idx = 0;
+  for (; idx + 8 <= sampleCount; idx += 8) {
+    __m128i h =
+        _mm_loadu_si128(reinterpret_cast<const __m128i *>(delayed + idx));
+    __m128i l = _mm_loadu_si128(reinterpret_cast<const __m128i *>(live + idx));
+
+    __m128i lo = _mm_madd_epi16(_mm_unpacklo_epi16(h, l), factors);
+    __m128i hi = _mm_madd_epi16(_mm_unpackhi_epi16(h, l), factors);
+    __m128i mixed =
+        _mm_packs_epi32(DivideByMapFactor(lo), DivideByMapFactor(hi));
+
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(live + idx), h);
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(feedback + idx), mixed);
+  }
+  DelayMixScalar(live + idx, delayed + idx, feedback + idx, sampleCount - idx,
+                 feedbackFactor, liveAudioFactor);
+}
+
+__attribute__((target("avx2"))) static inline __m256i DivideByMapFactor(
+    __m256i sum) {
+  __m256i bias = _mm256_and_si256(_mm256_srai_epi32(sum, 31),
+                                  _mm256_set1_epi32(kFloatToIntMapFactor - 1));
+  return _mm256_srai_epi32(_mm256_add_epi32(sum, bias), kMapFactorShift);
+}
+
+/*
+ * unpack and pack both work within 128 bit lanes, so the two cancel out and
+ * the samples come back in their original order.
+ */
+__attribute__((target("avx2"))) static void DelayMixAvx2(
+    int16_t *live, const int16_t *delayed, int16_t *feedback,
+    int32_t sampleCount, int32_t feedbackFactor, int32_t liveAudioFactor) {
+  if (!FactorsFitInt16(feedbackFactor, liveAudioFactor)) {
+    DelayMixScalar(live, delayed, feedback, sampleCount, feedbackFactor,
+                   liveAudioFactor);
+    return;
+  }
+  const __m256i factors = _mm256_set1_epi32(
+      static_cast<int32_t>((static_cast<uint32_t>(liveAudioFactor) << 16) |
+                           (static_cast<uint32_t>(feedbackFactor) & 0xFFFF)));
+
+  int32_t idx = 0;
+  for (; idx + 16 <= sampleCount; idx += 16) {
+    __m256i h = _mm256_loadu_si256(
+        reinterpret_cast<const __m256i *>(delayed + idx));
+    __m256i l =
+        _mm256_loadu_si256(reinterpret_cast<const __m256i *>(live + idx));
+
+    __m256i lo = _mm256_madd_epi16(_mm256_unpacklo_epi16(h, l), factors);
+    __m256i hi = _mm256_madd_epi16(_mm256_unpackhi_epi16(h, l), factors);
+    __m256i mixed =
+        _mm256_packs_epi32(DivideByMapFactor(lo), DivideByMapFactor(hi));
+
+    _mm256_storeu_si256(reinterpret_cast<__m256i *>(live + idx), h);
+    _mm256_storeu_si256(reinterpret_cast<__m256i *>(feedback + idx), mixed);
+  }
+  // the SSE2 tail is not VEX encoded: clear the upper halves first, or every
+  // SSE instruction in it pays for the AVX state
+  _mm256_zeroupper();
+  DelayMixSse2(live + idx, delayed + idx, feedback + idx, sampleCount - idx,
+               feedbackFactor, liveAudioFactor);
+}
+#endif  // DELAY_MIX_HAVE_X86
+
+static void SpectrumMacScalar(float *accRe, float *accIm, const float *aRe,
+                              const float *aIm, const float *bRe,
+                              const float *bIm, int32_t binCount) {
+  for (int32_t k = 0; k < binCount; k++) {
+    accRe[k] += aRe[k] * bRe[k] - aIm[k] * bIm[k];
+    accIm[k] += aRe[k] * bIm[k] + aIm[k] * bRe[k];
+  }
+}
+
+static void SpectrumConjMacScalar(float *accRe, float *accIm, const float *aRe,
+                                  const float *aIm, const float *bRe,
+                                  const float *bIm, const float *scale,
+                                  int32_t binCount) {
+  for (int32_t k = 0; k < binCount; k++) {
+    accRe[k] += scale[k] * (aRe[k] * bRe[k] + aIm[k] * bIm[k]);
+    accIm[k] += scale[k] * (aRe[k] * bIm[k] - aIm[k] * bRe[k]);
+  }
+}
+
+#ifdef DELAY_MIX_HAVE_NEON
+static void SpectrumMacNeon(float *accRe, float *accIm, const float *aRe,
+                            const float *aIm, const float *bRe,
+                            const float *bIm, int32_t binCount) {
+  int32_t k = 0;
+  for (; k + 4 <= binCount; k += 4) {
+    float32x4_t ar = vld1q_f32(aRe + k), ai = vld1q_f32(aIm + k);
+    float32x4_t br = vld1q_f32(bRe + k), bi = vld1q_f32(bIm + k);
+    float32x4_t re = vmlaq_f32(vld1q_f32(accRe + k), ar, br);
+    float32x4_t im = vmlaq_f32(vld1q_f32(accIm + k), ar, bi);
+    vst1q_f32(accRe + k, vmlsq_f32(re, ai, bi));
+    vst1q_f32(accIm + k, vmlaq_f32(im, ai, br));
+  }
+  SpectrumMacScalar(accRe + k, accIm + k, aRe + k, aIm + k, bRe + k, bIm + k,
+                    binCount - k);
+}
+
+static void SpectrumConjMacNeon(float *accRe, float *accIm, const float *aRe,
+                                const float *aIm, const float *bRe,
+                                const float *bIm, const float *scale,
+                                int32_t binCount) {
+  int32_t k = 0;
+  for (; k + 4 <= binCount; k += 4) {
+    float32x4_t ar = vld1q_f32(aRe + k), ai = vld1q_f32(aIm + k);
+    float32x4_t br = vld1q_f32(bRe + k), bi = vld1q_f32(bIm + k);
+    float32x4_t sc = vld1q_f32(scale + k);
+    float32x4_t re = vmlaq_f32(vmulq_f32(ar, br), ai, bi);
+    float32x4_t im = vmlsq_f32(vmulq_f32(ar, bi), ai, br);
+    vst1q_f32(accRe + k, vmlaq_f32(vld1q_f32(accRe + k), sc, re));
+    vst1q_f32(accIm + k, vmlaq_f32(vld1q_f32(accIm + k), sc, im));
+  }
+  SpectrumConjMacScalar(accRe + k, accIm + k, aRe + k, aIm + k, bRe + k,
+                        bIm + k, scale + k, binCount - k);
+}
+#endif  // DELAY_MIX_HAVE_NEON
+
+#ifdef DELAY_MIX_HAVE_X86
+__attribute__((target("sse2"))) static void SpectrumMacSse2(
+    float *accRe, float *accIm, const float *aRe, const float *aIm,
+    const float *bRe, const float *bIm, int32_t binCount) {
+  int32_t k = 0;
+  for (; k + 4 <= binCount; k += 4) {
+    __m128 ar = _mm_loadu_ps(aRe + k), ai = _mm_loadu_ps(aIm + k);
+    __m128 br = _mm_loadu_ps(bRe + k), bi = _mm_loadu_ps(bIm + k);
+    __m128 re = _mm_sub_ps(_mm_mul_ps(ar, br), _mm_mul_ps(ai, bi));
+    __m128 im = _mm_add_ps(_mm_mul_ps(ar, bi), _mm_mul_ps(ai, br));
+    _mm_storeu_ps(accRe + k, _mm_add_ps(_mm_loadu_ps(accRe + k), re));
+    _mm_storeu_ps(accIm + k, _mm_add_ps(_mm_loadu_ps(accIm + k), im));
+  }
+  SpectrumMacScalar(accRe + k, accIm + k, aRe + k, aIm + k, bRe + k, bIm + k,
+                    binCount - k);
+}
+
+__attribute__((target("sse2"))) static void SpectrumConjMacSse2(
+    float *accRe, float *accIm, const float *aRe, const float *aIm,
+    const float *bRe, const float *bIm, const float *scale,
+    int32_t binCount) {
+  int32_t k = 0;
+  for (; k + 4 <= binCount; k += 4) {
+    __m128 ar = _mm_loadu_ps(aRe + k), ai = _mm_loadu_ps(aIm + k);
+    __m128 br = _mm_loadu_ps(bRe + k), bi = _mm_loadu_ps(bIm + k);
+    __m128 sc = _mm_loadu_ps(scale + k);
+    __m128 re = _mm_add_ps(_mm_mul_ps(ar, br), _mm_mul_ps(ai, bi));
+    __m128 im = _mm_sub_ps(_mm_mul_ps(ar, bi), _mm_mul_ps(ai, br));
+    _mm_storeu_ps(accRe + k,
+                  _mm_add_ps(_mm_loadu_ps(accRe + k), _mm_mul_ps(sc, re)));
+    _mm_storeu_ps(accIm + k,
+                  _mm_add_ps(_mm_loadu_ps(accIm + k), _mm_mul_ps(sc, im)));
+  }
+  SpectrumConjMacScalar(accRe + k, accIm + k, aRe + k, aIm + k, bRe + k,
+                        bIm + k, scale + k, binCount - k);
+}
+
+__attribute__((target("avx2"))) static void SpectrumMacAvx2(
+    float *accRe, float *accIm, const float *aRe, const float *aIm,
+    const float *bRe, const float *bIm, int32_t binCount) {
+  int32_t k = 0;
+  for (; k + 8 <= binCount; k += 8) {
+    __m256 ar = _mm256_loadu_ps(aRe + k), ai = _mm256_loadu_ps(aIm + k);
+    __m256 br = _mm256_loadu_ps(bRe + k), bi = _mm256_loadu_ps(bIm + k);
+    __m256 re = _mm256_sub_ps(_mm256_mul_ps(ar, br), _mm256_mul_ps(ai, bi));
+    __m256 im = _mm256_add_ps(_mm256_mul_ps(ar, bi), _mm256_mul_ps(ai, br));
+    _mm256_storeu_ps(accRe + k, _mm256_add_ps(_mm256_loadu_ps(accRe + k), re));
+    _mm256_storeu_ps(accIm + k, _mm256_add_ps(_mm256_loadu_ps(accIm + k), im));
+  }
+  _mm256_zeroupper();  // before the SSE2 tail, as in DelayMixAvx2()
+  SpectrumMacSse2(accRe + k, accIm + k, aRe + k, aIm + k, bRe + k, bIm + k,
+                  binCount - k);
+}
+
+__attribute__((target("avx2"))) static void SpectrumConjMacAvx2(
+    float *accRe, float *accIm, const float *aRe, const float *aIm,
+    const float *bRe, const float *bIm, const float *scale,
+    int32_t binCount) {
+  int32_t k = 0;
+  for (; k + 8 <= binCount; k += 8) {
+    __m256 ar = _mm256_loadu_ps(aRe + k), ai = _mm256_loadu_ps(aIm + k);
+    __m256 br = _mm256_loadu_ps(bRe + k), bi = _mm256_loadu_ps(bIm + k);
+    __m256 sc = _mm256_loadu_ps(scale + k);
+    __m256 re = _mm256_add_ps(_mm256_mul_ps(ar, br), _mm256_mul_ps(ai, bi));
+    __m256 im = _mm256_sub_ps(_mm256_mul_ps(ar, bi), _mm256_mul_ps(ai, br));
+    _mm256_storeu_ps(accRe + k, _mm256_add_ps(_mm256_loadu_ps(accRe + k),
+                                              _mm256_mul_ps(sc, re)));
+    _mm256_storeu_ps(accIm + k, _mm256_add_ps(_mm256_loadu_ps(accIm + k),
+                                              _mm256_mul_ps(sc, im)));
+  }
+  _mm256_zeroupper();  // before the SSE2 tail, as in DelayMixAvx2()
+  SpectrumConjMacSse2(accRe + k, accIm + k, aRe + k, aIm + k, bRe + k,
+                      bIm + k, scale + k, binCount - k);
+}
+#endif  // DELAY_MIX_HAVE_X86
+
+static int32_t PeakInt16Scalar(const int16_t *samples, int32_t sampleCount) {
+  int32_t peak = 0;
+  for (int32_t i = 0; i < sampleCount; i++) {
+    peak = std::max(peak, std::abs(static_cast<int32_t>(samples[i])));
+  }
+  return std::min(peak, static_cast<int32_t>(SHRT_MAX));
+}
+
+static float PeakFloatScalar(const float *samples, int32_t sampleCount) {
+  float peak = 0.0f;
+  for (int32_t i = 0; i < sampleCount; i++) {
+    peak = std::max(peak, fabsf(samples[i]));
+  }
+  return peak;
+}
+
+#ifdef DELAY_MIX_HAVE_NEON
+static int32_t PeakInt16Neon(const int16_t *samples, int32_t sampleCount) {
+  int32_t i = 0;
+  int16x8_t peak = vdupq_n_s16(0);
+  for (; i + 8 <= sampleCount; i += 8) {
+    // saturating: |-32768| is 32767
+    peak = vmaxq_s16(peak, vqabsq_s16(vld1q_s16(samples + i)));
+  }
+  int16x4_t half = vmax_s16(vget_low_s16(peak), vget_high_s16(peak));
+  half = vpmax_s16(half, half);
+  half = vpmax_s16(half, half);
+  return std::max(static_cast<int32_t>(vget_lane_s16(half, 0)),
+                  PeakInt16Scalar(samples + i, sampleCount - i));
+}
+
+static float PeakFloatNeon(const float *samples, int32_t sampleCount) {
+  int32_t i = 0;
+  float32x4_t peak = vdupq_n_f32(0.0f);
+  for (; i + 4 <= sampleCount; i += 4) {
+    peak = vmaxq_f32(peak, vabsq_f32(vld1q_f32(samples + i)));
+  }
+  float32x2_t half = vmax_f32(vget_low_f32(peak), vget_high_f32(peak));
+  half = vpmax_f32(half, half);
+  return std::max(vget_lane_f32(half, 0),
+                  PeakFloatScalar(samples + i, sampleCount - i));
+}
+#endif  // DELAY_MIX_HAVE_NEON
+
+#ifdef DELAY_MIX_HAVE_X86
+__attribute__((target("sse2"))) static int32_t PeakInt16Sse2(
+    const int16_t *samples, int32_t sampleCount) {
+  int32_t i = 0;
+  __m128i peak = _mm_setzero_si128();
+  for (; i + 8 <= sampleCount; i += 8) {
+    __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i *>(samples + i));
+    // max(x, -x) with a saturating negate: |-32768| is 32767
+    x = _mm_max_epi16(x, _mm_subs_epi16(_mm_setzero_si128(), x));
+    peak = _mm_max_epi16(peak, x);
+  }
+  peak = _mm_max_epi16(peak, _mm_srli_si128(peak, 8));
+  peak = _mm_max_epi16(peak, _mm_srli_si128(peak, 4));
+  peak = _mm_max_epi16(peak, _mm_srli_si128(peak, 2));
+  return std::max(static_cast<int32_t>(
+                      static_cast<int16_t>(_mm_cvtsi128_si32(peak))),
+                  PeakInt16Scalar(samples + i, sampleCount - i));
+}
+
+__attribute__((target("sse2"))) static float PeakFloatSse2(
+    const float *samples, int32_t sampleCount) {
+  int32_t i = 0;
+  const __m128 absMask = _mm_castsi128_ps(_mm_set1_epi32(0x7FFFFFFF));
+  __m128 peak = _mm_setzero_ps();
+  for (; i + 4 <= sampleCount; i += 4) {
+    peak = _mm_max_ps(peak, _mm_and_ps(_mm_loadu_ps(samples + i), absMask));
+  }
+  peak = _mm_max_ps(peak, _mm_movehl_ps(peak, peak));
+  peak = _mm_max_ss(peak, _mm_shuffle_ps(peak, peak, 1));
+  return std::max(_mm_cvtss_f32(peak),
+                  PeakFloatScalar(samples + i, sampleCount - i));
+}
+
+__attribute__((target("avx2"))) static int32_t PeakInt16Avx2(
+    const int16_t *samples, int32_t sampleCount) {
+  int32_t i = 0;
+  __m256i peak = _mm256_setzero_si256();
+  for (; i + 16 <= sampleCount; i += 16) {
+    __m256i x =
+        _mm256_loadu_si256(reinterpret_cast<const __m256i *>(samples + i));
+    x = _mm256_max_epi16(x, _mm256_subs_epi16(_mm256_setzero_si256(), x));
+    peak = _mm256_max_epi16(peak, x);
+  }
+  __m128i half = _mm_max_epi16(_mm256_castsi256_si128(peak),
+                               _mm256_extracti128_si256(peak, 1));
+  half = _mm_max_epi16(half, _mm_srli_si128(half, 8));
+  half = _mm_max_epi16(half, _mm_srli_si128(half, 4));
+  half = _mm_max_epi16(half, _mm_srli_si128(half, 2));
+  int32_t result = static_cast<int16_t>(_mm_cvtsi128_si32(half));
+  _mm256_zeroupper();  // before the SSE2 tail, as in DelayMixAvx2()
+  return std::max(result, PeakInt16Sse2(samples + i, sampleCount - i));
+}
+
+__attribute__((target("avx2"))) static float PeakFloatAvx2(
+    const float *samples, int32_t sampleCount) {
+  int32_t i = 0;
+  const __m256 absMask = _mm256_castsi256_ps(_mm256_set1_epi32(0x7FFFFFFF));
+  __m256 peak = _mm256_setzero_ps();
+  for (; i + 8 <= sampleCount; i += 8) {
+    peak = _mm256_max_ps(peak,
+                         _mm256_and_ps(_mm256_loadu_ps(samples + i), absMask));
+  }
+  __m128 half = _mm_max_ps(_mm256_castps256_ps128(peak),
+                           _mm256_extractf128_ps(peak, 1));
+  half = _mm_max_ps(half, _mm_movehl_ps(half, half));
+  half = _mm_max_ss(half, _mm_shuffle_ps(half, half, 1));
+  float result = _mm_cvtss_f32(half);
+  _mm256_zeroupper();
+  return std::max(result, PeakFloatSse2(samples + i, sampleCount - i));
+}
+#endif  // DELAY_MIX_HAVE_X86
+
+struct DelayMixImpl {
+  DelayMixKernel kernel_;
+  const char *name_;
+};
+
+static DelayMixImpl SelectDelayMixKernel(void) {
+#if defined(DELAY_MIX_HAVE_NEON)
+  return {DelayMixNeon, "neon"};
+#elif defined(DELAY_MIX_HAVE_X86)
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2")) {
+    return {DelayMixAvx2, "avx2"};
+  }
+  if (__builtin_cpu_supports("sse2")) {
+    return {DelayMixSse2, "sse2"};
+  }
+  return {DelayMixScalar, "scalar"};
+#else
+  return {DelayMixScalar, "scalar"};
+#endif
+}
+
+static const DelayMixImpl &GetDelayMixImpl(void) {
+  static const DelayMixImpl impl = SelectDelayMixKernel();
+  return impl;
+}
+
+DelayMixKernel GetDelayMixKernel(void) { return GetDelayMixImpl().kernel_; }
+
+const char *GetDelayMixKernelName(void) { return GetDelayMixImpl().name_; }
+
+DelayMixKernel FindDelayMixKernel(const char *name) {
+  if (!strcmp(name, "scalar")) return DelayMixScalar;
+#if defined(DELAY_MIX_HAVE_NEON)
+  if (!strcmp(name, "neon")) return DelayMixNeon;
+#elif defined(DELAY_MIX_HAVE_X86)
+  __builtin_cpu_init();
+  if (!strcmp(name, "avx2") && __builtin_cpu_supports("avx2")) {
+    return DelayMixAvx2;
+  }
+  if (!strcmp(name, "sse2") && __builtin_cpu_supports("sse2")) {
+    return DelayMixSse2;
+  }
+#endif
+  return nullptr;
+}
+
+static SpectrumKernels SelectSpectrumKernels(void) {
+#if defined(DELAY_MIX_HAVE_NEON)
+  return {SpectrumMacNeon, SpectrumConjMacNeon, "neon"};
+#elif defined(DELAY_MIX_HAVE_X86)
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2")) {
+    return {SpectrumMacAvx2, SpectrumConjMacAvx2, "avx2"};
+  }
+  if (__builtin_cpu_supports("sse2")) {
+    return {SpectrumMacSse2, SpectrumConjMacSse2, "sse2"};
+  }
+  return {SpectrumMacScalar, SpectrumConjMacScalar, "scalar"};
+#else
+  return {SpectrumMacScalar, SpectrumConjMacScalar, "scalar"};
+#endif
+}
+
+const SpectrumKernels &GetSpectrumKernels(void) {
+  static const SpectrumKernels kernels = SelectSpectrumKernels();
+  return kernels;
+}
+
+static PeakKernels SelectPeakKernels(void) {
+#if defined(DELAY_MIX_HAVE_NEON)
+  return {PeakInt16Neon, PeakFloatNeon, "neon"};
+#elif defined(DELAY_MIX_HAVE_X86)
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2")) {
+    return {PeakInt16Avx2, PeakFloatAvx2, "avx2"};
+  }
+  if (__builtin_cpu_supports("sse2")) {
+    return {PeakInt16Sse2, PeakFloatSse2, "sse2"};
+  }
+  return {PeakInt16Scalar, PeakFloatScalar, "scalar"};
+#else
+  return {PeakInt16Scalar, PeakFloatScalar, "scalar"};
+#endif
+}
+
+const PeakKernels &GetPeakKernels(void) {
+  static const PeakKernels kernels = SelectPeakKernels();
+  return kernels;
+}
@@ -0,0 +1,118 @@
+/*
+ * Copyright 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef NATIVE_AUDIO_AUDIO_EFFECT_SIMD_H
+#define NATIVE_AUDIO_AUDIO_EFFECT_SIMD_H
+
+#include <cstdint>
+
+/*
+ * Mixing Audio in integer domain to avoid FP calculation
+ *   (FG * ( MixFactor * 16 ) + BG * ( (1.0f-MixFactor) * 16 )) / 16
+ */
+constexpr int32_t kFloatToIntMapFactor = 128;
+
+/**
+ * Delay line mixing kernel:
+ *   for every sample
+ *     out           = delayed[i]
+ *     feedback[i]   = sat16((delayed[i] * feedback + live[i] * liveFactor) /
+ *                           kFloatToIntMapFactor)
+ *     live[i]       = out
+ * Every implementation is bit-exact with DelayMixScalar(), including the
+ * round-toward-zero integer division.
+ *
+ * delayed and feedback may point into the same delay line, as long as
+ * delayed is not behind feedback by less than sampleCount.
+ *
+ * @param live is the recorded audio, replaced with the delayed audio
+ * @param delayed is the delay line at the read ( delayed ) position
+ * @param feedback is the delay line at the write position
+ * @param sampleCount is number of int16_t samples ( not frames )
+ * @param feedbackFactor weight for the delayed audio, in kFloatToIntMapFactor
+ * @param liveAudioFactor weight for the live audio, in kFloatToIntMapFactor
+ */
+typedef void (*DelayMixKernel)(int16_t *live, const int16_t *delayed,
+                               int16_t *feedback, int32_t sampleCount,
+                               int32_t feedbackFactor,
+                               int32_t liveAudioFactor);
+
+void DelayMixScalar(int16_t *live, const int16_t *delayed, int16_t *feedback,
+                    int32_t sampleCount, int32_t feedbackFactor,
+                    int32_t liveAudioFactor);
+
+/**
+ * Return the fastest kernel the running CPU supports ( NEON on ARM,
+ * AVX2 or SSE2 on x86 ), falling back to DelayMixScalar(). The CPU is
+ * only probed on the first call.
+ */
+DelayMixKernel GetDelayMixKernel(void);
+const char *GetDelayMixKernelName(void);
+
+/**
+ * The kernel called name ( "scalar", "neon", "sse2" or "avx2" ), for the
+ * host benchmark and tests; nullptr when it is not built in or the running
+ * CPU cannot run it.
+ */
+DelayMixKernel FindDelayMixKernel(const char *name);
+
+/**
+ * Complex multiply-accumulate kernels on split spectra ( re[], im[] ), for
+ * the frequency domain adaptive filters; binCount needs no alignment.
+ *   SpectrumMac:      acc[k] += a[k] * b[k]
+ *   SpectrumConjMac:  acc[k] += scale[k] * conj(a[k]) * b[k]
+ */
+typedef void (*SpectrumMacKernel)(float *accRe, float *accIm, const float *aRe,
+                                  const float *aIm, const float *bRe,
+                                  const float *bIm, int32_t binCount);
+typedef void (*SpectrumConjMacKernel)(float *accRe, float *accIm,
+                                      const float *aRe, const float *aIm,
+                                      const float *bRe, const float *bIm,
+                                      const float *scale, int32_t binCount);
+
+struct SpectrumKernels {
+  SpectrumMacKernel mac_;
+  SpectrumConjMacKernel conjMac_;
+  const char *name_;
+};
+
+/**
+ * Same selection as GetDelayMixKernel(): NEON, AVX2, SSE2 or scalar.
+ */
+const SpectrumKernels &GetSpectrumKernels(void);
+
+/**
+ * Peak level kernels, for the activity detection:
+ *   PeakInt16:  max |samples[i]|, -32768 counts as 32767
+ *   PeakFloat:  max |samples[i]|
+ * sampleCount needs no alignment; all implementations give the same result.
+ */
+typedef int32_t (*PeakInt16Kernel)(const int16_t *samples,
+                                   int32_t sampleCount);
+typedef float (*PeakFloatKernel)(const float *samples, int32_t sampleCount);
+
+struct PeakKernels {
+  PeakInt16Kernel int16_;
+  PeakFloatKernel float_;
+  const char *name_;
+};
+
+/**
+ * Same selection as GetDelayMixKernel(): NEON, AVX2, SSE2 or scalar.
+ */
+const PeakKernels &GetPeakKernels(void);
+
+#endif  // NATIVE_AUDIO_AUDIO_EFFECT_SIMD_H
@@ -0,0 +1,130 @@
+/*
+ * Copyright 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "audio_fft.h"
+
+#include <cassert>
+#include <cmath>
+
+/*
+ * The size_ real samples are packed as size_ / 2 complex ones ( even
+ * samples real, odd samples imaginary ), run through a radix-2 complex
+ * FFT, and the two interleaved spectra are separated afterwards.
+ */
+AudioFft::AudioFft(uint32_t size) : size_(size), half_(size / 2) {
+  assert(size >= 4 && (size & (size - 1)) == 0);
+
+  bitReverse_.reset(new uint32_t[half_]);
+  uint32_t bits = 0;
+  while ((1u << bits) < half_) bits++;
+  for (uint32_t idx = 0; idx < half_; idx++) {
+    uint32_t rev = 0;
+    for (uint32_t bit = 0; bit < bits; bit++) {
+      rev |= ((idx >> bit) & 1) << (bits - 1 - bit);
+    }
+    bitReverse_[idx] = rev;
+  }
+
+  cos_.reset(new float[half_]);
+  sin_.reset(new float[half_]);
+  for (uint32_t idx = 0; idx < half_; idx++) {
+    double angle = 2.0 * M_PI * idx / size_;
+    cos_[idx] = static_cast<float>(cos(angle));
+    sin_[idx] = static_cast<float>(sin(angle));
+  }
+  workRe_.reset(new float[half_]);
+  workIm_.reset(new float[half_]);
+}
+
+/*
+ * In place complex FFT of half_ points, input in bit reversed order
+ */
+void AudioFft::transform(float *re, float *im, bool inverse) const {
+  for (uint32_t len = 2; len <= half_; len <<= 1) {
+    uint32_t span = len / 2;
+    uint32_t step = size_ / len;
+    for (uint32_t base = 0; base < half_; base += len) {
+      for (uint32_t idx = 0; idx < span; idx++) {
+        float wr = cos_[idx * step];
+        float wi = inverse ? sin_[idx * step] : -sin_[idx * step];
+        uint32_t a = base + idx;
+        uint32_t b = a + span;
+        float tr = re[b] * wr - im[b] * wi;
+        float ti = re[b] * wi + im[b] * wr;
+        re[b] = re[a] - tr;
+        im[b] = im[a] - ti;
+        re[a] += tr;
+        im[a] += ti;
+      }
+    }
+  }
+}
+
+void AudioFft::forward(const float *in, float *re, float *im) {
+  float *zr = workRe_.get();
+  float *zi = workIm_.get();
+  for (uint32_t idx = 0; idx < half_; idx++) {
+    uint32_t src = bitReverse_[idx];
+    zr[idx] = in[2 * src];
+    zi[idx] = in[2 * src + 1];
+  }
+  transform(zr, zi, false);
+
+  re[0] = zr[0] + zi[0];
+  im[0] = 0.0f;
+  re[half_] = zr[0] - zi[0];
+  im[half_] = 0.0f;
+  for (uint32_t k = 1; k < half_; k++) {
+    // a = Z[k], b = conj(Z[half_ - k])
+    float ar = zr[k], ai = zi[k];
+    float br = zr[half_ - k], bi = -zi[half_ - k];
+    float evenRe = 0.5f * (ar + br);
+    float evenIm = 0.5f * (ai + bi);
+    float oddRe = 0.5f * (ai - bi);
+    float oddIm = -0.5f * (ar - br);
+    float wr = cos_[k];
+    float wi = -sin_[k];
+    re[k] = evenRe + wr * oddRe - wi * oddIm;
+    im[k] = evenIm + wr * oddIm + wi * oddRe;
+  }
+}
+
+void AudioFft::inverse(const float *re, const float *im, float *out) {
+  float *zr = workRe_.get();
+  float *zi = workIm_.get();
+  for (uint32_t k = 0; k < half_; k++) {
+    // a = X[k], b = conj(X[half_ - k])
+    float ar = re[k], ai = im[k];
+    float br = re[half_ - k], bi = -im[half_ - k];
+    float evenRe = 0.5f * (ar + br);
+    float evenIm = 0.5f * (ai + bi);
+    float tr = 0.5f * (ar - br);
+    float ti = 0.5f * (ai - bi);
+    float wr = cos_[k];
+    float wi = sin_[k];
+    float oddRe = tr * wr - ti * wi;
+    float oddIm = tr * wi + ti * wr;
+    uint32_t dst = bitReverse_[k];
+    zr[dst] = evenRe - oddIm;
+    zi[dst] = evenIm + oddRe;
+  }
+  transform(zr, zi, true);
+
+  float scale = 1.0f / half_;
+  for (uint32_t idx = 0; idx < half_; idx++) {
+    out[2 * idx] = zr[idx] * scale;
+    out[2 * idx + 1] = zi[idx] * scale;
+  }
+}
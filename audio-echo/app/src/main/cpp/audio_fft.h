@@ -0,0 +1,52 @@
+/*
+ * Copyright 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef NATIVE_AUDIO_AUDIO_FFT_H
+#define NATIVE_AUDIO_AUDIO_FFT_H
+
+#include <cstdint>
+#include <memory>
+
+/**
+ * Real FFT of one power of two size, for the frequency domain effects.
+ *   - spectra are split: re[] and im[], getBinCount() ( size / 2 + 1 ) each
+ *   - forward() is not scaled, inverse() is: inverse(forward(x)) == x
+ *   - the tables and the scratch are allocated in the constructor, so
+ *     forward() and inverse() can run on the audio thread; one AudioFft
+ *     must not be used from two threads at the same time
+ */
+class AudioFft {
+ public:
+  explicit AudioFft(uint32_t size);
+
+  uint32_t getSize(void) const { return size_; }
+  uint32_t getBinCount(void) const { return half_ + 1; }
+
+  void forward(const float *in, float *re, float *im);
+  void inverse(const float *re, const float *im, float *out);
+
+ private:
+  void transform(float *re, float *im, bool inverse) const;
+
+  uint32_t size_;
+  uint32_t half_;  // the real FFT runs as a complex FFT of size_ / 2
+  std::unique_ptr<uint32_t[]> bitReverse_;
+  std::unique_ptr<float[]> cos_;  // exp(-2 pi i k / size_), k < size_ / 2
+  std::unique_ptr<float[]> sin_;
+  std::unique_ptr<float[]> workRe_;
+  std::unique_ptr<float[]> workIm_;
+};
+
+#endif  // NATIVE_AUDIO_AUDIO_FFT_H
@@ -0,0 +1,320 @@
+/*
+ * Copyright 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "audio_filters.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include "audio_common.h"
+
+static const float kPi = 3.14159265358979f;
+// envelope release of the noise gate detector
+static const float kGateDetectorReleaseMs = 10.0f;
+
+/*
+ * AudioFormat keeps the sample rate in milli Hz ( SLmilliHertz )
+ */
+static inline float SampleRateInHz(int32_t sampleRate) {
+  return static_cast<float>(sampleRate) / 1000.0f;
+}
+
+static inline float DbToLinear(float db) { return powf(10.0f, db / 20.0f); }
+
+/*
+ * one pole smoothing coefficient reaching ~63% of a step in timeMs
+ */
+static inline float TimeToCoef(float timeMs, float sampleRateHz) {
+  float frames = timeMs * sampleRateHz / 1000.0f;
+  return frames < 1.0f ? 0.0f : expf(-1.0f / frames);
+}
+
+/*
+ * peak of all channels in one frame, in full scale
+ */
+template <typename Sample>
+static inline float FramePeak(const uint8_t *audio, int32_t frame,
+                              int32_t channelCount) {
+  float peak = 0.0f;
+  for (int32_t ch = 0; ch < channelCount; ch++) {
+    float sample = Sample::read(audio, frame * channelCount + ch);
+    peak = std::max(peak, fabsf(sample));
+  }
+  return peak;
+}
+
+AudioBiquad::AudioBiquad(int32_t sampleRate, int32_t channelCount,
+                         SLuint32 format, BiquadType type, float freqHz,
+                         float q, float gainDb)
+    : AudioEffect(sampleRate, channelCount, format) {
+  assert(channelCount_ <= AUDIO_EFFECT_MAX_CHANNELS);
+  setParams(type, freqHz, q, gainDb);
+}
+
+/**
+ * Compute the new coefficients into the inactive slot, then flip. Calls
+ * are expected from one control thread, at most once per audio buffer.
+ */
+void AudioBiquad::setParams(BiquadType type, float freqHz, float q,
+                            float gainDb) {
+  float A = powf(10.0f, gainDb / 40.0f);
+  float w0 = 2.0f * kPi * freqHz / SampleRateInHz(sampleRate_);
+  float cs = cosf(w0);
+  float alpha = sinf(w0) / (2.0f * q);
+  float sqrtA2alpha = 2.0f * sqrtf(A) * alpha;
+
+  float b0, b1, b2, a0, a1, a2;
+  switch (type) {
+    case BiquadType::LowPass:
+      b0 = (1.0f - cs) / 2.0f;
+      b1 = 1.0f - cs;
+      b2 = (1.0f - cs) / 2.0f;
+      a0 = 1.0f + alpha;
+      a1 = -2.0f * cs;
+      a2 = 1.0f - alpha;
+      break;
+    case BiquadType::HighPass:
+      b0 = (1.0f + cs) / 2.0f;
+      b1 = -(1.0f + cs);
+      b2 = (1.0f + cs) / 2.0f;
+      a0 = 1.0f + alpha;
+      a1 = -2.0f * cs;
+      a2 = 1.0f - alpha;
+      break;
+    case BiquadType::Peaking:
+      b0 = 1.0f + alpha * A;
+      b1 = -2.0f * cs;
+      b2 = 1.0f - alpha * A;
+      a0 = 1.0f + alpha / A;
+      a1 = -2.0f * cs;
+      a2 = 1.0f - alpha / A;
+      break;
+    case BiquadType::LowShelf:
+      b0 = A * ((A + 1.0f) - (A - 1.0f) * cs + sqrtA2alpha);
+      b1 = 2.0f * A * ((A - 1.0f) - (A + 1.0f) * cs);
+      b2 = A * ((A + 1.0f) - (A - 1.0f) * cs - sqrtA2alpha);
+      a0 = (A + 1.0f) + (A - 1.0f) * cs + sqrtA2alpha;
+      a1 = -2.0f * ((A - 1.0f) + (A + 1.0f) * cs);
+      a2 = (A + 1.0f) + (A - 1.0f) * cs - sqrtA2alpha;
+      break;
+    case BiquadType::HighShelf:
+    default:
+      b0 = A * ((A + 1.0f) + (A - 1.0f) * cs + sqrtA2alpha);
+      b1 = -2.0f * A * ((A - 1.0f) + (A + 1.0f) * cs);
+      b2 = A * ((A + 1.0f) + (A - 1.0f) * cs - sqrtA2alpha);
+      a0 = (A + 1.0f) - (A - 1.0f) * cs + sqrtA2alpha;
+      a1 = 2.0f * ((A - 1.0f) - (A + 1.0f) * cs);
+      a2 = (A + 1.0f) - (A - 1.0f) * cs - sqrtA2alpha;
+      break;
+  }
+
+  int32_t next = 1 - activeCoefs_.load(std::memory_order_relaxed);
+  coefs_[next] = {b0 / a0, b1 / a0, b2 / a0, a1 / a0, a2 / a0};
+  activeCoefs_.store(next, std::memory_order_release);
+}
+
+void AudioBiquad::process(void *liveAudio, int32_t numFrames) {
+  uint8_t *audio = static_cast<uint8_t *>(liveAudio);
+  switch (encoding_) {
+    case SampleEncoding::Int16:
+      processSamples<Int16Sample>(audio, numFrames);
+      break;
+    case SampleEncoding::Int24Packed:
+      processSamples<Int24Sample>(audio, numFrames);
+      break;
+    case SampleEncoding::Float32:
+      processSamples<Float32Sample>(audio, numFrames);
+      break;
+  }
+}
+
+template <typename Sample>
+void AudioBiquad::processSamples(uint8_t *liveAudio, int32_t numFrames) {
+  const Coefficients c = coefs_[activeCoefs_.load(std::memory_order_acquire)];
+
+  for (int32_t ch = 0; ch < channelCount_; ch++) {
+    float z1 = z1_[ch], z2 = z2_[ch];
+    for (int32_t idx = ch; idx < numFrames * channelCount_;
+         idx += channelCount_) {
+      float x = Sample::read(liveAudio, idx);
+      float y = c.b0_ * x + z1;
+      z1 = c.b1_ * x - c.a1_ * y + z2;
+      z2 = c.b2_ * x - c.a2_ * y;
+      Sample::write(liveAudio, idx, y, &dither_);
+    }
+    z1_[ch] = z1;
+    z2_[ch] = z2;
+  }
+}
+
+AudioCompressor::AudioCompressor(int32_t sampleRate, int32_t channelCount,
+                                 SLuint32 format, float thresholdDb,
+                                 float ratio, float attackMs, float releaseMs,
+                                 float makeupDb)
+    : AudioEffect(sampleRate, channelCount, format) {
+  setParams(thresholdDb, ratio, attackMs, releaseMs, makeupDb);
+}
+
+void AudioCompressor::setParams(float thresholdDb, float ratio,
+                                float attackMs, float releaseMs,
+                                float makeupDb) {
+  float threshold = DbToLinear(thresholdDb);
+  ratio = std::max(1.0f, std::min(ratio, kLimiterRatio));
+
+  threshold_.store(threshold, std::memory_order_relaxed);
+  thresholdLog2_.store(log2f(threshold), std::memory_order_relaxed);
+  slope_.store(1.0f / ratio - 1.0f, std::memory_order_relaxed);
+  attackCoef_.store(TimeToCoef(attackMs, SampleRateInHz(sampleRate_)),
+                    std::memory_order_relaxed);
+  releaseCoef_.store(TimeToCoef(releaseMs, SampleRateInHz(sampleRate_)),
+                     std::memory_order_relaxed);
+  makeup_.store(DbToLinear(makeupDb), std::memory_order_relaxed);
+}
+
+const char *AudioCompressor::name(void) const {
+  return slope_.load(std::memory_order_relaxed) <= 1.0f / kLimiterRatio - 1.0f
+             ? "limiter"
+             : "compressor";
+}
+
+void AudioCompressor::process(void *liveAudio, int32_t numFrames) {
+  uint8_t *audio = static_cast<uint8_t *>(liveAudio);
+  switch (encoding_) {
+    case SampleEncoding::Int16:
+      processSamples<Int16Sample>(audio, numFrames);
+      break;
+    case SampleEncoding::Int24Packed:
+      processSamples<Int24Sample>(audio, numFrames);
+      break;
+    case SampleEncoding::Float32:
+      processSamples<Float32Sample>(audio, numFrames);
+      break;
+  }
+}
+
+template <typename Sample>
+void AudioCompressor::processSamples(uint8_t *liveAudio, int32_t numFrames) {
+  const float threshold = threshold_.load(std::memory_order_relaxed);
+  const float thresholdLog2 = thresholdLog2_.load(std::memory_order_relaxed);
+  const float slope = slope_.load(std::memory_order_relaxed);
+  const float attack = attackCoef_.load(std::memory_order_relaxed);
+  const float release = releaseCoef_.load(std::memory_order_relaxed);
+  const float makeup = makeup_.load(std::memory_order_relaxed);
+
+  float env = envelope_;
+  for (int32_t frame = 0; frame < numFrames; frame++) {
+    float peak = FramePeak<Sample>(liveAudio, frame, channelCount_);
+    float coef = peak > env ? attack : release;
+    env = peak + coef * (env - peak);
+
+    // gain computer only runs above the threshold, the common case is cheap
+    float gain = makeup;
+    if (env > threshold) {
+      gain *= exp2f(slope * (log2f(env) - thresholdLog2));
+    }
+    // unity gain leaves the samples as they are, not dithered
+    if (gain == 1.0f) continue;
+    for (int32_t ch = 0; ch < channelCount_; ch++) {
+      int32_t idx = frame * channelCount_ + ch;
+      Sample::write(liveAudio, idx, Sample::read(liveAudio, idx) * gain,
+                    &dither_);
+    }
+  }
+  envelope_ = env;
+}
+
+AudioNoiseGate::AudioNoiseGate(int32_t sampleRate, int32_t channelCount,
+                               SLuint32 format, float openThresholdDb,
+                               float hysteresisDb, float holdMs,
+                               float attackMs, float releaseMs)
+    : AudioEffect(sampleRate, channelCount, format) {
+  setParams(openThresholdDb, hysteresisDb, holdMs, attackMs, releaseMs);
+}
+
+/**
+ * attack and release are the times for the gate gain to ramp fully
+ * open or fully closed.
+ */
+void AudioNoiseGate::setParams(float openThresholdDb, float hysteresisDb,
+                               float holdMs, float attackMs, float releaseMs) {
+  float rate = SampleRateInHz(sampleRate_);
+  openThreshold_.store(DbToLinear(openThresholdDb), std::memory_order_relaxed);
+  closeThreshold_.store(DbToLinear(openThresholdDb - fabsf(hysteresisDb)),
+                        std::memory_order_relaxed);
+  holdFrames_.store(static_cast<uint32_t>(holdMs * rate / 1000.0f),
+                    std::memory_order_relaxed);
+  attackStep_.store(1.0f / std::max(1.0f, attackMs * rate / 1000.0f),
+                    std::memory_order_relaxed);
+  releaseStep_.store(1.0f / std::max(1.0f, releaseMs * rate / 1000.0f),
+                     std::memory_order_relaxed);
+}
+
+void AudioNoiseGate::process(void *liveAudio, int32_t numFrames) {
+  uint8_t *audio = static_cast<uint8_t *>(liveAudio);
+  switch (encoding_) {
+    case SampleEncoding::Int16:
+      processSamples<Int16Sample>(audio, numFrames);
+      break;
+    case SampleEncoding::Int24Packed:
+      processSamples<Int24Sample>(audio, numFrames);
+      break;
+    case SampleEncoding::Float32:
+      processSamples<Float32Sample>(audio, numFrames);
+      break;
+  }
+}
+
+template <typename Sample>
+void AudioNoiseGate::processSamples(uint8_t *liveAudio, int32_t numFrames) {
+  const float openThreshold = openThreshold_.load(std::memory_order_relaxed);
+  const float closeThreshold = closeThreshold_.load(std::memory_order_relaxed);
+  const uint32_t holdFrames = holdFrames_.load(std::memory_order_relaxed);
+  const float attackStep = attackStep_.load(std::memory_order_relaxed);
+  const float releaseStep = releaseStep_.load(std::memory_order_relaxed);
+  const float detectorRelease =
+      TimeToCoef(kGateDetectorReleaseMs, SampleRateInHz(sampleRate_));
+
+  for (int32_t frame = 0; frame < numFrames; frame++) {
+    float peak = FramePeak<Sample>(liveAudio, frame, channelCount_);
+    envelope_ = std::max(peak, envelope_ * detectorRelease);
+
+    if (envelope_ >= openThreshold) {
+      open_ = true;
+      holdCount_ = holdFrames;
+    } else if (envelope_ < closeThreshold) {
+      if (holdCount_) {
+        --holdCount_;
+      } else {
+        open_ = false;
+      }
+    }
+
+    gain_ = open_ ? std::min(1.0f, gain_ + attackStep)
+                  : std::max(0.0f, gain_ - releaseStep);
+    // closed is digital silence and open is the input, only the ramps in
+    // between are dithered
+    if (gain_ == 0.0f) {
+      for (int32_t ch = 0; ch < channelCount_; ch++) {
+        Sample::write(liveAudio, frame * channelCount_ + ch, 0.0f, nullptr);
+      }
+    } else if (gain_ < 1.0f) {
+      for (int32_t ch = 0; ch < channelCount_; ch++) {
+        int32_t idx = frame * channelCount_ + ch;
+        Sample::write(liveAudio, idx, Sample::read(liveAudio, idx) * gain_,
+                      &dither_);
+      }
+    }
+  }
+}
@@ -0,0 +1,121 @@
+/*
+ * Copyright 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef NATIVE_AUDIO_AUDIO_FILTERS_H
+#define NATIVE_AUDIO_AUDIO_FILTERS_H
+
+#include <atomic>
+#include <cstdint>
+
+#include "audio_effect.h"
+
+/*
+ * Only mono and stereo are supported ( see ConvertToSLSampleFormat() ), all
+ * per channel filter state is preallocated for this many channels.
+ */
+#define AUDIO_EFFECT_MAX_CHANNELS 2
+
+enum class BiquadType { LowPass, HighPass, Peaking, LowShelf, HighShelf };
+
+/**
+ * A single biquad EQ section ( RBJ audio EQ cookbook ), transposed direct
+ * form II in float.
+ *   - setParams() computes the coefficients on the calling thread and
+ *     hands them to process() through a double buffer
+ */
+class AudioBiquad : public AudioEffect {
+ public:
+  explicit AudioBiquad(int32_t sampleRate, int32_t channelCount,
+                       SLuint32 format, BiquadType type, float freqHz,
+                       float q, float gainDb);
+  void setParams(BiquadType type, float freqHz, float q, float gainDb);
+  void process(void *liveAudio, int32_t numFrames) override;
+  const char *name(void) const override { return "biquad"; }
+
+ private:
+  struct Coefficients {
+    float b0_, b1_, b2_, a1_, a2_;
+  };
+  Coefficients coefs_[2];
+  std::atomic<int32_t> activeCoefs_{0};
+  float z1_[AUDIO_EFFECT_MAX_CHANNELS] = {0};
+  float z2_[AUDIO_EFFECT_MAX_CHANNELS] = {0};
+
+  template <typename Sample>
+  void processSamples(uint8_t *liveAudio, int32_t numFrames);
+};
+
+/**
+ * Feed-forward compressor with a peak envelope follower; the channels are
+ * linked so the stereo image does not move. With ratio set to
+ * kLimiterRatio it works as a limiter.
+ */
+class AudioCompressor : public AudioEffect {
+ public:
+  static constexpr float kLimiterRatio = 1000.0f;
+
+  explicit AudioCompressor(int32_t sampleRate, int32_t channelCount,
+                           SLuint32 format, float thresholdDb, float ratio,
+                           float attackMs, float releaseMs, float makeupDb);
+  void setParams(float thresholdDb, float ratio, float attackMs,
+                 float releaseMs, float makeupDb);
+  void process(void *liveAudio, int32_t numFrames) override;
+  const char *name(void) const override;
+
+ private:
+  std::atomic<float> threshold_{1.0f};  // linear, full scale is 1.0
+  std::atomic<float> thresholdLog2_{0.0f};
+  std::atomic<float> slope_{0.0f};  // 1 / ratio - 1
+  std::atomic<float> attackCoef_{0.0f};
+  std::atomic<float> releaseCoef_{0.0f};
+  std::atomic<float> makeup_{1.0f};
+  float envelope_ = 0.0f;
+
+  template <typename Sample>
+  void processSamples(uint8_t *liveAudio, int32_t numFrames);
+};
+
+/**
+ * Noise gate: mutes the audio once its envelope stays below the close
+ * threshold for the hold time, opens again above the open threshold.
+ */
+class AudioNoiseGate : public AudioEffect {
+ public:
+  explicit AudioNoiseGate(int32_t sampleRate, int32_t channelCount,
+                          SLuint32 format, float openThresholdDb,
+                          float hysteresisDb, float holdMs, float attackMs,
+                          float releaseMs);
+  void setParams(float openThresholdDb, float hysteresisDb, float holdMs,
+                 float attackMs, float releaseMs);
+  void process(void *liveAudio, int32_t numFrames) override;
+  const char *name(void) const override { return "noise-gate"; }
+
+ private:
+  std::atomic<float> openThreshold_{0.0f};
+  std::atomic<float> closeThreshold_{0.0f};
+  std::atomic<uint32_t> holdFrames_{0};
+  std::atomic<float> attackStep_{1.0f};
+  std::atomic<float> releaseStep_{1.0f};
+  float envelope_ = 0.0f;
+  float gain_ = 0.0f;
+  uint32_t holdCount_ = 0;
+  bool open_ = false;
+
+  template <typename Sample>
+  void processSamples(uint8_t *liveAudio, int32_t numFrames);
+};
+
+#endif  // NATIVE_AUDIO_AUDIO_FILTERS_H
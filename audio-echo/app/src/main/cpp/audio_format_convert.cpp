@@ -0,0 +1,245 @@
+/*
+ * Copyright 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "audio_format_convert.h"
+
+#include <algorithm>
+#include <cstring>
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define CONVERT_HAVE_NEON 1
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#define CONVERT_HAVE_SSE2 1
+#endif
+
+// uniform random in [0, 1) from the top 24 bits of a xorshift32 output,
+// as AudioDither::tpdf() does one lane at a time
+static const float kUniformScale = 1.0f / 16777216.0f;
+// scratch size used when two integer formats are converted through float
+static const int32_t kConvertChunk = 256;
+
+#if defined(CONVERT_HAVE_NEON)
+static inline uint32x4_t XorshiftNeon(uint32x4_t &s) {
+  s = veorq_u32(s, vshlq_n_u32(s, 13));
+  s = veorq_u32(s, vshrq_n_u32(s, 17));
+  s = veorq_u32(s, vshlq_n_u32(s, 5));
+  return s;
+}
+static inline float32x4_t TpdfNeon(uint32x4_t &s) {
+  float32x4_t u1 = vcvtq_f32_u32(vshrq_n_u32(XorshiftNeon(s), 8));
+  float32x4_t u2 = vcvtq_f32_u32(vshrq_n_u32(XorshiftNeon(s), 8));
+  return vmulq_n_f32(vsubq_f32(u1, u2), kUniformScale);
+}
+static inline int32x4_t RoundToInt(float32x4_t v) {
+#if defined(__aarch64__)
+  return vcvtnq_s32_f32(v);
+#else
+  // armv7 only truncates: bias away from zero by half an LSB first
+  uint32x4_t negative = vcltq_f32(v, vdupq_n_f32(0.0f));
+  float32x4_t half = vbslq_f32(negative, vdupq_n_f32(-0.5f), vdupq_n_f32(0.5f));
+  return vcvtq_s32_f32(vaddq_f32(v, half));
+#endif
+}
+#elif defined(CONVERT_HAVE_SSE2)
+static inline __m128i XorshiftSse2(__m128i &s) {
+  s = _mm_xor_si128(s, _mm_slli_epi32(s, 13));
+  s = _mm_xor_si128(s, _mm_srli_epi32(s, 17));
+  s = _mm_xor_si128(s, _mm_slli_epi32(s, 5));
+  return s;
+}
+static inline __m128 TpdfSse2(__m128i &s) {
+  __m128 u1 = _mm_cvtepi32_ps(_mm_srli_epi32(XorshiftSse2(s), 8));
+  __m128 u2 = _mm_cvtepi32_ps(_mm_srli_epi32(XorshiftSse2(s), 8));
+  return _mm_mul_ps(_mm_sub_ps(u1, u2), _mm_set1_ps(kUniformScale));
+}
+#endif
+
+void ConvertInt16ToFloat(const int16_t *src, float *dst, int32_t count) {
+  int32_t idx = 0;
+#if defined(CONVERT_HAVE_NEON)
+  for (; idx + 8 <= count; idx += 8) {
+    int16x8_t s = vld1q_s16(src + idx);
+    float32x4_t lo = vcvtq_f32_s32(vmovl_s16(vget_low_s16(s)));
+    float32x4_t hi = vcvtq_f32_s32(vmovl_s16(vget_high_s16(s)));
+    vst1q_f32(dst + idx, vmulq_n_f32(lo, 1.0f / 32768.0f));
+    vst1q_f32(dst + idx + 4, vmulq_n_f32(hi, 1.0f / 32768.0f));
+  }
+#elif defined(CONVERT_HAVE_SSE2)
+  const __m128 scale = _mm_set1_ps(1.0f / 32768.0f);
+  for (; idx + 8 <= count; idx += 8) {
+    __m128i s = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + idx));
+    __m128i lo = _mm_srai_epi32(_mm_unpacklo_epi16(s, s), 16);
+    __m128i hi = _mm_srai_epi32(_mm_unpackhi_epi16(s, s), 16);
+    _mm_storeu_ps(dst + idx, _mm_mul_ps(_mm_cvtepi32_ps(lo), scale));
+    _mm_storeu_ps(dst + idx + 4, _mm_mul_ps(_mm_cvtepi32_ps(hi), scale));
+  }
+#endif
+  for (; idx < count; idx++) {
+    dst[idx] = src[idx] * (1.0f / 32768.0f);
+  }
+}
+
+void ConvertFloatToInt16(const float *src, int16_t *dst, int32_t count,
+                         AudioDither *dither) {
+  int32_t idx = 0;
+#if defined(CONVERT_HAVE_NEON)
+  uint32x4_t state = vdupq_n_u32(0);
+  if (dither) state = vld1q_u32(dither->state_);
+  for (; idx + 8 <= count; idx += 8) {
+    float32x4_t lo = vmulq_n_f32(vld1q_f32(src + idx), 32768.0f);
+    float32x4_t hi = vmulq_n_f32(vld1q_f32(src + idx + 4), 32768.0f);
+    if (dither) {
+      lo = vaddq_f32(lo, TpdfNeon(state));
+      hi = vaddq_f32(hi, TpdfNeon(state));
+    }
+    // vqmovn saturates to 16 bit, the float to int conversion to 32 bit
+    int16x8_t out =
+        vcombine_s16(vqmovn_s32(RoundToInt(lo)), vqmovn_s32(RoundToInt(hi)));
+    vst1q_s16(dst + idx, out);
+  }
+  if (dither) vst1q_u32(dither->state_, state);
+#elif defined(CONVERT_HAVE_SSE2)
+  __m128i state = _mm_setzero_si128();
+  if (dither) {
+    state = _mm_loadu_si128(reinterpret_cast<const __m128i *>(dither->state_));
+  }
+  const __m128 scale = _mm_set1_ps(32768.0f);
+  const __m128 maxValue = _mm_set1_ps(32767.0f);
+  const __m128 minValue = _mm_set1_ps(-32768.0f);
+  for (; idx + 8 <= count; idx += 8) {
+    __m128 lo = _mm_mul_ps(_mm_loadu_ps(src + idx), scale);
+    __m128 hi = _mm_mul_ps(_mm_loadu_ps(src + idx + 4), scale);
+    if (dither) {
+      lo = _mm_add_ps(lo, TpdfSse2(state));
+      hi = _mm_add_ps(hi, TpdfSse2(state));
+    }
+    // clamp first: cvtps2dq turns overflow into INT_MIN
+    lo = _mm_min_ps(_mm_max_ps(lo, minValue), maxValue);
+    hi = _mm_min_ps(_mm_max_ps(hi, minValue), maxValue);
+    __m128i out = _mm_packs_epi32(_mm_cvtps_epi32(lo), _mm_cvtps_epi32(hi));
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + idx), out);
+  }
+  if (dither) {
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(dither->state_), state);
+  }
+#endif
+  for (; idx < count; idx++) {
+    Int16Sample::write(reinterpret_cast<uint8_t *>(dst), idx, src[idx],
+                       dither);
+  }
+}
+
+/*
+ * Packed 24 bit samples do not line up with SIMD lanes; these loops stay
+ * scalar and go through the Int24Sample traits.
+ */
+void ConvertInt24ToFloat(const uint8_t *src, float *dst, int32_t count) {
+  for (int32_t idx = 0; idx < count; idx++) {
+    dst[idx] = Int24Sample::read(src, idx);
+  }
+}
+
+void ConvertFloatToInt24(const float *src, uint8_t *dst, int32_t count,
+                         AudioDither *dither) {
+  for (int32_t idx = 0; idx < count; idx++) {
+    Int24Sample::write(dst, idx, src[idx], dither);
+  }
+}
+
+static int32_t BytesPerSample(SampleEncoding encoding) {
+  switch (encoding) {
+    case SampleEncoding::Int24Packed:
+      return Int24Sample::kBytes;
+    case SampleEncoding::Float32:
+      return Float32Sample::kBytes;
+    case SampleEncoding::Int16:
+    default:
+      return Int16Sample::kBytes;
+  }
+}
+
+static void ConvertToFloat(const uint8_t *src, SampleEncoding encoding,
+                           float *dst, int32_t count) {
+  switch (encoding) {
+    case SampleEncoding::Int16:
+      ConvertInt16ToFloat(reinterpret_cast<const int16_t *>(src), dst, count);
+      break;
+    case SampleEncoding::Int24Packed:
+      ConvertInt24ToFloat(src, dst, count);
+      break;
+    case SampleEncoding::Float32:
+      memcpy(dst, src, count * sizeof(float));
+      break;
+  }
+}
+
+static void ConvertFromFloat(const float *src, uint8_t *dst,
+                             SampleEncoding encoding, int32_t count,
+                             AudioDither *dither) {
+  switch (encoding) {
+    case SampleEncoding::Int16:
+      ConvertFloatToInt16(src, reinterpret_cast<int16_t *>(dst), count,
+                          dither);
+      break;
+    case SampleEncoding::Int24Packed:
+      ConvertFloatToInt24(src, dst, count, dither);
+      break;
+    case SampleEncoding::Float32:
+      memcpy(dst, src, count * sizeof(float));
+      break;
+  }
+}
+
+void ConvertSamples(const void *src, SampleEncoding srcEncoding, void *dst,
+                    SampleEncoding dstEncoding, int32_t count,
+                    AudioDither *dither) {
+  const uint8_t *in = static_cast<const uint8_t *>(src);
+  uint8_t *out = static_cast<uint8_t *>(dst);
+
+  if (srcEncoding == dstEncoding) {
+    memcpy(out, in, count * BytesPerSample(srcEncoding));
+    return;
+  }
+  if (srcEncoding == SampleEncoding::Float32) {
+    ConvertFromFloat(reinterpret_cast<const float *>(in), out, dstEncoding,
+                     count, dither);
+    return;
+  }
+  if (dstEncoding == SampleEncoding::Float32) {
+    ConvertToFloat(in, srcEncoding, reinterpret_cast<float *>(out), count);
+    return;
+  }
+  if (srcEncoding == SampleEncoding::Int16) {
+    // 16 -> 24 bit is exact, no need to go through float
+    const int16_t *samples = reinterpret_cast<const int16_t *>(in);
+    for (int32_t idx = 0; idx < count; idx++) {
+      Int24Sample::writeInt(out, idx, samples[idx] * 256);
+    }
+    return;
+  }
+
+  // 24 -> 16 bit: go through float in small chunks for the dither
+  float scratch[kConvertChunk];
+  int32_t srcBytes = BytesPerSample(srcEncoding);
+  int32_t dstBytes = BytesPerSample(dstEncoding);
+  for (int32_t done = 0; done < count; done += kConvertChunk) {
+    int32_t chunk = std::min(kConvertChunk, count - done);
+    ConvertToFloat(in + done * srcBytes, srcEncoding, scratch, chunk);
+    ConvertFromFloat(scratch, out + done * dstBytes, dstEncoding, chunk,
+                     dither);
+  }
+}
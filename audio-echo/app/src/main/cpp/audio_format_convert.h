@@ -0,0 +1,45 @@
+/*
+ * Copyright 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef NATIVE_AUDIO_AUDIO_FORMAT_CONVERT_H
+#define NATIVE_AUDIO_AUDIO_FORMAT_CONVERT_H
+
+#include <cstdint>
+
+#include "audio_sample.h"
+
+/*
+ * Sample format converters, count is in samples ( not frames ).
+ * Converting to a narrower integer format adds +-1 LSB TPDF dither before
+ * rounding ( AudioDither, audio_sample.h ); pass a nullptr dither to round
+ * only. The scalar loops and tails are the sample traits' write(), so a
+ * block converted here and one written sample by sample come out the same.
+ */
+void ConvertInt16ToFloat(const int16_t *src, float *dst, int32_t count);
+void ConvertFloatToInt16(const float *src, int16_t *dst, int32_t count,
+                         AudioDither *dither);
+void ConvertInt24ToFloat(const uint8_t *src, float *dst, int32_t count);
+void ConvertFloatToInt24(const float *src, uint8_t *dst, int32_t count,
+                         AudioDither *dither);
+
+/*
+ * Convert between any two SampleEncodings; same encodings are a memcpy.
+ */
+void ConvertSamples(const void *src, SampleEncoding srcEncoding, void *dst,
+                    SampleEncoding dstEncoding, int32_t count,
+                    AudioDither *dither);
+
+#endif  // NATIVE_AUDIO_AUDIO_FORMAT_CONVERT_H
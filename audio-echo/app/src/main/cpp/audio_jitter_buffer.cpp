@@ -0,0 +1,268 @@
+/*
+ * Copyright 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "audio_jitter_buffer.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+// a window averaging below this ( about -50 dBFS ) is quiet in any case
+static const float kQuietLevel = 0.003f;
+
+AudioJitterBuffer::AudioJitterBuffer(const SampleFormat &format,
+                                     uint32_t initialDepth, uint32_t maxDepth)
+    : encoding_(GetSampleEncoding(format.pcmFormat_)),
+      channels_(std::max<uint32_t>(format.channels_, 1)),
+      framesPerBuf_(std::max<uint32_t>(format.framesPerBuf_, 1)),
+      initialDepth_(initialDepth),
+      maxDepth_(std::max(maxDepth, kMinDepth)),
+      targetDepth_(initialDepth) {
+  frameSize_ = channels_ * (format.pcmFormat_ >> 3);
+  // sampleRate_ is in milli Hz
+  periodNs_ = static_cast<uint64_t>(framesPerBuf_) * 1000000000000ULL /
+              std::max<uint32_t>(format.sampleRate_, 1);
+  uint64_t window = static_cast<uint64_t>(format.sampleRate_) *
+                    kStableWindowMs / 1000000 / framesPerBuf_;
+  windowLen_ = static_cast<uint32_t>(std::max<uint64_t>(window, 1));
+  targetDepth_ = std::min(std::max(targetDepth_, kMinDepth), maxDepth_);
+  memset(&stats_, 0, sizeof(stats_));
+  reset();
+}
+
+/*
+ * Buffer up again before playing, keeping the depth learnt so far
+ */
+void AudioJitterBuffer::reset(void) {
+  buffering_ = true;
+  lastCallbackNs_ = 0;
+  queuedDepth_ = 0;
+  xrunHistory_ = 0;
+  windowCount_ = 0;
+  minSlack_ = UINT32_MAX;
+  minBacklog_ = UINT32_MAX;
+  pendingDrop_ = 0;
+  dropWait_ = 0;
+  stats_.minPhaseUs_ = UINT32_MAX;
+  stats_.maxPhaseUs_ = 0;
+}
+
+void AudioJitterBuffer::grow(void) {
+  targetDepth_ = std::min(targetDepth_ + 1, maxDepth_);
+  xrunHistory_ = std::min(xrunHistory_ + 1, kMaxXrunHistory);
+  windowCount_ = 0;
+  minSlack_ = UINT32_MAX;
+  minBacklog_ = UINT32_MAX;
+  pendingDrop_ = 0;
+  dropWait_ = 0;
+}
+
+/*
+ * The device is about to run dry: the player plays silence and buffers up
+ * to a deeper target.
+ */
+void AudioJitterBuffer::onUnderrun(void) {
+  stats_.underruns_++;
+  grow();
+  buffering_ = true;
+  lastCallbackNs_ = 0;
+}
+
+/**
+ * Called first thing in a player callback while playing: the buffers on
+ * the device after the last callback covered queuedDepth_ periods, give or
+ * take half a period of callback jitter.
+ * @return true if the device ran dry since the last callback
+ */
+bool AudioJitterBuffer::checkStarved(uint64_t nowNs) {
+  if (!lastCallbackNs_ || nowNs < lastCallbackNs_) return false;
+  if (nowNs - lastCallbackNs_ <= queuedDepth_ * periodNs_ + periodNs_ / 2) {
+    return false;
+  }
+  stats_.starved_++;
+  grow();
+  return true;
+}
+
+/*
+ * Track the recorder to player phase: how long a recorded buffer waited in
+ * the play queue before going to the device.
+ */
+void AudioJitterBuffer::onBufferQueued(uint64_t recordedNs, uint64_t nowNs) {
+  if (!recordedNs || nowNs < recordedNs) return;
+  uint32_t phaseUs = static_cast<uint32_t>(
+      std::min<uint64_t>((nowNs - recordedNs) / 1000, UINT32_MAX));
+  stats_.minPhaseUs_ = std::min(stats_.minPhaseUs_, phaseUs);
+  stats_.maxPhaseUs_ = std::max(stats_.maxPhaseUs_, phaseUs);
+}
+
+/**
+ * Called once per player callback while playing, last thing.
+ * @param devSlack buffers still on the device when the callback came
+ * @param backlog recorded buffers left in the play queue after topping up
+ *        the device
+ * @param devDepth buffers on the device after topping it up
+ */
+void AudioJitterBuffer::update(uint32_t devSlack, uint32_t backlog,
+                               uint32_t devDepth, uint64_t nowNs) {
+  lastCallbackNs_ = nowNs;
+  queuedDepth_ = devDepth;
+  minSlack_ = std::min(minSlack_, devSlack);
+  minBacklog_ = std::min(minBacklog_, backlog);
+  if (++windowCount_ < (windowLen_ << xrunHistory_)) {
+    return;
+  }
+
+  // the callback always came with one spare buffer on the device
+  if (minSlack_ >= 2 && targetDepth_ > kMinDepth) {
+    targetDepth_--;
+    stats_.shrinks_++;
+  }
+  if (!pendingDrop_ && minBacklog_) {
+    pendingDrop_ = minBacklog_ * framesPerBuf_;
+  }
+  if (xrunHistory_) {
+    xrunHistory_--;
+  }
+  windowCount_ = 0;
+  minSlack_ = UINT32_MAX;
+  minBacklog_ = UINT32_MAX;
+}
+
+/*
+ * Start of the dropFrames long window with the least energy in it.
+ * *quiet tells whether it is quiet enough to cut unnoticed: well below
+ * the buffer average, or close to silence.
+ */
+template <typename Sample>
+uint32_t AudioJitterBuffer::findQuietFrame(const uint8_t *audio,
+                                           uint32_t frames,
+                                           uint32_t dropFrames,
+                                           bool *quiet) const {
+  auto level = [&](uint32_t frame) {
+    float sum = 0.0f;
+    for (uint32_t ch = 0; ch < channels_; ch++) {
+      sum += fabsf(Sample::read(audio, frame * channels_ + ch));
+    }
+    return sum;
+  };
+
+  float window = 0.0f;
+  for (uint32_t frame = 0; frame < dropFrames; frame++) {
+    window += level(frame);
+  }
+  float total = window;
+  float best = window;
+  uint32_t bestStart = 0;
+  for (uint32_t frame = dropFrames; frame < frames; frame++) {
+    float in = level(frame);
+    total += in;
+    window += in - level(frame - dropFrames);
+    if (window < best) {
+      best = window;
+      bestStart = frame - dropFrames + 1;
+    }
+  }
+
+  best = std::max(best, 0.0f);  // running sum rounding
+  *quiet = best * frames <= total * dropFrames * 0.25f ||
+           best <= kQuietLevel * dropFrames * channels_;
+  return bestStart;
+}
+
+/*
+ * Cut dropFrames frames at start, cross fading across the cut
+ */
+template <typename Sample>
+void AudioJitterBuffer::splice(uint8_t *audio, uint32_t frames,
+                               uint32_t start, uint32_t dropFrames) {
+  uint32_t tail = start + dropFrames;
+  uint32_t fade = std::min(kCrossfadeFrames, frames - tail);
+  for (uint32_t frame = 0; frame < fade; frame++) {
+    float weight = static_cast<float>(frame + 1) / (fade + 1);
+    for (uint32_t ch = 0; ch < channels_; ch++) {
+      int32_t dst = (start + frame) * channels_ + ch;
+      int32_t src = (tail + frame) * channels_ + ch;
+      float value = Sample::read(audio, dst) * (1.0f - weight) +
+                    Sample::read(audio, src) * weight;
+      Sample::write(audio, dst, value, &dither_);
+    }
+  }
+  memmove(audio + (start + fade) * frameSize_,
+          audio + (tail + fade) * frameSize_,
+          (frames - tail - fade) * frameSize_);
+}
+
+/*
+ * Drop some of the owed frames from a buffer about to be played
+ */
+void AudioJitterBuffer::trim(sample_buf *buf) {
+  if (!pendingDrop_ || !frameSize_) return;
+  uint32_t frames = buf->size_ / frameSize_;
+  uint32_t drop =
+      std::min(pendingDrop_, std::max<uint32_t>(framesPerBuf_ / 8, 1));
+  if (frames <= drop) return;
+
+  bool quiet = false;
+  uint32_t start = 0;
+  switch (encoding_) {
+    case SampleEncoding::Int24Packed:
+      start = findQuietFrame<Int24Sample>(buf->buf_, frames, drop, &quiet);
+      break;
+    case SampleEncoding::Float32:
+      start = findQuietFrame<Float32Sample>(buf->buf_, frames, drop, &quiet);
+      break;
+    case SampleEncoding::Int16:
+      start = findQuietFrame<Int16Sample>(buf->buf_, frames, drop, &quiet);
+      break;
+  }
+  if (!quiet && ++dropWait_ < kDropPatience) {
+    return;
+  }
+
+  switch (encoding_) {
+    case SampleEncoding::Int24Packed:
+      splice<Int24Sample>(buf->buf_, frames, start, drop);
+      break;
+    case SampleEncoding::Float32:
+      splice<Float32Sample>(buf->buf_, frames, start, drop);
+      break;
+    case SampleEncoding::Int16:
+      splice<Int16Sample>(buf->buf_, frames, start, drop);
+      break;
+  }
+  buf->size_ -= drop * frameSize_;
+  pendingDrop_ -= drop;
+  dropWait_ = 0;
+  stats_.droppedFrames_ += drop;
+}
+
+void AudioJitterBuffer::getStats(AudioJitterStats *stats) const {
+  *stats = stats_;
+  stats->targetDepth_ = targetDepth_;
+}
+
+void AudioJitterBuffer::dumpStats(void) const {
+  AudioJitterStats stats;
+  getStats(&stats);
+  LOGI("JitterBuffer: depth=%d ( initial %d ), underruns=%d, starved=%d, "
+       "shrinks=%d, dropped frames=%llu",
+       stats.targetDepth_, initialDepth_, stats.underruns_, stats.starved_,
+       stats.shrinks_, static_cast<unsigned long long>(stats.droppedFrames_));
+  if (stats.minPhaseUs_ <= stats.maxPhaseUs_) {
+    LOGI("JitterBuffer: recorder to player phase min=%d us, max=%d us",
+         stats.minPhaseUs_, stats.maxPhaseUs_);
+  }
+}
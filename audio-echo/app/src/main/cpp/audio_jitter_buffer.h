@@ -0,0 +1,117 @@
+/*
+ * Copyright 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef NATIVE_AUDIO_AUDIO_JITTER_BUFFER_H
+#define NATIVE_AUDIO_AUDIO_JITTER_BUFFER_H
+
+#include <cstdint>
+
+#include "audio_common.h"
+#include "audio_sample.h"
+
+/*
+ * What the jitter buffer did since the player started
+ */
+struct AudioJitterStats {
+  uint32_t targetDepth_;
+  uint32_t underruns_;  // the player had to fill in silence
+  uint32_t starved_;    // a callback came after the device ran dry
+  uint32_t shrinks_;
+  uint64_t droppedFrames_;
+  uint32_t minPhaseUs_;  // shortest wait of a recorded buffer for the player
+  uint32_t maxPhaseUs_;
+};
+
+/**
+ * Adaptive jitter buffer for AudioPlayer: decides how many buffers the
+ * player keeps queued on the device ( the target depth ).
+ *   - starts buffering to the initial depth, playing silence meanwhile
+ *   - an underrun ( device and play queue both empty ) grows the depth by
+ *     one and buffers again: the silence is inserted where audio already
+ *     broke up
+ *   - so does a callback coming later than the buffers queued at the last
+ *     one could last: the device ran dry in between, and played silence
+ *   - after a stable window in which the device always had 2+ buffers
+ *     left at the callback, the depth shrinks by one; the window doubles
+ *     for each recent underrun
+ *   - recorded buffers piling up in the play queue for a whole window are
+ *     latency nobody needs: they are dropped a few frames per buffer, at
+ *     the quietest spot of the buffer
+ * All of it runs in the player callback: no locks, no allocation.
+ */
+class AudioJitterBuffer {
+ public:
+  AudioJitterBuffer(const SampleFormat &format, uint32_t initialDepth,
+                    uint32_t maxDepth);
+
+  void reset(void);
+  uint32_t getTargetDepth(void) const { return targetDepth_; }
+  bool isBuffering(void) const { return buffering_; }
+  void startPlaying(void) { buffering_ = false; }
+
+  void onUnderrun(void);
+  bool checkStarved(uint64_t nowNs);
+  void onBufferQueued(uint64_t recordedNs, uint64_t nowNs);
+  void update(uint32_t devSlack, uint32_t backlog, uint32_t devDepth,
+              uint64_t nowNs);
+  void trim(sample_buf *buf);
+
+  void getStats(AudioJitterStats *stats) const;
+  void dumpStats(void) const;
+
+ private:
+  static constexpr uint32_t kMinDepth = 1;
+  static constexpr uint32_t kMaxXrunHistory = 4;
+  static constexpr uint32_t kStableWindowMs = 2000;
+  // buffers a drop may wait for a quiet spot before it just happens
+  static constexpr uint32_t kDropPatience = 8;
+  static constexpr uint32_t kCrossfadeFrames = 16;
+
+  template <typename Sample>
+  uint32_t findQuietFrame(const uint8_t *audio, uint32_t frames,
+                          uint32_t dropFrames, bool *quiet) const;
+  template <typename Sample>
+  void splice(uint8_t *audio, uint32_t frames, uint32_t start,
+              uint32_t dropFrames);
+  void grow(void);
+
+  SampleEncoding encoding_;
+  uint32_t channels_;
+  uint32_t frameSize_;
+  uint32_t framesPerBuf_;
+  uint64_t periodNs_;
+  uint32_t windowLen_;  // callbacks in a stable window, without xruns
+
+  uint32_t initialDepth_;
+  uint32_t maxDepth_;
+  uint32_t targetDepth_;
+  bool buffering_;
+
+  uint64_t lastCallbackNs_;  // 0: buffering, nothing to compare with
+  uint32_t queuedDepth_;     // buffers on the device after it
+
+  uint32_t xrunHistory_;
+  uint32_t windowCount_;
+  uint32_t minSlack_;
+  uint32_t minBacklog_;
+
+  uint32_t pendingDrop_;  // frames still to drop
+  uint32_t dropWait_;     // buffers passed over waiting for a quiet spot
+  AudioDither dither_;    // for the crossfades of 16/24 bit audio
+
+  AudioJitterStats stats_;
+};
+
+#endif  // NATIVE_AUDIO_AUDIO_JITTER_BUFFER_H
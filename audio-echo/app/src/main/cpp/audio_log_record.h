@@ -0,0 +1,53 @@
+/*
+ * Copyright 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef NATIVE_AUDIO_AUDIO_LOG_RECORD_H
+#define NATIVE_AUDIO_AUDIO_LOG_RECORD_H
+
+#include <cstdint>
+
+/*
+ * On-disk format of the AndroidLog files: one AudioLogHeader, then
+ * fixed-size AudioLogRecords in the order they were logged. Shared with
+ * the host decoder ( audio-echo/tools/audio_log_decode.cpp ), so keep it
+ * free of Android headers.
+ */
+#define AUDIO_LOG_MAGIC 0x474F4C41u  // "ALOG"
+#define AUDIO_LOG_VERSION 1
+#define AUDIO_LOG_PAYLOAD_SIZE 48
+
+enum AudioLogRecordType : uint16_t {
+  AUDIO_LOG_RECORD_TIME = 1,  // payload: uint64_t delta since last, in ns
+  AUDIO_LOG_RECORD_TEXT = 2,  // payload: text, not 0 terminated
+  AUDIO_LOG_RECORD_DATA = 3,  // payload: raw bytes
+};
+
+struct AudioLogHeader {
+  uint32_t magic_;
+  uint32_t version_;
+  uint32_t recordSize_;
+  uint32_t reserved_;
+};
+
+struct AudioLogRecord {
+  uint64_t timeNs_;  // CLOCK_MONOTONIC
+  uint32_t seq_;     // per file; a gap means records were dropped
+  uint16_t type_;    // AudioLogRecordType
+  uint16_t size_;    // bytes used in payload_
+  uint8_t payload_[AUDIO_LOG_PAYLOAD_SIZE];
+};
+static_assert(sizeof(AudioLogRecord) == 64, "one record per cache line");
+
+#endif  // NATIVE_AUDIO_AUDIO_LOG_RECORD_H
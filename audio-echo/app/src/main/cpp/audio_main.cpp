@@ -19,11 +19,20 @@
 
 #include <cassert>
 #include <cstring>
+#include <vector>
 
+#include "audio_capture.h"
 #include "audio_common.h"
+#include "audio_echo_canceller.h"
 #include "audio_effect.h"
+#include "audio_effect_chain.h"
+#include "audio_filters.h"
 #include "audio_player.h"
 #include "audio_recorder.h"
+#include "audio_reverb.h"
+#include "audio_thread.h"
+#include "audio_trace.h"
+#include "buf_pool.h"
 #include "jni_interface.h"
 
 struct EchoAudioEngine {
@@ -31,6 +40,7 @@ struct EchoAudioEngine {
   uint32_t fastPathFramesPerBuf_;
   uint16_t sampleChannels_;
   uint16_t bitsPerSample_;
+  uint32_t representation_;
 
   SLObjectItf slEngineObj_;
   SLEngineItf slEngineItf_;
@@ -40,17 +50,49 @@ struct EchoAudioEngine {
   AudioQueue *freeBufQueue_;  // Owner of the queue
   AudioQueue *recBufQueue_;   // Owner of the queue
 
-  sample_buf *bufs_;
-  uint32_t bufCount_;
+  SampleBufPool *bufPool_;  // Owner of the sample buffers
+  AudioTrace *trace_;       // Owner of the callback trace
+  AudioThreadConfig threadConfig_;
+  AudioWakeupProbe *probe_;  // Owner of the wakeup probe
+  AudioCapture *capture_;    // Owner of the capture taps
   uint32_t frameCount_;
   int64_t echoDelay_;
   float echoDecay_;
-  AudioDelay *delayEffect_;
+  AudioEchoCanceller *echoCanceller_;  // owned by effectChain_
+  AudioDelay *delayEffect_;            // owned by effectChain_
+  AudioConvolutionReverb *reverb_;     // owned by effectChain_
+  AudioEffectChain *effectChain_;  // Owner of the effects
 };
 static EchoAudioEngine engine;
 
+// the room the reverb stage puts the recorded audio in
+static const uint32_t kReverbImpulseMs = 1000;
+static const uint32_t kReverbRt60Ms = 800;
+static const float kReverbWetLevel = 0.3f;
+// stack the callbacks may use without a page fault
+static const size_t kPrefaultStackBytes = 64 * 1024;
+// audio the capture rings hold while the writer thread is held up
+static const uint32_t kCaptureRingMs = 4000;
+// silence the effect chain skips: input under kGateCloseDb for kGateHoldMs
+// and the output for the effects' tails ( the echo delay ), and on until
+// the input is over kGateOpenDb again
+static const float kGateOpenDb = -54.0f;
+static const float kGateCloseDb = -60.0f;
+static const uint32_t kGateHoldMs = 250;
+
 bool EngineService(void *ctx, uint32_t msg, void *data);
 
+/*
+ * Append an effect to engine.effectChain_; one the chain rejects is
+ * deleted here. Returns whether the chain took it.
+ */
+static bool AddEffect(AudioEffect *effect, bool bypass = false) {
+  if (engine.effectChain_->addEffect(effect, bypass) >= 0) return true;
+  LOGE("effect chain is full, %s dropped", effect->name());
+  delete effect;
+  return false;
+}
+
 JNIEXPORT void JNICALL Java_com_google_sample_echo_MainActivity_createSLEngine(
     JNIEnv *env, jclass type, jint sampleRate, jint framesPerBuf,
     jlong delayInMs, jfloat decay) {
@@ -60,7 +102,19 @@ JNIEXPORT void JNICALL Java_com_google_sample_echo_MainActivity_createSLEngine(
   engine.fastPathSampleRate_ = static_cast<SLmilliHertz>(sampleRate) * 1000;
   engine.fastPathFramesPerBuf_ = static_cast<uint32_t>(framesPerBuf);
   engine.sampleChannels_ = AUDIO_SAMPLE_CHANNELS;
-  engine.bitsPerSample_ = SL_PCMSAMPLEFORMAT_FIXED_16;
+
+  // let OpenSL pick the container for the representation we want, and run
+  // the buffers and the effects in exactly that format
+  SampleFormat sampleFormat;
+  memset(&sampleFormat, 0, sizeof(sampleFormat));
+  sampleFormat.pcmFormat_ = AUDIO_SAMPLE_BITS;
+  sampleFormat.representation_ = AUDIO_SAMPLE_REPRESENTATION;
+  sampleFormat.channels_ = engine.sampleChannels_;
+  sampleFormat.sampleRate_ = engine.fastPathSampleRate_;
+  SLAndroidDataFormat_PCM_EX slFormat;
+  ConvertToSLSampleFormat(&slFormat, &sampleFormat);
+  engine.bitsPerSample_ = static_cast<uint16_t>(slFormat.containerSize);
+  engine.representation_ = slFormat.representation;
 
   result = slCreateEngine(&engine.slEngineObj_, 0, NULL, 0, NULL, NULL);
   SLASSERT(result);
@@ -83,23 +137,82 @@ JNIEXPORT void JNICALL Java_com_google_sample_echo_MainActivity_createSLEngine(
   uint32_t bufSize = engine.fastPathFramesPerBuf_ * engine.sampleChannels_ *
                      engine.bitsPerSample_;
   bufSize = (bufSize + 7) >> 3;  // bits --> byte
-  engine.bufCount_ = BUF_COUNT;
-  engine.bufs_ = allocateSampleBufs(engine.bufCount_, bufSize);
-  assert(engine.bufs_);
-
-  engine.freeBufQueue_ = new AudioQueue(engine.bufCount_);
-  engine.recBufQueue_ = new AudioQueue(engine.bufCount_);
+  engine.bufPool_ =
+      new SampleBufPool(BUF_COUNT, bufSize, SampleBufPool::kLockMemory);
+  assert(engine.bufPool_ && engine.bufPool_->getBufs());
+
+  engine.trace_ =
+      new AudioTrace(engine.fastPathSampleRate_, engine.fastPathFramesPerBuf_);
+
+  // the OpenSL ES callbacks set themselves up on their first call
+  engine.threadConfig_.priority_ = AudioThreadPriority::RealTime;
+  engine.threadConfig_.fifoPriority_ = kAudioFifoPriority;
+  engine.threadConfig_.cpuMask_ = GetFastCpuMask();
+  engine.threadConfig_.prefaultStackBytes_ = kPrefaultStackBytes;
+  if (!LockAudioMemory()) {
+    LOGI("only the sample buffers are locked in memory");
+  }
+  engine.probe_ = new AudioWakeupProbe();
+  engine.capture_ =
+      new AudioCapture(engine.fastPathSampleRate_, engine.sampleChannels_,
+                       engine.bitsPerSample_, bufSize, kCaptureRingMs);
+
+  uint32_t bufCount = engine.bufPool_->getBufCount();
+  engine.freeBufQueue_ = new AudioQueue(bufCount);
+  engine.recBufQueue_ = new AudioQueue(bufCount);
   assert(engine.freeBufQueue_ && engine.recBufQueue_);
-  for (uint32_t i = 0; i < engine.bufCount_; i++) {
-    engine.freeBufQueue_->push(&engine.bufs_[i]);
+  for (uint32_t i = 0; i < bufCount; i++) {
+    engine.freeBufQueue_->push(&engine.bufPool_->getBufs()[i]);
   }
 
   engine.echoDelay_ = delayInMs;
   engine.echoDecay_ = decay;
   engine.delayEffect_ = new AudioDelay(
       engine.fastPathSampleRate_, engine.sampleChannels_, engine.bitsPerSample_,
-      engine.echoDelay_, engine.echoDecay_);
+      engine.echoDelay_, engine.echoDecay_, ECHO_MAX_DELAY_IN_MS);
   assert(engine.delayEffect_);
+
+  // recorded audio goes through:
+  //   echo canceller -> noise gate -> rumble filter -> echo -> reverb ->
+  //   limiter
+  // only the echo is on by default, the others are added bypassed ( the
+  // reverb's worker thread only starts once it is enabled with setBypass() )
+  engine.echoCanceller_ = new AudioEchoCanceller(
+      engine.fastPathSampleRate_, engine.sampleChannels_, engine.bitsPerSample_,
+      AudioEchoCanceller::kDefaultTailMs);
+  engine.effectChain_ = new AudioEffectChain();
+  if (!AddEffect(engine.echoCanceller_, true)) {
+    engine.echoCanceller_ = nullptr;
+  }
+  AddEffect(
+      new AudioNoiseGate(engine.fastPathSampleRate_, engine.sampleChannels_,
+                         engine.bitsPerSample_, -50.0f, 6.0f, 100.0f, 1.0f,
+                         50.0f),
+      true);
+  AddEffect(
+      new AudioBiquad(engine.fastPathSampleRate_, engine.sampleChannels_,
+                      engine.bitsPerSample_, BiquadType::HighPass, 80.0f,
+                      0.707f, 0.0f),
+      true);
+  if (!AddEffect(engine.delayEffect_)) engine.delayEffect_ = nullptr;
+  std::vector<float> impulse(static_cast<uint64_t>(kReverbImpulseMs) *
+                             engine.fastPathSampleRate_ / 1000000);
+  AudioConvolutionReverb::SynthesizeRoom(impulse.data(), impulse.size(),
+                                         engine.fastPathSampleRate_,
+                                         kReverbRt60Ms);
+  engine.reverb_ = new AudioConvolutionReverb(
+      engine.fastPathSampleRate_, engine.sampleChannels_, engine.bitsPerSample_,
+      engine.fastPathFramesPerBuf_, impulse.data(), impulse.size(),
+      kReverbWetLevel);
+  if (!AddEffect(engine.reverb_, true)) engine.reverb_ = nullptr;
+  AddEffect(
+      new AudioCompressor(engine.fastPathSampleRate_, engine.sampleChannels_,
+                          engine.bitsPerSample_, -1.0f,
+                          AudioCompressor::kLimiterRatio, 0.5f, 50.0f, 0.0f),
+      true);
+  engine.effectChain_->setActivityGate(new AudioActivityGate(
+      engine.fastPathSampleRate_, engine.sampleChannels_, engine.bitsPerSample_,
+      kGateOpenDb, kGateCloseDb, kGateHoldMs));
 }
 
 JNIEXPORT jboolean JNICALL
@@ -109,8 +222,10 @@ Java_com_google_sample_echo_MainActivity_configureEcho(JNIEnv *env, jclass type,
   engine.echoDelay_ = delayInMs;
   engine.echoDecay_ = decay;
 
-  engine.delayEffect_->setDelayTime(delayInMs);
-  engine.delayEffect_->setDecayWeight(decay);
+  if (engine.delayEffect_) {
+    engine.delayEffect_->setDelayTime(delayInMs);
+    engine.delayEffect_->setDecayWeight(decay);
+  }
   return JNI_FALSE;
 }
 
@@ -121,8 +236,7 @@ Java_com_google_sample_echo_MainActivity_createSLBufferQueueAudioPlayer(
   memset(&sampleFormat, 0, sizeof(sampleFormat));
   sampleFormat.pcmFormat_ = (uint16_t)engine.bitsPerSample_;
   sampleFormat.framesPerBuf_ = engine.fastPathFramesPerBuf_;
-
-  // SampleFormat.representation_ = SL_ANDROID_PCM_REPRESENTATION_SIGNED_INT;
+  sampleFormat.representation_ = engine.representation_;
   sampleFormat.channels_ = (uint16_t)engine.sampleChannels_;
   sampleFormat.sampleRate_ = engine.fastPathSampleRate_;
 
@@ -131,6 +245,8 @@ Java_com_google_sample_echo_MainActivity_createSLBufferQueueAudioPlayer(
   if (engine.player_ == nullptr) return JNI_FALSE;
 
   engine.player_->SetBufQueue(engine.recBufQueue_, engine.freeBufQueue_);
+  engine.player_->SetTrace(engine.trace_);
+  engine.player_->SetThreadConfig(&engine.threadConfig_);
   engine.player_->RegisterCallback(EngineService, (void *)&engine);
 
   return JNI_TRUE;
@@ -151,8 +267,7 @@ Java_com_google_sample_echo_MainActivity_createAudioRecorder(JNIEnv *env,
   SampleFormat sampleFormat;
   memset(&sampleFormat, 0, sizeof(sampleFormat));
   sampleFormat.pcmFormat_ = static_cast<uint16_t>(engine.bitsPerSample_);
-
-  // SampleFormat.representation_ = SL_ANDROID_PCM_REPRESENTATION_SIGNED_INT;
+  sampleFormat.representation_ = engine.representation_;
   sampleFormat.channels_ = engine.sampleChannels_;
   sampleFormat.sampleRate_ = engine.fastPathSampleRate_;
   sampleFormat.framesPerBuf_ = engine.fastPathFramesPerBuf_;
@@ -161,6 +276,8 @@ Java_com_google_sample_echo_MainActivity_createAudioRecorder(JNIEnv *env,
     return JNI_FALSE;
   }
   engine.recorder_->SetBufQueues(engine.freeBufQueue_, engine.recBufQueue_);
+  engine.recorder_->SetTrace(engine.trace_);
+  engine.recorder_->SetThreadConfig(&engine.threadConfig_);
   engine.recorder_->RegisterCallback(EngineService, (void *)&engine);
   return JNI_TRUE;
 }
@@ -176,6 +293,10 @@ Java_com_google_sample_echo_MainActivity_deleteAudioRecorder(JNIEnv *env,
 JNIEXPORT void JNICALL
 Java_com_google_sample_echo_MainActivity_startPlay(JNIEnv *env, jclass type) {
   engine.frameCount_ = 0;
+  engine.effectChain_->resetStats();
+  if (engine.echoCanceller_) engine.echoCanceller_->resetStats();
+  if (engine.reverb_) engine.reverb_->resetStats();
+  engine.trace_->reset();
   /*
    * start player: make it into waitForData state
    */
@@ -190,6 +311,10 @@ JNIEXPORT void JNICALL
 Java_com_google_sample_echo_MainActivity_stopPlay(JNIEnv *env, jclass type) {
   engine.recorder_->Stop();
   engine.player_->Stop();
+  engine.effectChain_->dumpStats();
+  if (engine.echoCanceller_) engine.echoCanceller_->dumpStats();
+  if (engine.reverb_) engine.reverb_->dumpStats();
+  engine.trace_->dump();
 
   delete engine.recorder_;
   delete engine.player_;
@@ -197,39 +322,113 @@ Java_com_google_sample_echo_MainActivity_stopPlay(JNIEnv *env, jclass type) {
   engine.player_ = NULL;
 }
 
+/*
+ * Log the callback trace; safe to call while the echo is running, it never
+ * blocks the audio callbacks.
+ */
+JNIEXPORT void JNICALL
+Java_com_google_sample_echo_MainActivity_dumpAudioTrace(JNIEnv *env,
+                                                        jclass type) {
+  if (engine.trace_) {
+    engine.trace_->dump();
+  }
+}
+
+/*
+ * Measure how late a thread set up like the audio callbacks wakes up, once
+ * per buffer period, for seconds; the result is logged when done. Running
+ * it next to the echo shows what the callbacks compete with.
+ */
+JNIEXPORT jboolean JNICALL
+Java_com_google_sample_echo_MainActivity_startWakeupProbe(JNIEnv *env,
+                                                          jclass type,
+                                                          jint seconds) {
+  uint32_t periodUs = static_cast<uint32_t>(
+      1000000000ULL * engine.fastPathFramesPerBuf_ /
+      engine.fastPathSampleRate_);
+  return engine.probe_->start(engine.threadConfig_, periodUs,
+                              static_cast<uint32_t>(seconds))
+             ? JNI_TRUE
+             : JNI_FALSE;
+}
+
+/*
+ * Stream the recorded audio and the audio after the effects to WAV files
+ * in directory, fileSeconds per file, keeping the newest maxFiles of each;
+ * runs until stopAudioCapture(), across startPlay() / stopPlay().
+ */
+JNIEXPORT jboolean JNICALL
+Java_com_google_sample_echo_MainActivity_startAudioCapture(
+    JNIEnv *env, jclass type, jstring directory, jint fileSeconds,
+    jint maxFiles) {
+  const char *dir = env->GetStringUTFChars(directory, nullptr);
+  if (!dir) return JNI_FALSE;
+  bool started = engine.capture_->start(dir,
+                                        static_cast<uint32_t>(fileSeconds),
+                                        static_cast<uint32_t>(maxFiles));
+  env->ReleaseStringUTFChars(directory, dir);
+  return started ? JNI_TRUE : JNI_FALSE;
+}
+
+JNIEXPORT void JNICALL
+Java_com_google_sample_echo_MainActivity_stopAudioCapture(JNIEnv *env,
+                                                          jclass type) {
+  engine.capture_->stop();
+}
+
 JNIEXPORT void JNICALL Java_com_google_sample_echo_MainActivity_deleteSLEngine(
     JNIEnv *env, jclass type) {
   delete engine.recBufQueue_;
   delete engine.freeBufQueue_;
-  releaseSampleBufs(engine.bufs_, engine.bufCount_);
+  delete engine.bufPool_;
+  engine.bufPool_ = nullptr;
+  delete engine.trace_;
+  engine.trace_ = nullptr;
+  delete engine.probe_;
+  engine.probe_ = nullptr;
+  delete engine.capture_;
+  engine.capture_ = nullptr;
   if (engine.slEngineObj_ != NULL) {
     (*engine.slEngineObj_)->Destroy(engine.slEngineObj_);
     engine.slEngineObj_ = NULL;
     engine.slEngineItf_ = NULL;
   }
 
-  if (engine.delayEffect_) {
-    delete engine.delayEffect_;
+  if (engine.effectChain_) {
+    delete engine.effectChain_;
+    engine.effectChain_ = nullptr;
+    engine.echoCanceller_ = nullptr;
     engine.delayEffect_ = nullptr;
+    engine.reverb_ = nullptr;
   }
 }
 
+/*
+ * Count the buffers in every queue, and let the pool point out the ones
+ * that are not where it handed them to.
+ */
 uint32_t dbgEngineGetBufCount(void) {
-  uint32_t count = engine.player_->dbgGetDevBufCount();
-  count += engine.recorder_->dbgGetDevBufCount();
-  count += engine.freeBufQueue_->size();
-  count += engine.recBufQueue_->size();
-
+  uint32_t found[BUF_OWNER_COUNT];
+  found[static_cast<uint32_t>(BufOwner::Free)] = engine.freeBufQueue_->size();
+  found[static_cast<uint32_t>(BufOwner::RecordDevice)] =
+      engine.recorder_->dbgGetDevBufCount();
+  found[static_cast<uint32_t>(BufOwner::Recorded)] =
+      engine.recBufQueue_->size();
+  found[static_cast<uint32_t>(BufOwner::PlayDevice)] =
+      engine.player_->dbgGetDevBufCount();
+
+  uint32_t count = 0;
+  for (uint32_t idx = 0; idx < BUF_OWNER_COUNT; idx++) {
+    count += found[idx];
+  }
   LOGE(
       "Buf Disrtibutions: PlayerDev=%d, RecDev=%d, FreeQ=%d, "
       "RecQ=%d",
-      engine.player_->dbgGetDevBufCount(),
-      engine.recorder_->dbgGetDevBufCount(), engine.freeBufQueue_->size(),
-      engine.recBufQueue_->size());
-  if (count != engine.bufCount_) {
-    LOGE("====Lost Bufs among the queue(supposed = %d, found = %d)", BUF_COUNT,
-         count);
-  }
+      found[static_cast<uint32_t>(BufOwner::PlayDevice)],
+      found[static_cast<uint32_t>(BufOwner::RecordDevice)],
+      found[static_cast<uint32_t>(BufOwner::Free)],
+      found[static_cast<uint32_t>(BufOwner::Recorded)]);
+  engine.bufPool_->dbgCheckOwners(found);
   return count;
 }
 
@@ -244,12 +443,22 @@ bool EngineService(void *ctx, uint32_t msg, void *data) {
       break;
     }
     case ENGINE_SERVICE_MSG_RECORDED_AUDIO_AVAILABLE: {
-      // adding audio delay effect
+      // run the effect chain, in place, on the recorded audio
       sample_buf *buf = static_cast<sample_buf *>(data);
       assert(engine.fastPathFramesPerBuf_ ==
              buf->size_ / engine.sampleChannels_ / (engine.bitsPerSample_ / 8));
-      engine.delayEffect_->process(reinterpret_cast<int16_t *>(buf->buf_),
-                                   engine.fastPathFramesPerBuf_);
+      engine.capture_->tap(CaptureTap::PreEffect, buf->buf_, buf->size_);
+      engine.effectChain_->process(buf->buf_, engine.fastPathFramesPerBuf_);
+      engine.capture_->tap(CaptureTap::PostEffect, buf->buf_, buf->size_);
+      break;
+    }
+    case ENGINE_SERVICE_MSG_PLAY_AUDIO_QUEUED: {
+      // what goes to the speaker is what the echo canceller removes
+      sample_buf *buf = static_cast<sample_buf *>(data);
+      if (!engine.echoCanceller_) break;
+      engine.echoCanceller_->pushReference(
+          buf->buf_,
+          buf->size_ / engine.sampleChannels_ / (engine.bitsPerSample_ / 8));
       break;
     }
     default:
@@ -17,6 +17,11 @@
 
 #include <cstdlib>
 
+#include "buf_pool.h"
+
+// silent buffers queued to the device while the jitter buffer fills up
+static const uint32_t kSilentBufCount = 2;
+
 /*
  * Called by OpenSL SimpleBufferQueue for every audio buffer played
  * directly pass thru to our handler.
@@ -32,6 +37,14 @@ void bqPlayerCallback(SLAndroidSimpleBufferQueueItf bq, void *ctx) {
   (static_cast<AudioPlayer *>(ctx))->ProcessSLCallback(bq);
 }
 void AudioPlayer::ProcessSLCallback(SLAndroidSimpleBufferQueueItf bq) {
+  if (threadConfig_) {
+    PrepareAudioThread(*threadConfig_);
+  }
+  uint64_t now = GetMonotonicNs();
+  if (trace_) {
+    trace_->traceCallback(TraceSource::Player, now, devShadowQueue_->size(),
+                          playQueue_->size(), freeQueue_->size());
+  }
 #ifdef ENABLE_LOG
   logFile_->logTime();
 #endif
@@ -56,42 +69,72 @@ void AudioPlayer::ProcessSLCallback(SLAndroidSimpleBufferQueueItf bq) {
 
   if (buf != &silentBuf_) {
     buf->size_ = 0;
+    SetBufOwner(buf, BufOwner::Free);
     freeQueue_->push(buf);
+  } else {
+    silentBufCount_.fetch_sub(1, std::memory_order_relaxed);
+  }
 
-    if (!playQueue_->front(&buf)) {
+  uint32_t devSlack = devShadowQueue_->size();
+  if (!jitterBuf_.isBuffering()) {
+    if (!devSlack && !playQueue_->size()) {
 #ifdef ENABLE_LOG
       logFile_->log("%s", "====Warning: running out of the Audio buffers");
 #endif
-      return;
+      jitterBuf_.onUnderrun();
+    } else {
+      jitterBuf_.checkStarved(now);
     }
-
-    devShadowQueue_->push(buf);
-    (*bq)->Enqueue(bq, buf->buf_, buf->size_);
-    playQueue_->pop();
-    return;
   }
-
-  if (playQueue_->size() < PLAY_KICKSTART_BUFFER_COUNT) {
-    (*bq)->Enqueue(bq, buf->buf_, buf->size_);
-    devShadowQueue_->push(&silentBuf_);
-    return;
+  if (jitterBuf_.isBuffering()) {
+    if (playQueue_->size() < jitterBuf_.getTargetDepth()) {
+      // keep the device clock running on silence until there is enough
+      while (devShadowQueue_->size() < kSilentBufCount) {
+        EnqueueSilence(bq);
+      }
+      return;
+    }
+    jitterBuf_.startPlaying();
   }
 
-  assert(PLAY_KICKSTART_BUFFER_COUNT <=
-         (DEVICE_SHADOW_BUFFER_QUEUE_LEN - devShadowQueue_->size()));
-  for (int32_t idx = 0; idx < PLAY_KICKSTART_BUFFER_COUNT; idx++) {
-    playQueue_->front(&buf);
+  while (devShadowQueue_->size() < jitterBuf_.getTargetDepth() &&
+         playQueue_->front(&buf)) {
     playQueue_->pop();
+    jitterBuf_.trim(buf);
+    jitterBuf_.onBufferQueued(buf->timeNs_, now);
+    if (trace_) {
+      trace_->traceLatency(buf->timeNs_, now, devShadowQueue_->size());
+    }
+    if (callback_) {
+      callback_(ctx_, ENGINE_SERVICE_MSG_PLAY_AUDIO_QUEUED, buf);
+    }
+    SetBufOwner(buf, BufOwner::PlayDevice);
     devShadowQueue_->push(buf);
     (*bq)->Enqueue(bq, buf->buf_, buf->size_);
   }
+  jitterBuf_.update(devSlack, playQueue_->size(), devShadowQueue_->size(),
+                    now);
+}
+
+void AudioPlayer::EnqueueSilence(SLAndroidSimpleBufferQueueItf bq) {
+  silentBufCount_.fetch_add(1, std::memory_order_relaxed);
+  if (callback_) {
+    callback_(ctx_, ENGINE_SERVICE_MSG_PLAY_AUDIO_QUEUED, &silentBuf_);
+  }
+  devShadowQueue_->push(&silentBuf_);
+  (*bq)->Enqueue(bq, silentBuf_.buf_, silentBuf_.size_);
 }
 
 AudioPlayer::AudioPlayer(SampleFormat *sampleFormat, SLEngineItf slEngine)
     : freeQueue_(nullptr),
       playQueue_(nullptr),
       devShadowQueue_(nullptr),
-      callback_(nullptr) {
+      callback_(nullptr),
+      trace_(nullptr),
+      threadConfig_(nullptr),
+      jitterBuf_(*sampleFormat, PLAY_KICKSTART_BUFFER_COUNT,
+                 DEVICE_SHADOW_BUFFER_QUEUE_LEN),
+      silentBufCount_(0) {
   SLresult result;
   assert(sampleFormat);
   sampleInfo_ = *sampleFormat;
@@ -181,6 +224,7 @@ AudioPlayer::~AudioPlayer() {
     buf->size_ = 0;
     devShadowQueue_->pop();
     if (buf != &silentBuf_) {
+      SetBufOwner(buf, BufOwner::Free);
       freeQueue_->push(buf);
     }
   }
@@ -189,6 +233,7 @@ AudioPlayer::~AudioPlayer() {
   while (playQueue_->front(&buf)) {
     buf->size_ = 0;
     playQueue_->pop();
+    SetBufOwner(buf, BufOwner::Free);
     freeQueue_->push(buf);
   }
 
@@ -218,11 +263,10 @@ SLresult AudioPlayer::Start(void) {
   result = (*playItf_)->SetPlayState(playItf_, SL_PLAYSTATE_STOPPED);
   SLASSERT(result);
 
-  result =
-      (*playBufferQueueItf_)
-          ->Enqueue(playBufferQueueItf_, silentBuf_.buf_, silentBuf_.size_);
-  SLASSERT(result);
-  devShadowQueue_->push(&silentBuf_);
+  jitterBuf_.reset();
+  for (uint32_t idx = 0; idx < kSilentBufCount; idx++) {
+    EnqueueSilence(playBufferQueueItf_);
+  }
 
   result = (*playItf_)->SetPlayState(playItf_, SL_PLAYSTATE_PLAYING);
   SLASSERT(result);
@@ -242,6 +286,7 @@ void AudioPlayer::Stop(void) {
   result = (*playItf_)->SetPlayState(playItf_, SL_PLAYSTATE_STOPPED);
   SLASSERT(result);
   (*playBufferQueueItf_)->Clear(playBufferQueueItf_);
+  jitterBuf_.dumpStats();
 
 #ifdef ENABLE_LOG
   if (logFile_) {
@@ -251,11 +296,26 @@ void AudioPlayer::Stop(void) {
 #endif
 }
 
+void AudioPlayer::SetTrace(AudioTrace *trace) { trace_ = trace; }
+
+void AudioPlayer::SetThreadConfig(const AudioThreadConfig *config) {
+  threadConfig_ = config;
+}
+
+void AudioPlayer::GetJitterStats(AudioJitterStats *stats) {
+  std::lock_guard<std::mutex> lock(stopMutex_);
+  jitterBuf_.getStats(stats);
+}
+
 void AudioPlayer::RegisterCallback(ENGINE_CALLBACK cb, void *ctx) {
   callback_ = cb;
   ctx_ = ctx;
 }
 
+/*
+ * engine buffers held by the device, not counting the silent buffer
+ */
 uint32_t AudioPlayer::dbgGetDevBufCount(void) {
-  return (devShadowQueue_->size());
+  return (devShadowQueue_->size() -
+          silentBufCount_.load(std::memory_order_relaxed));
 }
\ No newline at end of file
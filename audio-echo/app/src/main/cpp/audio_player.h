@@ -18,7 +18,13 @@
 #define NATIVE_AUDIO_AUDIO_PLAYER_H
 #include <sys/types.h>
 
+#include <atomic>
+#include <mutex>
+
 #include "audio_common.h"
+#include "audio_jitter_buffer.h"
+#include "audio_thread.h"
+#include "audio_trace.h"
 #include "buf_manager.h"
 #include "debug_utils.h"
 
@@ -36,16 +42,25 @@ class AudioPlayer {
 
   ENGINE_CALLBACK callback_;
   void *ctx_;
+  AudioTrace *trace_;                       // user
+  const AudioThreadConfig *threadConfig_;  // user
+  AudioJitterBuffer jitterBuf_;
   sample_buf silentBuf_;
+  std::atomic<uint32_t> silentBufCount_;  // silentBuf_ in devShadowQueue_
 #ifdef ENABLE_LOG
   AndroidLog *logFile_;
 #endif
   std::mutex stopMutex_;
 
+  void EnqueueSilence(SLAndroidSimpleBufferQueueItf bq);
+
  public:
   explicit AudioPlayer(SampleFormat *sampleFormat, SLEngineItf engine);
   ~AudioPlayer();
   void SetBufQueue(AudioQueue *playQ, AudioQueue *freeQ);
+  void SetTrace(AudioTrace *trace);
+  void SetThreadConfig(const AudioThreadConfig *config);
+  void GetJitterStats(AudioJitterStats *stats);
   SLresult Start(void);
   void Stop(void);
   void ProcessSLCallback(SLAndroidSimpleBufferQueueItf bq);
@@ -18,6 +18,8 @@
 
 #include <cstdlib>
 #include <cstring>
+
+#include "buf_pool.h"
 /*
  * bqRecorderCallback(): called for every buffer is full;
  *                       pass directly to handler
@@ -27,22 +29,38 @@ void bqRecorderCallback(SLAndroidSimpleBufferQueueItf bq, void *rec) {
 }
 
 void AudioRecorder::ProcessSLCallback(SLAndroidSimpleBufferQueueItf bq) {
+  if (threadConfig_) {
+    PrepareAudioThread(*threadConfig_);
+  }
 #ifdef ENABLE_LOG
   recLog_->logTime();
 #endif
   assert(bq == recBufQueueItf_);
+  // the player's jitter buffer and latency trace both read it
+  uint64_t now = GetMonotonicNs();
+  if (trace_) {
+    trace_->traceCallback(TraceSource::Recorder, now, devShadowQueue_->size(),
+                          recQueue_->size(), freeQueue_->size());
+  }
   sample_buf *dataBuf = NULL;
   devShadowQueue_->front(&dataBuf);
   devShadowQueue_->pop();
   dataBuf->size_ = dataBuf->cap_;  // device only calls us when it is really
                                    // full
+  dataBuf->timeNs_ = now;
 
   callback_(ctx_, ENGINE_SERVICE_MSG_RECORDED_AUDIO_AVAILABLE, dataBuf);
+  SetBufOwner(dataBuf, BufOwner::Recorded);
   recQueue_->push(dataBuf);
 
+  // the SL queue holds DEVICE_SHADOW_BUFFER_QUEUE_LEN buffers; the shadow
+  // queue's capacity() may be rounded up past that
   sample_buf *freeBuf;
-  while (freeQueue_->front(&freeBuf) && devShadowQueue_->push(freeBuf)) {
+  while (devShadowQueue_->size() < DEVICE_SHADOW_BUFFER_QUEUE_LEN &&
+         freeQueue_->front(&freeBuf)) {
     freeQueue_->pop();
+    SetBufOwner(freeBuf, BufOwner::RecordDevice);
+    devShadowQueue_->push(freeBuf);
     SLresult result = (*bq)->Enqueue(bq, freeBuf->buf_, freeBuf->cap_);
     SLASSERT(result);
   }
@@ -59,7 +77,9 @@ AudioRecorder::AudioRecorder(SampleFormat *sampleFormat, SLEngineItf slEngine)
     : freeQueue_(nullptr),
       recQueue_(nullptr),
       devShadowQueue_(nullptr),
-      callback_(nullptr) {
+      callback_(nullptr),
+      trace_(nullptr),
+      threadConfig_(nullptr) {
   SLresult result;
   sampleInfo_ = *sampleFormat;
   SLAndroidDataFormat_PCM_EX format_pcm;
@@ -145,6 +165,7 @@ SLboolean AudioRecorder::Start(void) {
     }
     freeQueue_->pop();
     assert(buf->buf_ && buf->cap_ && !buf->size_);
+    SetBufOwner(buf, BufOwner::RecordDevice);
 
     result = (*recBufQueueItf_)->Enqueue(recBufQueueItf_, buf->buf_, buf->cap_);
     SLASSERT(result);
@@ -188,6 +209,7 @@ AudioRecorder::~AudioRecorder() {
     sample_buf *buf = NULL;
     while (devShadowQueue_->front(&buf)) {
       devShadowQueue_->pop();
+      SetBufOwner(buf, BufOwner::Free);
       freeQueue_->push(buf);
     }
     delete (devShadowQueue_);
@@ -205,6 +227,12 @@ void AudioRecorder::SetBufQueues(AudioQueue *freeQ, AudioQueue *recQ) {
   recQueue_ = recQ;
 }
 
+void AudioRecorder::SetTrace(AudioTrace *trace) { trace_ = trace; }
+
+void AudioRecorder::SetThreadConfig(const AudioThreadConfig *config) {
+  threadConfig_ = config;
+}
+
 void AudioRecorder::RegisterCallback(ENGINE_CALLBACK cb, void *ctx) {
   callback_ = cb;
   ctx_ = ctx;
@@ -21,6 +21,8 @@
 #include <sys/types.h>
 
 #include "audio_common.h"
+#include "audio_thread.h"
+#include "audio_trace.h"
 #include "buf_manager.h"
 #include "debug_utils.h"
 
@@ -37,6 +39,8 @@ class AudioRecorder {
 
   ENGINE_CALLBACK callback_;
   void *ctx_;
+  AudioTrace *trace_;                       // user
+  const AudioThreadConfig *threadConfig_;  // user
 
  public:
   explicit AudioRecorder(SampleFormat *, SLEngineItf engineEngine);
@@ -44,6 +48,8 @@ class AudioRecorder {
   SLboolean Start(void);
   SLboolean Stop(void);
   void SetBufQueues(AudioQueue *freeQ, AudioQueue *recQ);
+  void SetTrace(AudioTrace *trace);
+  void SetThreadConfig(const AudioThreadConfig *config);
   void ProcessSLCallback(SLAndroidSimpleBufferQueueItf bq);
   void RegisterCallback(ENGINE_CALLBACK cb, void *ctx);
   int32_t dbgGetDevBufCount(void);
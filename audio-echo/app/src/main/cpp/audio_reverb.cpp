@@ -0,0 +1,336 @@
+/*
+ * Copyright 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "audio_reverb.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cerrno>
+#include <cmath>
+#include <cstring>
+
+#include "audio_common.h"
+#include "audio_format_convert.h"
+#include "audio_thread.h"
+
+// audio spectra kept past the last partition, so a worker a little late
+// does not read a spectrum process() is overwriting
+static const uint32_t kRingSlack = 2;
+
+// overlap-save needs an FFT of at least twice the block
+static uint32_t FftSizeFor(uint32_t blockFrames) {
+  uint32_t size = 4;
+  while (size < 2 * blockFrames) size <<= 1;
+  return size;
+}
+
+// only process() writes the counters, see AudioEffectChain::process()
+static inline void Bump(std::atomic<uint32_t> &counter) {
+  counter.store(counter.load(std::memory_order_relaxed) + 1,
+                std::memory_order_relaxed);
+}
+
+AudioConvolutionReverb::AudioConvolutionReverb(
+    int32_t sampleRate, int32_t channelCount, SLuint32 format,
+    uint32_t blockFrames, const float *impulse, uint32_t impulseFrames,
+    float wetLevel, bool useWorker)
+    : AudioEffect(sampleRate, channelCount, format),
+      blockFrames_(std::max(blockFrames, 1u)),
+      fftSize_(FftSizeFor(blockFrames_)),
+      binCount_(0),
+      binStride_(0),
+      partitions_(0),
+      ringSize_(0),
+      tailSlots_(kHeadPartitions + 1),
+      kernels_(GetSpectrumKernels()),
+      fft_(fftSize_),
+      useWorker_(useWorker) {
+  assert(impulse && impulseFrames);
+  binCount_ = fft_.getBinCount();
+  binStride_ = (binCount_ + 7) & ~7u;
+  partitions_ = (impulseFrames + blockFrames_ - 1) / blockFrames_;
+  ringSize_ = partitions_ + kRingSlack;
+  useWorker_ = useWorker && partitions_ > kHeadPartitions;
+  setWetLevel(wetLevel);
+
+  uint32_t channels = static_cast<uint32_t>(std::max(channelCount_, 1));
+  inFifo_.reset(new float[blockFrames_ * channels]());
+  outFifo_.reset(new float[blockFrames_ * channels]());
+  xTime_.reset(new float[fftSize_]());
+  work_.reset(new float[fftSize_]());
+
+  uint32_t spectra = 2 * (partitions_ + ringSize_ + tailSlots_ + 1);
+  spectra_.reset(new float[static_cast<size_t>(spectra) * binStride_]());
+  float *spectrum = spectra_.get();
+  auto take = [&](uint32_t count) {
+    float *first = spectrum;
+    spectrum += static_cast<size_t>(count) * binStride_;
+    return first;
+  };
+  hRe_ = take(partitions_);
+  hIm_ = take(partitions_);
+  xRe_ = take(ringSize_);
+  xIm_ = take(ringSize_);
+  tRe_ = take(tailSlots_);
+  tIm_ = take(tailSlots_);
+  yRe_ = take(1);
+  yIm_ = take(1);
+
+  // partition p: impulse[p * blockFrames_, ( p + 1 ) * blockFrames_),
+  // zero padded to the FFT size
+  for (uint32_t p = 0; p < partitions_; p++) {
+    uint32_t first = p * blockFrames_;
+    uint32_t count = std::min(blockFrames_, impulseFrames - first);
+    memset(work_.get(), 0, fftSize_ * sizeof(float));
+    memcpy(work_.get(), impulse + first, count * sizeof(float));
+    fft_.forward(work_.get(), hRe_ + p * binStride_, hIm_ + p * binStride_);
+  }
+  memset(work_.get(), 0, fftSize_ * sizeof(float));
+
+  tailBlock_.reset(new std::atomic<uint64_t>[tailSlots_]);
+  for (uint32_t slot = 0; slot < tailSlots_; slot++) {
+    tailBlock_[slot].store(UINT64_MAX, std::memory_order_relaxed);
+  }
+  sem_init(&wake_, 0, 0);
+
+  LOGI("Reverb: %d frames of impulse, %d partitions of %d frames, "
+       "FFT %d, %s, %s kernels",
+       impulseFrames, partitions_, blockFrames_, fftSize_,
+       useWorker_ ? "tail on a worker" : "no worker", kernels_.name_);
+}
+
+AudioConvolutionReverb::~AudioConvolutionReverb() {
+  setActive(false);
+  sem_destroy(&wake_);
+}
+
+/*
+ * Start the tail worker, or stop it. Until it is started process() sums
+ * every tail itself.
+ */
+void AudioConvolutionReverb::setActive(bool active) {
+  if (!useWorker_ || active == worker_.joinable()) return;
+  if (active) {
+    quit_.store(false, std::memory_order_relaxed);
+    worker_ = std::thread(&AudioConvolutionReverb::runWorker, this);
+  } else {
+    quit_.store(true, std::memory_order_release);
+    sem_post(&wake_);
+    worker_.join();
+  }
+}
+
+void AudioConvolutionReverb::setWetLevel(float wetLevel) {
+  wetLevel_.store(std::min(std::max(wetLevel, 0.0f), 1.0f),
+                  std::memory_order_relaxed);
+}
+
+void AudioConvolutionReverb::process(void *liveAudio, int32_t numFrames) {
+  uint8_t *audio = static_cast<uint8_t *>(liveAudio);
+  switch (encoding_) {
+    case SampleEncoding::Int16:
+      processSamples<Int16Sample>(audio, numFrames);
+      break;
+    case SampleEncoding::Int24Packed:
+      processSamples<Int24Sample>(audio, numFrames);
+      break;
+    case SampleEncoding::Float32:
+      processSamples<Float32Sample>(audio, numFrames);
+      break;
+  }
+}
+
+/*
+ * Swap the recorded frames with the ones of the previous block, reverb
+ * added, running the convolution every time a block is complete.
+ */
+template <typename Sample>
+void AudioConvolutionReverb::processSamples(uint8_t *liveAudio,
+                                            int32_t numFrames) {
+  int32_t frame = 0;
+  while (frame < numFrames) {
+    uint32_t count = std::min(static_cast<uint32_t>(numFrames - frame),
+                              blockFrames_ - fifoPos_);
+    int32_t first = frame * channelCount_;
+    int32_t fifoFirst = fifoPos_ * channelCount_;
+    uint8_t *audio = liveAudio + first * Sample::kBytes;
+    int32_t samples = static_cast<int32_t>(count) * channelCount_;
+    ConvertSamples(audio, Sample::kEncoding, &inFifo_[fifoFirst],
+                   SampleEncoding::Float32, samples, nullptr);
+    ConvertSamples(&outFifo_[fifoFirst], SampleEncoding::Float32, audio,
+                   Sample::kEncoding, samples,
+                   outChanged_ ? &dither_ : nullptr);
+    frame += count;
+    fifoPos_ += count;
+    if (fifoPos_ == blockFrames_) {
+      processBlock();
+      fifoPos_ = 0;
+    }
+  }
+}
+
+/*
+ * One block: inFifo_ -> outFifo_. Block m is
+ *   y = sum over p of H[p] * X[m - p]
+ * with X[m] the spectrum of the last fftSize_ samples; the last
+ * blockFrames_ samples of its inverse are the new reverb ( overlap-save ).
+ */
+void AudioConvolutionReverb::processBlock(void) {
+  float *x = xTime_.get();
+  float *fresh = x + fftSize_ - blockFrames_;
+  memmove(x, x + blockFrames_, (fftSize_ - blockFrames_) * sizeof(float));
+  float gain = 1.0f / channelCount_;
+  for (uint32_t n = 0; n < blockFrames_; n++) {
+    float sum = 0.0f;
+    for (int32_t ch = 0; ch < channelCount_; ch++) {
+      sum += inFifo_[n * channelCount_ + ch];
+    }
+    fresh[n] = sum * gain;
+  }
+  uint32_t slot = static_cast<uint32_t>(block_ % ringSize_);
+  fft_.forward(x, xRe_ + slot * binStride_, xIm_ + slot * binStride_);
+  written_.store(block_ + 1, std::memory_order_release);
+
+  memset(yRe_, 0, binStride_ * sizeof(float));
+  memset(yIm_, 0, binStride_ * sizeof(float));
+  uint32_t head = std::min(kHeadPartitions, partitions_);
+  for (uint32_t p = 0; p < head && p <= block_; p++) {
+    uint32_t src = static_cast<uint32_t>((block_ - p) % ringSize_);
+    kernels_.mac_(yRe_, yIm_, hRe_ + p * binStride_, hIm_ + p * binStride_,
+                  xRe_ + src * binStride_, xIm_ + src * binStride_,
+                  binCount_);
+  }
+  if (partitions_ > kHeadPartitions && block_ >= kHeadPartitions) {
+    uint32_t tail = static_cast<uint32_t>(block_ % tailSlots_);
+    if (!useWorker_) {
+      sumTail(block_, yRe_, yIm_, false);
+    } else if (tailBlock_[tail].load(std::memory_order_acquire) == block_) {
+      const float *re = tRe_ + tail * binStride_;
+      const float *im = tIm_ + tail * binStride_;
+      for (uint32_t k = 0; k < binCount_; k++) {
+        yRe_[k] += re[k];
+        yIm_[k] += im[k];
+      }
+    } else {
+      // written_ is past block_: the worker gives up on it, and the
+      // spectra it needs are only overwritten from the next block on
+      sumTail(block_, yRe_, yIm_, false);
+      Bump(lateTails_);
+    }
+  }
+  if (useWorker_) {
+    // everything the tail of block_ + kHeadPartitions needs is in the ring
+    requested_.store(block_ + kHeadPartitions, std::memory_order_release);
+    sem_post(&wake_);
+  }
+
+  fft_.inverse(yRe_, yIm_, work_.get());
+  const float *wet = work_.get() + fftSize_ - blockFrames_;
+  float wetLevel = wetLevel_.load(std::memory_order_relaxed);
+  float dryLevel = 1.0f - wetLevel;
+  outChanged_ = wetLevel != 0.0f;
+  for (uint32_t n = 0; n < blockFrames_; n++) {
+    float reverb = wet[n] * wetLevel;
+    for (int32_t ch = 0; ch < channelCount_; ch++) {
+      uint32_t idx = n * channelCount_ + ch;
+      outFifo_[idx] = inFifo_[idx] * dryLevel + reverb;
+    }
+  }
+  block_++;
+  Bump(blocks_);
+}
+
+/*
+ * Add the tail partitions of block to re / im. On the worker it gives up
+ * as soon as process() has moved on to that block: process() sums it
+ * itself then, and the oldest spectra are about to be overwritten.
+ * @return false when it gave up
+ */
+bool AudioConvolutionReverb::sumTail(uint64_t block, float *re, float *im,
+                                     bool onWorker) {
+  for (uint32_t p = kHeadPartitions; p < partitions_ && p <= block; p++) {
+    if (onWorker && written_.load(std::memory_order_acquire) > block) {
+      return false;
+    }
+    uint32_t src = static_cast<uint32_t>((block - p) % ringSize_);
+    kernels_.mac_(re, im, hRe_ + p * binStride_, hIm_ + p * binStride_,
+                  xRe_ + src * binStride_, xIm_ + src * binStride_,
+                  binCount_);
+  }
+  return true;
+}
+
+/*
+ * Worker thread: sums the tails process() asked for, oldest first,
+ * skipping the ones whose block is already gone.
+ */
+void AudioConvolutionReverb::runWorker(void) {
+  SetAudioThreadPriority(AudioThreadPriority::Background, 0);
+  uint64_t next = kHeadPartitions;
+  while (true) {
+    if (sem_wait(&wake_) && errno == EINTR) continue;
+    if (quit_.load(std::memory_order_acquire)) break;
+    uint64_t newest = requested_.load(std::memory_order_acquire);
+    next = std::max(next, written_.load(std::memory_order_acquire));
+    for (; next <= newest; next++) {
+      uint32_t slot = static_cast<uint32_t>(next % tailSlots_);
+      float *re = tRe_ + slot * binStride_;
+      float *im = tIm_ + slot * binStride_;
+      memset(re, 0, binStride_ * sizeof(float));
+      memset(im, 0, binStride_ * sizeof(float));
+      if (sumTail(next, re, im, true)) {
+        tailBlock_[slot].store(next, std::memory_order_release);
+      }
+    }
+  }
+}
+
+void AudioConvolutionReverb::getStats(AudioReverbStats *stats) const {
+  stats->blocks_ = blocks_.load(std::memory_order_relaxed);
+  stats->lateTails_ = lateTails_.load(std::memory_order_relaxed);
+}
+
+void AudioConvolutionReverb::resetStats(void) {
+  blocks_.store(0, std::memory_order_relaxed);
+  lateTails_.store(0, std::memory_order_relaxed);
+}
+
+void AudioConvolutionReverb::dumpStats(void) const {
+  AudioReverbStats stats;
+  getStats(&stats);
+  LOGI("Reverb: blocks=%d, late tails=%d", stats.blocks_, stats.lateTails_);
+}
+
+void AudioConvolutionReverb::SynthesizeRoom(float *impulse,
+                                            uint32_t impulseFrames,
+                                            int32_t sampleRate,
+                                            uint32_t rt60Ms) {
+  // sampleRate is in milli Hz: -60 dB ( ln 1000 ) after rt60Ms
+  double rt60Frames = static_cast<double>(rt60Ms) * sampleRate / 1000000;
+  double decay = exp(-log(1000.0) / std::max(rt60Frames, 1.0));
+  double envelope = 1.0, energy = 0.0;
+  uint32_t seed = 1;
+  for (uint32_t n = 0; n < impulseFrames; n++) {
+    seed = seed * 1664525u + 1013904223u;
+    float noise = static_cast<int32_t>(seed) * (1.0f / 2147483648.0f);
+    impulse[n] = static_cast<float>(noise * envelope);
+    energy += impulse[n] * impulse[n];
+    envelope *= decay;
+  }
+  float scale = energy > 0.0 ? static_cast<float>(1.0 / sqrt(energy)) : 0.0f;
+  for (uint32_t n = 0; n < impulseFrames; n++) {
+    impulse[n] *= scale;
+  }
+}
@@ -0,0 +1,139 @@
+/*
+ * Copyright 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef NATIVE_AUDIO_AUDIO_REVERB_H
+#define NATIVE_AUDIO_AUDIO_REVERB_H
+
+#include <semaphore.h>
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <thread>
+
+#include "audio_effect.h"
+#include "audio_effect_simd.h"
+#include "audio_fft.h"
+
+/*
+ * What the reverb did since the last resetStats()
+ */
+struct AudioReverbStats {
+  uint32_t blocks_;
+  uint32_t lateTails_;  // the worker missed a block, process() summed its
+                        // tail itself
+};
+
+/**
+ * Convolution reverb: uniformly partitioned overlap-save convolution with
+ * an impulse response of any length.
+ *   - the impulse response is cut into blockFrames long partitions, each
+ *     block of audio costs one real FFT, one inverse FFT and a complex
+ *     multiply-accumulate per partition ( SIMD kernels of
+ *     audio_effect_simd.h )
+ *   - process() only runs the first kHeadPartitions; the tail partitions
+ *     of a block only need audio from kHeadPartitions blocks before, so a
+ *     low priority worker thread sums them in advance and has that many
+ *     buffer periods to do it. process() never waits for it: a tail that
+ *     is not ready in time is summed by process() itself ( lateTails_ ),
+ *     the worker giving up on it
+ *   - the worker only runs while the effect is active ( setActive() ), a
+ *     bypassed reverb costs memory but no thread
+ *   - the output is blockFrames late ( getLatencyFrames() ): one buffer,
+ *     when blockFrames is the buffer size the device asked for
+ * The recorded channels are mixed down to mono and the reverb is added to
+ * every channel, wetLevel times the reverb over ( 1 - wetLevel ) times
+ * the dry audio.
+ */
+class AudioConvolutionReverb : public AudioEffect {
+ public:
+  static constexpr uint32_t kHeadPartitions = 2;
+
+  explicit AudioConvolutionReverb(int32_t sampleRate, int32_t channelCount,
+                                  SLuint32 format, uint32_t blockFrames,
+                                  const float *impulse, uint32_t impulseFrames,
+                                  float wetLevel, bool useWorker = true);
+  ~AudioConvolutionReverb();
+  void setWetLevel(float wetLevel);
+  void process(void *liveAudio, int32_t numFrames) override;
+  void setActive(bool active) override;
+  const char *name(void) const override { return "reverb"; }
+  uint32_t getLatencyFrames(void) const { return blockFrames_; }
+  uint32_t getPartitionCount(void) const { return partitions_; }
+  // the impulse response rings out one block late
+  uint32_t getTailFrames(void) const override {
+    return (partitions_ + 1) * blockFrames_;
+  }
+
+  void getStats(AudioReverbStats *stats) const;
+  void resetStats(void);
+  void dumpStats(void) const;
+
+  /*
+   * A made up room for the sample: decaying noise, falling 60 dB in
+   * rt60Ms, with unit energy.
+   */
+  static void SynthesizeRoom(float *impulse, uint32_t impulseFrames,
+                             int32_t sampleRate, uint32_t rt60Ms);
+
+ private:
+  template <typename Sample>
+  void processSamples(uint8_t *liveAudio, int32_t numFrames);
+  void processBlock(void);
+  bool sumTail(uint64_t block, float *re, float *im, bool onWorker);
+  void runWorker(void);
+
+  uint32_t blockFrames_;
+  uint32_t fftSize_;
+  uint32_t binCount_;
+  uint32_t binStride_;  // binCount_ padded for the SIMD kernels
+  uint32_t partitions_;
+  uint32_t ringSize_;  // audio spectra kept: partitions_ + slack
+  uint32_t tailSlots_;
+  SpectrumKernels kernels_;
+  AudioFft fft_;
+  std::atomic<float> wetLevel_{0.0f};
+
+  // process() only
+  uint64_t block_ = 0;
+  uint32_t fifoPos_ = 0;  // frames in inFifo_ / left to read in outFifo_
+  std::unique_ptr<float[]> inFifo_;   // blockFrames_ interleaved frames
+  std::unique_ptr<float[]> outFifo_;  // the previous block, with reverb
+  bool outChanged_ = false;           // outFifo_ is not just the dry audio
+  std::unique_ptr<float[]> xTime_;    // last fftSize_ mono samples
+  std::unique_ptr<float[]> work_;     // fftSize_ scratch
+  float *yRe_, *yIm_;                 // reverb spectrum of the block
+
+  // one allocation: partitions_ impulse spectra, ringSize_ audio spectra,
+  // tailSlots_ tail sums and the block's own spectrum
+  std::unique_ptr<float[]> spectra_;
+  float *hRe_, *hIm_;
+  float *xRe_, *xIm_;
+  float *tRe_, *tIm_;
+
+  // process() -> worker
+  std::atomic<uint64_t> written_{0};    // audio spectra in the ring
+  std::atomic<uint64_t> requested_{0};  // newest block to sum the tail of
+  std::unique_ptr<std::atomic<uint64_t>[]> tailBlock_;  // per tail slot
+  std::atomic<bool> quit_{false};
+  sem_t wake_;
+  std::thread worker_;
+  bool useWorker_;
+
+  std::atomic<uint32_t> blocks_{0};
+  std::atomic<uint32_t> lateTails_{0};
+};
+
+#endif  // NATIVE_AUDIO_AUDIO_REVERB_H
@@ -0,0 +1,136 @@
+/*
+ * Copyright 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef NATIVE_AUDIO_AUDIO_SAMPLE_H
+#define NATIVE_AUDIO_AUDIO_SAMPLE_H
+
+#include <SLES/OpenSLES.h>
+
+#include <cmath>
+#include <cstdint>
+
+/*
+ * Sample encodings the echo pipeline runs in natively. They follow what
+ * ConvertToSLSampleFormat() negotiates:
+ *   SL_PCMSAMPLEFORMAT_FIXED_16: 16 bit signed int
+ *   SL_PCMSAMPLEFORMAT_FIXED_24: 24 bit signed int, packed in 3 bytes
+ *   SL_PCMSAMPLEFORMAT_FIXED_32: 32 bit float ( the float representation )
+ */
+enum class SampleEncoding { Int16, Int24Packed, Float32 };
+
+inline SampleEncoding GetSampleEncoding(SLuint32 bitsPerSample) {
+  switch (bitsPerSample) {
+    case SL_PCMSAMPLEFORMAT_FIXED_24:
+      return SampleEncoding::Int24Packed;
+    case SL_PCMSAMPLEFORMAT_FIXED_32:
+      return SampleEncoding::Float32;
+    default:
+      return SampleEncoding::Int16;
+  }
+}
+
+/*
+ * TPDF dither source for narrowing float to integer samples: 4 xorshift32
+ * generators, one per SIMD lane of the converters ( audio_format_convert.h ).
+ * Each effect owns one, so it is never shared between threads.
+ */
+struct AudioDither {
+  uint32_t state_[4] = {0x9E3779B9u, 0x7F4A7C15u, 0x85EBCA6Bu, 0xC2B2AE35u};
+
+  // triangular dither in LSB units: difference of two uniforms in [0, 1)
+  inline float tpdf(void) {
+    float u1 = (next() >> 8) * (1.0f / 16777216.0f);
+    float u2 = (next() >> 8) * (1.0f / 16777216.0f);
+    return u1 - u2;
+  }
+
+ private:
+  inline uint32_t next(void) {
+    uint32_t &state = state_[0];
+    state ^= state << 13;
+    state ^= state >> 17;
+    state ^= state << 5;
+    return state;
+  }
+};
+
+/*
+ * Sample traits: compile time access to one encoding, in full scale float
+ * ( -1.0 -- 1.0 ). Effects are templated on these, so every encoding gets
+ * its own inlined processing loop instead of a per buffer conversion.
+ * idx is the sample index ( frame * channelCount + channel ).
+ * write() to an integer encoding adds +-1 LSB TPDF dither from dither before
+ * rounding, the same as the block converters; a nullptr dither rounds only.
+ */
+struct Int16Sample {
+  static constexpr SampleEncoding kEncoding = SampleEncoding::Int16;
+  static constexpr int32_t kBytes = 2;
+
+  static inline float read(const uint8_t *buf, int32_t idx) {
+    return reinterpret_cast<const int16_t *>(buf)[idx] * (1.0f / 32768.0f);
+  }
+  static inline void write(uint8_t *buf, int32_t idx, float value,
+                           AudioDither *dither) {
+    value = value * 32768.0f + (dither ? dither->tpdf() : 0.0f);
+    value = fminf(fmaxf(value, -32768.0f), 32767.0f);
+    reinterpret_cast<int16_t *>(buf)[idx] =
+        static_cast<int16_t>(lrintf(value));
+  }
+};
+
+struct Int24Sample {
+  static constexpr SampleEncoding kEncoding = SampleEncoding::Int24Packed;
+  static constexpr int32_t kBytes = 3;
+  static constexpr int32_t kMax = 0x7FFFFF;
+  static constexpr int32_t kMin = -0x800000;
+
+  static inline int32_t readInt(const uint8_t *buf, int32_t idx) {
+    const uint8_t *p = buf + idx * kBytes;
+    uint32_t value = p[0] | (p[1] << 8) | (static_cast<uint32_t>(p[2]) << 16);
+    return static_cast<int32_t>(value << 8) >> 8;  // sign extend
+  }
+  static inline void writeInt(uint8_t *buf, int32_t idx, int32_t value) {
+    uint8_t *p = buf + idx * kBytes;
+    p[0] = static_cast<uint8_t>(value);
+    p[1] = static_cast<uint8_t>(value >> 8);
+    p[2] = static_cast<uint8_t>(value >> 16);
+  }
+  static inline float read(const uint8_t *buf, int32_t idx) {
+    return readInt(buf, idx) * (1.0f / 8388608.0f);
+  }
+  static inline void write(uint8_t *buf, int32_t idx, float value,
+                           AudioDither *dither) {
+    value = value * 8388608.0f + (dither ? dither->tpdf() : 0.0f);
+    value = fminf(fmaxf(value, static_cast<float>(kMin)),
+                  static_cast<float>(kMax));
+    writeInt(buf, idx, static_cast<int32_t>(lrintf(value)));
+  }
+};
+
+struct Float32Sample {
+  static constexpr SampleEncoding kEncoding = SampleEncoding::Float32;
+  static constexpr int32_t kBytes = 4;
+
+  static inline float read(const uint8_t *buf, int32_t idx) {
+    return reinterpret_cast<const float *>(buf)[idx];
+  }
+  static inline void write(uint8_t *buf, int32_t idx, float value,
+                           AudioDither *) {
+    reinterpret_cast<float *>(buf)[idx] = value;
+  }
+};
+
+#endif  // NATIVE_AUDIO_AUDIO_SAMPLE_H
@@ -0,0 +1,245 @@
+/*
+ * Copyright 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "audio_thread.h"
+
+#include <alloca.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+
+#include "audio_common.h"
+
+// cpufreq is only looked at for this many cores
+static const int kMaxCpus = 64;
+
+static bool SetNice(int nice) {
+  // on Linux this only changes the calling thread
+  if (setpriority(PRIO_PROCESS, 0, nice)) {
+    LOGW("AudioThread: nice %d refused ( errno %d )", nice, errno);
+    return false;
+  }
+  return true;
+}
+
+AudioSchedResult SetAudioThreadPriority(AudioThreadPriority priority,
+                                        int fifoPriority) {
+  if (priority == AudioThreadPriority::RealTime) {
+    int policy;
+    sched_param param;
+    if (!pthread_getschedparam(pthread_self(), &policy, &param) &&
+        (policy == SCHED_FIFO || policy == SCHED_RR)) {
+      // the fast track callback threads already are: keep their priority
+      return AudioSchedResult::Fifo;
+    }
+    param.sched_priority = fifoPriority;
+    int err = pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+    if (!err) return AudioSchedResult::Fifo;
+    LOGW("AudioThread: SCHED_FIFO %d refused ( errno %d ), using nice",
+         fifoPriority, err);
+  }
+  int nice = priority == AudioThreadPriority::Background ? kBackgroundNice
+                                                         : kUrgentAudioNice;
+  return SetNice(nice) ? AudioSchedResult::Nice : AudioSchedResult::Unchanged;
+}
+
+bool SetAudioThreadAffinity(uint64_t cpuMask) {
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  for (int cpu = 0; cpu < kMaxCpus; cpu++) {
+    if (cpuMask & (1ULL << cpu)) CPU_SET(cpu, &set);
+  }
+  // 0 is the calling thread; it fails when the mask misses our cpuset
+  if (sched_setaffinity(0, sizeof(set), &set)) {
+    LOGW("AudioThread: affinity 0x%llx refused ( errno %d )",
+         static_cast<unsigned long long>(cpuMask), errno);
+    return false;
+  }
+  return true;
+}
+
+uint64_t GetFastCpuMask(void) {
+  uint64_t fastest = 0, slowest = UINT64_MAX, mask = 0;
+  for (int cpu = 0; cpu < kMaxCpus; cpu++) {
+    char path[80];
+    snprintf(path, sizeof(path),
+             "/sys/devices/system/cpu/cpu%d/cpufreq/cpuinfo_max_freq", cpu);
+    FILE *file = fopen(path, "r");
+    if (!file) continue;
+    unsigned long long freq = 0;
+    int read = fscanf(file, "%llu", &freq);
+    fclose(file);
+    if (read != 1 || !freq) continue;
+    slowest = std::min<uint64_t>(slowest, freq);
+    if (freq > fastest) {
+      fastest = freq;
+      mask = 0;
+    }
+    if (freq == fastest) mask |= 1ULL << cpu;
+  }
+  return fastest > slowest ? mask : 0;
+}
+
+bool LockAudioMemory(void) {
+  int flags = MCL_CURRENT | MCL_FUTURE;
+#ifdef MCL_ONFAULT
+  // lock what gets touched, without faulting in every mapping right now
+  flags |= MCL_ONFAULT;
+#endif
+  if (mlockall(flags)) {
+    LOGW("AudioThread: mlockall refused ( errno %d )", errno);
+    return false;
+  }
+  return true;
+}
+
+/*
+ * Touch the next bytes of stack so the callbacks never fault them in; the
+ * pages stay mapped once touched ( and locked, after LockAudioMemory() ).
+ */
+__attribute__((noinline)) void PrefaultStack(size_t bytes) {
+  volatile uint8_t *stack = static_cast<uint8_t *>(alloca(bytes));
+  for (size_t offset = 0; offset < bytes; offset += 256) {
+    stack[offset] = 0;
+  }
+}
+
+void PrepareAudioThread(const AudioThreadConfig &config) {
+  static thread_local bool prepared = false;
+  if (prepared) return;
+  prepared = true;
+
+  AudioSchedResult sched =
+      SetAudioThreadPriority(config.priority_, config.fifoPriority_);
+  bool pinned = config.cpuMask_ && SetAudioThreadAffinity(config.cpuMask_);
+  if (config.prefaultStackBytes_) {
+    PrefaultStack(config.prefaultStackBytes_);
+  }
+  LOGI("AudioThread: thread %d runs %s%s", gettid(), GetSchedResultName(sched),
+       pinned ? ", pinned" : "");
+}
+
+const char *GetSchedResultName(AudioSchedResult result) {
+  switch (result) {
+    case AudioSchedResult::Fifo:
+      return "SCHED_FIFO";
+    case AudioSchedResult::Nice:
+      return "niced";
+    case AudioSchedResult::Unchanged:
+      break;
+  }
+  return "unchanged";
+}
+
+AudioWakeupProbe::AudioWakeupProbe()
+    : buckets_(new uint32_t[kMaxBucketUs + 1]) {
+  memset(&stats_, 0, sizeof(stats_));
+}
+
+AudioWakeupProbe::~AudioWakeupProbe() {
+  if (thread_.joinable()) thread_.join();
+}
+
+bool AudioWakeupProbe::start(const AudioThreadConfig &config,
+                             uint32_t periodUs, uint32_t seconds) {
+  if (thread_.joinable()) {
+    if (!isDone()) return false;
+    thread_.join();
+  }
+  if (!periodUs) return false;
+  periodUs_ = periodUs;
+  wakeups_ = static_cast<uint32_t>(seconds * 1000000ULL / periodUs);
+  memset(buckets_.get(), 0, (kMaxBucketUs + 1) * sizeof(uint32_t));
+  memset(&stats_, 0, sizeof(stats_));
+  done_.store(false, std::memory_order_relaxed);
+  thread_ = std::thread(&AudioWakeupProbe::run, this, config);
+  return true;
+}
+
+void AudioWakeupProbe::run(AudioThreadConfig config) {
+  stats_.sched_ =
+      SetAudioThreadPriority(config.priority_, config.fifoPriority_);
+  if (config.cpuMask_) SetAudioThreadAffinity(config.cpuMask_);
+  if (config.prefaultStackBytes_) PrefaultStack(config.prefaultStackBytes_);
+
+  uint64_t periodNs = static_cast<uint64_t>(periodUs_) * 1000;
+  uint64_t deadline = GetMonotonicNs() + periodNs;
+  uint64_t totalUs = 0;
+  uint32_t minUs = UINT32_MAX, maxUs = 0;
+  for (uint32_t idx = 0; idx < wakeups_; idx++) {
+    timespec wake;
+    wake.tv_sec = static_cast<time_t>(deadline / 1000000000);
+    wake.tv_nsec = static_cast<long>(deadline % 1000000000);
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &wake, nullptr) ==
+           EINTR) {
+    }
+    uint64_t now = GetMonotonicNs();
+    uint32_t lateUs =
+        static_cast<uint32_t>(std::min<uint64_t>((now - deadline) / 1000,
+                                                 UINT32_MAX));
+    buckets_[std::min(lateUs, kMaxBucketUs)]++;
+    totalUs += lateUs;
+    minUs = std::min(minUs, lateUs);
+    maxUs = std::max(maxUs, lateUs);
+    if (lateUs >= periodUs_) stats_.latePeriods_++;
+    // keep the absolute schedule, like the device clock would
+    deadline += periodNs;
+  }
+
+  stats_.wakeups_ = wakeups_;
+  stats_.minUs_ = wakeups_ ? minUs : 0;
+  stats_.maxUs_ = maxUs;
+  stats_.avgUs_ = wakeups_ ? static_cast<float>(totalUs) / wakeups_ : 0.0f;
+  uint32_t *percentiles[] = {&stats_.p50Us_, &stats_.p99Us_, &stats_.p999Us_};
+  const double fractions[] = {0.5, 0.99, 0.999};
+  uint64_t seen = 0;
+  uint32_t next = 0;
+  for (uint32_t us = 0; us <= kMaxBucketUs && next < 3; us++) {
+    seen += buckets_[us];
+    while (next < 3 && seen >= fractions[next] * wakeups_ && wakeups_) {
+      // the last bucket holds everything beyond: report the max there
+      *percentiles[next++] = us < kMaxBucketUs ? us : maxUs;
+    }
+  }
+  done_.store(true, std::memory_order_release);
+  dump();
+}
+
+bool AudioWakeupProbe::getStats(AudioWakeupStats *stats) const {
+  if (!isDone()) return false;
+  *stats = stats_;
+  return true;
+}
+
+void AudioWakeupProbe::dump(void) const {
+  AudioWakeupStats stats;
+  if (!getStats(&stats)) {
+    LOGI("WakeupProbe: still running");
+    return;
+  }
+  LOGI("WakeupProbe: %d wakeups every %d us, %s", stats.wakeups_, periodUs_,
+       GetSchedResultName(stats.sched_));
+  LOGI("WakeupProbe: late by min=%d avg=%.1f p50=%d p99=%d p99.9=%d max=%d "
+       "us, %d over a period",
+       stats.minUs_, stats.avgUs_, stats.p50Us_, stats.p99Us_, stats.p999Us_,
+       stats.maxUs_, stats.latePeriods_);
+}
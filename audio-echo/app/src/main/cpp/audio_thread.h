@@ -0,0 +1,122 @@
+/*
+ * Copyright 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef NATIVE_AUDIO_AUDIO_THREAD_H
+#define NATIVE_AUDIO_AUDIO_THREAD_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <thread>
+
+/*
+ * Scheduling of the threads touching audio. Everything here applies to the
+ * calling thread only, and falls back quietly ( with a log ) when the
+ * system says no: an app usually gets no SCHED_FIFO, and a limited nice.
+ */
+enum class AudioThreadPriority {
+  RealTime,    // SCHED_FIFO, else kUrgentAudioNice
+  Urgent,      // kUrgentAudioNice
+  Background,  // kBackgroundNice: helpers that must not disturb audio
+};
+
+enum class AudioSchedResult { Fifo, Nice, Unchanged };
+
+// Android's THREAD_PRIORITY_URGENT_AUDIO and THREAD_PRIORITY_BACKGROUND
+static constexpr int kUrgentAudioNice = -19;
+static constexpr int kBackgroundNice = 10;
+// below the fast mixer / fast capture threads ( 3 ), like the fast tracks'
+// own callback threads
+static constexpr int kAudioFifoPriority = 2;
+
+struct AudioThreadConfig {
+  AudioThreadPriority priority_;
+  int fifoPriority_;
+  uint64_t cpuMask_;          // 0: leave the affinity alone
+  size_t prefaultStackBytes_;  // 0: no stack prefault
+};
+
+AudioSchedResult SetAudioThreadPriority(AudioThreadPriority priority,
+                                        int fifoPriority);
+bool SetAudioThreadAffinity(uint64_t cpuMask);
+/*
+ * The cores with the highest maximum frequency ( the big cores ); 0 when
+ * they all run at the same speed or cpufreq cannot be read.
+ */
+uint64_t GetFastCpuMask(void);
+/*
+ * mlockall() of the whole process, current and future pages. An app rarely
+ * may ( RLIMIT_MEMLOCK ): the sample buffers are locked on their own anyway
+ * ( SampleBufPool::kLockMemory ).
+ */
+bool LockAudioMemory(void);
+void PrefaultStack(size_t bytes);
+/*
+ * All of the above that config asks for, once per thread: cheap enough to
+ * call from every callback.
+ */
+void PrepareAudioThread(const AudioThreadConfig &config);
+const char *GetSchedResultName(AudioSchedResult result);
+
+/*
+ * Wakeup latency distribution, in micro sec
+ */
+struct AudioWakeupStats {
+  uint32_t wakeups_;
+  uint32_t minUs_;
+  uint32_t p50Us_;
+  uint32_t p99Us_;
+  uint32_t p999Us_;
+  uint32_t maxUs_;
+  float avgUs_;
+  uint32_t latePeriods_;  // wakeups later than a whole period
+  AudioSchedResult sched_;
+};
+
+/**
+ * cyclictest style probe: a thread set up like the audio threads sleeps
+ * to an absolute deadline every period, and records how late it woke up.
+ * A buffer size is safe when the tail of the distribution stays well
+ * inside a buffer period.
+ *   - start() returns at once, the probe runs on its own thread
+ *   - getStats() and dump() give the result once it is done
+ */
+class AudioWakeupProbe {
+ public:
+  // 1 us histogram buckets, everything later lands in the last one
+  static constexpr uint32_t kMaxBucketUs = 20000;
+
+  AudioWakeupProbe();
+  ~AudioWakeupProbe();
+
+  bool start(const AudioThreadConfig &config, uint32_t periodUs,
+             uint32_t seconds);
+  bool isDone(void) const { return done_.load(std::memory_order_acquire); }
+  bool getStats(AudioWakeupStats *stats) const;
+  void dump(void) const;
+
+ private:
+  void run(AudioThreadConfig config);
+
+  uint32_t periodUs_ = 0;
+  uint32_t wakeups_ = 0;
+  std::unique_ptr<uint32_t[]> buckets_;  // kMaxBucketUs + 1, last: beyond
+  std::thread thread_;
+  std::atomic<bool> done_{false};
+  AudioWakeupStats stats_;
+};
+
+#endif  // NATIVE_AUDIO_AUDIO_THREAD_H
@@ -0,0 +1,216 @@
+/*
+ * Copyright 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "audio_trace.h"
+
+#include <algorithm>
+
+#include "audio_common.h"
+
+static const char *kSourceNames[TRACE_SOURCE_COUNT] = {"recorder", "player"};
+// events printed by dump(), per source
+static const uint32_t kDumpEventCount = 8;
+
+static inline uint8_t ClampDepth(uint32_t depth) {
+  return static_cast<uint8_t>(std::min(depth, 255u));
+}
+
+static inline uint64_t PackInfo(uint32_t intervalUs, uint32_t devDepth,
+                                uint32_t dataDepth, uint32_t freeDepth) {
+  return static_cast<uint64_t>(intervalUs) << 32 |
+         static_cast<uint64_t>(ClampDepth(devDepth)) << 16 |
+         static_cast<uint64_t>(ClampDepth(dataDepth)) << 8 |
+         ClampDepth(freeDepth);
+}
+
+static inline void UnpackInfo(uint64_t info, TraceEvent *event) {
+  event->intervalUs_ = static_cast<uint32_t>(info >> 32);
+  event->devDepth_ = static_cast<uint8_t>(info >> 16);
+  event->dataDepth_ = static_cast<uint8_t>(info >> 8);
+  event->freeDepth_ = static_cast<uint8_t>(info);
+}
+
+AudioTrace::AudioTrace(uint32_t sampleRate, uint32_t framesPerBuf) {
+  // sampleRate is in milli Hz ( SLmilliHertz )
+  periodNs_ = static_cast<uint64_t>(framesPerBuf) * 1000000000000ULL /
+              std::max(sampleRate, 1u);
+  for (auto &ring : rings_) {
+    for (uint32_t idx = 0; idx < kEventCount; idx++) {
+      ring.time_[idx].store(0, std::memory_order_relaxed);
+      ring.info_[idx].store(0, std::memory_order_relaxed);
+    }
+  }
+  reset();
+}
+
+/**
+ * Called first thing in a recorder / player callback, with the time stamp
+ * the callback gives its buffers ( GetMonotonicNs() ).
+ */
+void AudioTrace::traceCallback(TraceSource source, uint64_t now,
+                               uint32_t devDepth, uint32_t dataDepth,
+                               uint32_t freeDepth) {
+  Ring &ring = rings_[static_cast<uint32_t>(source)];
+  uint32_t intervalUs = 0;
+  if (ring.lastNs_) {
+    uint64_t interval = now - ring.lastNs_;
+    intervalUs = static_cast<uint32_t>(
+        std::min<uint64_t>(interval / 1000, UINT32_MAX));
+
+    uint64_t deviation =
+        interval > periodNs_ ? interval - periodNs_ : periodNs_ - interval;
+    uint32_t bucket = static_cast<uint32_t>(std::min<uint64_t>(
+        deviation / (kJitterBucketUs * 1000ULL), kJitterBuckets - 1));
+    ring.jitter_[bucket].store(
+        ring.jitter_[bucket].load(std::memory_order_relaxed) + 1,
+        std::memory_order_relaxed);
+    if (intervalUs < ring.minIntervalUs_.load(std::memory_order_relaxed)) {
+      ring.minIntervalUs_.store(intervalUs, std::memory_order_relaxed);
+    }
+    if (intervalUs > ring.maxIntervalUs_.load(std::memory_order_relaxed)) {
+      ring.maxIntervalUs_.store(intervalUs, std::memory_order_relaxed);
+    }
+  }
+  ring.lastNs_ = now;
+
+  uint32_t write = ring.write_.load(std::memory_order_relaxed);
+  uint32_t slot = write & (kEventCount - 1);
+  ring.time_[slot].store(now, std::memory_order_relaxed);
+  ring.info_[slot].store(PackInfo(intervalUs, devDepth, dataDepth, freeDepth),
+                         std::memory_order_relaxed);
+  ring.write_.store(write + 1, std::memory_order_release);
+}
+
+/**
+ * Estimate how long the first sample of a recorded buffer takes to come
+ * out of the player: one period to fill it, the time spent in the engine
+ * queues, and one period for each buffer already queued to the device.
+ * The latency inside the audio HAL is not included.
+ */
+void AudioTrace::traceLatency(uint64_t recordedNs, uint64_t enqueuedNs,
+                              uint32_t buffersAhead) {
+  if (!recordedNs || enqueuedNs < recordedNs) return;
+
+  uint64_t latencyNs =
+      (enqueuedNs - recordedNs) + periodNs_ * (1 + buffersAhead);
+  uint32_t latencyUs = static_cast<uint32_t>(
+      std::min<uint64_t>(latencyNs / 1000, UINT32_MAX));
+  latencyCount_.store(latencyCount_.load(std::memory_order_relaxed) + 1,
+                      std::memory_order_relaxed);
+  latencyTotalUs_.store(
+      latencyTotalUs_.load(std::memory_order_relaxed) + latencyUs,
+      std::memory_order_relaxed);
+  if (latencyUs < latencyMinUs_.load(std::memory_order_relaxed)) {
+    latencyMinUs_.store(latencyUs, std::memory_order_relaxed);
+  }
+  if (latencyUs > latencyMaxUs_.load(std::memory_order_relaxed)) {
+    latencyMaxUs_.store(latencyUs, std::memory_order_relaxed);
+  }
+}
+
+/**
+ * Copy the newest events of a source, oldest first, without stopping the
+ * writer: after copying, the ones the writer may have lapped are dropped.
+ * @return number of events in events[]
+ */
+uint32_t AudioTrace::snapshot(TraceSource source, TraceEvent *events,
+                              uint32_t maxCount) const {
+  const Ring &ring = rings_[static_cast<uint32_t>(source)];
+  uint32_t end = ring.write_.load(std::memory_order_acquire);
+  uint32_t count = std::min(std::min(end, maxCount), kEventCount);
+  uint32_t begin = end - count;
+
+  for (uint32_t idx = 0; idx < count; idx++) {
+    uint32_t slot = (begin + idx) & (kEventCount - 1);
+    events[idx].timeNs_ = ring.time_[slot].load(std::memory_order_relaxed);
+    UnpackInfo(ring.info_[slot].load(std::memory_order_relaxed), &events[idx]);
+  }
+
+  // the writer could be storing event "write_" right now, into the slot of
+  // event "write_ - kEventCount": everything up to that one is suspect
+  std::atomic_thread_fence(std::memory_order_acquire);
+  uint32_t firstValid =
+      ring.write_.load(std::memory_order_relaxed) - kEventCount + 1;
+  int32_t stale = static_cast<int32_t>(firstValid - begin);
+  if (stale <= 0) {
+    return count;
+  }
+  if (static_cast<uint32_t>(stale) >= count) {
+    return 0;
+  }
+  std::copy(events + stale, events + count, events);
+  return count - stale;
+}
+
+/*
+ * Only call it while the recorder and the player are stopped
+ */
+void AudioTrace::reset(void) {
+  for (auto &ring : rings_) {
+    ring.write_.store(0, std::memory_order_relaxed);
+    ring.lastNs_ = 0;
+    for (auto &bucket : ring.jitter_) {
+      bucket.store(0, std::memory_order_relaxed);
+    }
+    ring.minIntervalUs_.store(UINT32_MAX, std::memory_order_relaxed);
+    ring.maxIntervalUs_.store(0, std::memory_order_relaxed);
+  }
+  latencyCount_.store(0, std::memory_order_relaxed);
+  latencyTotalUs_.store(0, std::memory_order_relaxed);
+  latencyMinUs_.store(UINT32_MAX, std::memory_order_relaxed);
+  latencyMaxUs_.store(0, std::memory_order_relaxed);
+}
+
+void AudioTrace::dump(void) const {
+  LOGI("Trace: buffer period = %d us", static_cast<int>(periodNs_ / 1000));
+  for (uint32_t src = 0; src < TRACE_SOURCE_COUNT; src++) {
+    const Ring &ring = rings_[src];
+    uint32_t callbacks = ring.write_.load(std::memory_order_relaxed);
+    if (!callbacks) {
+      LOGI("Trace %s: no callbacks", kSourceNames[src]);
+      continue;
+    }
+    LOGI("Trace %s: callbacks=%d, interval min=%d us, max=%d us",
+         kSourceNames[src], callbacks,
+         ring.minIntervalUs_.load(std::memory_order_relaxed),
+         ring.maxIntervalUs_.load(std::memory_order_relaxed));
+    for (uint32_t bucket = 0; bucket < kJitterBuckets; bucket++) {
+      uint32_t hits = ring.jitter_[bucket].load(std::memory_order_relaxed);
+      if (!hits) continue;
+      LOGI("Trace %s: jitter %d+ us: %d", kSourceNames[src],
+           bucket * kJitterBucketUs, hits);
+    }
+
+    TraceEvent events[kDumpEventCount];
+    uint32_t count = snapshot(static_cast<TraceSource>(src), events,
+                              kDumpEventCount);
+    for (uint32_t idx = 0; idx < count; idx++) {
+      LOGI("Trace %s: t=%llu us, interval=%d us, dev=%d, data=%d, free=%d",
+           kSourceNames[src],
+           static_cast<unsigned long long>(events[idx].timeNs_ / 1000),
+           events[idx].intervalUs_, events[idx].devDepth_,
+           events[idx].dataDepth_, events[idx].freeDepth_);
+    }
+  }
+
+  uint32_t latencies = latencyCount_.load(std::memory_order_relaxed);
+  if (latencies) {
+    LOGI("Trace: estimated latency min=%d us, avg=%llu us, max=%d us",
+         latencyMinUs_.load(std::memory_order_relaxed),
+         static_cast<unsigned long long>(
+             latencyTotalUs_.load(std::memory_order_relaxed) / latencies),
+         latencyMaxUs_.load(std::memory_order_relaxed));
+  }
+}
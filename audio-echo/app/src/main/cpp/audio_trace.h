@@ -0,0 +1,89 @@
+/*
+ * Copyright 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef NATIVE_AUDIO_AUDIO_TRACE_H
+#define NATIVE_AUDIO_AUDIO_TRACE_H
+
+#include <atomic>
+#include <cstdint>
+
+enum class TraceSource : uint32_t { Recorder = 0, Player };
+#define TRACE_SOURCE_COUNT 2
+
+/*
+ * One callback of the recorder or the player, with the depth of the
+ * queues it works on when it was called
+ */
+struct TraceEvent {
+  uint64_t timeNs_;      // GetMonotonicNs()
+  uint32_t intervalUs_;  // since the previous callback of the same source
+  uint8_t devDepth_;     // device shadow queue
+  uint8_t dataDepth_;    // rec queue ( recorder: output, player: input )
+  uint8_t freeDepth_;    // free queue
+};
+
+/**
+ * Lock-free trace of the audio callbacks:
+ *   - the recorder and the player each write their own event ring, so
+ *     every ring has one writer and the callbacks never wait
+ *   - callback intervals are binned into a jitter histogram: the distance
+ *     to the nominal buffer period, kJitterBucketUs per bucket
+ *   - the player adds one latency estimate per recorded buffer it hands to
+ *     the device ( see traceLatency() )
+ * snapshot() and dump() only read atomics, they can run on any thread at
+ * any time; events overwritten while being copied are dropped.
+ */
+class AudioTrace {
+ public:
+  static constexpr uint32_t kEventCount = 1024;  // per source, power of 2
+  static constexpr uint32_t kJitterBuckets = 16;
+  static constexpr uint32_t kJitterBucketUs = 250;
+
+  explicit AudioTrace(uint32_t sampleRate, uint32_t framesPerBuf);
+
+  void traceCallback(TraceSource source, uint64_t now, uint32_t devDepth,
+                     uint32_t dataDepth, uint32_t freeDepth);
+  void traceLatency(uint64_t recordedNs, uint64_t enqueuedNs,
+                    uint32_t buffersAhead);
+
+  uint32_t snapshot(TraceSource source, TraceEvent *events,
+                    uint32_t maxCount) const;
+  void reset(void);
+  void dump(void) const;
+
+ private:
+  struct Ring {
+    // an event is 2 words so the reader never sees a torn half of a word
+    std::atomic<uint64_t> time_[kEventCount];
+    std::atomic<uint64_t> info_[kEventCount];
+    std::atomic<uint32_t> write_{0};
+    uint64_t lastNs_ = 0;  // writer only
+
+    std::atomic<uint32_t> jitter_[kJitterBuckets];
+    std::atomic<uint32_t> minIntervalUs_;
+    std::atomic<uint32_t> maxIntervalUs_;
+  };
+
+  uint64_t periodNs_;
+  Ring rings_[TRACE_SOURCE_COUNT];
+
+  std::atomic<uint32_t> latencyCount_;
+  std::atomic<uint64_t> latencyTotalUs_;
+  std::atomic<uint32_t> latencyMinUs_;
+  std::atomic<uint32_t> latencyMaxUs_;
+};
+
+#endif  // NATIVE_AUDIO_AUDIO_TRACE_H
@@ -18,6 +18,7 @@
 #include <SLES/OpenSLES.h>
 #include <sys/types.h>
 
+#include <algorithm>
 #include <atomic>
 #include <cassert>
 #include <limits>
@@ -29,18 +30,29 @@
 
 /*
  * ProducerConsumerQueue, borrowed from Ian NiLewis
+ *   - single producer, single consumer
+ *   - capacity is a power of two so slots are found by masking
+ *   - each side keeps a cached copy of the other side's index and only
+ *     reloads it (touching the other side's cache line) when the cached
+ *     value says there is less room / data than the call asks for
+ *   - besides the one-element calls, getWriteableSpan()/commitWriteableSpan()
+ *     and getReadableSpan()/consume() move up to N contiguous slots at once
  */
 template <typename T>
 class ProducerConsumerQueue {
  public:
   explicit ProducerConsumerQueue(int size)
-      : ProducerConsumerQueue(size, new T[size]) {}
+      : ProducerConsumerQueue(RoundUpToPowerOfTwo(size),
+                              new T[RoundUpToPowerOfTwo(size)]) {}
 
+  // buffer must hold size elements, and size must be a power of two
   explicit ProducerConsumerQueue(int size, T* buffer)
-      : size_(size), buffer_(buffer) {
-    // This is necessary because we depend on twos-complement wraparound
-    // to take care of overflow conditions.
-    assert(size < std::numeric_limits<int>::max());
+      : size_(static_cast<uint32_t>(size)),
+        mask_(static_cast<uint32_t>(size) - 1),
+        buffer_(buffer) {
+    // we depend on unsigned wraparound of the read and write indices, and
+    // on masking to map them into the buffer
+    assert(size > 0 && (size & (size - 1)) == 0);
   }
 
   bool push(const T& item) {
@@ -87,25 +99,40 @@ class ProducerConsumerQueue {
   // of push() changed its mind while writing (e.g. ran out of bytes)
   template <typename F>
   bool push(const F& writer) {
-    bool result = false;
-    int readptr = read_.load(std::memory_order_acquire);
-    int writeptr = write_.load(std::memory_order_relaxed);
-
-    // note that while readptr and writeptr will eventually
-    // wrap around, taking their difference is still valid as
-    // long as size_ < MAXINT.
-    int space = size_ - (int)(writeptr - readptr);
-    if (space >= 1) {
-      result = true;
-
-      // writer
-      if (writer(buffer_.get() + (writeptr % size_))) {
-        ++writeptr;
-        write_.store(writeptr, std::memory_order_release);
-      }
+    uint32_t writeptr = write_.load(std::memory_order_relaxed);
+    if (writeSpace(writeptr, 1) < 1) {
+      return false;
     }
-    return result;
+    if (writer(buffer_.get() + (writeptr & mask_))) {
+      write_.store(writeptr + 1, std::memory_order_release);
+    }
+    return true;
+  }
+
+  /**
+   * Producer: claim up to maxCount contiguous free slots starting at the
+   * write head. The slots stop at the end of the buffer, so a second call
+   * after commitWriteableSpan() may return the wrapped-around part.
+   * Like getWriteablePtr(), it is idempotent until the next commit.
+   * @return number of slots at *first, 0 if the queue is full
+   */
+  uint32_t getWriteableSpan(T** first, uint32_t maxCount) {
+    uint32_t writeptr = write_.load(std::memory_order_relaxed);
+    uint32_t count = std::min(maxCount, size_ - (writeptr & mask_));
+    count = std::min(count, writeSpace(writeptr, count));
+    *first = buffer_.get() + (writeptr & mask_);
+    return count;
   }
+
+  /**
+   * Producer: publish count slots filled after getWriteableSpan()
+   */
+  void commitWriteableSpan(uint32_t count) {
+    uint32_t writeptr = write_.load(std::memory_order_relaxed);
+    assert(count <= size_ - (writeptr - readCache_));
+    write_.store(writeptr + count, std::memory_order_release);
+  }
+
   // front out the queue, but not pop-out
   bool front(T* out_item) {
     return front([&](T* ptr) -> bool {
@@ -114,90 +141,103 @@ class ProducerConsumerQueue {
     });
   }
 
-  void pop(void) {
-    int readptr = read_.load(std::memory_order_relaxed);
-    ++readptr;
-    read_.store(readptr, std::memory_order_release);
-  }
+  void pop(void) { consume(1); }
 
   template <typename F>
   bool front(const F& reader) {
-    bool result = false;
-
-    int writeptr = write_.load(std::memory_order_acquire);
-    int readptr = read_.load(std::memory_order_relaxed);
-
-    // As above, wraparound is ok
-    int available = (int)(writeptr - readptr);
-    if (available >= 1) {
-      result = true;
-      reader(buffer_.get() + (readptr % size_));
+    uint32_t readptr = read_.load(std::memory_order_relaxed);
+    if (readAvailable(readptr, 1) < 1) {
+      return false;
     }
+    reader(buffer_.get() + (readptr & mask_));
+    return true;
+  }
 
-    return result;
+  /**
+   * Consumer: peek up to maxCount contiguous filled slots starting at the
+   * read head, without removing them; release them with consume().
+   * @return number of slots at *first, 0 if the queue is empty
+   */
+  uint32_t getReadableSpan(T** first, uint32_t maxCount) {
+    uint32_t readptr = read_.load(std::memory_order_relaxed);
+    uint32_t count = std::min(maxCount, size_ - (readptr & mask_));
+    count = std::min(count, readAvailable(readptr, count));
+    *first = buffer_.get() + (readptr & mask_);
+    return count;
   }
+
+  /**
+   * Consumer: hand count slots back to the producer
+   */
+  void consume(uint32_t count) {
+    uint32_t readptr = read_.load(std::memory_order_relaxed);
+    read_.store(readptr + count, std::memory_order_release);
+  }
+
   uint32_t size(void) {
-    int writeptr = write_.load(std::memory_order_acquire);
-    int readptr = read_.load(std::memory_order_relaxed);
+    uint32_t writeptr = write_.load(std::memory_order_acquire);
+    uint32_t readptr = read_.load(std::memory_order_relaxed);
 
-    return (uint32_t)(writeptr - readptr);
+    return writeptr - readptr;
   }
 
+  uint32_t capacity(void) const { return size_; }
+
  private:
-  int size_;
-  std::unique_ptr<T> buffer_;
+  static int RoundUpToPowerOfTwo(int size) {
+    assert(size > 0 && size <= (std::numeric_limits<int>::max() >> 1) + 1);
+    int capacity = 1;
+    while (capacity < size) capacity <<= 1;
+    return capacity;
+  }
+
+  // free slots seen by the producer; reloads read_ only when the cached
+  // copy says there are fewer than wanted
+  uint32_t writeSpace(uint32_t writeptr, uint32_t wanted) {
+    uint32_t space = size_ - (writeptr - readCache_);
+    if (space < wanted) {
+      readCache_ = read_.load(std::memory_order_acquire);
+      space = size_ - (writeptr - readCache_);
+    }
+    return space;
+  }
+
+  // filled slots seen by the consumer, same idea with write_
+  uint32_t readAvailable(uint32_t readptr, uint32_t wanted) {
+    uint32_t available = writeCache_ - readptr;
+    if (available < wanted) {
+      writeCache_ = write_.load(std::memory_order_acquire);
+      available = writeCache_ - readptr;
+    }
+    return available;
+  }
+
+  const uint32_t size_;
+  const uint32_t mask_;
+  std::unique_ptr<T[]> buffer_;
 
   // forcing cache line alignment to eliminate false sharing of the
   // frequently-updated read and write pointers. The object is to never
   // let these get into the "shared" state where they'd cause a cache miss
-  // for every write.
-  alignas(CACHE_ALIGN) std::atomic<int> read_{0};
-  alignas(CACHE_ALIGN) std::atomic<int> write_{0};
+  // for every write. Each index shares its line with the owner's cached
+  // copy of the other index.
+  alignas(CACHE_ALIGN) std::atomic<uint32_t> read_{0};
+  uint32_t writeCache_ = 0;  // consumer only
+  alignas(CACHE_ALIGN) std::atomic<uint32_t> write_{0};
+  uint32_t readCache_ = 0;  // producer only
 };
 
+class SampleBufPool;
+
 struct sample_buf {
-  uint8_t* buf_;   // audio sample container
-  uint32_t cap_;   // buffer capacity in byte
-  uint32_t size_;  // audio sample size (n buf) in byte
+  uint8_t* buf_ = nullptr;         // audio sample container
+  uint32_t cap_ = 0;               // buffer capacity in byte
+  uint32_t size_ = 0;              // audio sample size (n buf) in byte
+  uint32_t owner_ = 0;             // BufOwner, see buf_pool.h
+  uint64_t timeNs_ = 0;            // GetMonotonicNs() when recorded
+  SampleBufPool* pool_ = nullptr;  // nullptr if not from a pool
 };
 
 using AudioQueue = ProducerConsumerQueue<sample_buf*>;
 
-__inline__ void releaseSampleBufs(sample_buf* bufs, uint32_t& count) {
-  if (!bufs || !count) {
-    return;
-  }
-  for (uint32_t i = 0; i < count; i++) {
-    if (bufs[i].buf_) delete[] bufs[i].buf_;
-  }
-  delete[] bufs;
-}
-__inline__ sample_buf* allocateSampleBufs(uint32_t count, uint32_t sizeInByte) {
-  if (count <= 0 || sizeInByte <= 0) {
-    return nullptr;
-  }
-  sample_buf* bufs = new sample_buf[count];
-  assert(bufs);
-  memset(bufs, 0, sizeof(sample_buf) * count);
-
-  uint32_t allocSize = (sizeInByte + 3) & ~3;  // padding to 4 bytes aligned
-  uint32_t i;
-  for (i = 0; i < count; i++) {
-    bufs[i].buf_ = new uint8_t[allocSize];
-    if (bufs[i].buf_ == nullptr) {
-      LOGW("====Requesting %d buffers, allocated %d in %s", count, i,
-           __FUNCTION__);
-      break;
-    }
-    bufs[i].cap_ = sizeInByte;
-    bufs[i].size_ = 0;  // 0 data in it
-  }
-  if (i < 2) {
-    releaseSampleBufs(bufs, i);
-    bufs = nullptr;
-  }
-  count = i;
-  return bufs;
-}
-
 #endif  // NATIVE_AUDIO_BUF_MANAGER_H
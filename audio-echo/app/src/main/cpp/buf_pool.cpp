@@ -0,0 +1,165 @@
+/*
+ * Copyright 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "buf_pool.h"
+
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <cstring>
+
+#include "android_debug.h"
+
+static const size_t kHugePageSize = 2 * 1024 * 1024;
+static const char *kOwnerNames[BUF_OWNER_COUNT] = {"FreeQ", "RecDev", "RecQ",
+                                                   "PlayDev"};
+
+static inline size_t AlignUp(size_t value, size_t alignment) {
+  return (value + alignment - 1) & ~(alignment - 1);
+}
+
+/*
+ * Legal moves of the buffer life cycle, see BufOwner
+ */
+static bool IsLegalTransfer(uint32_t from, BufOwner to) {
+  switch (to) {
+    case BufOwner::RecordDevice:
+      return from == static_cast<uint32_t>(BufOwner::Free);
+    case BufOwner::Recorded:
+      return from == static_cast<uint32_t>(BufOwner::RecordDevice);
+    case BufOwner::PlayDevice:
+      return from == static_cast<uint32_t>(BufOwner::Recorded);
+    case BufOwner::Free:
+      return from != static_cast<uint32_t>(BufOwner::Free);
+  }
+  return false;
+}
+
+SampleBufPool::SampleBufPool(uint32_t count, uint32_t sizeInByte,
+                             uint32_t flags)
+    : arena_(nullptr),
+      arenaSize_(0),
+      locked_(false),
+      bufs_(nullptr),
+      count_(0),
+      badTransfers_(0) {
+  for (auto &owner : owners_) {
+    owner.store(0, std::memory_order_relaxed);
+  }
+  if (count < 2 || sizeInByte == 0) {
+    return;
+  }
+
+  size_t stride = AlignUp(sizeInByte, CACHE_ALIGN);
+  size_t pageSize = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+  void *arena = MAP_FAILED;
+  if (flags & kHugePages) {
+    arenaSize_ = AlignUp(stride * count, kHugePageSize);
+    arena = mmap(nullptr, arenaSize_, PROT_READ | PROT_WRITE,
+                 MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    if (arena == MAP_FAILED) {
+      LOGW("No huge pages for the sample buffers, using regular pages");
+    }
+  }
+  if (arena == MAP_FAILED) {
+    arenaSize_ = AlignUp(stride * count, pageSize);
+    arena = mmap(nullptr, arenaSize_, PROT_READ | PROT_WRITE,
+                 MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (arena == MAP_FAILED) {
+      LOGE("====Failed to map %zu bytes for %d sample buffers", arenaSize_,
+           count);
+      arenaSize_ = 0;
+      return;
+    }
+  }
+  arena_ = static_cast<uint8_t *>(arena);
+
+  if (flags & kLockMemory) {
+    locked_ = (mlock(arena_, arenaSize_) == 0);
+    if (!locked_) {
+      LOGW("mlock() of the sample buffers failed, they could be paged out");
+    }
+  }
+  // touch every page now, the audio callbacks should never fault them in
+  memset(arena_, 0, arenaSize_);
+
+  bufs_ = new sample_buf[count];
+  for (uint32_t i = 0; i < count; i++) {
+    bufs_[i].buf_ = arena_ + i * stride;
+    bufs_[i].cap_ = sizeInByte;
+    bufs_[i].size_ = 0;
+    bufs_[i].owner_ = static_cast<uint32_t>(BufOwner::Free);
+    bufs_[i].pool_ = this;
+  }
+  count_ = count;
+  owners_[static_cast<uint32_t>(BufOwner::Free)].store(
+      count, std::memory_order_relaxed);
+}
+
+SampleBufPool::~SampleBufPool() {
+  delete[] bufs_;
+  if (arena_) {
+    if (locked_) {
+      munlock(arena_, arenaSize_);
+    }
+    munmap(arena_, arenaSize_);
+  }
+}
+
+/**
+ * Move buf to a new owner. Only the thread holding the buffer calls it,
+ * right before handing it over, so owner_ itself needs no atomics; the
+ * per owner counts are read by other threads.
+ */
+void SampleBufPool::transfer(sample_buf *buf, BufOwner to) {
+  assert(buf->pool_ == this);
+  uint32_t from = buf->owner_;
+  if (!IsLegalTransfer(from, to)) {
+    badTransfers_.fetch_add(1, std::memory_order_relaxed);
+    LOGE("====Buffer %p handed from %s to %s", buf->buf_, kOwnerNames[from],
+         kOwnerNames[static_cast<uint32_t>(to)]);
+  }
+  owners_[from].fetch_sub(1, std::memory_order_relaxed);
+  owners_[static_cast<uint32_t>(to)].fetch_add(1, std::memory_order_relaxed);
+  buf->owner_ = static_cast<uint32_t>(to);
+}
+
+uint32_t SampleBufPool::getOwnerCount(BufOwner owner) const {
+  return owners_[static_cast<uint32_t>(owner)].load(std::memory_order_relaxed);
+}
+
+/**
+ * Compare what the pool handed to each owner with what the owner's queue
+ * really holds; found[] is indexed by BufOwner.
+ * The queues keep moving while they are counted, so one off readings during
+ * playback are possible; a shortage that stays is a lost buffer.
+ * @return number of pool buffers not found in any queue
+ */
+uint32_t SampleBufPool::dbgCheckOwners(const uint32_t *found) {
+  uint32_t lost = 0;
+  for (uint32_t idx = 0; idx < BUF_OWNER_COUNT; idx++) {
+    uint32_t expected = owners_[idx].load(std::memory_order_relaxed);
+    if (found[idx] < expected) {
+      LOGE("====Lost %d buffer(s) in %s (handed = %d, found = %d)",
+           expected - found[idx], kOwnerNames[idx], expected, found[idx]);
+      lost += expected - found[idx];
+    }
+  }
+  uint32_t bad = badTransfers_.load(std::memory_order_relaxed);
+  if (bad) {
+    LOGE("====%d buffer(s) skipped a step of their life cycle", bad);
+  }
+  return lost;
+}
@@ -0,0 +1,83 @@
+/*
+ * Copyright 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef NATIVE_AUDIO_BUF_POOL_H
+#define NATIVE_AUDIO_BUF_POOL_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+#include "buf_manager.h"
+
+/*
+ * Who holds a pool buffer. Buffers go around
+ *   Free -> RecordDevice -> Recorded -> PlayDevice -> Free
+ * and on stop fall back from RecordDevice / Recorded to Free.
+ */
+enum class BufOwner : uint32_t {
+  Free = 0,      // free queue
+  RecordDevice,  // recorder device shadow queue
+  Recorded,      // rec queue, waiting to be played
+  PlayDevice,    // player device shadow queue
+};
+#define BUF_OWNER_COUNT 4
+
+/**
+ * All sample buffers of the engine, carved out of one arena:
+ *   - each buffer starts on a cache line ( CACHE_ALIGN )
+ *   - the arena is mmap()ed, optionally from huge pages and mlock()ed, and
+ *     prefaulted, so callbacks never take a page fault on a buffer
+ *   - every buffer carries its owner; transfer() moves it to the next
+ *     owner, and dbgCheckOwners() compares the per owner counts with the
+ *     queues to find buffers that fell between them
+ */
+class SampleBufPool {
+ public:
+  static constexpr uint32_t kHugePages = 1;   // try MAP_HUGETLB first
+  static constexpr uint32_t kLockMemory = 2;  // mlock() the arena
+
+  explicit SampleBufPool(uint32_t count, uint32_t sizeInByte, uint32_t flags);
+  ~SampleBufPool();
+
+  sample_buf *getBufs(void) { return bufs_; }
+  uint32_t getBufCount(void) const { return count_; }
+
+  void transfer(sample_buf *buf, BufOwner to);
+  uint32_t getOwnerCount(BufOwner owner) const;
+  uint32_t dbgCheckOwners(const uint32_t *found);
+
+ private:
+  uint8_t *arena_;
+  size_t arenaSize_;
+  bool locked_;
+  sample_buf *bufs_;
+  uint32_t count_;
+  std::atomic<uint32_t> owners_[BUF_OWNER_COUNT];
+  std::atomic<uint32_t> badTransfers_;
+};
+
+/*
+ * Hand a buffer to its next owner; buffers not from a pool ( like the
+ * player's silent buffer ) are not tracked.
+ */
+__inline__ void SetBufOwner(sample_buf *buf, BufOwner to) {
+  if (buf->pool_) {
+    buf->pool_->transfer(buf, to);
+  }
+}
+
+#endif  // NATIVE_AUDIO_BUF_POOL_H
@@ -15,76 +15,236 @@
  */
 #include "debug_utils.h"
 
-#include <inttypes.h>
+#include <fcntl.h>
 #include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
 
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
 #include <cstdio>
+#include <cstring>
+#include <mutex>
+#include <thread>
+#include <vector>
 
 #include "android_debug.h"
 
 static const char* FILE_PREFIX = "/sdcard/data/audio";
+// how often the writer thread empties the rings
+static const int kDrainPeriodMs = 50;
 
-volatile uint32_t AndroidLog::fileIdx_ = 0;
-AndroidLog::AndroidLog() : fp_(NULL), prevTick_(static_cast<uint64_t>(0)) {
+/*
+ * The background thread writing every AndroidLog to its file. It only runs
+ * while there is at least one log.
+ */
+class AndroidLogWriter {
+ public:
+  static AndroidLogWriter& instance() {
+    static AndroidLogWriter writer;
+    return writer;
+  }
+
+  void add(AndroidLog* log) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    logs_.push_back(log);
+    if (!thread_.joinable()) {
+      quit_ = false;
+      thread_ = std::thread(&AndroidLogWriter::run, this);
+    }
+  }
+
+  void remove(AndroidLog* log) {
+    std::thread stopped;
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      log->drain();
+      logs_.erase(std::remove(logs_.begin(), logs_.end(), log), logs_.end());
+      if (logs_.empty() && thread_.joinable()) {
+        quit_ = true;
+        stopped = std::move(thread_);
+      }
+    }
+    wake_.notify_one();
+    if (stopped.joinable()) {
+      stopped.join();
+    }
+  }
+
+  void flush(AndroidLog* log) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    log->drain();
+  }
+
+ private:
+  AndroidLogWriter() : quit_(false) {}
+
+  void run() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (!quit_) {
+      for (AndroidLog* log : logs_) {
+        log->drain();
+      }
+      wake_.wait_for(lock, std::chrono::milliseconds(kDrainPeriodMs));
+    }
+  }
+
+  std::mutex mutex_;
+  std::condition_variable wake_;
+  std::vector<AndroidLog*> logs_;
+  std::thread thread_;
+  bool quit_;
+};
+
+std::atomic<uint32_t> AndroidLog::fileIdx_(0);
+AndroidLog::AndroidLog()
+    : records_(kRecordCount),
+      dropped_(0),
+      resetTick_(false),
+      seq_(0),
+      prevTick_(static_cast<uint64_t>(0)),
+      fd_(-1) {
   fileName_ = FILE_PREFIX;
   openFile();
+  AndroidLogWriter::instance().add(this);
 }
 
 AndroidLog::AndroidLog(std::string& file_name)
-    : fp_(NULL), prevTick_(static_cast<uint64_t>(0)) {
+    : records_(kRecordCount),
+      dropped_(0),
+      resetTick_(false),
+      seq_(0),
+      prevTick_(static_cast<uint64_t>(0)),
+      fd_(-1) {
   fileName_ = std::string(FILE_PREFIX) + std::string("_") + file_name;
   openFile();
+  AndroidLogWriter::instance().add(this);
 }
 
-AndroidLog::~AndroidLog() { flush(); }
+AndroidLog::~AndroidLog() {
+  AndroidLogWriter::instance().remove(this);
+  if (fd_ >= 0) {
+    close(fd_);
+  }
+}
 
+/*
+ * Write out everything logged so far; not for the audio thread.
+ */
 void AndroidLog::flush() {
-  if (fp_) {
-    fflush(fp_);
-    fclose(fp_);
-    fp_ = NULL;
+  AndroidLogWriter::instance().flush(this);
+  uint32_t dropped = dropped_.exchange(0, std::memory_order_relaxed);
+  if (dropped) {
+    LOGW("%s: dropped %d log records, ring full", fileName_.c_str(), dropped);
   }
-  prevTick_ = static_cast<uint64_t>(0);
+  // prevTick_ belongs to the producer: it drops it on its next logTime()
+  resetTick_.store(true, std::memory_order_relaxed);
 }
 
+void AndroidLog::push(AudioLogRecordType type, const void* payload,
+                      uint32_t size) {
+  uint32_t seq = seq_++;
+  AudioLogRecord* record = records_.getWriteablePtr();
+  if (!record) {
+    dropped_.fetch_add(1, std::memory_order_relaxed);
+    return;
+  }
+  record->timeNs_ = getCurrentTicks();
+  record->seq_ = seq;
+  record->type_ = type;
+  record->size_ = static_cast<uint16_t>(size);
+  memcpy(record->payload_, payload, size);
+  records_.commitWriteablePtr(record);
+}
+
+/*
+ * Raw data is cut into as many records as needed
+ */
 void AndroidLog::log(void* buf, uint32_t size) {
-  Lock fileLock(&mutex_);
   if (!buf || !size) return;
 
-  if (fp_ || openFile()) {
-    fwrite(buf, size, 1, fp_);
+  const uint8_t* data = static_cast<const uint8_t*>(buf);
+  while (size) {
+    uint32_t chunk =
+        std::min(size, static_cast<uint32_t>(AUDIO_LOG_PAYLOAD_SIZE));
+    push(AUDIO_LOG_RECORD_DATA, data, chunk);
+    data += chunk;
+    size -= chunk;
   }
 }
 
+/*
+ * Formatted on the calling thread into one record, longer text is cut at
+ * AUDIO_LOG_PAYLOAD_SIZE characters.
+ */
 void AndroidLog::log(const char* fmt, ...) {
-  Lock fileLock(&mutex_);
   if (!fmt) {
     return;
   }
-  if (fp_ || openFile()) {
-    va_list vp;
-    va_start(vp, fmt);
-    vfprintf(fp_, fmt, vp);
-    va_end(vp);
-  }
+  char text[AUDIO_LOG_PAYLOAD_SIZE + 1];
+  va_list vp;
+  va_start(vp, fmt);
+  int len = vsnprintf(text, sizeof(text), fmt, vp);
+  va_end(vp);
+  if (len < 0) return;
+  push(AUDIO_LOG_RECORD_TEXT, text,
+       std::min(static_cast<uint32_t>(len),
+                static_cast<uint32_t>(AUDIO_LOG_PAYLOAD_SIZE)));
 }
 
-FILE* AndroidLog::openFile() {
-  Lock fileLock(&mutex_);
-
-  if (fp_) {
-    return fp_;
+bool AndroidLog::openFile() {
+  if (fd_ >= 0) {
+    return true;
   }
 
   char fileName[64];
-  sprintf(fileName, "%s_%d", fileName_.c_str(), AndroidLog::fileIdx_++);
-  fp_ = fopen(fileName, "wb");
-  if (fp_ == NULL) {
+  snprintf(fileName, sizeof(fileName), "%s_%d", fileName_.c_str(),
+           AndroidLog::fileIdx_++);
+  fd_ = open(fileName, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  if (fd_ < 0) {
     LOGE("====failed to open file %s", fileName);
+    return false;
   }
-  return fp_;
+  AudioLogHeader header = {AUDIO_LOG_MAGIC, AUDIO_LOG_VERSION,
+                           sizeof(AudioLogRecord), 0};
+  if (write(fd_, &header, sizeof(header)) != sizeof(header)) {
+    LOGE("====failed to write file %s", fileName);
+  }
+  return true;
 }
+
+/*
+ * Consumer side of records_: append every queued record to the file, one
+ * write() per contiguous run of the ring.
+ */
+void AndroidLog::drain() {
+  AudioLogRecord* records;
+  uint32_t count;
+  while ((count = records_.getReadableSpan(&records, kRecordCount)) > 0) {
+    if (fd_ >= 0) {
+      const uint8_t* data = reinterpret_cast<const uint8_t*>(records);
+      size_t remaining = count * sizeof(AudioLogRecord);
+      while (remaining) {
+        ssize_t written = write(fd_, data, remaining);
+        if (written <= 0) {
+          LOGE("====failed to write %s", fileName_.c_str());
+          break;
+        }
+        data += written;
+        remaining -= written;
+      }
+    }
+    records_.consume(count);
+  }
+}
+
 void AndroidLog::logTime() {
+  // load first: no read-modify-write on the usual call
+  if (resetTick_.load(std::memory_order_relaxed) &&
+      resetTick_.exchange(false, std::memory_order_relaxed)) {
+    prevTick_ = static_cast<uint64_t>(0);
+  }
   if (prevTick_ == static_cast<uint64_t>(0)) {
     /*
      * initVoxelResources counter, bypass the first one
@@ -94,13 +254,13 @@ void AndroidLog::logTime() {
   }
   uint64_t curTick = getCurrentTicks();
   uint64_t delta = curTick - prevTick_;
-  log("%" PRIu64 "    %" PRIu64 "\n", curTick, delta);
+  push(AUDIO_LOG_RECORD_TIME, &delta, sizeof(delta));
   prevTick_ = curTick;
 }
 
 uint64_t AndroidLog::getCurrentTicks() {
-  struct timeval Time;
-  gettimeofday(&Time, NULL);
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
 
-  return (static_cast<uint64_t>(1000000) * Time.tv_sec + Time.tv_usec);
-}
\ No newline at end of file
+  return (static_cast<uint64_t>(1000000000) * ts.tv_sec + ts.tv_nsec);
+}
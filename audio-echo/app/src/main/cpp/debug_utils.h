@@ -15,29 +15,26 @@
  */
 #ifndef NATIVE_AUDIO_DEBUG_UTILS_H
 #define NATIVE_AUDIO_DEBUG_UTILS_H
-#include <cstdio>
-#include <mutex>
+#include <atomic>
+#include <cstdarg>
+#include <cstdint>
 #include <string>
 
-/*
- * debug_write_file()
- *  Write given data to a file as binary file. File name is
- *     "/sdcard/data/audio_%d", file_index++
- *  requirement: must have /sdcard/data already created on android device
- */
-class Lock {
- public:
-  explicit Lock(std::recursive_mutex* mtx) {
-    mutex_ = mtx;
-    mutex_->lock();
-  }
-  ~Lock() { mutex_->unlock(); }
+#include "audio_log_record.h"
+#include "buf_manager.h"
 
- private:
-  std::recursive_mutex* mutex_;
-};
+/**
+ * Binary log for the audio threads. Every log is written by one thread:
+ *   - log() / logTime() fill a fixed-size AudioLogRecord in a wait-free
+ *     ring, no lock, no allocation, no I/O; a full ring drops the record
+ *   - one background thread drains all the logs and appends the records
+ *     to their files in large write()s
+ * Decode the files on the host with audio-echo/tools/audio_log_decode.cpp.
+ */
 class AndroidLog {
  public:
+  static constexpr int kRecordCount = 1024;  // ring size, power of 2
+
   AndroidLog();
   AndroidLog(std::string& fileName);
   ~AndroidLog();
@@ -45,17 +42,23 @@ class AndroidLog {
   void log(const char* fmt, ...);
   void logTime();
   void flush();
-  static volatile uint32_t fileIdx_;
+  static std::atomic<uint32_t> fileIdx_;
 
  private:
+  friend class AndroidLogWriter;
+
   uint64_t getCurrentTicks();
-  FILE* fp_;
-  FILE* openFile();
-  uint64_t prevTick_;  // Tick in milisecond
-  std::recursive_mutex mutex_;
+  bool openFile();
+  void push(AudioLogRecordType type, const void* payload, uint32_t size);
+  void drain();  // writer thread, or flush() with the writer locked
+
+  ProducerConsumerQueue<AudioLogRecord> records_;
+  std::atomic<uint32_t> dropped_;
+  std::atomic<bool> resetTick_;  // set by flush(), logTime() restarts
+  uint32_t seq_;                 // producer only
+  uint64_t prevTick_;            // producer only, tick in nano second
+  int fd_;
   std::string fileName_;
 };
 
-void debug_write_file(void* buf, uint32_t size);
-
 #endif  // NATIVE_AUDIO_DEBUG_UTILS_H
@@ -43,6 +43,20 @@ JNIEXPORT void JNICALL
 Java_com_google_sample_echo_MainActivity_startPlay(JNIEnv *env, jclass type);
 JNIEXPORT void JNICALL
 Java_com_google_sample_echo_MainActivity_stopPlay(JNIEnv *env, jclass type);
+JNIEXPORT void JNICALL
+Java_com_google_sample_echo_MainActivity_dumpAudioTrace(JNIEnv *env,
+                                                        jclass type);
+JNIEXPORT jboolean JNICALL
+Java_com_google_sample_echo_MainActivity_startWakeupProbe(JNIEnv *env,
+                                                          jclass type,
+                                                          jint seconds);
+JNIEXPORT jboolean JNICALL
+Java_com_google_sample_echo_MainActivity_startAudioCapture(
+    JNIEnv *env, jclass type, jstring directory, jint fileSeconds,
+    jint maxFiles);
+JNIEXPORT void JNICALL
+Java_com_google_sample_echo_MainActivity_stopAudioCapture(JNIEnv *env,
+                                                          jclass type);
 JNIEXPORT jboolean JNICALL
 Java_com_google_sample_echo_MainActivity_configureEcho(JNIEnv *env, jclass type,
                                                        jint delayInMs,
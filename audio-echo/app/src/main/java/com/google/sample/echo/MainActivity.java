@@ -301,4 +301,9 @@ public class MainActivity extends Activity
     static native void deleteAudioRecorder();
     static native void startPlay();
     static native void stopPlay();
+    static native void dumpAudioTrace();
+    static native boolean startWakeupProbe(int seconds);
+    static native boolean startAudioCapture(String directory, int fileSeconds,
+                                            int maxFiles);
+    static native void stopAudioCapture();
 }
@@ -0,0 +1,442 @@
+/*
+ * Copyright 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Offline host harness for AudioEchoCanceller: runs a mic recording and
+ * the reference played at the same time through it, buffer by buffer as
+ * EngineService does, and reports the echo return loss enhancement ( ERLE )
+ * and the cost per frame.
+ *   build: mkdir -p inc && ln -sf $NDK/sysroot/usr/include/SLES inc/SLES
+ *          SRC=../../app/src/main/cpp
+ *          c++ -std=c++17 -O2 -I. -Iinc -I$SRC aec_harness.cpp \
+ *              $SRC/audio_echo_canceller.cpp $SRC/audio_fft.cpp \
+ *              $SRC/audio_effect_simd.cpp $SRC/audio_format_convert.cpp \
+ *              -o aec_harness
+ *   usage: ./aec_harness mic.wav ref.wav [out.wav] [options]
+ *          ./aec_harness --synth [out.wav] [options]
+ *   options: --tail-ms 128   echo canceller tail
+ *            --frames 192    frames per buffer
+ *            --lead-ms 20    how much earlier the reference is queued
+ *                            than it is played ( device queue + latency )
+ *            --seconds 10 --rate 48000 --delay-ms 3 --double-talk --float
+ *                            ( --synth only )
+ * Wav files are 16 bit PCM or 32 bit float, mono or stereo; the echo
+ * canceller runs in the mic file's format. --synth makes up the far end
+ * ( noise bursts ), a decaying echo path and, with --double-talk, a near
+ * end talker, so the ERLE of the echo alone can be printed too.
+ */
+#include <algorithm>
+#include <cinttypes>
+#include <cmath>
+#include <cstdarg>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <random>
+#include <string>
+#include <vector>
+
+#if defined(__i386__) || defined(__x86_64__)
+#include <x86intrin.h>
+#define HARNESS_HAVE_RDTSC
+#endif
+
+#include "audio_echo_canceller.h"
+#include "audio_format_convert.h"
+
+static bool verbose = false;
+
+extern "C" int __android_log_print(int prio, const char *tag, const char *fmt,
+                                   ...) {
+  if (!verbose) return 0;
+  va_list args;
+  va_start(args, fmt);
+  fprintf(stderr, "%s: ", tag);
+  int count = vfprintf(stderr, fmt, args);
+  fputc('\n', stderr);
+  va_end(args);
+  return count;
+}
+
+struct WavData {
+  uint32_t sampleRate_;
+  uint32_t channels_;
+  bool float_;
+  std::vector<float> samples_;  // interleaved, full scale
+
+  uint32_t frames(void) const {
+    return static_cast<uint32_t>(samples_.size() / channels_);
+  }
+};
+
+static uint32_t ReadLE(const uint8_t *p, int bytes) {
+  uint32_t value = 0;
+  for (int idx = bytes - 1; idx >= 0; idx--) value = (value << 8) | p[idx];
+  return value;
+}
+
+static bool ReadWav(const char *path, WavData *wav) {
+  FILE *file = fopen(path, "rb");
+  if (!file) {
+    fprintf(stderr, "%s: cannot open\n", path);
+    return false;
+  }
+  std::vector<uint8_t> data;
+  uint8_t chunk[4096];
+  size_t count;
+  while ((count = fread(chunk, 1, sizeof(chunk), file)) > 0) {
+    data.insert(data.end(), chunk, chunk + count);
+  }
+  fclose(file);
+
+  if (data.size() < 12 || memcmp(&data[0], "RIFF", 4) ||
+      memcmp(&data[8], "WAVE", 4)) {
+    fprintf(stderr, "%s: not a wav file\n", path);
+    return false;
+  }
+  uint32_t format = 0, bits = 0;
+  wav->channels_ = 0;
+  for (size_t pos = 12; pos + 8 <= data.size();) {
+    uint32_t size = ReadLE(&data[pos + 4], 4);
+    const uint8_t *body = &data[pos + 8];
+    size = static_cast<uint32_t>(std::min<size_t>(size, data.size() - pos - 8));
+    if (!memcmp(&data[pos], "fmt ", 4) && size >= 16) {
+      format = ReadLE(body, 2);
+      if (format == 0xFFFE && size >= 26) format = ReadLE(body + 24, 2);
+      wav->channels_ = ReadLE(body + 2, 2);
+      wav->sampleRate_ = ReadLE(body + 4, 4);
+      bits = ReadLE(body + 14, 2);
+    } else if (!memcmp(&data[pos], "data", 4)) {
+      bool pcm16 = format == 1 && bits == 16;
+      bool float32 = format == 3 && bits == 32;
+      if ((!pcm16 && !float32) || wav->channels_ < 1 || wav->channels_ > 2) {
+        fprintf(stderr, "%s: only 16 bit PCM or float, mono or stereo\n",
+                path);
+        return false;
+      }
+      wav->float_ = float32;
+      uint32_t samples = size / (bits / 8);
+      wav->samples_.resize(samples);
+      for (uint32_t idx = 0; idx < samples; idx++) {
+        if (float32) {
+          memcpy(&wav->samples_[idx], body + idx * 4, 4);
+        } else {
+          int16_t value = static_cast<int16_t>(ReadLE(body + idx * 2, 2));
+          wav->samples_[idx] = value / 32768.0f;
+        }
+      }
+      return true;
+    }
+    pos += 8 + size + (size & 1);
+  }
+  fprintf(stderr, "%s: no audio found\n", path);
+  return false;
+}
+
+static void WriteLE(FILE *file, uint32_t value, int bytes) {
+  for (int idx = 0; idx < bytes; idx++) {
+    fputc((value >> (8 * idx)) & 0xFF, file);
+  }
+}
+
+static bool WriteWav(const char *path, const WavData &wav) {
+  FILE *file = fopen(path, "wb");
+  if (!file) {
+    fprintf(stderr, "%s: cannot create\n", path);
+    return false;
+  }
+  uint32_t bytes = wav.float_ ? 4 : 2;
+  uint32_t size = static_cast<uint32_t>(wav.samples_.size()) * bytes;
+  fwrite("RIFF", 1, 4, file);
+  WriteLE(file, 36 + size, 4);
+  fwrite("WAVEfmt ", 1, 8, file);
+  WriteLE(file, 16, 4);
+  WriteLE(file, wav.float_ ? 3 : 1, 2);
+  WriteLE(file, wav.channels_, 2);
+  WriteLE(file, wav.sampleRate_, 4);
+  WriteLE(file, wav.sampleRate_ * wav.channels_ * bytes, 4);
+  WriteLE(file, wav.channels_ * bytes, 2);
+  WriteLE(file, bytes * 8, 2);
+  fwrite("data", 1, 4, file);
+  WriteLE(file, size, 4);
+  for (float sample : wav.samples_) {
+    if (wav.float_) {
+      fwrite(&sample, 4, 1, file);
+    } else {
+      float value = fminf(fmaxf(sample * 32768.0f, -32768.0f), 32767.0f);
+      WriteLE(file, static_cast<uint16_t>(static_cast<int16_t>(lrintf(value))),
+              2);
+    }
+  }
+  bool ok = !ferror(file);
+  fclose(file);
+  return ok;
+}
+
+/*
+ * Far end: low passed noise in 1.5 s bursts, 0.5 s pauses. Echo path: a
+ * bulk delay then 60 ms of exponentially decaying random taps, -6 dB
+ * overall. Near end ( --double-talk ): another noise burst, 6 s -- 7.5 s.
+ */
+static void Synthesize(uint32_t sampleRate, uint32_t seconds, uint32_t delayMs,
+                       bool doubleTalk, WavData *mic, WavData *ref,
+                       std::vector<float> *near) {
+  std::mt19937 rng(1);
+  std::normal_distribution<float> noise(0.0f, 1.0f);
+  uint32_t frames = sampleRate * seconds;
+
+  ref->samples_.assign(frames, 0.0f);
+  float lowpass = 0.0f;
+  for (uint32_t n = 0; n < frames; n++) {
+    lowpass += 0.3f * (noise(rng) - lowpass);
+    bool on = (n % (2 * sampleRate)) < sampleRate * 3 / 2;
+    ref->samples_[n] = on ? 0.3f * lowpass : 0.0f;
+  }
+
+  uint32_t delay = sampleRate * delayMs / 1000;
+  uint32_t taps = sampleRate * 60 / 1000;
+  std::vector<float> path(delay + taps, 0.0f);
+  float energy = 0.0f;
+  for (uint32_t idx = 0; idx < taps; idx++) {
+    float decay = -static_cast<float>(idx) / (sampleRate / 100);
+    float tap = noise(rng) * expf(decay);
+    path[delay + idx] = tap;
+    energy += tap * tap;
+  }
+  float gain = 0.5f / sqrtf(energy);
+  for (float &tap : path) tap *= gain;
+
+  near->assign(frames, 0.0f);
+  for (uint32_t n = 0; n < frames; n++) {
+    (*near)[n] = 1e-4f * noise(rng);
+    if (doubleTalk && n >= sampleRate * 6 && n < sampleRate * 15 / 2) {
+      (*near)[n] += 0.1f * noise(rng);
+    }
+  }
+  mic->samples_ = *near;
+  for (uint32_t n = 0; n < frames; n++) {
+    float value = ref->samples_[n];
+    if (value == 0.0f) continue;
+    uint32_t end = std::min<uint32_t>(frames, n + path.size());
+    for (uint32_t m = n + delay; m < end; m++) {
+      mic->samples_[m] += value * path[m - n];
+    }
+  }
+}
+
+static inline uint64_t ReadCycles(void) {
+#ifdef HARNESS_HAVE_RDTSC
+  return __rdtsc();
+#else
+  timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return static_cast<uint64_t>(now.tv_sec) * 1000000000 + now.tv_nsec;
+#endif
+}
+
+static inline double Db(double num, double den) {
+  return den > 0.0 ? 10.0 * log10(num / den) : 0.0;
+}
+
+static void PackBuffer(const float *samples, uint32_t count, bool isFloat,
+                       std::vector<uint8_t> *buf) {
+  buf->resize(count * (isFloat ? 4 : 2));
+  ConvertSamples(samples, SampleEncoding::Float32, buf->data(),
+                 isFloat ? SampleEncoding::Float32 : SampleEncoding::Int16,
+                 static_cast<int32_t>(count), nullptr);
+}
+
+int main(int argc, char *argv[]) {
+  std::vector<const char *> files;
+  bool synth = false, doubleTalk = false, useFloat = false;
+  uint32_t tailMs = AudioEchoCanceller::kDefaultTailMs;
+  uint32_t framesPerBuf = 192, leadMs = 20, seconds = 10, sampleRate = 48000;
+  uint32_t delayMs = 3;
+  for (int idx = 1; idx < argc; idx++) {
+    const char *arg = argv[idx];
+    if (!strcmp(arg, "--synth")) {
+      synth = true;
+    } else if (!strcmp(arg, "--double-talk")) {
+      doubleTalk = true;
+    } else if (!strcmp(arg, "--float")) {
+      useFloat = true;
+    } else if (!strcmp(arg, "--verbose")) {
+      verbose = true;
+    } else if (!strncmp(arg, "--", 2)) {
+      if (idx + 1 == argc) {
+        fprintf(stderr, "%s: missing value\n", arg);
+        return 2;
+      }
+      uint32_t value = static_cast<uint32_t>(strtoul(argv[++idx], nullptr, 0));
+      if (!strcmp(arg, "--tail-ms")) {
+        tailMs = value;
+      } else if (!strcmp(arg, "--frames")) {
+        framesPerBuf = value;
+      } else if (!strcmp(arg, "--lead-ms")) {
+        leadMs = value;
+      } else if (!strcmp(arg, "--seconds")) {
+        seconds = value;
+      } else if (!strcmp(arg, "--rate")) {
+        sampleRate = value;
+      } else if (!strcmp(arg, "--delay-ms")) {
+        delayMs = value;
+      } else {
+        fprintf(stderr, "unknown option %s\n", arg);
+        return 2;
+      }
+    } else {
+      files.push_back(arg);
+    }
+  }
+  if (files.size() > (synth ? 1u : 3u) || (!synth && files.size() < 2) ||
+      !framesPerBuf || !sampleRate || !seconds) {
+    fprintf(stderr, "usage: %s mic.wav ref.wav [out.wav] [options]\n"
+                    "       %s --synth [out.wav] [options]\n",
+            argv[0], argv[0]);
+    return 2;
+  }
+
+  WavData mic, ref;
+  std::vector<float> near;
+  const char *outPath = nullptr;
+  if (synth) {
+    mic.sampleRate_ = ref.sampleRate_ = sampleRate;
+    mic.channels_ = ref.channels_ = 1;
+    mic.float_ = ref.float_ = useFloat;
+    Synthesize(sampleRate, seconds, delayMs, doubleTalk, &mic, &ref, &near);
+    if (!files.empty()) outPath = files[0];
+  } else {
+    if (!ReadWav(files[0], &mic) || !ReadWav(files[1], &ref)) return 1;
+    if (mic.sampleRate_ != ref.sampleRate_) {
+      fprintf(stderr, "mic and reference sample rates differ\n");
+      return 1;
+    }
+    if (files.size() > 2) outPath = files[2];
+  }
+
+  // the player queues the reference in the mic's format, as in audio_main
+  uint32_t channels = mic.channels_;
+  uint32_t frames = mic.frames();
+  std::vector<float> refSamples(static_cast<size_t>(frames) * channels, 0.0f);
+  for (uint32_t n = 0; n < std::min(frames, ref.frames()); n++) {
+    for (uint32_t ch = 0; ch < channels; ch++) {
+      refSamples[n * channels + ch] =
+          ref.samples_[n * ref.channels_ + std::min(ch, ref.channels_ - 1)];
+    }
+  }
+
+  AudioEchoCanceller aec(
+      static_cast<int32_t>(mic.sampleRate_ * 1000), channels,
+      mic.float_ ? SL_PCMSAMPLEFORMAT_FIXED_32 : SL_PCMSAMPLEFORMAT_FIXED_16,
+      tailMs);
+  uint32_t lag = aec.getLatencyFrames();
+  uint32_t lead = mic.sampleRate_ * leadMs / 1000;
+
+  std::vector<float> out(mic.samples_.size(), 0.0f);
+  std::vector<uint8_t> buf;
+  uint64_t cycles = 0;
+  uint32_t refPos = 0;
+  auto pushRef = [&](uint32_t end) {
+    end = std::min(end, frames);
+    while (refPos < end) {
+      uint32_t count = std::min(framesPerBuf, end - refPos);
+      PackBuffer(&refSamples[refPos * channels], count * channels, mic.float_,
+                 &buf);
+      aec.pushReference(buf.data(), count);
+      refPos += count;
+    }
+  };
+  pushRef(lead);
+  for (uint32_t pos = 0; pos < frames; pos += framesPerBuf) {
+    uint32_t count = std::min(framesPerBuf, frames - pos);
+    pushRef(pos + count + lead);
+    PackBuffer(&mic.samples_[pos * channels], count * channels, mic.float_,
+               &buf);
+    uint64_t start = ReadCycles();
+    aec.process(buf.data(), count);
+    cycles += ReadCycles() - start;
+    for (uint32_t idx = 0; idx < count * channels; idx++) {
+      out[pos * channels + idx] = mic.float_
+                                      ? Float32Sample::read(buf.data(), idx)
+                                      : Int16Sample::read(buf.data(), idx);
+    }
+  }
+
+  // per second: mic power over output power, the output moved back by lag;
+  // with --synth also the echo alone: the echo over what is left of it
+  printf("%u Hz, %u channel(s), %s, %u frames per buffer, tail %u ms, "
+         "reference lead %u ms\n",
+         mic.sampleRate_, channels, mic.float_ ? "float" : "16 bit",
+         framesPerBuf, tailMs, leadMs);
+  printf("second   mic dBFS   ERLE dB%s\n", synth ? "   echo ERLE dB" : "");
+  double micTotal = 0.0, outTotal = 0.0, echoTotal = 0.0, residueTotal = 0.0;
+  for (uint32_t first = 0; first + lag < frames; first += mic.sampleRate_) {
+    uint32_t last = std::min(first + mic.sampleRate_, frames - lag);
+    double micPower = 0.0, outPower = 0.0, echo = 0.0, residue = 0.0;
+    for (uint32_t n = first; n < last; n++) {
+      for (uint32_t ch = 0; ch < channels; ch++) {
+        float in = mic.samples_[n * channels + ch];
+        float cleaned = out[(n + lag) * channels + ch];
+        micPower += in * in;
+        outPower += cleaned * cleaned;
+        if (synth) {
+          echo += (in - near[n]) * (in - near[n]);
+          residue += (cleaned - near[n]) * (cleaned - near[n]);
+        }
+      }
+    }
+    printf("%6u %10.1f %9.1f", first / mic.sampleRate_,
+           Db(micPower / ((last - first) * channels), 1.0),
+           Db(micPower, outPower));
+    if (synth) printf(" %16.1f", Db(echo, residue));
+    printf("\n");
+    // the first two seconds are convergence
+    if (first >= 2 * mic.sampleRate_) {
+      micTotal += micPower;
+      outTotal += outPower;
+      echoTotal += echo;
+      residueTotal += residue;
+    }
+  }
+  if (micTotal > 0.0) {
+    printf("after 2 s: ERLE %.1f dB", Db(micTotal, outTotal));
+    if (synth) printf(", echo ERLE %.1f dB", Db(echoTotal, residueTotal));
+    printf("\n");
+  }
+
+  AudioEchoCancellerStats stats;
+  aec.getStats(&stats);
+  printf("echo canceller: ERLE=%.1f dB, blocks=%u, adapted=%u, double talk=%u,"
+         " resets=%u, realigns=%u, ref underruns=%u\n",
+         stats.erleDb_, stats.blocks_, stats.adaptedBlocks_,
+         stats.doubleTalkBlocks_, stats.resets_, stats.realigns_,
+         stats.refUnderruns_);
+#ifdef HARNESS_HAVE_RDTSC
+  printf("cost: %.1f cycles per frame ( %s kernels )\n",
+         static_cast<double>(cycles) / frames, GetSpectrumKernels().name_);
+#else
+  printf("cost: %.1f ns per frame ( %s kernels )\n",
+         static_cast<double>(cycles) / frames, GetSpectrumKernels().name_);
+#endif
+
+  if (outPath) {
+    WavData cleaned = mic;
+    cleaned.samples_ = out;
+    if (!WriteWav(outPath, cleaned)) return 1;
+  }
+  return 0;
+}
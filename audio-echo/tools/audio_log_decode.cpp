@@ -0,0 +1,120 @@
+/*
+ * Copyright 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Host tool turning an audio-echo binary log ( ENABLE_LOG ) into text/CSV.
+ *   build: c++ -std=c++11 -I../app/src/main/cpp audio_log_decode.cpp \
+ *              -o audio_log_decode
+ *   usage: adb pull /sdcard/data/audio_play_0
+ *          ./audio_log_decode [--csv] audio_play_0
+ */
+#include <cinttypes>
+#include <cstdio>
+#include <cstring>
+
+#include "audio_log_record.h"
+
+static void PrintPayload(const AudioLogRecord &record, bool csv) {
+  uint32_t size = record.size_;
+  if (size > AUDIO_LOG_PAYLOAD_SIZE) size = AUDIO_LOG_PAYLOAD_SIZE;
+
+  switch (record.type_) {
+    case AUDIO_LOG_RECORD_TIME: {
+      uint64_t delta = 0;
+      memcpy(&delta, record.payload_, sizeof(delta));
+      printf(csv ? "time,%" PRIu64 : "delta %" PRIu64 " us", delta / 1000);
+      break;
+    }
+    case AUDIO_LOG_RECORD_TEXT:
+      // quotes are doubled for CSV
+      fputs(csv ? "text,\"" : "", stdout);
+      for (uint32_t idx = 0; idx < size; idx++) {
+        char c = static_cast<char>(record.payload_[idx]);
+        if (csv && c == '"') putchar('"');
+        putchar(c == '\n' ? ' ' : c);
+      }
+      fputs(csv ? "\"" : "", stdout);
+      break;
+    case AUDIO_LOG_RECORD_DATA:
+      printf(csv ? "data," : "data ");
+      for (uint32_t idx = 0; idx < size; idx++) {
+        printf("%02x", record.payload_[idx]);
+      }
+      break;
+    default:
+      printf(csv ? "unknown," : "unknown record type %d", record.type_);
+      break;
+  }
+}
+
+int main(int argc, char *argv[]) {
+  bool csv = false;
+  const char *fileName = nullptr;
+  for (int idx = 1; idx < argc; idx++) {
+    if (!strcmp(argv[idx], "--csv")) {
+      csv = true;
+    } else {
+      fileName = argv[idx];
+    }
+  }
+  if (!fileName) {
+    fprintf(stderr, "usage: %s [--csv] <log file>\n", argv[0]);
+    return 1;
+  }
+
+  FILE *fp = fopen(fileName, "rb");
+  if (!fp) {
+    fprintf(stderr, "cannot open %s\n", fileName);
+    return 1;
+  }
+  AudioLogHeader header;
+  if (fread(&header, sizeof(header), 1, fp) != 1 ||
+      header.magic_ != AUDIO_LOG_MAGIC ||
+      header.version_ != AUDIO_LOG_VERSION ||
+      header.recordSize_ != sizeof(AudioLogRecord)) {
+    fprintf(stderr, "%s is not an audio-echo log\n", fileName);
+    fclose(fp);
+    return 1;
+  }
+
+  if (csv) {
+    printf("seq,time_ns,type,value\n");
+  }
+  AudioLogRecord record;
+  uint32_t expected = 0;
+  uint64_t dropped = 0;
+  while (fread(&record, sizeof(record), 1, fp) == 1) {
+    if (record.seq_ != expected) {
+      uint32_t gap = record.seq_ - expected;
+      dropped += gap;
+      if (!csv) {
+        printf("---- %u record(s) dropped\n", gap);
+      }
+    }
+    expected = record.seq_ + 1;
+
+    printf(csv ? "%u,%" PRIu64 "," : "%8u %16" PRIu64 " ", record.seq_,
+           record.timeNs_);
+    PrintPayload(record, csv);
+    putchar('\n');
+  }
+  fclose(fp);
+
+  if (dropped) {
+    fprintf(stderr, "%" PRIu64 " record(s) dropped while logging\n", dropped);
+  }
+  return 0;
+}
@@ -0,0 +1,264 @@
+/*
+ * Copyright 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Host check and benchmark of the AudioDelay mixing kernels: every vector
+ * kernel the CPU runs ( NEON, SSE2, AVX2 ) against DelayMixScalar().
+ *   build: SRC=../../app/src/main/cpp
+ *          c++ -std=c++17 -O2 -I$SRC delay_mix_bench.cpp \
+ *              $SRC/audio_effect_simd.cpp -o delay_mix_bench
+ *   usage: ./delay_mix_bench [--seconds 0.2]
+ * The check runs mono and stereo buffers of every size from 1 to 4096
+ * frames ( so every tail length ), with the delay line laid out the ways
+ * AudioDelay::mixSteady() calls it: the read position behind the write
+ * position by exactly the block or more, ahead of it ( after a wrap ), and
+ * both the same. Factors cover the decay weights 0.0 to 1.0 plus ones too
+ * big for 16 bits, samples include full scale. Every output sample and the
+ * guard samples around them must match the scalar kernel: exits with 1 if
+ * one does not. The benchmark then times each kernel on 32 to 4096 frame
+ * stereo buffers for --seconds each.
+ */
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <vector>
+
+#include "audio_effect_simd.h"
+
+static const char *const kKernelNames[] = {"neon", "sse2", "avx2"};
+static const int32_t kGuard = 16;
+static const int16_t kGuardValue = 0x5A5A;
+
+static uint32_t rngState = 1;
+
+static int16_t RandomSample(void) {
+  rngState = rngState * 1664525 + 1013904223;
+  switch (rngState >> 28) {
+    case 0:
+      return INT16_MIN;
+    case 1:
+      return INT16_MAX;
+    default:
+      return static_cast<int16_t>(rngState >> 12);
+  }
+}
+
+static inline uint64_t NowNs(void) {
+  timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return static_cast<uint64_t>(now.tv_sec) * 1000000000 + now.tv_nsec;
+}
+
+/*
+ * Where the read ( delayed ) samples sit relative to the write ( feedback )
+ * ones in the delay line, in samples
+ */
+enum class Layout { kSeparate, kBehindByCount, kBehindFar, kAhead, kSame };
+
+static const char *LayoutName(Layout layout) {
+  switch (layout) {
+    case Layout::kSeparate:
+      return "separate";
+    case Layout::kBehindByCount:
+      return "behind by count";
+    case Layout::kBehindFar:
+      return "behind far";
+    case Layout::kAhead:
+      return "ahead";
+    case Layout::kSame:
+      return "same";
+  }
+  return "?";
+}
+
+/*
+ * One kernel call on a fresh copy of the same line and live audio, against
+ * DelayMixScalar() on another; checks live, the whole line and the guards
+ */
+static bool CheckOnce(DelayMixKernel kernel, int32_t count, Layout layout,
+                      int32_t feedbackFactor, int32_t liveAudioFactor) {
+  // [ guard | line of 3 * count + 64 | guard ]
+  int32_t lineSize = 3 * count + 64;
+  std::vector<int16_t> line(lineSize + 2 * kGuard);
+  std::vector<int16_t> live(count + 2 * kGuard, kGuardValue);
+  for (int32_t idx = 0; idx < lineSize; idx++) {
+    line[kGuard + idx] = RandomSample();
+  }
+  for (int32_t idx = 0; idx < count; idx++) {
+    live[kGuard + idx] = RandomSample();
+  }
+  for (int32_t idx = 0; idx < kGuard; idx++) {
+    line[idx] = line[kGuard + lineSize + idx] = kGuardValue;
+  }
+
+  int32_t writeAt = count + 32, readAt = 0;
+  switch (layout) {
+    case Layout::kSeparate:
+      readAt = writeAt;  // into a copy of the line, below
+      break;
+    case Layout::kBehindByCount:
+      readAt = writeAt - count;
+      break;
+    case Layout::kBehindFar:
+      readAt = writeAt - count - 31;
+      break;
+    case Layout::kAhead:
+      readAt = writeAt + 1 + static_cast<int32_t>(rngState % 31);
+      break;
+    case Layout::kSame:
+      readAt = writeAt;
+      break;
+  }
+
+  std::vector<int16_t> refLine(line), refLive(live);
+  std::vector<int16_t> source(line);  // kSeparate reads from here
+  std::vector<int16_t> refSource(line);
+  int16_t *delayed = &(layout == Layout::kSeparate ? source : line)[kGuard];
+  int16_t *refDelayed =
+      &(layout == Layout::kSeparate ? refSource : refLine)[kGuard];
+
+  kernel(&live[kGuard], delayed + readAt, &line[kGuard + writeAt], count,
+         feedbackFactor, liveAudioFactor);
+  DelayMixScalar(&refLive[kGuard], refDelayed + readAt,
+                 &refLine[kGuard + writeAt], count, feedbackFactor,
+                 liveAudioFactor);
+
+  for (size_t idx = 0; idx < line.size(); idx++) {
+    if (line[idx] != refLine[idx]) {
+      printf("  %d samples, %s, factors %d/%d: line[%d] is %d, not %d\n",
+             count, LayoutName(layout), feedbackFactor, liveAudioFactor,
+             static_cast<int>(idx) - kGuard - writeAt, line[idx],
+             refLine[idx]);
+      return false;
+    }
+  }
+  for (size_t idx = 0; idx < live.size(); idx++) {
+    if (live[idx] != refLive[idx]) {
+      printf("  %d samples, %s, factors %d/%d: live[%d] is %d, not %d\n",
+             count, LayoutName(layout), feedbackFactor, liveAudioFactor,
+             static_cast<int>(idx) - kGuard, live[idx], refLive[idx]);
+      return false;
+    }
+  }
+  return true;
+}
+
+static bool CheckKernel(const char *name, DelayMixKernel kernel) {
+  // { feedback, live } as AudioDelay makes them from the decay weight, then
+  // out of the 16 bit range the vector kernels take
+  static const int32_t kFactors[][2] = {
+      {0, 128}, {1, 127}, {64, 64}, {89, 39}, {127, 1},
+      {128, 0}, {128, 128}, {-128, 255}, {40000, 3}, {3, -40000}};
+  static const Layout kLayouts[] = {Layout::kSeparate, Layout::kBehindByCount,
+                                    Layout::kBehindFar, Layout::kAhead,
+                                    Layout::kSame};
+  const uint32_t numFactors = sizeof(kFactors) / sizeof(kFactors[0]);
+  uint32_t checks = 0;
+  for (int32_t channels = 1; channels <= 2; channels++) {
+    for (int32_t frames = 1; frames <= 4096; frames++) {
+      // every size up to 256 frames, then enough of them for every tail
+      if (frames > 256 && frames % 61 != 0 && frames != 4096) continue;
+      for (Layout layout : kLayouts) {
+        const int32_t *factors = kFactors[checks % numFactors];
+        if (!CheckOnce(kernel, frames * channels, layout, factors[0],
+                       factors[1])) {
+          printf("%-6s FAILED\n", name);
+          return false;
+        }
+        checks++;
+      }
+    }
+  }
+  // every factor pair on the common sizes
+  for (const auto &factors : kFactors) {
+    for (int32_t count : {32, 64, 192, 384, 480, 960, 4096, 8192}) {
+      for (Layout layout : kLayouts) {
+        if (!CheckOnce(kernel, count, layout, factors[0], factors[1])) {
+          printf("%-6s FAILED\n", name);
+          return false;
+        }
+        checks++;
+      }
+    }
+  }
+  printf("%-6s ok, %u checks\n", name, checks);
+  return true;
+}
+
+/* ns per call of kernel on stereo buffers of frames, the best of 5 runs */
+static double TimeKernel(DelayMixKernel kernel, int32_t frames,
+                         double seconds) {
+  int32_t count = frames * 2;
+  std::vector<int16_t> line(4 * count), live(count);
+  for (int16_t &sample : line) sample = RandomSample();
+  for (int16_t &sample : live) sample = RandomSample();
+
+  double best = 1e30;
+  uint64_t runNs = static_cast<uint64_t>(seconds * 1e9 / 5);
+  for (int run = 0; run < 5; run++) {
+    uint64_t calls = 0, start = NowNs(), elapsed;
+    do {
+      for (int idx = 0; idx < 64; idx++) {
+        // the same layout as AudioDelay: read one block behind the write
+        kernel(live.data(), &line[count], &line[2 * count], count, 89, 39);
+      }
+      calls += 64;
+      elapsed = NowNs() - start;
+    } while (elapsed < runNs);
+    best = std::min(best, static_cast<double>(elapsed) / calls);
+  }
+  return best;
+}
+
+int main(int argc, char *argv[]) {
+  double seconds = 0.2;
+  if (argc == 3 && !strcmp(argv[1], "--seconds")) {
+    seconds = strtod(argv[2], nullptr);
+  } else if (argc != 1) {
+    fprintf(stderr, "usage: %s [--seconds 0.2]\n", argv[0]);
+    return 2;
+  }
+
+  printf("AudioDelay uses the %s kernel\n", GetDelayMixKernelName());
+  int failures = 0;
+  for (const char *name : kKernelNames) {
+    DelayMixKernel kernel = FindDelayMixKernel(name);
+    if (!kernel) {
+      printf("%-6s not available\n", name);
+      continue;
+    }
+    failures += !CheckKernel(name, kernel);
+  }
+
+  printf("\n%7s %-6s %10s %12s %8s\n", "frames", "kernel", "ns/call",
+         "ns/frame", "speedup");
+  for (int32_t frames : {32, 64, 192, 256, 480, 1024, 4096}) {
+    double scalarNs = TimeKernel(DelayMixScalar, frames, seconds);
+    printf("%7d %-6s %10.1f %12.3f %8s\n", frames, "scalar", scalarNs,
+           scalarNs / frames, "");
+    for (const char *name : kKernelNames) {
+      DelayMixKernel kernel = FindDelayMixKernel(name);
+      if (!kernel) continue;
+      double ns = TimeKernel(kernel, frames, seconds);
+      printf("%7s %-6s %10.1f %12.3f %7.1fx\n", "", name, ns, ns / frames,
+             scalarNs / ns);
+    }
+  }
+  return failures ? 1 : 0;
+}
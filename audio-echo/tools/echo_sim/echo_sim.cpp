@@ -0,0 +1,284 @@
+/*
+ * Copyright 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Host tool running the audio-echo AudioRecorder -> AudioPlayer pipeline
+ * on a simulated OpenSL ES device ( sl_sim.cpp ), with a virtual clock, so
+ * callback jitter and stalls can be replayed deterministically.
+ *   build: mkdir -p inc && ln -sf $NDK/sysroot/usr/include/SLES inc/SLES
+ *          ( any OpenSL ES headers do: NDK r19+ keeps them under
+ *            toolchains/llvm/prebuilt/<host>/sysroot/usr/include )
+ *          SRC=../../app/src/main/cpp
+ *          c++ -std=c++17 -I. -Iinc -I$SRC echo_sim.cpp sl_sim.cpp \
+ *              $SRC/audio_player.cpp $SRC/audio_recorder.cpp \
+ *              $SRC/audio_common.cpp $SRC/audio_trace.cpp \
+ *              $SRC/audio_jitter_buffer.cpp $SRC/audio_thread.cpp \
+ *              $SRC/buf_pool.cpp $SRC/debug_utils.cpp -pthread -o echo_sim
+ *   usage: ./echo_sim [--rate 48000] [--frames 192] [--seconds 10]
+ *                     [--jitter-us 0] [--stall-us 0] [--stall-every 0]
+ *                     [--phase-us 0] [--seed 1] [--verbose]
+ * The exit status is 1 when buffers were lost.
+ */
+#include <algorithm>
+#include <cinttypes>
+#include <cmath>
+#include <cstdarg>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include "audio_common.h"
+#include "audio_player.h"
+#include "audio_recorder.h"
+#include "buf_pool.h"
+#include "sl_sim.h"
+
+static bool verbose = false;
+
+extern "C" int __android_log_print(int prio, const char *tag, const char *fmt,
+                                   ...) {
+  if (!verbose) return 0;
+  va_list args;
+  va_start(args, fmt);
+  fprintf(stderr, "%s: ", tag);
+  int count = vfprintf(stderr, fmt, args);
+  fputc('\n', stderr);
+  va_end(args);
+  return count;
+}
+
+/*
+ * The buffer plumbing of EchoAudioEngine in audio_main.cpp, without the
+ * effects: the "recorded" buffers get a tone burst pattern ( 200 ms of
+ * 440 Hz, 200 ms of silence ), then go straight to the player.
+ */
+struct SimEngine {
+  SLObjectItf slEngineObj_;
+  SLEngineItf slEngineItf_;
+
+  SampleBufPool *bufPool_;
+  AudioQueue *freeBufQueue_;
+  AudioQueue *recBufQueue_;
+  AudioRecorder *recorder_;
+  AudioPlayer *player_;
+
+  uint32_t sampleRate_;
+  uint64_t recordedFrames_;
+  uint32_t dumpCount_;  // RETRIEVE_DUMP_BUFS requests: lost buffers
+  uint32_t lostCount_;
+};
+static SimEngine engine;
+
+static uint32_t CheckBufs(void) {
+  uint32_t found[BUF_OWNER_COUNT];
+  found[static_cast<uint32_t>(BufOwner::Free)] = engine.freeBufQueue_->size();
+  found[static_cast<uint32_t>(BufOwner::RecordDevice)] =
+      engine.recorder_ ? engine.recorder_->dbgGetDevBufCount() : 0;
+  found[static_cast<uint32_t>(BufOwner::Recorded)] =
+      engine.recBufQueue_->size();
+  found[static_cast<uint32_t>(BufOwner::PlayDevice)] =
+      engine.player_ ? engine.player_->dbgGetDevBufCount() : 0;
+  return engine.bufPool_->dbgCheckOwners(found);
+}
+
+static void FillRecorded(sample_buf *buf) {
+  int16_t *samples = reinterpret_cast<int16_t *>(buf->buf_);
+  uint32_t frames = buf->size_ / (AUDIO_SAMPLE_CHANNELS * sizeof(int16_t));
+  uint32_t burstFrames = engine.sampleRate_ / 5;
+  for (uint32_t frame = 0; frame < frames; frame++) {
+    uint64_t pos = engine.recordedFrames_++;
+    int16_t value = 0;
+    if ((pos / burstFrames) % 2 == 0) {
+      value = static_cast<int16_t>(
+          16384 * sin(2 * M_PI * 440 * pos / engine.sampleRate_));
+    }
+    for (uint32_t ch = 0; ch < AUDIO_SAMPLE_CHANNELS; ch++) {
+      samples[frame * AUDIO_SAMPLE_CHANNELS + ch] = value;
+    }
+  }
+}
+
+static bool SimEngineService(void *ctx, uint32_t msg, void *data) {
+  switch (msg) {
+    case ENGINE_SERVICE_MSG_RETRIEVE_DUMP_BUFS:
+      engine.dumpCount_++;
+      *(static_cast<uint32_t *>(data)) = CheckBufs();
+      break;
+    case ENGINE_SERVICE_MSG_RECORDED_AUDIO_AVAILABLE:
+      FillRecorded(static_cast<sample_buf *>(data));
+      break;
+    case ENGINE_SERVICE_MSG_PLAY_AUDIO_QUEUED:
+      break;
+    default:
+      return false;
+  }
+  return true;
+}
+
+static void CreateEngine(uint32_t sampleRate, uint32_t framesPerBuf) {
+  engine.sampleRate_ = sampleRate;
+  SLresult result =
+      slCreateEngine(&engine.slEngineObj_, 0, NULL, 0, NULL, NULL);
+  SLASSERT(result);
+  result = (*engine.slEngineObj_)
+               ->GetInterface(engine.slEngineObj_, SL_IID_ENGINE,
+                              &engine.slEngineItf_);
+  SLASSERT(result);
+
+  SampleFormat sampleFormat;
+  memset(&sampleFormat, 0, sizeof(sampleFormat));
+  sampleFormat.pcmFormat_ = SL_PCMSAMPLEFORMAT_FIXED_16;
+  sampleFormat.representation_ = SL_ANDROID_PCM_REPRESENTATION_SIGNED_INT;
+  sampleFormat.channels_ = AUDIO_SAMPLE_CHANNELS;
+  sampleFormat.sampleRate_ = sampleRate * 1000;
+  sampleFormat.framesPerBuf_ = framesPerBuf;
+
+  engine.bufPool_ = new SampleBufPool(
+      BUF_COUNT, framesPerBuf * AUDIO_SAMPLE_CHANNELS * 2, 0);
+  uint32_t bufCount = engine.bufPool_->getBufCount();
+  engine.freeBufQueue_ = new AudioQueue(bufCount);
+  engine.recBufQueue_ = new AudioQueue(bufCount);
+  for (uint32_t idx = 0; idx < bufCount; idx++) {
+    engine.freeBufQueue_->push(&engine.bufPool_->getBufs()[idx]);
+  }
+
+  engine.player_ = new AudioPlayer(&sampleFormat, engine.slEngineItf_);
+  engine.player_->SetBufQueue(engine.recBufQueue_, engine.freeBufQueue_);
+  engine.player_->RegisterCallback(SimEngineService, &engine);
+  engine.recorder_ = new AudioRecorder(&sampleFormat, engine.slEngineItf_);
+  engine.recorder_->SetBufQueues(engine.freeBufQueue_, engine.recBufQueue_);
+  engine.recorder_->RegisterCallback(SimEngineService, &engine);
+}
+
+static void DeleteEngine(void) {
+  delete engine.recorder_;
+  delete engine.player_;
+  engine.recorder_ = nullptr;
+  engine.player_ = nullptr;
+
+  // the player and recorder hand everything back to the free queue
+  engine.lostCount_ =
+      std::max(engine.lostCount_, engine.bufPool_->getBufCount() -
+                                      engine.freeBufQueue_->size());
+  delete engine.recBufQueue_;
+  delete engine.freeBufQueue_;
+  delete engine.bufPool_;
+  (*engine.slEngineObj_)->Destroy(engine.slEngineObj_);
+}
+
+static void PrintStream(const char *name, const char *xrun,
+                        const SimStreamStats &stats) {
+  printf("%-9s callbacks=%u, %s=%u, rejected enqueues=%u, max late=%u us\n",
+         name, stats.callbacks, xrun, stats.xruns, stats.rejected,
+         stats.maxLateUs);
+}
+
+int main(int argc, char *argv[]) {
+  uint32_t sampleRate = 48000;
+  uint32_t framesPerBuf = 192;
+  uint32_t seconds = 10;
+  uint32_t seed = 1;
+  SimStreamConfig config;
+  memset(&config, 0, sizeof(config));
+
+  for (int idx = 1; idx < argc; idx++) {
+    const char *arg = argv[idx];
+    if (!strcmp(arg, "--verbose")) {
+      verbose = true;
+      continue;
+    }
+    if (idx + 1 == argc) {
+      fprintf(stderr, "%s: missing value or unknown option\n", arg);
+      return 2;
+    }
+    uint32_t value = static_cast<uint32_t>(strtoul(argv[++idx], nullptr, 0));
+    if (!strcmp(arg, "--rate")) {
+      sampleRate = value;
+    } else if (!strcmp(arg, "--frames")) {
+      framesPerBuf = value;
+    } else if (!strcmp(arg, "--seconds")) {
+      seconds = value;
+    } else if (!strcmp(arg, "--jitter-us")) {
+      config.jitterUs = value;
+    } else if (!strcmp(arg, "--stall-us")) {
+      config.stallUs = value;
+    } else if (!strcmp(arg, "--stall-every")) {
+      config.stallEvery = value;
+    } else if (!strcmp(arg, "--phase-us")) {
+      config.phaseUs = value;
+    } else if (!strcmp(arg, "--seed")) {
+      seed = value;
+    } else {
+      fprintf(stderr, "unknown option %s\n", arg);
+      return 2;
+    }
+  }
+  if (!sampleRate || !framesPerBuf) {
+    fprintf(stderr, "--rate and --frames must not be 0\n");
+    return 2;
+  }
+
+  config.periodUs = static_cast<uint32_t>(
+      static_cast<uint64_t>(framesPerBuf) * 1000000 / sampleRate);
+  config.bufBytes = framesPerBuf * AUDIO_SAMPLE_CHANNELS * 2;
+  // the recorder starts the device clock, the player is phaseUs behind
+  SimStreamConfig recConfig = config;
+  recConfig.phaseUs = 0;
+  SimConfigure(recConfig, config, seed);
+
+  memset(&engine, 0, sizeof(engine));
+  CreateEngine(sampleRate, framesPerBuf);
+  engine.player_->Start();
+  engine.recorder_->Start();
+  SimRun(static_cast<uint64_t>(seconds) * 1000000);
+  engine.recorder_->Stop();
+  engine.player_->Stop();
+  engine.lostCount_ = CheckBufs();
+  AudioJitterStats jitter;
+  engine.player_->GetJitterStats(&jitter);
+  DeleteEngine();
+
+  SimStreamStats recStats, playStats;
+  SimLatencyStats latency;
+  SimGetStats(&recStats, &playStats, &latency);
+  printf("%u Hz, %u frames ( %u us ), %u s, jitter %u us, stall %u us every "
+         "%u, player phase %u us\n",
+         sampleRate, framesPerBuf, config.periodUs, seconds, config.jitterUs,
+         config.stallUs, config.stallEvery, config.phaseUs);
+  PrintStream("recorder:", "overruns", recStats);
+  PrintStream("player:", "underruns", playStats);
+  if (latency.count) {
+    printf("latency:  min=%" PRIu64 " us, avg=%" PRIu64 " us, max=%" PRIu64
+           " us over %u buffers\n",
+           latency.minUs, latency.totalUs / latency.count, latency.maxUs,
+           latency.count);
+  } else {
+    printf("latency:  no recorded buffer was played\n");
+  }
+  printf("jitter:   depth=%u, underruns=%u, starved=%u, shrinks=%u, dropped "
+         "frames=%" PRIu64 "\n",
+         jitter.targetDepth_, jitter.underruns_, jitter.starved_,
+         jitter.shrinks_, jitter.droppedFrames_);
+  if (jitter.minPhaseUs_ <= jitter.maxPhaseUs_) {
+    printf("phase:    min=%u us, max=%u us\n", jitter.minPhaseUs_,
+           jitter.maxPhaseUs_);
+  } else {
+    printf("phase:    no recorded buffer was time stamped\n");
+  }
+  printf("buffers:  lost=%u, lost buffer reports=%u\n", engine.lostCount_,
+         engine.dumpCount_);
+  return engine.lostCount_ ? 1 : 0;
+}
@@ -0,0 +1,496 @@
+/*
+ * Copyright 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Just enough of OpenSL ES for AudioPlayer and AudioRecorder: an engine,
+ * an output mix, a buffer queue player and a buffer queue recorder, all
+ * running on a virtual clock.
+ *
+ * clock_gettime() is replaced by the virtual clock, for every clock id:
+ * this is a Linux host tool.
+ *
+ * Device model, per stream:
+ *   - the device ticks every periodUs ( plus phaseUs ); on each tick the
+ *     buffer at the head of the queue is done, and the next one starts to
+ *     play / fill. An empty queue on a tick is an xrun. A buffer shorter
+ *     than bufBytes plays for a part of the period only.
+ *   - a done buffer is reported through the buffer queue callback, jitterUs
+ *     ( and every stallEvery-th time stallUs ) late; callbacks of a stream
+ *     are delivered in order, like from one audio thread.
+ */
+#include "sl_sim.h"
+
+#include <SLES/OpenSLES.h>
+#include <SLES/OpenSLES_Android.h>
+
+#include <time.h>
+
+#include <algorithm>
+#include <deque>
+#include <random>
+#include <unordered_map>
+
+namespace {
+
+enum class SimKind { Engine, OutputMix, Player, Recorder };
+const int kRecorder = 0;
+const int kPlayer = 1;
+
+struct SimObject;
+
+// every interface handed out is a pointer to one of these
+template <typename Vtbl>
+struct ItfHolder {
+  const Vtbl *vtbl;
+  SimObject *owner;
+};
+
+struct SimBuffer {
+  const void *data;
+  SLuint32 size;
+};
+
+struct SimObject {
+  SimKind kind;
+  ItfHolder<SLObjectItf_> object;
+  ItfHolder<SLEngineItf_> engine;
+  ItfHolder<SLPlayItf_> play;
+  ItfHolder<SLRecordItf_> record;
+  ItfHolder<SLAndroidSimpleBufferQueueItf_> bufQueue;
+  ItfHolder<SLAndroidConfigurationItf_> config;
+
+  // buffer queue streams only
+  int stream;
+  SLuint32 queueLen;
+  std::deque<SimBuffer> queue;  // head: the buffer on the device
+  bool headActive;
+  uint64_t headStartUs;
+  SLuint32 state;  // SL_PLAYSTATE_* or SL_RECORDSTATE_*, same values
+  uint64_t nextTickUs;
+  std::deque<uint64_t> callbacksDue;
+  uint32_t callbackCount;
+  slAndroidSimpleBufferQueueCallback callback;
+  void *context;
+};
+
+struct SimDevice {
+  uint64_t nowUs = 0;
+  std::mt19937 rng;
+  SimStreamConfig config[2] = {};
+  SimObject *streams[2] = {nullptr, nullptr};
+  SimStreamStats stats[2] = {};
+  SimLatencyStats latency = {};
+  // recorded buffer -> when its first frame was captured
+  std::unordered_map<const void *, uint64_t> captured;
+};
+SimDevice gDevice;
+
+template <typename Vtbl, typename Self>
+SimObject *Owner(Self self) {
+  return reinterpret_cast<const ItfHolder<Vtbl> *>(self)->owner;
+}
+
+bool IsRunning(const SimObject *obj) {
+  // SL_PLAYSTATE_PLAYING == SL_RECORDSTATE_RECORDING
+  return obj->state == SL_PLAYSTATE_PLAYING;
+}
+
+uint64_t NextTick(int stream, uint64_t nowUs) {
+  const SimStreamConfig &config = gDevice.config[stream];
+  uint64_t period = std::max(config.periodUs, 1u);
+  if (nowUs <= config.phaseUs) return config.phaseUs;
+  uint64_t periods = (nowUs - config.phaseUs + period - 1) / period;
+  return config.phaseUs + periods * period;
+}
+
+void ScheduleCallback(SimObject *obj) {
+  const SimStreamConfig &config = gDevice.config[obj->stream];
+  uint64_t due = gDevice.nowUs;
+  if (config.jitterUs) {
+    due += std::uniform_int_distribution<uint32_t>(0, config.jitterUs)(
+        gDevice.rng);
+  }
+  if (config.stallEvery && ++obj->callbackCount % config.stallEvery == 0) {
+    due += config.stallUs;
+  }
+  if (!obj->callbacksDue.empty()) {
+    due = std::max(due, obj->callbacksDue.back());
+  }
+  obj->callbacksDue.push_back(due);
+
+  SimStreamStats &stats = gDevice.stats[obj->stream];
+  stats.maxLateUs = std::max(stats.maxLateUs,
+                             static_cast<uint32_t>(due - gDevice.nowUs));
+}
+
+void DeviceTick(SimObject *obj) {
+  SimStreamStats &stats = gDevice.stats[obj->stream];
+  if (obj->headActive) {
+    SimBuffer done = obj->queue.front();
+    obj->queue.pop_front();
+    if (obj->kind == SimKind::Recorder) {
+      gDevice.captured[done.data] = obj->headStartUs;
+    }
+    ScheduleCallback(obj);
+  }
+
+  obj->headActive = !obj->queue.empty();
+  obj->headStartUs = gDevice.nowUs;
+  if (!obj->headActive) {
+    stats.xruns++;
+  } else if (obj->kind == SimKind::Player) {
+    auto it = gDevice.captured.find(obj->queue.front().data);
+    if (it != gDevice.captured.end()) {
+      uint64_t latency = gDevice.nowUs - it->second;
+      SimLatencyStats &lat = gDevice.latency;
+      lat.minUs = lat.count ? std::min(lat.minUs, latency) : latency;
+      lat.maxUs = std::max(lat.maxUs, latency);
+      lat.totalUs += latency;
+      lat.count++;
+      gDevice.captured.erase(it);
+    }
+  }
+  const SimStreamConfig &config = gDevice.config[obj->stream];
+  uint64_t durationUs = config.periodUs;
+  if (obj->headActive && config.bufBytes) {
+    durationUs = durationUs * obj->queue.front().size / config.bufBytes;
+  }
+  obj->nextTickUs = gDevice.nowUs + std::max<uint64_t>(durationUs, 1);
+}
+
+void DeliverCallback(SimObject *obj) {
+  obj->callbacksDue.pop_front();
+  gDevice.stats[obj->stream].callbacks++;
+  if (obj->callback) {
+    obj->callback(reinterpret_cast<SLAndroidSimpleBufferQueueItf>(
+                      &obj->bufQueue),
+                  obj->context);
+  }
+}
+
+void SetState(SimObject *obj, SLuint32 state) {
+  if (state == SL_PLAYSTATE_PLAYING && !IsRunning(obj)) {
+    obj->headActive = false;
+    obj->nextTickUs = NextTick(obj->stream, gDevice.nowUs);
+  }
+  obj->state = state;
+}
+
+// SLObjectItf
+SLresult ObjRealize(SLObjectItf self, SLboolean async) {
+  return SL_RESULT_SUCCESS;
+}
+
+SLresult ObjGetState(SLObjectItf self, SLuint32 *pState) {
+  *pState = 2;  // SL_OBJECT_STATE_REALIZED
+  return SL_RESULT_SUCCESS;
+}
+
+SLresult ObjGetInterface(SLObjectItf self, const SLInterfaceID iid,
+                         void *pInterface) {
+  SimObject *obj = Owner<SLObjectItf_>(self);
+  void *itf = nullptr;
+  switch (obj->kind) {
+    case SimKind::Engine:
+      if (iid == SL_IID_ENGINE) itf = &obj->engine;
+      break;
+    case SimKind::OutputMix:
+      break;
+    case SimKind::Player:
+      if (iid == SL_IID_PLAY) itf = &obj->play;
+      if (iid == SL_IID_BUFFERQUEUE || iid == SL_IID_ANDROIDSIMPLEBUFFERQUEUE)
+        itf = &obj->bufQueue;
+      break;
+    case SimKind::Recorder:
+      if (iid == SL_IID_RECORD) itf = &obj->record;
+      if (iid == SL_IID_ANDROIDSIMPLEBUFFERQUEUE) itf = &obj->bufQueue;
+      if (iid == SL_IID_ANDROIDCONFIGURATION) itf = &obj->config;
+      break;
+  }
+  if (!itf) return SL_RESULT_FEATURE_UNSUPPORTED;
+  *static_cast<void **>(pInterface) = itf;
+  return SL_RESULT_SUCCESS;
+}
+
+void ObjDestroy(SLObjectItf self) {
+  SimObject *obj = Owner<SLObjectItf_>(self);
+  if (obj->kind == SimKind::Player || obj->kind == SimKind::Recorder) {
+    gDevice.streams[obj->stream] = nullptr;
+  }
+  delete obj;
+}
+
+SLObjectItf_ MakeObjectItf() {
+  SLObjectItf_ itf = {};
+  itf.Realize = ObjRealize;
+  itf.GetState = ObjGetState;
+  itf.GetInterface = ObjGetInterface;
+  itf.Destroy = ObjDestroy;
+  return itf;
+}
+const SLObjectItf_ kObjectItf = MakeObjectItf();
+
+// SLPlayItf / SLRecordItf
+SLresult SetPlayState(SLPlayItf self, SLuint32 state) {
+  SetState(Owner<SLPlayItf_>(self), state);
+  return SL_RESULT_SUCCESS;
+}
+
+SLresult GetPlayState(SLPlayItf self, SLuint32 *pState) {
+  *pState = Owner<SLPlayItf_>(self)->state;
+  return SL_RESULT_SUCCESS;
+}
+
+SLPlayItf_ MakePlayItf() {
+  SLPlayItf_ itf = {};
+  itf.SetPlayState = SetPlayState;
+  itf.GetPlayState = GetPlayState;
+  return itf;
+}
+const SLPlayItf_ kPlayItf = MakePlayItf();
+
+SLresult SetRecordState(SLRecordItf self, SLuint32 state) {
+  SetState(Owner<SLRecordItf_>(self), state);
+  return SL_RESULT_SUCCESS;
+}
+
+SLresult GetRecordState(SLRecordItf self, SLuint32 *pState) {
+  *pState = Owner<SLRecordItf_>(self)->state;
+  return SL_RESULT_SUCCESS;
+}
+
+SLRecordItf_ MakeRecordItf() {
+  SLRecordItf_ itf = {};
+  itf.SetRecordState = SetRecordState;
+  itf.GetRecordState = GetRecordState;
+  return itf;
+}
+const SLRecordItf_ kRecordItf = MakeRecordItf();
+
+// SLAndroidSimpleBufferQueueItf
+SLresult BqEnqueue(SLAndroidSimpleBufferQueueItf self, const void *pBuffer,
+                   SLuint32 size) {
+  SimObject *obj = Owner<SLAndroidSimpleBufferQueueItf_>(self);
+  if (obj->queue.size() >= obj->queueLen) {
+    gDevice.stats[obj->stream].rejected++;
+    return SL_RESULT_BUFFER_INSUFFICIENT;
+  }
+  obj->queue.push_back({pBuffer, size});
+  return SL_RESULT_SUCCESS;
+}
+
+SLresult BqClear(SLAndroidSimpleBufferQueueItf self) {
+  SimObject *obj = Owner<SLAndroidSimpleBufferQueueItf_>(self);
+  obj->queue.clear();
+  obj->headActive = false;
+  obj->callbacksDue.clear();
+  return SL_RESULT_SUCCESS;
+}
+
+SLresult BqGetState(SLAndroidSimpleBufferQueueItf self,
+                    SLAndroidSimpleBufferQueueState *pState) {
+  SimObject *obj = Owner<SLAndroidSimpleBufferQueueItf_>(self);
+  pState->count = static_cast<SLuint32>(obj->queue.size());
+  pState->index = obj->callbackCount;
+  return SL_RESULT_SUCCESS;
+}
+
+SLresult BqRegisterCallback(SLAndroidSimpleBufferQueueItf self,
+                            slAndroidSimpleBufferQueueCallback callback,
+                            void *pContext) {
+  SimObject *obj = Owner<SLAndroidSimpleBufferQueueItf_>(self);
+  obj->callback = callback;
+  obj->context = pContext;
+  return SL_RESULT_SUCCESS;
+}
+
+SLAndroidSimpleBufferQueueItf_ MakeBufQueueItf() {
+  SLAndroidSimpleBufferQueueItf_ itf = {};
+  itf.Enqueue = BqEnqueue;
+  itf.Clear = BqClear;
+  itf.GetState = BqGetState;
+  itf.RegisterCallback = BqRegisterCallback;
+  return itf;
+}
+const SLAndroidSimpleBufferQueueItf_ kBufQueueItf = MakeBufQueueItf();
+
+// SLAndroidConfigurationItf: accept and ignore everything
+SLresult SetConfiguration(SLAndroidConfigurationItf self,
+                          const SLchar *configKey, const void *pConfigValue,
+                          SLuint32 valueSize) {
+  return SL_RESULT_SUCCESS;
+}
+
+SLAndroidConfigurationItf_ MakeConfigItf() {
+  SLAndroidConfigurationItf_ itf = {};
+  itf.SetConfiguration = SetConfiguration;
+  return itf;
+}
+const SLAndroidConfigurationItf_ kConfigItf = MakeConfigItf();
+
+SimObject *NewObject(SimKind kind);
+
+// SLEngineItf
+SLresult CreateStream(SimKind kind, SLObjectItf *pObject, void *pLocator) {
+  int stream = kind == SimKind::Player ? kPlayer : kRecorder;
+  if (gDevice.streams[stream]) {
+    return SL_RESULT_PARAMETER_INVALID;  // one of each only
+  }
+  SimObject *obj = NewObject(kind);
+  obj->stream = stream;
+  obj->queueLen =
+      static_cast<SLDataLocator_AndroidSimpleBufferQueue *>(pLocator)
+          ->numBuffers;
+  obj->state = SL_PLAYSTATE_STOPPED;
+  gDevice.streams[stream] = obj;
+  *pObject = reinterpret_cast<SLObjectItf>(&obj->object);
+  return SL_RESULT_SUCCESS;
+}
+
+SLresult CreateAudioPlayer(SLEngineItf self, SLObjectItf *pPlayer,
+                           SLDataSource *pAudioSrc, SLDataSink *pAudioSnk,
+                           SLuint32 numInterfaces,
+                           const SLInterfaceID *pInterfaceIds,
+                           const SLboolean *pInterfaceRequired) {
+  return CreateStream(SimKind::Player, pPlayer, pAudioSrc->pLocator);
+}
+
+SLresult CreateAudioRecorder(SLEngineItf self, SLObjectItf *pRecorder,
+                             SLDataSource *pAudioSrc, SLDataSink *pAudioSnk,
+                             SLuint32 numInterfaces,
+                             const SLInterfaceID *pInterfaceIds,
+                             const SLboolean *pInterfaceRequired) {
+  return CreateStream(SimKind::Recorder, pRecorder, pAudioSnk->pLocator);
+}
+
+SLresult CreateOutputMix(SLEngineItf self, SLObjectItf *pMix,
+                         SLuint32 numInterfaces,
+                         const SLInterfaceID *pInterfaceIds,
+                         const SLboolean *pInterfaceRequired) {
+  *pMix = reinterpret_cast<SLObjectItf>(&NewObject(SimKind::OutputMix)->object);
+  return SL_RESULT_SUCCESS;
+}
+
+SLEngineItf_ MakeEngineItf() {
+  SLEngineItf_ itf = {};
+  itf.CreateAudioPlayer = CreateAudioPlayer;
+  itf.CreateAudioRecorder = CreateAudioRecorder;
+  itf.CreateOutputMix = CreateOutputMix;
+  return itf;
+}
+const SLEngineItf_ kEngineItf = MakeEngineItf();
+
+SimObject *NewObject(SimKind kind) {
+  SimObject *obj = new SimObject();
+  obj->kind = kind;
+  obj->object = {&kObjectItf, obj};
+  obj->engine = {&kEngineItf, obj};
+  obj->play = {&kPlayItf, obj};
+  obj->record = {&kRecordItf, obj};
+  obj->bufQueue = {&kBufQueueItf, obj};
+  obj->config = {&kConfigItf, obj};
+  return obj;
+}
+
+// only the addresses matter
+const struct SLInterfaceID_ kSimIids[7] = {};
+
+}  // namespace
+
+extern "C" {
+const SLInterfaceID SL_IID_ENGINE = &kSimIids[0];
+const SLInterfaceID SL_IID_PLAY = &kSimIids[1];
+const SLInterfaceID SL_IID_RECORD = &kSimIids[2];
+const SLInterfaceID SL_IID_BUFFERQUEUE = &kSimIids[3];
+const SLInterfaceID SL_IID_ANDROIDSIMPLEBUFFERQUEUE = &kSimIids[4];
+const SLInterfaceID SL_IID_ANDROIDCONFIGURATION = &kSimIids[5];
+const SLInterfaceID SL_IID_VOLUME = &kSimIids[6];
+
+SLresult slCreateEngine(SLObjectItf *pEngine, SLuint32 numOptions,
+                        const SLEngineOption *pEngineOptions,
+                        SLuint32 numInterfaces,
+                        const SLInterfaceID *pInterfaceIds,
+                        const SLboolean *pInterfaceRequired) {
+  *pEngine = reinterpret_cast<SLObjectItf>(&NewObject(SimKind::Engine)->object);
+  return SL_RESULT_SUCCESS;
+}
+}
+
+void SimConfigure(const SimStreamConfig &recorder,
+                  const SimStreamConfig &player, uint32_t seed) {
+  gDevice.config[kRecorder] = recorder;
+  gDevice.config[kPlayer] = player;
+  gDevice.rng.seed(seed);
+}
+
+/**
+ * Advance the virtual clock by durationUs, running every device tick and
+ * callback due on the way, in time order; on a tie the device goes first.
+ */
+void SimRun(uint64_t durationUs) {
+  uint64_t endUs = gDevice.nowUs + durationUs;
+  while (true) {
+    SimObject *next = nullptr;
+    bool tick = false;
+    uint64_t nextUs = UINT64_MAX;
+    for (SimObject *obj : gDevice.streams) {
+      if (!obj) continue;
+      if (IsRunning(obj) && obj->nextTickUs < nextUs) {
+        next = obj;
+        tick = true;
+        nextUs = obj->nextTickUs;
+      }
+    }
+    for (SimObject *obj : gDevice.streams) {
+      if (!obj || obj->callbacksDue.empty()) continue;
+      if (obj->callbacksDue.front() < nextUs) {
+        next = obj;
+        tick = false;
+        nextUs = obj->callbacksDue.front();
+      }
+    }
+    if (!next || nextUs > endUs) break;
+
+    gDevice.nowUs = nextUs;
+    if (tick) {
+      DeviceTick(next);
+    } else {
+      DeliverCallback(next);
+    }
+  }
+  gDevice.nowUs = endUs;
+}
+
+uint64_t SimNowUs(void) { return gDevice.nowUs; }
+
+/*
+ * GetMonotonicNs() in the pipeline runs on the virtual clock too, so its
+ * trace and jitter buffer see the simulated timing. The clock starts at
+ * 1 s: time stamp 0 means "none" in places.
+ */
+extern "C" int clock_gettime(clockid_t clock, struct timespec *ts) noexcept {
+  uint64_t nowUs = gDevice.nowUs + 1000000;
+  ts->tv_sec = static_cast<time_t>(nowUs / 1000000);
+  ts->tv_nsec = static_cast<long>(nowUs % 1000000 * 1000);
+  return 0;
+}
+
+void SimGetStats(SimStreamStats *recorder, SimStreamStats *player,
+                 SimLatencyStats *latency) {
+  *recorder = gDevice.stats[kRecorder];
+  *player = gDevice.stats[kPlayer];
+  *latency = gDevice.latency;
+}
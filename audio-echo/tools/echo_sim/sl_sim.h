@@ -0,0 +1,59 @@
+/*
+ * Copyright 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef ECHO_SIM_SL_SIM_H
+#define ECHO_SIM_SL_SIM_H
+
+#include <cstdint>
+
+/*
+ * Timing of one simulated device stream, in micro seconds of virtual time
+ */
+struct SimStreamConfig {
+  uint32_t periodUs;    // one buffer
+  uint32_t phaseUs;     // device clock offset from time 0
+  uint32_t jitterUs;    // callbacks are late by [0, jitterUs]
+  uint32_t stallUs;     // extra lateness of a stalled callback
+  uint32_t stallEvery;  // every Nth callback stalls, 0: never
+  uint32_t bufBytes;    // size of a one period buffer, 0: any size is one
+};
+
+struct SimStreamStats {
+  uint32_t callbacks;
+  uint32_t xruns;      // player: underruns, recorder: overruns
+  uint32_t rejected;   // Enqueue() on a full device queue
+  uint32_t maxLateUs;  // latest callback delivery
+};
+
+struct SimLatencyStats {
+  uint32_t count;
+  uint64_t minUs;
+  uint64_t maxUs;
+  uint64_t totalUs;
+};
+
+/*
+ * Virtual clock OpenSL ES device behind slCreateEngine(). The player and
+ * recorder created through it are driven by SimRun(), on the calling
+ * thread, so a run is deterministic for a given seed.
+ */
+void SimConfigure(const SimStreamConfig &recorder,
+                  const SimStreamConfig &player, uint32_t seed);
+void SimRun(uint64_t durationUs);
+uint64_t SimNowUs(void);
+void SimGetStats(SimStreamStats *recorder, SimStreamStats *player,
+                 SimLatencyStats *latency);
+
+#endif  // ECHO_SIM_SL_SIM_H
@@ -0,0 +1,199 @@
+/*
+ * Copyright 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Host round trip test of the sample format converters
+ * ( audio_format_convert.h ) and the sample traits they share with the
+ * effects ( audio_sample.h ).
+ *   build: mkdir -p inc && ln -sf $NDK/sysroot/usr/include/SLES inc/SLES
+ *          SRC=../../app/src/main/cpp
+ *          c++ -std=c++17 -O2 -Iinc -I$SRC format_convert_test.cpp \
+ *              $SRC/audio_format_convert.cpp -o format_convert_test
+ *   usage: ./format_convert_test
+ * It checks that:
+ *   - every 16 bit and every 24 bit value comes back unchanged through
+ *     float, and every 16 bit one through 24 bit;
+ *   - with dither, the round trip is off by at most 1 LSB, and a level
+ *     between two LSBs averages out to itself instead of rounding away;
+ *   - out of range floats clip to full scale;
+ *   - a block from the ( SIMD ) converters is the same as the one the
+ *     traits write sample by sample, for every block length up to 40.
+ * Exits with 1 if any of that does not hold.
+ */
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+#include "audio_format_convert.h"
+
+static int failures = 0;
+
+static void Check(bool ok, const char *what) {
+  printf("%-60s %s\n", what, ok ? "ok" : "FAILED");
+  if (!ok) failures++;
+}
+
+static bool RoundTripInt16(AudioDither *dither, int32_t maxError) {
+  std::vector<int16_t> in(65536), out(65536);
+  std::vector<float> mid(65536);
+  for (int32_t idx = 0; idx < 65536; idx++) {
+    in[idx] = static_cast<int16_t>(idx - 32768);
+  }
+  ConvertSamples(in.data(), SampleEncoding::Int16, mid.data(),
+                 SampleEncoding::Float32, 65536, nullptr);
+  ConvertSamples(mid.data(), SampleEncoding::Float32, out.data(),
+                 SampleEncoding::Int16, 65536, dither);
+  for (int32_t idx = 0; idx < 65536; idx++) {
+    if (abs(out[idx] - in[idx]) > maxError) {
+      printf("  %d came back as %d\n", in[idx], out[idx]);
+      return false;
+    }
+  }
+  return true;
+}
+
+static bool RoundTripInt24(AudioDither *dither, int32_t maxError) {
+  const int32_t chunk = 1 << 16;
+  std::vector<uint8_t> in(chunk * Int24Sample::kBytes);
+  std::vector<uint8_t> out(chunk * Int24Sample::kBytes);
+  std::vector<float> mid(chunk);
+  for (int32_t first = Int24Sample::kMin; first <= Int24Sample::kMax;
+       first += chunk) {
+    for (int32_t idx = 0; idx < chunk; idx++) {
+      Int24Sample::writeInt(in.data(), idx, first + idx);
+    }
+    ConvertSamples(in.data(), SampleEncoding::Int24Packed, mid.data(),
+                   SampleEncoding::Float32, chunk, nullptr);
+    ConvertSamples(mid.data(), SampleEncoding::Float32, out.data(),
+                   SampleEncoding::Int24Packed, chunk, dither);
+    for (int32_t idx = 0; idx < chunk; idx++) {
+      int32_t value = Int24Sample::readInt(out.data(), idx);
+      if (abs(value - (first + idx)) > maxError) {
+        printf("  %d came back as %d\n", first + idx, value);
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+static bool RoundTripInt16ThroughInt24(void) {
+  std::vector<int16_t> in(65536), out(65536);
+  std::vector<uint8_t> mid(65536 * Int24Sample::kBytes);
+  for (int32_t idx = 0; idx < 65536; idx++) {
+    in[idx] = static_cast<int16_t>(idx - 32768);
+  }
+  ConvertSamples(in.data(), SampleEncoding::Int16, mid.data(),
+                 SampleEncoding::Int24Packed, 65536, nullptr);
+  ConvertSamples(mid.data(), SampleEncoding::Int24Packed, out.data(),
+                 SampleEncoding::Int16, 65536, nullptr);
+  return in == out;
+}
+
+/*
+ * the mean of a constant level lsb16 16 bit LSBs converted count times
+ */
+static double MeanOfLevel(float lsb16, AudioDither *dither) {
+  const int32_t count = 1 << 20;
+  std::vector<float> in(count, lsb16 / 32768.0f);
+  std::vector<int16_t> out(count);
+  ConvertFloatToInt16(in.data(), out.data(), count, dither);
+  double sum = 0.0;
+  for (int16_t value : out) sum += value;
+  return sum / count;
+}
+
+static bool Clips(AudioDither *dither) {
+  const float in[] = {1.5f, -1.5f, 1.0f, -1.0f, 40.0f, -40.0f, 1.0f, -1.0f,
+                      1.5f, -1.5f, 1.0f, -1.0f};
+  const int16_t expected[] = {32767, -32768, 32767, -32768, 32767, -32768,
+                              32767, -32768, 32767, -32768, 32767, -32768};
+  int16_t out16[12];
+  uint8_t out24[12 * Int24Sample::kBytes];
+  ConvertFloatToInt16(in, out16, 12, dither);
+  ConvertFloatToInt24(in, out24, 12, dither);
+  for (int32_t idx = 0; idx < 12; idx++) {
+    int32_t value24 = Int24Sample::readInt(out24, idx);
+    // 1.0 with -1 LSB of dither may land one below full scale
+    if (abs(out16[idx] - expected[idx]) > (dither ? 1 : 0) ||
+        abs(value24 - expected[idx] * 256 - (expected[idx] > 0 ? 255 : 0)) >
+            (dither ? 1 : 0)) {
+      printf("  %g came out as %d / %d\n", in[idx], out16[idx], value24);
+      return false;
+    }
+  }
+  return true;
+}
+
+/*
+ * ConvertFloatToInt16() and Int16Sample::write() on the same floats, every
+ * block length the SIMD loop and its tail can split into
+ */
+static bool BlocksMatchTraits(void) {
+  uint32_t seed = 1;
+  for (int32_t count = 0; count <= 40; count++) {
+    std::vector<float> in(count);
+    for (float &sample : in) {
+      seed = seed * 1664525 + 1013904223;
+      // whole and half LSBs too, where the rounding matters most
+      int32_t lsbs = static_cast<int32_t>(seed >> 14) - 131072;
+      sample = (seed & 1 ? lsbs * 0.5f : lsbs * 0.37f) / 32768.0f;
+    }
+    std::vector<int16_t> block(count), traits(count);
+    ConvertFloatToInt16(in.data(), block.data(), count, nullptr);
+    for (int32_t idx = 0; idx < count; idx++) {
+      Int16Sample::write(reinterpret_cast<uint8_t *>(traits.data()), idx,
+                         in[idx], nullptr);
+    }
+    if (block != traits) {
+      printf("  blocks of %d samples differ\n", count);
+      return false;
+    }
+  }
+  return true;
+}
+
+int main(int argc, char *argv[]) {
+  if (argc != 1) {
+    fprintf(stderr, "usage: %s\n", argv[0]);
+    return 2;
+  }
+  AudioDither dither;
+
+  Check(RoundTripInt16(nullptr, 0), "16 bit -> float -> 16 bit is exact");
+  Check(RoundTripInt16(&dither, 1),
+        "16 bit -> float -> 16 bit, dithered, within 1 LSB");
+  Check(RoundTripInt24(nullptr, 0), "24 bit -> float -> 24 bit is exact");
+  Check(RoundTripInt24(&dither, 1),
+        "24 bit -> float -> 24 bit, dithered, within 1 LSB");
+  Check(RoundTripInt16ThroughInt24(), "16 bit -> 24 bit -> 16 bit is exact");
+
+  double plain = MeanOfLevel(0.25f, nullptr);
+  double dithered = MeanOfLevel(0.25f, &dither);
+  printf("  0.25 LSB averages to %.4f rounded, %.4f dithered\n", plain,
+         dithered);
+  Check(plain == 0.0 && fabs(dithered - 0.25) < 0.01,
+        "dither keeps a level below 1 LSB");
+  dithered = MeanOfLevel(-7.6f, &dither);
+  Check(fabs(dithered + 7.6) < 0.01, "dither keeps a level between LSBs");
+
+  Check(Clips(nullptr), "out of range clips to full scale");
+  Check(Clips(&dither), "out of range clips to full scale, dithered");
+  Check(BlocksMatchTraits(), "converter blocks match the sample traits");
+  return failures ? 1 : 0;
+}
@@ -0,0 +1,259 @@
+/*
+ * Copyright 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Host benchmark for ProducerConsumerQueue ( buf_manager.h ): a producer
+ * and a consumer thread pass items through it, against the queue it
+ * replaced ( OldQueue below, as it was before the span API ).
+ *   build: mkdir -p inc && ln -sf $NDK/sysroot/usr/include/SLES inc/SLES
+ *          SRC=../../app/src/main/cpp
+ *          c++ -std=c++17 -O2 -Iinc -I$SRC queue_bench.cpp -pthread \
+ *              -o queue_bench
+ *   usage: ./queue_bench [--items 5000000] [--slots 1024] [--span 32]
+ * It prints, for the old queue, the new one item at a time and the new
+ * one --span items at a time:
+ *   Mops/s     items through the queue per second, as fast as they go
+ *   latency    push to pop of one item at a time, the producer waiting
+ *              for each to be taken before the next ( median, 99th
+ *              percentile and max, in ns )
+ * Every item is checked to come out in order: exits with 1 if not. Full
+ * and empty queues yield the thread, so one core does for a run; pin the
+ * two threads to two cores ( taskset -c 2,3 ) for the cache traffic.
+ */
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "buf_manager.h"
+
+static inline uint64_t NowNs(void) {
+  timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return static_cast<uint64_t>(now.tv_sec) * 1000000000 + now.tv_nsec;
+}
+
+/*
+ * ProducerConsumerQueue as it was: modulo indexing, and both indices
+ * loaded on every call
+ */
+template <typename T>
+class OldQueue {
+ public:
+  explicit OldQueue(int size) : size_(size), buffer_(new T[size]) {}
+
+  bool push(const T& item) {
+    int readptr = read_.load(std::memory_order_acquire);
+    int writeptr = write_.load(std::memory_order_relaxed);
+    int space = size_ - (int)(writeptr - readptr);
+    if (space < 1) return false;
+    buffer_[writeptr % size_] = item;
+    write_.store(writeptr + 1, std::memory_order_release);
+    return true;
+  }
+
+  bool front(T* out_item) {
+    int writeptr = write_.load(std::memory_order_acquire);
+    int readptr = read_.load(std::memory_order_relaxed);
+    if ((int)(writeptr - readptr) < 1) return false;
+    *out_item = buffer_[readptr % size_];
+    return true;
+  }
+
+  void pop(void) {
+    int readptr = read_.load(std::memory_order_relaxed);
+    read_.store(readptr + 1, std::memory_order_release);
+  }
+
+ private:
+  const int size_;
+  std::unique_ptr<T[]> buffer_;
+  alignas(CACHE_ALIGN) std::atomic<int> read_{0};
+  alignas(CACHE_ALIGN) std::atomic<int> write_{0};
+};
+
+/*
+ * The three ways through a queue; Send() and Receive() move up to count
+ * items, return how many they did
+ */
+struct OldSingle {
+  OldQueue<uint64_t> queue_;
+  explicit OldSingle(int slots) : queue_(slots) {}
+  uint32_t Send(const uint64_t* items, uint32_t) {
+    return queue_.push(items[0]) ? 1 : 0;
+  }
+  uint32_t Receive(uint64_t* items, uint32_t) {
+    if (!queue_.front(items)) return 0;
+    queue_.pop();
+    return 1;
+  }
+};
+
+struct NewSingle {
+  ProducerConsumerQueue<uint64_t> queue_;
+  explicit NewSingle(int slots) : queue_(slots) {}
+  uint32_t Send(const uint64_t* items, uint32_t) {
+    return queue_.push(items[0]) ? 1 : 0;
+  }
+  uint32_t Receive(uint64_t* items, uint32_t) {
+    if (!queue_.front(items)) return 0;
+    queue_.pop();
+    return 1;
+  }
+};
+
+struct NewSpan {
+  ProducerConsumerQueue<uint64_t> queue_;
+  explicit NewSpan(int slots) : queue_(slots) {}
+  uint32_t Send(const uint64_t* items, uint32_t count) {
+    uint64_t* slots;
+    count = queue_.getWriteableSpan(&slots, count);
+    std::copy(items, items + count, slots);
+    queue_.commitWriteableSpan(count);
+    return count;
+  }
+  uint32_t Receive(uint64_t* items, uint32_t count) {
+    uint64_t* slots;
+    count = queue_.getReadableSpan(&slots, count);
+    std::copy(slots, slots + count, items);
+    queue_.consume(count);
+    return count;
+  }
+};
+
+/* items per second through a fresh queue, or 0 if one came out wrong */
+template <typename Q>
+static double Throughput(int slots, uint64_t itemCount, uint32_t span) {
+  Q q(slots);
+  std::atomic<bool> ok{true};
+  uint64_t start = NowNs();
+  std::thread consumer([&] {
+    std::vector<uint64_t> items(span);
+    uint64_t next = 0;
+    while (next < itemCount) {
+      uint32_t count = q.Receive(items.data(), span);
+      if (!count) {
+        std::this_thread::yield();
+        continue;
+      }
+      for (uint32_t idx = 0; idx < count; idx++, next++) {
+        if (items[idx] != next) ok = false;
+      }
+    }
+  });
+  std::vector<uint64_t> items(span);
+  for (uint64_t next = 0; next < itemCount;) {
+    uint32_t count =
+        static_cast<uint32_t>(std::min<uint64_t>(span, itemCount - next));
+    for (uint32_t idx = 0; idx < count; idx++) items[idx] = next + idx;
+    count = q.Send(items.data(), count);
+    if (!count) std::this_thread::yield();
+    next += count;
+  }
+  consumer.join();
+  double seconds = (NowNs() - start) / 1e9;
+  return ok ? itemCount / seconds : 0.0;
+}
+
+/*
+ * push to pop time of rounds single items, each pushed once the last one
+ * is taken: sorted, in ns
+ */
+template <typename Q>
+static std::vector<uint64_t> Latency(int slots, uint32_t rounds) {
+  Q q(slots);
+  std::atomic<uint32_t> taken{0};
+  std::vector<uint64_t> latency(rounds);
+  std::thread consumer([&] {
+    for (uint32_t round = 0; round < rounds; round++) {
+      uint64_t sent = 0;
+      while (!q.Receive(&sent, 1)) std::this_thread::yield();
+      latency[round] = NowNs() - sent;
+      taken.store(round + 1, std::memory_order_release);
+    }
+  });
+  for (uint32_t round = 0; round < rounds; round++) {
+    uint64_t now = NowNs();
+    q.Send(&now, 1);
+    while (taken.load(std::memory_order_acquire) <= round) {
+      std::this_thread::yield();
+    }
+  }
+  consumer.join();
+  std::sort(latency.begin(), latency.end());
+  return latency;
+}
+
+template <typename Q>
+static bool Run(const char* name, int slots, uint64_t itemCount,
+                uint32_t span) {
+  double rate = Throughput<Q>(slots, itemCount, span);
+  std::vector<uint64_t> latency = Latency<Q>(slots, 20000);
+  size_t count = latency.size();
+  printf("%-14s %9.1f %10llu %10llu %10llu\n", name, rate / 1e6,
+         static_cast<unsigned long long>(latency[count / 2]),
+         static_cast<unsigned long long>(latency[count * 99 / 100]),
+         static_cast<unsigned long long>(latency[count - 1]));
+  if (rate == 0.0) printf("%s: items came out of order\n", name);
+  return rate != 0.0;
+}
+
+int main(int argc, char* argv[]) {
+  uint64_t itemCount = 5000000;
+  uint32_t slots = 1024, span = 32;
+  for (int idx = 1; idx < argc; idx++) {
+    const char* arg = argv[idx];
+    if (idx + 1 == argc) {
+      fprintf(stderr, "%s: missing value\n", arg);
+      return 2;
+    }
+    uint64_t value = strtoull(argv[++idx], nullptr, 0);
+    if (!strcmp(arg, "--items")) {
+      itemCount = value;
+    } else if (!strcmp(arg, "--slots")) {
+      slots = static_cast<uint32_t>(value);
+    } else if (!strcmp(arg, "--span")) {
+      span = static_cast<uint32_t>(value);
+    } else {
+      fprintf(stderr, "unknown option %s\n", arg);
+      return 2;
+    }
+  }
+  if (!itemCount || !span || slots < 2 || slots > (1u << 24) ||
+      (slots & (slots - 1))) {
+    fprintf(stderr, "--items and --span must not be 0, --slots must be a "
+                    "power of two from 2 to 2^24\n");
+    return 2;
+  }
+
+  char spanName[32];
+  snprintf(spanName, sizeof(spanName), "new, spans %u", span);
+  printf("%llu items through %u slots, %u cores\n",
+         static_cast<unsigned long long>(itemCount), slots,
+         std::thread::hardware_concurrency());
+  printf("%-14s %9s %10s %10s %10s\n", "queue", "Mops/s", "median ns",
+         "p99 ns", "max ns");
+  bool ok = Run<OldSingle>("old", slots, itemCount, 1);
+  ok &= Run<NewSingle>("new", slots, itemCount, 1);
+  ok &= Run<NewSpan>(spanName, slots, itemCount, span);
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,254 @@
+/*
+ * Copyright 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Host benchmark for AudioConvolutionReverb: the cost of one buffer of
+ * reverb against a direct form FIR with the same impulse response, for
+ * impulse responses of 0.1 to 3 seconds.
+ *   build: mkdir -p inc && ln -sf $NDK/sysroot/usr/include/SLES inc/SLES
+ *          SRC=../../app/src/main/cpp
+ *          c++ -std=c++17 -O2 -I. -Iinc -I$SRC reverb_bench.cpp \
+ *              $SRC/audio_reverb.cpp $SRC/audio_fft.cpp \
+ *              $SRC/audio_effect_simd.cpp $SRC/audio_thread.cpp \
+ *              $SRC/audio_format_convert.cpp -pthread -o reverb_bench
+ *   usage: ./reverb_bench [--rate 48000] [--frames 192] [--seconds 2]
+ *                         [--verbose]
+ * For every impulse response it prints, per buffer:
+ *   fir        direct form FIR
+ *   partitioned  the whole convolution on the calling thread
+ *   callback   what process() costs with the tail on the worker, run in
+ *              real time for --seconds; late is the count of tails the
+ *              worker did not have ready ( process() summed them )
+ * and the largest difference between the FIR and the reverb output; rt
+ * err is the same between the reverb with and without the worker, over
+ * the --seconds run.
+ */
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdarg>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <thread>
+#include <vector>
+
+#include "audio_reverb.h"
+
+static bool verbose = false;
+
+extern "C" int __android_log_print(int prio, const char *tag, const char *fmt,
+                                   ...) {
+  if (!verbose) return 0;
+  va_list args;
+  va_start(args, fmt);
+  fprintf(stderr, "%s: ", tag);
+  int count = vfprintf(stderr, fmt, args);
+  fputc('\n', stderr);
+  va_end(args);
+  return count;
+}
+
+static inline uint64_t NowNs(void) {
+  timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return static_cast<uint64_t>(now.tv_sec) * 1000000000 + now.tv_nsec;
+}
+
+/*
+ * y[n] = sum over k of h[k] * x[n - k], on a history kept contiguous so
+ * the inner loop is a plain dot product
+ */
+class DirectFir {
+ public:
+  DirectFir(const float *impulse, uint32_t taps, uint32_t maxFrames)
+      : taps_(taps),
+        reversed_(impulse, impulse + taps),
+        history_(taps + maxFrames, 0.0f) {
+    std::reverse(reversed_.begin(), reversed_.end());
+  }
+
+  void process(const float *in, float *out, uint32_t frames) {
+    float *history = history_.data();
+    memmove(history, history + frames, (taps_ - 1) * sizeof(float));
+    memcpy(history + taps_ - 1, in, frames * sizeof(float));
+    const float *h = reversed_.data();
+    for (uint32_t n = 0; n < frames; n++) {
+      const float *x = history + n;
+      float acc[4] = {0.0f, 0.0f, 0.0f, 0.0f};
+      uint32_t k = 0;
+      for (; k + 4 <= taps_; k += 4) {
+        acc[0] += h[k] * x[k];
+        acc[1] += h[k + 1] * x[k + 1];
+        acc[2] += h[k + 2] * x[k + 2];
+        acc[3] += h[k + 3] * x[k + 3];
+      }
+      for (; k < taps_; k++) acc[0] += h[k] * x[k];
+      out[n] = (acc[0] + acc[1]) + (acc[2] + acc[3]);
+    }
+  }
+
+ private:
+  uint32_t taps_;
+  std::vector<float> reversed_;
+  std::vector<float> history_;
+};
+
+static float Noise(uint32_t *seed) {
+  *seed = *seed * 1664525u + 1013904223u;
+  return static_cast<int32_t>(*seed) * (0.5f / 2147483648.0f);
+}
+
+int main(int argc, char *argv[]) {
+  uint32_t sampleRate = 48000, framesPerBuf = 192, seconds = 2;
+  for (int idx = 1; idx < argc; idx++) {
+    const char *arg = argv[idx];
+    if (!strcmp(arg, "--verbose")) {
+      verbose = true;
+      continue;
+    }
+    if (idx + 1 == argc) {
+      fprintf(stderr, "%s: missing value\n", arg);
+      return 2;
+    }
+    uint32_t value = static_cast<uint32_t>(strtoul(argv[++idx], nullptr, 0));
+    if (!strcmp(arg, "--rate")) {
+      sampleRate = value;
+    } else if (!strcmp(arg, "--frames")) {
+      framesPerBuf = value;
+    } else if (!strcmp(arg, "--seconds")) {
+      seconds = value;
+    } else {
+      fprintf(stderr, "unknown option %s\n", arg);
+      return 2;
+    }
+  }
+  if (!sampleRate || !framesPerBuf) {
+    fprintf(stderr, "--rate and --frames must not be 0\n");
+    return 2;
+  }
+  SLmilliHertz rate = sampleRate * 1000;
+  double periodNs = 1e9 * framesPerBuf / sampleRate;
+
+  printf("%u frames per buffer at %u Hz ( %.0f us ), %s kernels\n",
+         framesPerBuf, sampleRate, periodNs / 1000.0,
+         GetSpectrumKernels().name_);
+  printf("%6s %7s %6s %12s %12s %12s %12s %6s %9s %9s\n", "ir s", "taps",
+         "parts", "fir us", "partitioned", "callback", "callback max", "late",
+         "error dB", "rt err dB");
+
+  static const float kIrSeconds[] = {0.1f, 0.25f, 0.5f, 1.0f, 2.0f, 3.0f};
+  for (float irSeconds : kIrSeconds) {
+    uint32_t taps = static_cast<uint32_t>(irSeconds * sampleRate);
+    std::vector<float> impulse(taps);
+    AudioConvolutionReverb::SynthesizeRoom(impulse.data(), taps, rate,
+                                           static_cast<uint32_t>(
+                                               irSeconds * 1000));
+
+    // the FIR and the partitioned convolution on the same input, blocks
+    // enough to fill the whole impulse response, plus a few
+    uint32_t blocks = taps / framesPerBuf + 8;
+    std::vector<float> in(blocks * framesPerBuf);
+    uint32_t seed = 1;
+    for (float &sample : in) sample = Noise(&seed);
+
+    DirectFir fir(impulse.data(), taps, framesPerBuf);
+    std::vector<float> firOut(in.size());
+    // the FIR is slow: time as many blocks as fit in about a second
+    uint64_t firNs = 0;
+    uint32_t firBlocks = 0;
+    for (uint32_t block = 0; block < blocks; block++) {
+      uint32_t first = block * framesPerBuf;
+      uint64_t start = NowNs();
+      fir.process(&in[first], &firOut[first], framesPerBuf);
+      uint64_t spent = NowNs() - start;
+      if (firNs < 1000000000ull) {
+        firNs += spent;
+        firBlocks++;
+      }
+    }
+
+    AudioConvolutionReverb inline_(rate, 1, SL_PCMSAMPLEFORMAT_FIXED_32,
+                                   framesPerBuf, impulse.data(), taps, 1.0f,
+                                   false);
+    std::vector<float> out(in);
+    for (uint32_t block = 0; block < blocks; block++) {
+      inline_.process(&out[block * framesPerBuf], framesPerBuf);
+    }
+    // and timed on at least a thousand more
+    uint32_t inlineBlocks = std::max(blocks, 1000u);
+    std::vector<float> buf(framesPerBuf);
+    uint64_t inlineNs = 0;
+    for (uint32_t block = 0; block < inlineBlocks; block++) {
+      uint32_t first = (block % blocks) * framesPerBuf;
+      memcpy(buf.data(), &in[first], framesPerBuf * sizeof(float));
+      uint64_t start = NowNs();
+      inline_.process(buf.data(), framesPerBuf);
+      inlineNs += NowNs() - start;
+    }
+    // the reverb is framesPerBuf late
+    float peak = 0.0f, error = 0.0f;
+    for (uint32_t n = 0; n + framesPerBuf < in.size(); n++) {
+      peak = std::max(peak, fabsf(firOut[n]));
+      error = std::max(error, fabsf(firOut[n] - out[n + framesPerBuf]));
+    }
+
+    // with the worker, paced like the audio callbacks
+    AudioConvolutionReverb reverb(rate, 1, SL_PCMSAMPLEFORMAT_FIXED_32,
+                                  framesPerBuf, impulse.data(), taps, 1.0f);
+    reverb.setActive(true);
+    // and without, on the same buffers
+    AudioConvolutionReverb reference(rate, 1, SL_PCMSAMPLEFORMAT_FIXED_32,
+                                     framesPerBuf, impulse.data(), taps, 1.0f,
+                                     false);
+    std::vector<float> ref(framesPerBuf);
+    uint32_t rtBlocks =
+        static_cast<uint32_t>(seconds * 1e9 / periodNs) + 1;
+    uint64_t callbackNs = 0, callbackMax = 0;
+    float rtError = 0.0f;
+    auto next = std::chrono::steady_clock::now();
+    for (uint32_t block = 0; block < rtBlocks; block++) {
+      uint32_t first = (block % blocks) * framesPerBuf;
+      memcpy(buf.data(), &in[first], framesPerBuf * sizeof(float));
+      uint64_t start = NowNs();
+      reverb.process(buf.data(), framesPerBuf);
+      uint64_t spent = NowNs() - start;
+      callbackNs += spent;
+      callbackMax = std::max(callbackMax, spent);
+      memcpy(ref.data(), &in[first], framesPerBuf * sizeof(float));
+      reference.process(ref.data(), framesPerBuf);
+      for (uint32_t n = 0; n < framesPerBuf; n++) {
+        rtError = std::max(rtError, fabsf(ref[n] - buf[n]));
+      }
+      next += std::chrono::nanoseconds(static_cast<int64_t>(periodNs));
+      std::this_thread::sleep_until(next);
+    }
+    AudioReverbStats stats;
+    reverb.getStats(&stats);
+
+    printf("%6.2f %7u %6u %12.1f %12.1f %12.1f %12.1f %6u %9.1f %9.1f\n",
+           irSeconds, taps, inline_.getPartitionCount(),
+           firNs / 1000.0 / std::max(firBlocks, 1u),
+           inlineNs / 1000.0 / inlineBlocks, callbackNs / 1000.0 / rtBlocks,
+           callbackMax / 1000.0, stats.lateTails_,
+           20.0 * log10(std::max(error, 1e-12f) / peak),
+           20.0 * log10(std::max(rtError, 1e-12f) / peak));
+  }
+  printf("( us per buffer; error is the FIR against the reverb, to the "
+         "FIR's peak )\n");
+  return 0;
+}
@@ -15,15 +15,94 @@
  */
 #include "sfxman.hpp"
 
-#include <random>
+#include <atomic>
+#include <cmath>
+#include <cstring>
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
 
 #define SAMPLES_PER_SEC 8000
-#define BUF_SAMPLES_MAX SAMPLES_PER_SEC * 5  // 5 seconds
+#define BUF_SAMPLES_MAX SAMPLES_PER_SEC * 5  // 5 seconds, per sound
 #define DEFAULT_VOLUME 0.9f
 
+// voices mixed at the same time
+#define MIX_VOICES 8
+// samples mixed per callback, 20 ms
+#define MIX_BUF_SAMPLES 160
+// sounds triggered but not picked up by the audio callback yet; power of 2
+#define TRIGGER_QUEUE_SIZE 8
+// different recipes kept compiled, and tones in one recipe
+#define RECIPES_MAX 32
+#define RECIPE_STEPS_MAX 32
+// samples in one period of a wavetable; the table has one more, a copy of
+// the first, so that interpolating never wraps around
+#define WAVETABLE_BITS 10
+#define WAVETABLE_SIZE (1 << WAVETABLE_BITS)
+
+enum SfxWave { WAVE_SILENCE, WAVE_NOISE, WAVE_TONE, WAVE_SINE };
+
+// one tone of a recipe, ready to render
+struct SfxStep {
+  SfxWave wave;
+  uint32_t phaseStep;  // per sample; a whole period is 2^32
+  short amplitude;     // Q15
+  int samples;
+};
+
+/* A recipe string, compiled the first time it is played. The game thread
+ * writes it before it triggers it for the first time, and never again. */
+struct SfxRecipe {
+  char *text;
+  unsigned hash;
+  int samples;  // of all steps
+  int taper;    // faded in at the start, and out at the end
+  int stepCount;
+  SfxStep steps[RECIPE_STEPS_MAX];
+};
+
+struct SfxTrigger {
+  const SfxRecipe *recipe;
+  short gain;  // Q15
+};
+
+// audio thread only
+struct SfxVoice {
+  const SfxRecipe *recipe;  // NULL when free
+  int pos;                  // in the whole sound
+  int step;
+  int stepPos;
+  uint32_t phase;
+  uint32_t noise;  // xorshift state, never 0
+  short gain;
+  unsigned startedAt;  // trigger sequence number, to find the oldest
+};
+
 static SfxMan *_instance = new SfxMan();
-static short _sample_buf[BUF_SAMPLES_MAX];
-static volatile bool _bufferActive = false;
+
+// game thread only
+static SfxRecipe _recipes[RECIPES_MAX];
+static int _recipeCount = 0;
+
+// one period of a tone, with its second harmonic, and of the fundamental
+// alone for tones whose harmonic would alias; Q15, peaks a bit over 1
+static int32_t _toneTable[WAVETABLE_SIZE + 1];
+static int32_t _sineTable[WAVETABLE_SIZE + 1];
+
+// single producer (game thread), single consumer (audio thread)
+static SfxTrigger _triggers[TRIGGER_QUEUE_SIZE];
+static std::atomic<unsigned> _triggerHead(0);
+static std::atomic<unsigned> _triggerTail(0);
+
+static SfxVoice _voices[MIX_VOICES];
+static std::atomic<int> _activeVoices(0);
+static short _voiceBuf[MIX_BUF_SAMPLES];
+static int32_t _mixAcc[MIX_BUF_SAMPLES];
+static short _mixBuf[2][MIX_BUF_SAMPLES];
+static int _mixNext = 0;
 
 SfxMan *SfxMan::GetInstance() {
   return _instance ? _instance : (_instance = new SfxMan());
@@ -38,8 +117,180 @@ static bool _checkError(SLresult r, const char *what) {
   return false;
 }
 
+static void _buildWavetables() {
+  for (int i = 0; i <= WAVETABLE_SIZE; i++) {
+    double x = 2 * M_PI * i / WAVETABLE_SIZE;
+    _sineTable[i] = (int32_t)lrint(32768.0 * sin(x));
+    _toneTable[i] = (int32_t)lrint(32768.0 * (sin(x) + 0.1 * sin(2 * x)));
+  }
+}
+
+/* Render up to count samples of the voice's sound into out; returns how many
+ * it rendered, fewer than count when the sound ends. */
+static int _render(SfxVoice *voice, short *out, int count) {
+  const SfxRecipe *recipe = voice->recipe;
+  int done = 0;
+  while (done < count && voice->step < recipe->stepCount) {
+    const SfxStep &step = recipe->steps[voice->step];
+    int n = step.samples - voice->stepPos;
+    n = n < count - done ? n : count - done;
+    short *dst = out + done;
+    if (step.wave == WAVE_SILENCE) {
+      memset(dst, 0, n * sizeof(short));
+    } else if (step.wave == WAVE_NOISE) {
+      uint32_t x = voice->noise;
+      for (int i = 0; i < n; i++) {
+        x ^= x << 13;
+        x ^= x >> 17;
+        x ^= x << 5;
+        dst[i] = (short)(((int16_t)(x >> 16) * step.amplitude) >> 15);
+      }
+      voice->noise = x;
+    } else {
+      const int32_t *table = step.wave == WAVE_TONE ? _toneTable : _sineTable;
+      uint32_t phase = voice->phase;
+      for (int i = 0; i < n; i++) {
+        // linear interpolation, between entries 15 bits apart
+        uint32_t index = phase >> (32 - WAVETABLE_BITS);
+        int32_t frac = (phase >> (17 - WAVETABLE_BITS)) & 0x7fff;
+        int32_t v = table[index];
+        v += ((table[index + 1] - v) * frac) >> 15;
+        v = (v * step.amplitude) >> 15;
+        dst[i] = v < -32767 ? -32767 : v > 32767 ? 32767 : v;
+        phase += step.phaseStep;
+      }
+      voice->phase = phase;
+    }
+    done += n;
+    voice->stepPos += n;
+    if (voice->stepPos >= step.samples) {
+      // every tone starts at the beginning of its wave
+      voice->step++;
+      voice->stepPos = 0;
+      voice->phase = 0;
+    }
+  }
+
+  // ramp up over the first samples of the sound, and down over the last
+  int taper = recipe->taper;
+  for (int i = 0; i < done; i++) {
+    int pos = voice->pos + i;
+    int ramp = pos < recipe->samples - pos ? pos : recipe->samples - pos;
+    if (ramp < taper) out[i] = (short)(out[i] * ramp / taper);
+  }
+  voice->pos += done;
+  return done;
+}
+
+/* acc[i] += in[i] * gain (Q15), for one voice */
+static void _accumulate(int32_t *acc, const short *in, short gain, int count) {
+  int i = 0;
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+  int16x4_t g = vdup_n_s16(gain);
+  for (; i + 8 <= count; i += 8) {
+    int16x8_t x = vld1q_s16(in + i);
+    int32x4_t lo = vshrq_n_s32(vmull_s16(vget_low_s16(x), g), 15);
+    int32x4_t hi = vshrq_n_s32(vmull_s16(vget_high_s16(x), g), 15);
+    vst1q_s32(acc + i, vaddq_s32(vld1q_s32(acc + i), lo));
+    vst1q_s32(acc + i + 4, vaddq_s32(vld1q_s32(acc + i + 4), hi));
+  }
+#elif defined(__SSE2__)
+  __m128i g = _mm_set1_epi16(gain);
+  for (; i + 8 <= count; i += 8) {
+    __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i *>(in + i));
+    // the low and high halves of the 32 bit products
+    __m128i low = _mm_mullo_epi16(x, g);
+    __m128i high = _mm_mulhi_epi16(x, g);
+    __m128i lo = _mm_srai_epi32(_mm_unpacklo_epi16(low, high), 15);
+    __m128i hi = _mm_srai_epi32(_mm_unpackhi_epi16(low, high), 15);
+    __m128i *dst = reinterpret_cast<__m128i *>(acc + i);
+    _mm_storeu_si128(dst, _mm_add_epi32(_mm_loadu_si128(dst), lo));
+    _mm_storeu_si128(dst + 1, _mm_add_epi32(_mm_loadu_si128(dst + 1), hi));
+  }
+#endif
+  for (; i < count; i++) {
+    acc[i] += (in[i] * gain) >> 15;
+  }
+}
+
+/* out[i] = acc[i], saturated to 16 bits */
+static void _saturate(const int32_t *acc, short *out, int count) {
+  int i = 0;
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+  for (; i + 8 <= count; i += 8) {
+    vst1q_s16(out + i, vcombine_s16(vqmovn_s32(vld1q_s32(acc + i)),
+                                    vqmovn_s32(vld1q_s32(acc + i + 4))));
+  }
+#elif defined(__SSE2__)
+  for (; i + 8 <= count; i += 8) {
+    const __m128i *src = reinterpret_cast<const __m128i *>(acc + i);
+    _mm_storeu_si128(
+        reinterpret_cast<__m128i *>(out + i),
+        _mm_packs_epi32(_mm_loadu_si128(src), _mm_loadu_si128(src + 1)));
+  }
+#endif
+  for (; i < count; i++) {
+    out[i] = acc[i] < -32768 ? -32768 : acc[i] > 32767 ? 32767 : acc[i];
+  }
+}
+
+/* Give every sound triggered since the last buffer a voice: a free one, or
+ * the one that started first. */
+static void _startVoices() {
+  unsigned tail = _triggerTail.load(std::memory_order_relaxed);
+  unsigned head = _triggerHead.load(std::memory_order_acquire);
+  for (; tail != head; tail++) {
+    const SfxTrigger &trigger = _triggers[tail % TRIGGER_QUEUE_SIZE];
+    SfxVoice *voice = NULL;
+    for (int i = 0; i < MIX_VOICES && !voice; i++) {
+      if (!_voices[i].recipe) voice = &_voices[i];
+    }
+    if (!voice) {
+      voice = &_voices[0];
+      for (int i = 1; i < MIX_VOICES; i++) {
+        // wraps around correctly, the voices are far fewer than 2^31 apart
+        if ((int)(_voices[i].startedAt - voice->startedAt) < 0) {
+          voice = &_voices[i];
+        }
+      }
+    }
+    voice->recipe = trigger.recipe;
+    voice->pos = 0;
+    voice->step = 0;
+    voice->stepPos = 0;
+    voice->phase = 0;
+    voice->noise = tail * 2654435761u | 1;
+    voice->gain = trigger.gain;
+    voice->startedAt = tail;
+  }
+  _triggerTail.store(tail, std::memory_order_release);
+}
+
+static void _mix(short *out) {
+  _startVoices();
+  memset(_mixAcc, 0, sizeof(_mixAcc));
+  int active = 0;
+  for (int i = 0; i < MIX_VOICES; i++) {
+    SfxVoice *voice = &_voices[i];
+    if (!voice->recipe) continue;
+    int count = _render(voice, _voiceBuf, MIX_BUF_SAMPLES);
+    _accumulate(_mixAcc, _voiceBuf, voice->gain, count);
+    if (voice->pos >= voice->recipe->samples) {
+      voice->recipe = NULL;
+    } else {
+      active++;
+    }
+  }
+  _activeVoices.store(active, std::memory_order_relaxed);
+  _saturate(_mixAcc, out, MIX_BUF_SAMPLES);
+}
+
+/* The queue always holds both mix buffers: each one that finished playing
+ * gets the next 20 ms of the mix, silence when no voice is playing. */
 static void _bqPlayerCallback(SLAndroidSimpleBufferQueueItf bq, void *context) {
-  _bufferActive = false;
+  _mix(_mixBuf[_mixNext]);
+  (*bq)->Enqueue(bq, _mixBuf[_mixNext], sizeof(_mixBuf[_mixNext]));
+  _mixNext ^= 1;
 }
 
 SfxMan::SfxMan() {
@@ -58,6 +309,7 @@ SfxMan::SfxMan() {
 
   LOGD("SfxMan: initializing.");
   mPlayerBufferQueue = NULL;
+  _buildWavetables();
 
   // create engine
   result = slCreateEngine(&engineObject, 0, NULL, 0, NULL, NULL);
@@ -156,6 +408,14 @@ SfxMan::SfxMan() {
                ->GetInterface(bqPlayerObject, SL_IID_VOLUME, &bqPlayerVolume);
   if (_checkError(result, "getting volume interface")) return;
 
+  // start the mix with two buffers of silence, the callback keeps it going
+  for (int i = 0; i < 2; i++) {
+    _mix(_mixBuf[i]);
+    result = (*mPlayerBufferQueue)
+                 ->Enqueue(mPlayerBufferQueue, _mixBuf[i], sizeof(_mixBuf[i]));
+    if (_checkError(result, "enqueueing mix buffer")) return;
+  }
+
   // set the player's state to playing
   result = (*bqPlayerPlay)->SetPlayState(bqPlayerPlay, SL_PLAYSTATE_PLAYING);
   if (_checkError(result, "setting play state to playing")) return;
@@ -164,7 +424,11 @@ SfxMan::SfxMan() {
   mInitOk = true;
 }
 
-bool SfxMan::IsIdle() { return !_bufferActive; }
+bool SfxMan::IsIdle() {
+  return _activeVoices.load(std::memory_order_relaxed) == 0 &&
+         _triggerTail.load(std::memory_order_acquire) ==
+             _triggerHead.load(std::memory_order_relaxed);
+}
 
 static const char *_parseInt(const char *s, int *result) {
   *result = 0;
@@ -175,62 +439,73 @@ static const char *_parseInt(const char *s, int *result) {
   return s;
 }
 
-static int _synth(int frequency, int duration, float amplitude,
-                  short *sample_buf, int samples) {
-  int i;
-
-  for (i = 0; i < samples; i++) {
-    float t = i / (float)SAMPLES_PER_SEC;
-    float v;
-    if (frequency > 0) {
-      v = amplitude * sin(frequency * t * 2 * M_PI) +
-          (amplitude * 0.1f) * sin(frequency * 2 * t * 2 * M_PI);
-    } else {
-      int r = rand();
-      r = r > 0 ? r : -r;
-      v = amplitude * (-0.5f + (r % 1024) / 512.0f);
-    }
-    int value = (int)(v * 32768.0f);
-    sample_buf[i] = value < -32767 ? -32767 : value > 32767 ? 32767 : value;
-
-    if (i > 0 && sample_buf[i - 1] < 0 && sample_buf[i] >= 0) {
-      // start of new wave -- check if we have room for a full period of it
-      int period_samples = (1.0f / frequency) * SAMPLES_PER_SEC;
-      if (i + period_samples >= samples) break;
-    }
+/* Samples of a tone, cut where its wave starts over for the last period
+ * that fits whole, so that it ends without a click. */
+static int _wholePeriods(int frequency, int samples) {
+  int period_samples = SAMPLES_PER_SEC / frequency;
+  for (int k = 1;; k++) {
+    // first sample of the k-th period
+    int start = (k * SAMPLES_PER_SEC + frequency - 1) / frequency;
+    if (start >= samples) return samples;
+    if (start + period_samples >= samples) return start;
   }
-
-  return i;
 }
 
-static void _taper(short *sample_buf, int samples) {
-  int i;
-  const float TAPER_SAMPLES_FRACTION = 0.1f;
-  int taper_samples = (int)(TAPER_SAMPLES_FRACTION * samples);
-  for (i = 0; i < taper_samples && i < samples; i++) {
-    float factor = i / (float)taper_samples;
-    sample_buf[i] = (short)((float)sample_buf[i] * factor);
+static void _addStep(SfxRecipe *recipe, int frequency, float amplitude,
+                     int samples) {
+  if (samples <= 0) return;
+  if (recipe->stepCount >= RECIPE_STEPS_MAX) {
+    LOGW("SfxMan: tone has too many parts; cutting it short.");
+    return;
   }
-  for (i = samples - taper_samples; i < samples; i++) {
-    if (i < 0) continue;
-    float factor = (samples - i) / (float)taper_samples;
-    sample_buf[i] = (short)((float)sample_buf[i] * factor);
+  SfxStep *step = &recipe->steps[recipe->stepCount++];
+  step->amplitude = (short)(amplitude * 32767.0f);
+  step->phaseStep = 0;
+  if (frequency <= 0) {
+    step->wave = WAVE_NOISE;
+  } else if (amplitude <= 0.0f || 2 * frequency >= SAMPLES_PER_SEC) {
+    // silent, or too high to play without aliasing
+    step->wave = WAVE_SILENCE;
+  } else {
+    step->wave = 4 * frequency >= SAMPLES_PER_SEC ? WAVE_SINE : WAVE_TONE;
+    step->phaseStep = (uint32_t)((((uint64_t)frequency << 32) +
+                                  SAMPLES_PER_SEC / 2) /
+                                 SAMPLES_PER_SEC);
+    samples = _wholePeriods(frequency, samples);
   }
+  step->samples = samples;
+  recipe->samples += samples;
 }
 
-void SfxMan::PlayTone(const char *tone) {
-  if (!mInitOk) {
-    LOGW("SfxMan: not playing sound because initialization failed.");
-    return;
+static unsigned _hash(const char *s) {
+  // FNV-1a
+  unsigned hash = 2166136261u;
+  while (*s) {
+    hash = (hash ^ (unsigned char)*s++) * 16777619u;
   }
-  if (_bufferActive) {
-    // can't play -- the buffer is in use
-    LOGW("SfxMan: can't play tone; buffer is active.");
-    return;
+  return hash;
+}
+
+/* Returns the compiled recipe, compiling it if it is new; NULL when it
+ * can't be kept. */
+static const SfxRecipe *_getRecipe(const char *tone) {
+  unsigned hash = _hash(tone);
+  for (int i = 0; i < _recipeCount; i++) {
+    if (_recipes[i].hash == hash && !strcmp(_recipes[i].text, tone)) {
+      return &_recipes[i];
+    }
+  }
+  if (_recipeCount >= RECIPES_MAX) {
+    LOGW("SfxMan: can't play tone; too many different tones.");
+    return NULL;
   }
+  SfxRecipe *recipe = &_recipes[_recipeCount];
+  recipe->text = strdup(tone);
+  if (!recipe->text) return NULL;
+  recipe->hash = hash;
+  recipe->samples = 0;
+  recipe->stepCount = 0;
 
-  // synth the tone
-  int total_samples = 0;
   int num_samples;
   int frequency = 100;
   int duration = 50;
@@ -256,14 +531,12 @@ void SfxMan::PlayTone(const char *tone) {
                                        : amplitude;
         break;
       case '.':
-        // synth
+        // add a tone
         num_samples = duration * SAMPLES_PER_SEC / 1000;
-        if (num_samples > (BUF_SAMPLES_MAX - total_samples - 1)) {
-          num_samples = BUF_SAMPLES_MAX - total_samples - 1;
+        if (num_samples > (BUF_SAMPLES_MAX - recipe->samples - 1)) {
+          num_samples = BUF_SAMPLES_MAX - recipe->samples - 1;
         }
-        num_samples = _synth(frequency, duration, amplitude,
-                             _sample_buf + total_samples, num_samples);
-        total_samples += num_samples;
+        _addStep(recipe, frequency, amplitude, num_samples);
         tone++;
         break;
       default:
@@ -272,21 +545,35 @@ void SfxMan::PlayTone(const char *tone) {
     }
   }
 
-  SLresult result;
-  int total_size = total_samples * sizeof(short);
-  if (total_size <= 0) {
-    LOGW("Tone is empty. Not playing.");
+  const float TAPER_SAMPLES_FRACTION = 0.1f;
+  recipe->taper = (int)(TAPER_SAMPLES_FRACTION * recipe->samples);
+  _recipeCount++;
+  return recipe;
+}
+
+void SfxMan::PlayTone(const char *tone, float gain) {
+  if (!mInitOk) {
+    LOGW("SfxMan: not playing sound because initialization failed.");
     return;
   }
-
-  _taper(_sample_buf, total_samples);
-
-  _bufferActive = true;
-  result = (*mPlayerBufferQueue)
-               ->Enqueue(mPlayerBufferQueue, _sample_buf, total_size);
-  if (result != SL_RESULT_SUCCESS) {
-    LOGW("SfxMan: warning: failed to enqueue buffer: %lu",
-         (unsigned long)result);
+  unsigned head = _triggerHead.load(std::memory_order_relaxed);
+  if (head - _triggerTail.load(std::memory_order_acquire) >=
+      TRIGGER_QUEUE_SIZE) {
+    // the audio thread is not picking up sounds (yet)
+    LOGW("SfxMan: can't play tone; too many tones pending.");
     return;
   }
+  const SfxRecipe *recipe = _getRecipe(tone);
+  if (!recipe) return;
+  if (recipe->samples <= 0) {
+    LOGW("Tone is empty. Not playing.");
+    return;
+  }
+
+  // hand it to the audio thread, which starts it from its next buffer
+  gain = gain < 0.0f ? 0.0f : gain > 1.0f ? 1.0f : gain;
+  SfxTrigger &trigger = _triggers[head % TRIGGER_QUEUE_SIZE];
+  trigger.recipe = recipe;
+  trigger.gain = (short)(gain * 32767.0f);
+  _triggerHead.store(head + 1, std::memory_order_release);
 }
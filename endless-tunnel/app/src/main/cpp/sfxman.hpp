@@ -24,10 +24,12 @@
 /* Sound effect manager. This class is a singleton that manages sound effect
  * playback. Sound effects are defined by recipes (which are strings) that
  * indicate frequencies and durations. See the PlayTone() method for more info.
- * Note: our sfx generation code is very simplistic and lacks a mixer, so
- * only one sound can be playing at any given time. This is not a problematic
- * limitation for this simple sample but, needless to say, doesn't scale well
- * to a more complex game. */
+ * Sounds are mixed in software: a fixed number of voices play at the same
+ * time, and when they are all busy the one that has been playing longest is
+ * cut off for the new sound. PlayTone() compiles each recipe once, the first
+ * time it is played, and hands it to the audio callback through a lock-free
+ * queue; the callback synthesizes every sound as it mixes it in, so the game
+ * thread does no synthesis and never waits for the audio thread. */
 class SfxMan {
  private:
   bool mInitOk;
@@ -55,11 +57,14 @@ class SfxMan {
    * Example: "d100 f300. d50 f250. a0 d100. a100 d50 f0."
    * This will play a 300Hz tone for 100ms, followed by a 250Hz tone
    * for 50 milliseconds, followed by 100ms of silence, followed
-   * by 50 milliseconds of loud random noise. */
-  void PlayTone(const char* tone);
+   * by 50 milliseconds of loud random noise.
+   *
+   * gain (0-1) scales the whole sound in the mix. Up to 32 different recipes
+   * are kept compiled. Call from one thread only (the game thread). */
+  void PlayTone(const char* tone, float gain = 1.0f);
 
-  // Returns whether or not the sound effect pipeline is idle (able to play
-  // a tone right now).
+  // Returns whether or not the sound effect pipeline is idle (no sound is
+  // playing or about to).
   bool IsIdle();
 };
 
@@ -0,0 +1,349 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+#include "fir-bench.h"
+
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#if defined(__linux__)
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+/*
+ * The JSON fir_bench_run() returns:
+ *
+ * {
+ *   "schema": "hello-neon-fir-bench/1",
+ *   "label": "pixel-7",            the caller's
+ *   "abi": "arm64-v8a",            what this was built for
+ *   "best_backend": "neon",        the one fir_filter() uses
+ *   "cycles": true,                whether there are cycle counts
+ *   "warmup": 3, "repetitions": 21, "min_run_us": 500,
+ *   "results": [
+ *     {
+ *       "id": "neon/32/2560",      filter/kernel_size/width, the same from
+ *                                  one build to the next, to diff them by
+ *       "filter": "neon", "kernel_size": 32, "width": 2560,
+ *       "calls_per_run": 120,
+ *       "ns_per_call": {"median": 1510.2, "p95": 1544.0, "mad": 6.1},
+ *       "ns_per_output": {"median": 0.59, "p95": 0.603, "mad": 0.0024},
+ *       "cycles_per_output": {...}, or null without cycle counts
+ *     },
+ *     ...
+ *   ]
+ * }
+ */
+
+static const int default_kernel_sizes[] = {4, 15, 16, 32, 63, 64};
+static const int default_widths[] = {64, 256, 2560, 16384};
+
+void fir_bench_default_options(FirBenchOptions* options) {
+  options->kernelSizes = default_kernel_sizes;
+  options->numKernelSizes =
+      sizeof(default_kernel_sizes) / sizeof(default_kernel_sizes[0]);
+  options->widths = default_widths;
+  options->numWidths = sizeof(default_widths) / sizeof(default_widths[0]);
+  options->warmup = 3;
+  options->repetitions = 21;
+  options->minRunUs = 500;
+}
+
+/* The JSON as it is written; failed once out of memory */
+typedef struct {
+  char* data;
+  size_t size;
+  size_t capacity;
+  int failed;
+} JsonText;
+
+static void append(JsonText* text, const char* format, ...) {
+  va_list args;
+  int length;
+  if (text->failed) return;
+
+  va_start(args, format);
+  length = vsnprintf(NULL, 0, format, args);
+  va_end(args);
+  if (text->size + length + 1 > text->capacity) {
+    size_t capacity = 2 * (text->size + length + 1);
+    char* data = (char*)realloc(text->data, capacity);
+    if (!data) {
+      text->failed = 1;
+      return;
+    }
+    text->data = data;
+    text->capacity = capacity;
+  }
+  va_start(args, format);
+  vsnprintf(text->data + text->size, text->capacity - text->size, format,
+            args);
+  va_end(args);
+  text->size += length;
+}
+
+/* value as a JSON string, quotes and all */
+static void append_string(JsonText* text, const char* value) {
+  append(text, "\"");
+  for (; *value; value++) {
+    unsigned char ch = (unsigned char)*value;
+    if (ch == '"' || ch == '\\') {
+      append(text, "\\%c", ch);
+    } else if (ch < 0x20) {
+      append(text, "\\u%04x", ch);
+    } else {
+      append(text, "%c", ch);
+    }
+  }
+  append(text, "\"");
+}
+
+static double now_ns(void) {
+  struct timespec res;
+  clock_gettime(CLOCK_MONOTONIC, &res);
+  return 1e9 * res.tv_sec + (double)res.tv_nsec;
+}
+
+/* A counter of the CPU cycles this thread spends in user space; -1 where
+ * there is none, or the kernel does not let this process have it */
+static int open_cycle_counter(void) {
+#if defined(__linux__)
+  struct perf_event_attr attr;
+  memset(&attr, 0, sizeof(attr));
+  attr.type = PERF_TYPE_HARDWARE;
+  attr.size = sizeof(attr);
+  attr.config = PERF_COUNT_HW_CPU_CYCLES;
+  attr.exclude_kernel = 1;
+  attr.exclude_hv = 1;
+  return (int)syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+#else
+  return -1;
+#endif
+}
+
+static double read_cycles(int fd) {
+#if defined(__linux__)
+  uint64_t count;
+  if (fd >= 0 && read(fd, &count, sizeof(count)) == sizeof(count)) {
+    return (double)count;
+  }
+#else
+  (void)fd;
+#endif
+  return 0;
+}
+
+static int compare_doubles(const void* a, const void* b) {
+  double x = *(const double*)a, y = *(const double*)b;
+  return x < y ? -1 : x > y;
+}
+
+static double median_of_sorted(const double* values, int count) {
+  return count % 2 ? values[count / 2]
+                   : (values[count / 2 - 1] + values[count / 2]) / 2;
+}
+
+/* Appends {"median": , "p95": , "mad": } of values, each divided by scale;
+ * sorts values, and uses scratch */
+static void append_stats(JsonText* json, double* values, double* scratch,
+                         int count, double scale) {
+  double median, p95;
+  int idx;
+  qsort(values, count, sizeof(double), compare_doubles);
+  median = median_of_sorted(values, count);
+  /* nearest rank */
+  p95 = values[(95 * count + 99) / 100 - 1];
+  for (idx = 0; idx < count; idx++) {
+    scratch[idx] = values[idx] > median ? values[idx] - median
+                                        : median - values[idx];
+  }
+  qsort(scratch, count, sizeof(double), compare_doubles);
+  append(json, "{\"median\": %.6g, \"p95\": %.6g, \"mad\": %.6g}",
+         median / scale, p95 / scale, median_of_sorted(scratch, count) / scale);
+}
+
+/* One run of calls calls; returns ns, and the cycles in *cycles */
+static double time_run(FirFilterFunc filter, short* output, const short* input,
+                       const short* kernel, int width, int kernelSize,
+                       int calls, int cycleFd, double* cycles) {
+  double c0 = read_cycles(cycleFd);
+  double t0 = now_ns();
+  int count;
+  for (count = 0; count < calls; count++) {
+    filter(output, input, kernel, width, kernelSize);
+  }
+  t0 = now_ns() - t0;
+  *cycles = read_cycles(cycleFd) - c0;
+  return t0;
+}
+
+static void bench_one(JsonText* json, const FirBenchOptions* options,
+                      const FirBenchFilter* filter, int kernelSize, int width,
+                      short* output, const short* input, const short* kernel,
+                      int cycleFd, double* times, double* cycles,
+                      double* scratch) {
+  const short* centered = input + kernelSize / 2;
+  double minRunNs = 1000.0 * options->minRunUs, t, c;
+  int calls = 1, run;
+
+  /* enough calls to make a run last minRunUs */
+  for (;;) {
+    t = time_run(filter->filter, output, centered, kernel, width, kernelSize,
+                 calls, cycleFd, &c);
+    if (t >= minRunNs || calls >= (1 << 24)) break;
+    if (t < minRunNs / 16) {
+      calls *= 16;
+    } else {
+      calls = (int)(calls * 1.1 * minRunNs / t) + 1;
+    }
+  }
+  for (run = 0; run < options->warmup; run++) {
+    time_run(filter->filter, output, centered, kernel, width, kernelSize,
+             calls, cycleFd, &c);
+  }
+  for (run = 0; run < options->repetitions; run++) {
+    times[run] = time_run(filter->filter, output, centered, kernel, width,
+                          kernelSize, calls, cycleFd, &c) /
+                 calls;
+    cycles[run] = c / calls;
+  }
+
+  append(json,
+         "    {\"id\": \"%s/%d/%d\", \"filter\": \"%s\", \"kernel_size\": %d, "
+         "\"width\": %d, \"calls_per_run\": %d,\n      \"ns_per_call\": ",
+         filter->name, kernelSize, width, filter->name, kernelSize, width,
+         calls);
+  append_stats(json, times, scratch, options->repetitions, 1);
+  append(json, ",\n      \"ns_per_output\": ");
+  append_stats(json, times, scratch, options->repetitions, width);
+  append(json, ",\n      \"cycles_per_output\": ");
+  if (cycleFd >= 0) {
+    append_stats(json, cycles, scratch, options->repetitions, width);
+  } else {
+    append(json, "null");
+  }
+  append(json, "}");
+}
+
+static const char* abi_name(void) {
+#if defined(__aarch64__)
+  return "arm64-v8a";
+#elif defined(__arm__)
+  return "armeabi-v7a";
+#elif defined(__x86_64__)
+  return "x86_64";
+#elif defined(__i386__)
+  return "x86";
+#else
+  return "unknown";
+#endif
+}
+
+char* fir_bench_run(const FirBenchOptions* options, const FirBenchFilter* extra,
+                    int numExtra, const char* label) {
+  JsonText json = {NULL, 0, 0, 0};
+  FirBenchFilter filters[16];
+  int numFilters = 0, maxKernelSize = 1, maxWidth = 1, idx, kk, ww;
+  int cycleFd, first = 1;
+  short *kernel, *input, *output;
+  double *times, *cycles, *scratch;
+
+  for (idx = 0; idx < numExtra && numFilters < 16; idx++) {
+    filters[numFilters++] = extra[idx];
+  }
+  for (idx = 0; idx < FIR_BACKEND_COUNT && numFilters < 16; idx++) {
+    FirFilterFunc filter = fir_backend_filter((FirBackend)idx);
+    if (filter) {
+      filters[numFilters].name = fir_backend_name((FirBackend)idx);
+      filters[numFilters].filter = filter;
+      numFilters++;
+    }
+  }
+  for (idx = 0; idx < options->numKernelSizes; idx++) {
+    if (options->kernelSizes[idx] > maxKernelSize) {
+      maxKernelSize = options->kernelSizes[idx];
+    }
+  }
+  for (idx = 0; idx < options->numWidths; idx++) {
+    if (options->widths[idx] > maxWidth) maxWidth = options->widths[idx];
+  }
+
+  kernel = (short*)malloc(maxKernelSize * sizeof(short));
+  input = (short*)malloc((maxWidth + maxKernelSize) * sizeof(short));
+  output = (short*)malloc(maxWidth * sizeof(short));
+  times = (double*)malloc(options->repetitions * sizeof(double));
+  cycles = (double*)malloc(options->repetitions * sizeof(double));
+  scratch = (double*)malloc(options->repetitions * sizeof(double));
+  if (!kernel || !input || !output || !times || !cycles || !scratch ||
+      options->repetitions < 1) {
+    json.failed = 1;
+    goto EXIT;
+  }
+  /* a low pass, with its taps adding up to about 1.0 in Q16 */
+  for (idx = 0; idx < maxKernelSize; idx++) {
+    kernel[idx] = (short)(65536 / maxKernelSize / 2 + (idx & 7));
+  }
+  for (idx = 0; idx < maxWidth + maxKernelSize; idx++) {
+    input[idx] = (short)((5 * idx) & 255);
+  }
+  cycleFd = open_cycle_counter();
+
+  append(&json,
+         "{\n  \"schema\": \"hello-neon-fir-bench/1\",\n  \"label\": ");
+  append_string(&json, label ? label : "");
+  append(&json,
+         ",\n  \"abi\": \"%s\",\n  \"best_backend\": \"%s\",\n"
+         "  \"cycles\": %s,\n"
+         "  \"warmup\": %d, \"repetitions\": %d, \"min_run_us\": %d,\n"
+         "  \"results\": [\n",
+         abi_name(), fir_backend_name(fir_best_backend()),
+         cycleFd >= 0 ? "true" : "false", options->warmup,
+         options->repetitions, options->minRunUs);
+  for (idx = 0; idx < numFilters; idx++) {
+    for (kk = 0; kk < options->numKernelSizes; kk++) {
+      for (ww = 0; ww < options->numWidths; ww++) {
+        if (!first) append(&json, ",\n");
+        first = 0;
+        bench_one(&json, options, &filters[idx], options->kernelSizes[kk],
+                  options->widths[ww], output, input, kernel, cycleFd, times,
+                  cycles, scratch);
+      }
+    }
+  }
+  append(&json, "\n  ]\n}\n");
+
+#if defined(__linux__)
+  if (cycleFd >= 0) close(cycleFd);
+#endif
+EXIT:
+  free(kernel);
+  free(input);
+  free(output);
+  free(times);
+  free(cycles);
+  free(scratch);
+  if (json.failed) {
+    free(json.data);
+    return NULL;
+  }
+  return json.data;
+}
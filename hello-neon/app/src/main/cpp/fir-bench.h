@@ -0,0 +1,69 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+#ifndef HELLONEON_FIR_BENCH_H
+#define HELLONEON_FIR_BENCH_H
+
+#include "fir-filter.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Times FIR filters over a sweep of kernel and output sizes, the same way
+ * on a device ( HelloNeon, see helloneon.c ) and on a host
+ * ( tools/fir_bench ), and reports it as JSON.
+ *
+ * Each filter runs a few untimed warm-up runs, then repetitions timed runs
+ * of enough calls to last at least minRunUs each. Every run gives the time
+ * of one call, and, where the kernel lets this process count CPU cycles
+ * ( perf_event_open ), its cycles; over the runs, the JSON has the median,
+ * the 95th percentile and the median absolute deviation ( MAD ) of each,
+ * per call and per output sample.
+ */
+typedef struct {
+  const char* name;
+  FirFilterFunc filter;
+} FirBenchFilter;
+
+typedef struct {
+  const int* kernelSizes;
+  int numKernelSizes;
+  const int* widths; /* outputs per call */
+  int numWidths;
+  int warmup;
+  int repetitions;
+  int minRunUs;
+} FirBenchOptions;
+
+/* The sweep HelloNeon runs: 4 to 64 taps, 64 to 16384 outputs */
+void fir_bench_default_options(FirBenchOptions* options);
+
+/*
+ * Benchmarks the numExtra filters in extra ( say the reference C one ),
+ * then every fir-filter.h backend the CPU can run, and returns the JSON
+ * ( laid out at the top of fir-bench.c ), to free(); NULL if out of
+ * memory. label names the machine or build, for the dashboard.
+ */
+char* fir_bench_run(const FirBenchOptions* options, const FirBenchFilter* extra,
+                    int numExtra, const char* label);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* HELLONEON_FIR_BENCH_H */
@@ -0,0 +1,80 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+#include <immintrin.h>
+
+#include "fir-filter-backends.h"
+
+/* this source file is built with -mavx2, and only runs when the CPU has it.
+ *
+ * It works as fir-filter-sse41.c does, on 16 outputs per register. The
+ * 256-bit unpacks work on each 128-bit half apart, so a register of pairs
+ * holds outputs 0-3 and 8-11, or 4-7 and 12-15; the 256-bit pack puts them
+ * back in order.
+ */
+
+static inline __m256i tap_pair(const short* kernel, int mm, int kernelSize) {
+  unsigned second = mm + 1 < kernelSize ? (unsigned short)kernel[mm + 1] : 0;
+  return _mm256_set1_epi32((int)((unsigned short)kernel[mm] | (second << 16)));
+}
+
+static inline void add_tap_pair(__m256i* acc_lo, __m256i* acc_hi,
+                                const short* in, __m256i taps, int single) {
+  __m256i first = _mm256_loadu_si256((const __m256i*)in);
+  __m256i second = single ? _mm256_setzero_si256()
+                          : _mm256_loadu_si256((const __m256i*)(in + 1));
+  *acc_lo = _mm256_add_epi32(
+      *acc_lo, _mm256_madd_epi16(_mm256_unpacklo_epi16(first, second), taps));
+  *acc_hi = _mm256_add_epi32(
+      *acc_hi, _mm256_madd_epi16(_mm256_unpackhi_epi16(first, second), taps));
+}
+
+static inline void store_outputs(short* output, __m256i acc_lo,
+                                 __m256i acc_hi) {
+  const __m256i round = _mm256_set1_epi32(0x8000);
+  acc_lo = _mm256_srai_epi32(_mm256_add_epi32(acc_lo, round), 16);
+  acc_hi = _mm256_srai_epi32(_mm256_add_epi32(acc_hi, round), 16);
+  _mm256_storeu_si256((__m256i*)output, _mm256_packs_epi32(acc_lo, acc_hi));
+}
+
+void fir_filter_avx2(short* output, const short* input, const short* kernel,
+                     int width, int kernelSize) {
+  int nn = 0, mm, offset = -kernelSize / 2;
+
+  /* 32 outputs at a time, in 4 registers */
+  for (; nn + 32 <= width; nn += 32) {
+    const short* in = input + nn + offset;
+    __m256i acc0 = _mm256_setzero_si256(), acc1 = acc0, acc2 = acc0,
+            acc3 = acc0;
+    for (mm = 0; mm + 1 < kernelSize; mm += 2) {
+      __m256i taps = tap_pair(kernel, mm, kernelSize);
+      add_tap_pair(&acc0, &acc1, in + mm, taps, 0);
+      add_tap_pair(&acc2, &acc3, in + mm + 16, taps, 0);
+    }
+    if (mm < kernelSize) {
+      __m256i taps = tap_pair(kernel, mm, kernelSize);
+      add_tap_pair(&acc0, &acc1, in + mm, taps, 1);
+      add_tap_pair(&acc2, &acc3, in + mm + 16, taps, 1);
+    }
+    store_outputs(output + nn, acc0, acc1);
+    store_outputs(output + nn + 16, acc2, acc3);
+  }
+
+  /* any CPU with AVX2 has SSE4.1, for the rest */
+  if (nn < width) {
+    fir_filter_sse41(output + nn, input + nn, kernel, width - nn, kernelSize);
+  }
+}
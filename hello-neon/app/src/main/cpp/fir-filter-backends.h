@@ -0,0 +1,47 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+#ifndef HELLONEON_FIR_FILTER_BACKENDS_H
+#define HELLONEON_FIR_FILTER_BACKENDS_H
+
+/*
+ * The backends behind fir-filter.h, one per source file, each compiled with
+ * the flags for its instructions ( see CMakeLists.txt ). The build defines
+ * HAVE_FIR_NEON, HAVE_FIR_SSE41 and HAVE_FIR_AVX2 for the ones it has; only
+ * call them through fir_backend_filter(), which checks the CPU.
+ */
+void fir_filter_scalar(short* output, const short* input, const short* kernel,
+                       int width, int kernelSize);
+void fir_filter_neon(short* output, const short* input, const short* kernel,
+                     int width, int kernelSize);
+void fir_filter_sse41(short* output, const short* input, const short* kernel,
+                      int width, int kernelSize);
+void fir_filter_avx2(short* output, const short* input, const short* kernel,
+                     int width, int kernelSize);
+
+/* One output, the way fir_filter_c() works it out; input is where the
+ * first tap falls. For the outputs left over after the blocks. */
+static inline short fir_output(const short* input, const short* kernel,
+                               int kernelSize) {
+  int sum = 0;
+  int mm;
+  for (mm = 0; mm < kernelSize; mm++) {
+    sum += kernel[mm] * input[mm];
+  }
+  return (short)((sum + 0x8000) >> 16);
+}
+
+#endif /* HELLONEON_FIR_FILTER_BACKENDS_H */
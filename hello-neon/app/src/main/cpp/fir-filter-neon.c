@@ -0,0 +1,86 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+#include "fir-filter-backends.h"
+#if defined(HAVE_NEON_X86)
+/* only to check this file on an x86 host, see tools/fir_filter_test */
+#include "NEON_2_SSE.h"
+#else
+#include <arm_neon.h>
+#endif
+
+/* this source file is built in NEON mode ( -mfpu=neon on armeabi-v7a ).
+ *
+ * Unlike fir_filter_neon_intrinsics(), which works one output at a time and
+ * adds up the 4 lanes for each, every lane here is an output of its own:
+ * each tap of the kernel is multiplied into 16 inputs in a row, for 16
+ * outputs, so there is nothing to add up across lanes at the end.
+ */
+
+/* Adds tap `lane` of taps, at in, to the 16 outputs of acc0-3 */
+#define FIR_TAP16(lane, in)                                              \
+  do {                                                                   \
+    int16x8_t lo = vld1q_s16(in);                                        \
+    int16x8_t hi = vld1q_s16((in) + 8);                                  \
+    acc0 = vmlal_lane_s16(acc0, vget_low_s16(lo), taps, lane);           \
+    acc1 = vmlal_lane_s16(acc1, vget_high_s16(lo), taps, lane);          \
+    acc2 = vmlal_lane_s16(acc2, vget_low_s16(hi), taps, lane);           \
+    acc3 = vmlal_lane_s16(acc3, vget_high_s16(hi), taps, lane);          \
+  } while (0)
+
+/* (acc + 0x8000) >> 16, for 4 outputs */
+static inline int16x4_t round_outputs(int32x4_t acc) {
+  return vshrn_n_s32(vaddq_s32(acc, vdupq_n_s32(0x8000)), 16);
+}
+
+void fir_filter_neon(short* output, const short* input, const short* kernel,
+                     int width, int kernelSize) {
+  int nn = 0, mm, offset = -kernelSize / 2;
+
+  /* 16 outputs at a time, in 4 registers */
+  for (; nn + 16 <= width; nn += 16) {
+    const short* in = input + nn + offset;
+    int32x4_t acc0 = vdupq_n_s32(0), acc1 = acc0, acc2 = acc0, acc3 = acc0;
+    for (mm = 0; mm + 4 <= kernelSize; mm += 4) {
+      int16x4_t taps = vld1_s16(kernel + mm);
+      FIR_TAP16(0, in + mm);
+      FIR_TAP16(1, in + mm + 1);
+      FIR_TAP16(2, in + mm + 2);
+      FIR_TAP16(3, in + mm + 3);
+    }
+    for (; mm < kernelSize; mm++) {
+      int16x4_t taps = vdup_n_s16(kernel[mm]);
+      FIR_TAP16(0, in + mm);
+    }
+    vst1q_s16(output + nn,
+              vcombine_s16(round_outputs(acc0), round_outputs(acc1)));
+    vst1q_s16(output + nn + 8,
+              vcombine_s16(round_outputs(acc2), round_outputs(acc3)));
+  }
+
+  for (; nn + 4 <= width; nn += 4) {
+    const short* in = input + nn + offset;
+    int32x4_t acc = vdupq_n_s32(0);
+    for (mm = 0; mm < kernelSize; mm++) {
+      acc = vmlal_n_s16(acc, vld1_s16(in + mm), kernel[mm]);
+    }
+    vst1_s16(output + nn, round_outputs(acc));
+  }
+
+  for (; nn < width; nn++) {
+    output[nn] = fir_output(input + nn + offset, kernel, kernelSize);
+  }
+}
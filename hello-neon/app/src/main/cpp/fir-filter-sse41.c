@@ -0,0 +1,97 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+#include <smmintrin.h>
+
+#include "fir-filter-backends.h"
+
+/* this source file is built with -msse4.1, and only runs when the CPU has
+ * it.
+ *
+ * _mm_madd_epi16() multiplies 8 pairs of 16-bit values and adds up each
+ * pair: given (input[nn + mm], input[nn + mm + 1]) for 4 outputs nn, and
+ * (kernel[mm], kernel[mm + 1]) in every lane, it applies two taps to 4
+ * outputs at once, in 32 bits, with no adding across lanes afterwards.
+ */
+
+/* (kernel[mm], kernel[mm + 1]) in each 32-bit lane; 0 past the end */
+static inline __m128i tap_pair(const short* kernel, int mm, int kernelSize) {
+  unsigned second = mm + 1 < kernelSize ? (unsigned short)kernel[mm + 1] : 0;
+  return _mm_set1_epi32((int)((unsigned short)kernel[mm] | (second << 16)));
+}
+
+/* Adds taps mm and mm + 1 to the 8 outputs of acc_lo and acc_hi; in points
+ * at the first of their inputs, for tap mm. */
+static inline void add_tap_pair(__m128i* acc_lo, __m128i* acc_hi,
+                                const short* in, __m128i taps, int single) {
+  __m128i first = _mm_loadu_si128((const __m128i*)in);
+  /* one tap left: pair it with 0, without reading past the input */
+  __m128i second = single ? _mm_setzero_si128()
+                          : _mm_loadu_si128((const __m128i*)(in + 1));
+  *acc_lo = _mm_add_epi32(
+      *acc_lo, _mm_madd_epi16(_mm_unpacklo_epi16(first, second), taps));
+  *acc_hi = _mm_add_epi32(
+      *acc_hi, _mm_madd_epi16(_mm_unpackhi_epi16(first, second), taps));
+}
+
+/* (acc + 0x8000) >> 16, for 8 outputs */
+static inline void store_outputs(short* output, __m128i acc_lo,
+                                 __m128i acc_hi) {
+  const __m128i round = _mm_set1_epi32(0x8000);
+  acc_lo = _mm_srai_epi32(_mm_add_epi32(acc_lo, round), 16);
+  acc_hi = _mm_srai_epi32(_mm_add_epi32(acc_hi, round), 16);
+  _mm_storeu_si128((__m128i*)output, _mm_packs_epi32(acc_lo, acc_hi));
+}
+
+void fir_filter_sse41(short* output, const short* input, const short* kernel,
+                      int width, int kernelSize) {
+  int nn = 0, mm, offset = -kernelSize / 2;
+
+  /* 16 outputs at a time, in 4 registers */
+  for (; nn + 16 <= width; nn += 16) {
+    const short* in = input + nn + offset;
+    __m128i acc0 = _mm_setzero_si128(), acc1 = acc0, acc2 = acc0,
+            acc3 = acc0;
+    for (mm = 0; mm + 1 < kernelSize; mm += 2) {
+      __m128i taps = tap_pair(kernel, mm, kernelSize);
+      add_tap_pair(&acc0, &acc1, in + mm, taps, 0);
+      add_tap_pair(&acc2, &acc3, in + mm + 8, taps, 0);
+    }
+    if (mm < kernelSize) {
+      __m128i taps = tap_pair(kernel, mm, kernelSize);
+      add_tap_pair(&acc0, &acc1, in + mm, taps, 1);
+      add_tap_pair(&acc2, &acc3, in + mm + 8, taps, 1);
+    }
+    store_outputs(output + nn, acc0, acc1);
+    store_outputs(output + nn + 8, acc2, acc3);
+  }
+
+  for (; nn + 8 <= width; nn += 8) {
+    const short* in = input + nn + offset;
+    __m128i acc0 = _mm_setzero_si128(), acc1 = acc0;
+    for (mm = 0; mm + 1 < kernelSize; mm += 2) {
+      add_tap_pair(&acc0, &acc1, in + mm, tap_pair(kernel, mm, kernelSize), 0);
+    }
+    if (mm < kernelSize) {
+      add_tap_pair(&acc0, &acc1, in + mm, tap_pair(kernel, mm, kernelSize), 1);
+    }
+    store_outputs(output + nn, acc0, acc1);
+  }
+
+  for (; nn < width; nn++) {
+    output[nn] = fir_output(input + nn + offset, kernel, kernelSize);
+  }
+}
@@ -0,0 +1,175 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+#include "fir-filter.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "fir-filter-backends.h"
+
+#if defined(__ANDROID__) && defined(__arm__)
+#include <cpu-features.h>
+#endif
+
+void fir_filter_scalar(short* output, const short* input, const short* kernel,
+                       int width, int kernelSize) {
+  int nn, offset = -kernelSize / 2;
+  for (nn = 0; nn < width; nn++) {
+    output[nn] = fir_output(input + nn + offset, kernel, kernelSize);
+  }
+}
+
+static const char* const backend_names[FIR_BACKEND_COUNT] = {
+    "c", "neon", "sse4.1", "avx2"};
+
+const char* fir_backend_name(FirBackend backend) {
+  if (backend < 0 || backend >= FIR_BACKEND_COUNT) return "?";
+  return backend_names[backend];
+}
+
+/* Whether this CPU can run the backend, which is built in */
+static int cpu_supports(FirBackend backend) {
+  switch (backend) {
+    case FIR_BACKEND_C:
+      return 1;
+#if defined(HAVE_FIR_NEON)
+    case FIR_BACKEND_NEON:
+#if defined(__ANDROID__) && defined(__arm__)
+      /* optional on ARMv7 */
+      return (android_getCpuFeatures() & ANDROID_CPU_ARM_FEATURE_NEON) != 0;
+#else
+      /* always there on ARMv8, and NEON_2_SSE.h only needs SSSE3 */
+      return 1;
+#endif
+#endif
+#if defined(HAVE_FIR_SSE41)
+    case FIR_BACKEND_SSE41:
+      __builtin_cpu_init();
+      return __builtin_cpu_supports("sse4.1");
+#endif
+#if defined(HAVE_FIR_AVX2) && defined(HAVE_FIR_SSE41)
+    case FIR_BACKEND_AVX2:
+      /* fir_filter_avx2() leaves what is left over to fir_filter_sse41() */
+      __builtin_cpu_init();
+      return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("sse4.1");
+#endif
+    default:
+      return 0;
+  }
+}
+
+FirFilterFunc fir_backend_filter(FirBackend backend) {
+  if (!cpu_supports(backend)) return NULL;
+  switch (backend) {
+    case FIR_BACKEND_C:
+      return fir_filter_scalar;
+#if defined(HAVE_FIR_NEON)
+    case FIR_BACKEND_NEON:
+      return fir_filter_neon;
+#endif
+#if defined(HAVE_FIR_SSE41)
+    case FIR_BACKEND_SSE41:
+      return fir_filter_sse41;
+#endif
+#if defined(HAVE_FIR_AVX2) && defined(HAVE_FIR_SSE41)
+    case FIR_BACKEND_AVX2:
+      return fir_filter_avx2;
+#endif
+    default:
+      return NULL;
+  }
+}
+
+FirBackend fir_best_backend(void) {
+  /* worked out once; threads racing here all store the same */
+  static int best = -1;
+  if (best < 0) {
+    static const FirBackend fastest_first[] = {
+        FIR_BACKEND_AVX2, FIR_BACKEND_SSE41, FIR_BACKEND_NEON, FIR_BACKEND_C};
+    int idx = 0;
+    while (!fir_backend_filter(fastest_first[idx])) idx++;
+    best = fastest_first[idx];
+  }
+  return (FirBackend)best;
+}
+
+void fir_filter(short* output, const short* input, const short* kernel,
+                int width, int kernelSize) {
+  fir_backend_filter(fir_best_backend())(output, input, kernel, width,
+                                         kernelSize);
+}
+
+/* Inputs filtered per call to the backend */
+#define FIR_STREAM_BLOCK 256
+
+struct FirStream {
+  FirFilterFunc filter;
+  short* kernel;
+  int kernelSize;
+  /* kernelSize - 1 inputs from before, then up to FIR_STREAM_BLOCK new */
+  short* window;
+};
+
+FirStream* fir_stream_create(const short* kernel, int kernelSize,
+                             FirBackend backend) {
+  FirStream* stream;
+  FirFilterFunc filter = fir_backend_filter(backend);
+  if (!filter || kernelSize < 1) return NULL;
+
+  stream = (FirStream*)calloc(1, sizeof(*stream));
+  if (!stream) return NULL;
+  stream->filter = filter;
+  stream->kernelSize = kernelSize;
+  stream->kernel = (short*)malloc(kernelSize * sizeof(short));
+  stream->window =
+      (short*)malloc((kernelSize - 1 + FIR_STREAM_BLOCK) * sizeof(short));
+  if (!stream->kernel || !stream->window) {
+    fir_stream_destroy(stream);
+    return NULL;
+  }
+  memcpy(stream->kernel, kernel, kernelSize * sizeof(short));
+  fir_stream_reset(stream);
+  return stream;
+}
+
+void fir_stream_process(FirStream* stream, short* output, const short* input,
+                        int count) {
+  int kernelSize = stream->kernelSize;
+  while (count > 0) {
+    int block = count < FIR_STREAM_BLOCK ? count : FIR_STREAM_BLOCK;
+    memcpy(stream->window + kernelSize - 1, input, block * sizeof(short));
+    /* the taps of the first output start at window[0] */
+    stream->filter(output, stream->window + kernelSize / 2, stream->kernel,
+                   block, kernelSize);
+    memmove(stream->window, stream->window + block,
+            (kernelSize - 1) * sizeof(short));
+    output += block;
+    input += block;
+    count -= block;
+  }
+}
+
+void fir_stream_reset(FirStream* stream) {
+  memset(stream->window, 0, (stream->kernelSize - 1) * sizeof(short));
+}
+
+void fir_stream_destroy(FirStream* stream) {
+  if (!stream) return;
+  free(stream->kernel);
+  free(stream->window);
+  free(stream);
+}
@@ -0,0 +1,90 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+#ifndef HELLONEON_FIR_FILTER_H
+#define HELLONEON_FIR_FILTER_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * 16-bit FIR filters, each output computed as fir_filter_c() in helloneon.c
+ * does, to the bit:
+ *
+ *   output[nn] = (sum(kernel[mm] * input[nn - kernelSize / 2 + mm]) + 0x8000)
+ *                >> 16
+ *
+ * so input must have kernelSize / 2 samples before it, and the rest of the
+ * kernel after its last output, and the sums must fit in 32 bits. Any
+ * kernelSize works, and any width.
+ *
+ * Each backend works out a block of outputs at a time, in registers, one
+ * kernel tap after the other; the C one is the reference. fir_filter()
+ * picks the fastest that the CPU it runs on can run.
+ */
+typedef enum {
+  FIR_BACKEND_C,
+  FIR_BACKEND_NEON,
+  FIR_BACKEND_SSE41,
+  FIR_BACKEND_AVX2,
+  FIR_BACKEND_COUNT
+} FirBackend;
+
+typedef void (*FirFilterFunc)(short* output, const short* input,
+                              const short* kernel, int width, int kernelSize);
+
+/* "c", "neon", "sse4.1" or "avx2" */
+const char* fir_backend_name(FirBackend backend);
+
+/* The backend's filter, or NULL when it is not built in, or the CPU lacks
+ * the instructions it needs */
+FirFilterFunc fir_backend_filter(FirBackend backend);
+
+/* The fastest backend this CPU can run */
+FirBackend fir_best_backend(void);
+
+/* Filters with the fastest backend */
+void fir_filter(short* output, const short* input, const short* kernel,
+                int width, int kernelSize);
+
+/*
+ * A filter over a stream that comes in blocks of any size. Output nn of the
+ * stream is that of fir_filter() centered kernelSize - 1 - kernelSize / 2
+ * samples earlier, so that it only needs input up to nn; the stream starts
+ * out with silence before it.
+ */
+typedef struct FirStream FirStream;
+
+/* The kernel is copied; NULL if out of memory, or backend is not
+ * available */
+FirStream* fir_stream_create(const short* kernel, int kernelSize,
+                             FirBackend backend);
+
+/* count outputs, for the next count inputs */
+void fir_stream_process(FirStream* stream, short* output, const short* input,
+                        int count);
+
+/* Back to silence */
+void fir_stream_reset(FirStream* stream);
+
+void fir_stream_destroy(FirStream* stream);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* HELLONEON_FIR_FILTER_H */
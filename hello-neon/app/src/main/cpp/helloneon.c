@@ -21,6 +21,8 @@
 #include <string.h>
 #include <time.h>
 
+#include "fir-bench.h"
+#include "fir-filter.h"
 #include "helloneon-intrinsics.h"
 
 #define DEBUG 0
@@ -37,7 +39,7 @@
 /* return current time in milliseconds */
 static double now_ms(void) {
   struct timespec res;
-  clock_gettime(CLOCK_REALTIME, &res);
+  clock_gettime(CLOCK_MONOTONIC, &res);
   return 1000.0 * res.tv_sec + (double)res.tv_nsec / 1e6;
 }
 
@@ -83,7 +85,7 @@ jstring Java_com_example_helloneon_HelloNeon_stringFromJNI(JNIEnv* env,
   AndroidCpuFamily family;
   uint64_t features;
   char buffer[512];
-  double t0, t1, time_c, time_neon;
+  double t0, t1, time_c, time_neon, time_lib;
 
   /* setup FIR input - whatever */
   {
@@ -111,6 +113,27 @@ jstring Java_com_example_helloneon_HelloNeon_stringFromJNI(JNIEnv* env,
   strlcpy(buffer, str, sizeof buffer);
   free(str);
 
+  /* Benchmark small FIR filter loop - fir-filter.h, on whichever backend
+   * suits this CPU best */
+  t0 = now_ms();
+  {
+    int count = FIR_ITERATIONS;
+    for (; count > 0; count--) {
+      fir_filter(fir_output, fir_input, fir_kernel, FIR_OUTPUT_SIZE,
+                 FIR_KERNEL_SIZE);
+    }
+  }
+  t1 = now_ms();
+  time_lib = t1 - t0;
+  asprintf(&str, "Library (%s) : %g ms (x%g faster)\n",
+           fir_backend_name(fir_best_backend()), time_lib,
+           time_c / (time_lib < 1e-6 ? 1. : time_lib));
+  strlcat(buffer, str, sizeof buffer);
+  free(str);
+  if (memcmp(fir_output, fir_output_expected, sizeof fir_output) != 0) {
+    strlcat(buffer, "Library output differs from C version !\n", sizeof buffer);
+  }
+
   strlcat(buffer, "Neon version   : ", sizeof buffer);
 
   features = android_getCpuFeatures();
@@ -163,3 +186,39 @@ EXIT:
   D("%s", buffer);
   return (*env)->NewStringUTF(env, buffer);
 }
+
+/* The sweep of fir-bench.h, as JSON: fir_filter_c() and, where it is built,
+ * fir_filter_neon_intrinsics() when the CPU has NEON, then every fir-filter.h
+ * backend. Takes a few seconds; HelloNeon runs it off the UI thread. */
+jstring Java_com_example_helloneon_HelloNeon_benchmarkJson(JNIEnv* env,
+                                                           jobject thiz,
+                                                           jstring label) {
+  FirBenchFilter extra[2] = {{"fir_filter_c", fir_filter_c}};
+  int extraCount = 1;
+  FirBenchOptions options;
+  const char* labelChars;
+  char* json;
+  jstring result;
+
+#ifdef HAVE_NEON
+#ifdef __arm__
+  /* NEON is optional on ARMv7: running without it raises SIGILL */
+  if (android_getCpuFeatures() & ANDROID_CPU_ARM_FEATURE_NEON)
+#endif
+  {
+    extra[extraCount].name = "neon_intrinsics";
+    extra[extraCount].filter = fir_filter_neon_intrinsics;
+    extraCount++;
+  }
+#endif
+
+  labelChars = (*env)->GetStringUTFChars(env, label, NULL);
+  fir_bench_default_options(&options);
+  json = fir_bench_run(&options, extra, extraCount, labelChars);
+  (*env)->ReleaseStringUTFChars(env, label, labelChars);
+  if (!json) return NULL;
+  D("%s", json);
+  result = (*env)->NewStringUTF(env, json);
+  free(json);
+  return result;
+}
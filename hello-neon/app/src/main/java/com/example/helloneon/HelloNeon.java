@@ -1,10 +1,17 @@
 package com.example.helloneon;
 
 import androidx.appcompat.app.AppCompatActivity;
+import android.os.Build;
 import android.os.Bundle;
+import android.util.Log;
 import android.widget.TextView;
 
+import java.io.File;
+import java.io.FileWriter;
+import java.io.IOException;
+
 public class HelloNeon extends AppCompatActivity {
+    private static final String TAG = "helloneon";
 
     @Override
     protected void onCreate(Bundle savedInstanceState) {
@@ -13,10 +20,52 @@ public class HelloNeon extends AppCompatActivity {
 
         ((TextView)findViewById(R.id.text_view_hello_neon))
                 .setText(stringFromJNI());
+
+        if (getIntent().getBooleanExtra("benchmark", false)) {
+            runBenchmark();
+        }
+    }
+
+    /**
+     * Runs the FIR benchmark sweep off the UI thread, and writes its JSON to
+     * fir-bench.json in getExternalFilesDir(), for the dashboard:
+     *   adb shell am start -n com.example.helloneon/.HelloNeon --ez benchmark true
+     *   adb pull /sdcard/Android/data/com.example.helloneon/files/fir-bench.json
+     */
+    private void runBenchmark() {
+        final TextView textView = (TextView)findViewById(R.id.text_view_hello_neon);
+        textView.append("\nRunning the benchmark sweep...\n");
+        new Thread(new Runnable() {
+            public void run() {
+                String json = benchmarkJson(Build.MANUFACTURER + " " + Build.MODEL);
+                File file = new File(getExternalFilesDir(null), "fir-bench.json");
+                String result;
+                if (json == null) {
+                    result = "Benchmark failed";
+                } else {
+                    try (FileWriter writer = new FileWriter(file)) {
+                        writer.write(json);
+                        result = "Benchmark written to " + file;
+                    } catch (IOException e) {
+                        result = "Could not write " + file + ": " + e;
+                    }
+                }
+                Log.i(TAG, result);
+                final String message = result;
+                runOnUiThread(new Runnable() {
+                    public void run() {
+                        textView.append(message + "\n");
+                    }
+                });
+            }
+        }).start();
     }
 
     public native String stringFromJNI();
 
+    // The benchmark sweep of fir-bench.h, as JSON; takes seconds
+    public native String benchmarkJson(String label);
+
     static {
         System.loadLibrary("hello-neon");
     }
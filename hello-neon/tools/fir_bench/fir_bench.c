@@ -0,0 +1,154 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+/*
+ * Host runner of the hello-neon FIR benchmark sweep ( fir-bench.h ), the
+ * same one HelloNeon runs on a device when started with
+ * --ez benchmark true; prints its JSON.
+ *   build on x86-64 ( NEON through NEON_2_SSE.h ):
+ *     SRC=../../app/src/main/cpp
+ *     cc -O2 -c -msse4.1 $SRC/fir-filter-sse41.c
+ *     cc -O2 -c -mavx2 $SRC/fir-filter-avx2.c
+ *     cc -O2 -c -mssse3 -w -DHAVE_NEON=1 -DHAVE_NEON_X86=1 \
+ *         $SRC/fir-filter-neon.c $SRC/helloneon-intrinsics.c
+ *     cc -O2 -DHAVE_FIR_NEON -DHAVE_FIR_SSE41 -DHAVE_FIR_AVX2 -I$SRC \
+ *         fir_bench.c $SRC/fir-bench.c $SRC/fir-filter.c *.o -o fir_bench
+ *   build on arm64:
+ *     cc -O2 -DHAVE_NEON=1 -DHAVE_FIR_NEON -I$SRC fir_bench.c \
+ *         $SRC/fir-bench.c $SRC/fir-filter.c $SRC/fir-filter-neon.c \
+ *         $SRC/helloneon-intrinsics.c -o fir_bench
+ *   usage: ./fir_bench [--kernels 4,15,16,32,63,64]
+ *                      [--widths 64,256,2560,16384] [--warmup 3]
+ *                      [--repetitions 21] [--min-run-us 500]
+ *                      [--label $(hostname)] [--out fir-bench.json]
+ * Cycles per output need perf_event_open to be allowed
+ * ( /proc/sys/kernel/perf_event_paranoid at 2 or less ); they are null
+ * otherwise. For steady numbers, pin it to one core ( taskset -c 2 ), and
+ * keep the CPU frequency fixed.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "fir-bench.h"
+#include "helloneon-intrinsics.h"
+
+/* as in helloneon.c */
+static void fir_filter_c(short* output, const short* input, const short* kernel,
+                         int width, int kernelSize) {
+  int offset = -kernelSize / 2;
+  int nn;
+  for (nn = 0; nn < width; nn++) {
+    int sum = 0;
+    int mm;
+    for (mm = 0; mm < kernelSize; mm++) {
+      sum += kernel[mm] * input[nn + offset + mm];
+    }
+    output[nn] = (short)((sum + 0x8000) >> 16);
+  }
+}
+
+/* "4,16,32" into values; returns how many, 0 if malformed */
+static int parse_list(const char* text, int* values, int maxValues) {
+  int count = 0;
+  while (count < maxValues) {
+    char* end;
+    long value = strtol(text, &end, 10);
+    if (end == text || value < 1 || value > 1 << 20) return 0;
+    values[count++] = (int)value;
+    if (*end == '\0') return count;
+    if (*end != ',') return 0;
+    text = end + 1;
+  }
+  return 0;
+}
+
+int main(int argc, char* argv[]) {
+  static const FirBenchFilter extra[] = {
+      {"fir_filter_c", fir_filter_c},
+      {"neon_intrinsics", fir_filter_neon_intrinsics},
+  };
+  int kernelSizes[32], widths[32], idx;
+  FirBenchOptions options;
+  char label[256];
+  const char* outPath = NULL;
+  char* json;
+
+  fir_bench_default_options(&options);
+  if (gethostname(label, sizeof(label)) != 0) strcpy(label, "host");
+  label[sizeof(label) - 1] = '\0';
+
+  for (idx = 1; idx < argc; idx++) {
+    const char* arg = argv[idx];
+    const char* value = idx + 1 < argc ? argv[idx + 1] : NULL;
+    int ok = value != NULL;
+    if (ok && !strcmp(arg, "--kernels")) {
+      options.numKernelSizes = parse_list(value, kernelSizes, 32);
+      options.kernelSizes = kernelSizes;
+      ok = options.numKernelSizes > 0;
+    } else if (ok && !strcmp(arg, "--widths")) {
+      options.numWidths = parse_list(value, widths, 32);
+      options.widths = widths;
+      ok = options.numWidths > 0;
+    } else if (ok && !strcmp(arg, "--warmup")) {
+      options.warmup = atoi(value);
+      ok = options.warmup >= 0;
+    } else if (ok && !strcmp(arg, "--repetitions")) {
+      options.repetitions = atoi(value);
+      ok = options.repetitions > 0;
+    } else if (ok && !strcmp(arg, "--min-run-us")) {
+      options.minRunUs = atoi(value);
+      ok = options.minRunUs > 0;
+    } else if (ok && !strcmp(arg, "--label")) {
+      snprintf(label, sizeof(label), "%s", value);
+    } else if (ok && !strcmp(arg, "--out")) {
+      outPath = value;
+    } else {
+      ok = 0;
+    }
+    if (!ok) {
+      fprintf(stderr,
+              "usage: %s [--kernels 4,15,16,32,63,64] "
+              "[--widths 64,256,2560,16384]\n"
+              "       [--warmup 3] [--repetitions 21] [--min-run-us 500] "
+              "[--label name] [--out file]\n",
+              argv[0]);
+      return 2;
+    }
+    idx++;
+  }
+
+  json = fir_bench_run(&options, extra, sizeof(extra) / sizeof(extra[0]),
+                       label);
+  if (!json) {
+    fprintf(stderr, "out of memory\n");
+    return 1;
+  }
+  if (outPath) {
+    FILE* file = fopen(outPath, "w");
+    if (!file || fputs(json, file) < 0 || fclose(file) != 0) {
+      perror(outPath);
+      free(json);
+      return 1;
+    }
+  } else {
+    fputs(json, stdout);
+  }
+  free(json);
+  return 0;
+}
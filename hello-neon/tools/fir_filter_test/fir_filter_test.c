@@ -0,0 +1,273 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+/*
+ * Host check of every fir-filter.h backend against fir_filter_c(), and
+ * their speed on the FIR benchmark of helloneon.c.
+ *   build on x86-64 ( NEON through NEON_2_SSE.h ):
+ *     SRC=../../app/src/main/cpp
+ *     cc -O2 -c -msse4.1 $SRC/fir-filter-sse41.c
+ *     cc -O2 -c -mavx2 $SRC/fir-filter-avx2.c
+ *     cc -O2 -c -mssse3 -w -DHAVE_NEON=1 -DHAVE_NEON_X86=1 \
+ *         $SRC/fir-filter-neon.c $SRC/helloneon-intrinsics.c
+ *     cc -O2 -DHAVE_FIR_NEON -DHAVE_FIR_SSE41 -DHAVE_FIR_AVX2 -I$SRC \
+ *         fir_filter_test.c $SRC/fir-filter.c *.o -o fir_filter_test
+ *   build on arm64:
+ *     cc -O2 -DHAVE_NEON=1 -DHAVE_FIR_NEON -I$SRC fir_filter_test.c \
+ *         $SRC/fir-filter.c $SRC/fir-filter-neon.c \
+ *         $SRC/helloneon-intrinsics.c -o fir_filter_test
+ *   usage: ./fir_filter_test [--seed 1]
+ * For each backend the CPU can run, it filters random input with random
+ * kernels of 1 to 70 taps into 0 to 300 outputs and more, each time in a
+ * buffer of its own, so that reading or writing past it shows up under
+ * -fsanitize=address; then streams random blocks through a FirStream. Any
+ * output off by as much as one bit is a failure: exits with 1.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "fir-filter.h"
+#include "helloneon-intrinsics.h"
+
+/* as in helloneon.c */
+static void fir_filter_c(short* output, const short* input, const short* kernel,
+                         int width, int kernelSize) {
+  int offset = -kernelSize / 2;
+  int nn;
+  for (nn = 0; nn < width; nn++) {
+    int sum = 0;
+    int mm;
+    for (mm = 0; mm < kernelSize; mm++) {
+      sum += kernel[mm] * input[nn + offset + mm];
+    }
+    output[nn] = (short)((sum + 0x8000) >> 16);
+  }
+}
+
+static unsigned long rng_state = 1;
+
+static unsigned random_bits(void) {
+  rng_state = rng_state * 6364136223846793005ULL + 1442695040888963407ULL;
+  return (unsigned)(rng_state >> 33);
+}
+
+static short random_sample(void) {
+  /* now and then the extremes */
+  switch (random_bits() % 16) {
+    case 0:
+      return -32768;
+    case 1:
+      return 32767;
+    default:
+      return (short)random_bits();
+  }
+}
+
+/* Taps whose magnitudes add up to under 65536, so that the sum of any
+ * input fits in 32 bits, as fir_filter_c() needs */
+static void random_kernel(short* kernel, int kernelSize) {
+  int mm, total = 0, limit = 65534;
+  for (mm = 0; mm < kernelSize; mm++) {
+    int left = limit - total;
+    int tap = left > 0 ? (int)(random_bits() % (unsigned)(left / 2 + 1)) : 0;
+    if (tap > 32767) tap = 32767;
+    kernel[mm] = (short)(random_bits() & 1 ? -tap : tap);
+    total += tap;
+  }
+  /* shuffled, so that the big taps are not all first */
+  for (mm = kernelSize - 1; mm > 0; mm--) {
+    int other = (int)(random_bits() % (unsigned)(mm + 1));
+    short tmp = kernel[mm];
+    kernel[mm] = kernel[other];
+    kernel[other] = tmp;
+  }
+}
+
+/* One filter call, with every buffer exactly as big as it has to be */
+static int check_once(FirFilterFunc filter, int width, int kernelSize) {
+  int inputSize = width + kernelSize - 1;
+  short* kernel = (short*)malloc(kernelSize * sizeof(short));
+  short* input = (short*)malloc((inputSize ? inputSize : 1) * sizeof(short));
+  short* expected = (short*)malloc((width + 1) * sizeof(short));
+  short* output = (short*)malloc((width + 1) * sizeof(short));
+  int nn, ok = 1;
+
+  random_kernel(kernel, kernelSize);
+  for (nn = 0; nn < inputSize; nn++) input[nn] = random_sample();
+  output[width] = 0x5A5A;
+  fir_filter_c(expected, input + kernelSize / 2, kernel, width, kernelSize);
+  filter(output, input + kernelSize / 2, kernel, width, kernelSize);
+  for (nn = 0; nn < width && ok; nn++) {
+    if (output[nn] != expected[nn]) {
+      printf("  %d taps, %d outputs: output %d is %d, not %d\n", kernelSize,
+             width, nn, output[nn], expected[nn]);
+      ok = 0;
+    }
+  }
+  if (ok && output[width] != 0x5A5A) {
+    printf("  %d taps, %d outputs: wrote past the end\n", kernelSize, width);
+    ok = 0;
+  }
+
+  free(kernel);
+  free(input);
+  free(expected);
+  free(output);
+  return ok;
+}
+
+/* Random blocks through a FirStream, against one fir_filter_c() call over
+ * the whole signal, silence before it */
+static int check_stream(FirBackend backend, int kernelSize, int length) {
+  int lead = kernelSize - 1;
+  short* kernel = (short*)malloc(kernelSize * sizeof(short));
+  short* signal = (short*)calloc(lead + length, sizeof(short));
+  short* expected = (short*)malloc(length * sizeof(short));
+  short* output = (short*)malloc(length * sizeof(short));
+  FirStream* stream;
+  int nn, pos, ok = 1;
+
+  random_kernel(kernel, kernelSize);
+  for (nn = 0; nn < length; nn++) signal[lead + nn] = random_sample();
+  /* output nn has its taps on signal[nn .. nn + kernelSize - 1] */
+  fir_filter_c(expected, signal + kernelSize / 2, kernel, length, kernelSize);
+
+  stream = fir_stream_create(kernel, kernelSize, backend);
+  for (pos = 0; pos < length;) {
+    int block = 1 + (int)(random_bits() % 700);
+    if (block > length - pos) block = length - pos;
+    fir_stream_process(stream, output + pos, signal + lead + pos, block);
+    pos += block;
+  }
+  for (nn = 0; nn < length && ok; nn++) {
+    if (output[nn] != expected[nn]) {
+      printf("  stream of %d taps: output %d is %d, not %d\n", kernelSize, nn,
+             output[nn], expected[nn]);
+      ok = 0;
+    }
+  }
+
+  fir_stream_destroy(stream);
+  free(kernel);
+  free(signal);
+  free(expected);
+  free(output);
+  return ok;
+}
+
+static int check_backend(FirBackend backend) {
+  static const int big_widths[] = {511, 512, 513, 1000, 2560};
+  FirFilterFunc filter = fir_backend_filter(backend);
+  int kernelSize, width, idx, checks = 0, ok = 1;
+
+  for (kernelSize = 1; kernelSize <= 70 && ok; kernelSize++) {
+    for (width = 0; width <= 300 && ok; width++, checks++) {
+      ok = check_once(filter, width, kernelSize);
+    }
+    for (idx = 0; idx < 5 && ok; idx++, checks++) {
+      ok = check_once(filter, big_widths[idx], kernelSize);
+    }
+    if (ok && (kernelSize <= 8 || kernelSize % 8 == 1)) {
+      ok = check_stream(backend, kernelSize, 5000);
+      checks++;
+    }
+  }
+  printf("%-8s %s, %d checks\n", fir_backend_name(backend),
+         ok ? "ok" : "FAILED", checks);
+  return ok;
+}
+
+static double now_ms(void) {
+  struct timespec res;
+  clock_gettime(CLOCK_MONOTONIC, &res);
+  return 1000.0 * res.tv_sec + (double)res.tv_nsec / 1e6;
+}
+
+/* The benchmark of helloneon.c: 32 taps, 2560 outputs, 600 times; the best
+ * of 5 runs */
+#define FIR_KERNEL_SIZE 32
+#define FIR_OUTPUT_SIZE 2560
+#define FIR_INPUT_SIZE (FIR_OUTPUT_SIZE + FIR_KERNEL_SIZE)
+#define FIR_ITERATIONS 600
+
+static const short fir_kernel[FIR_KERNEL_SIZE] = {
+    0x10, 0x20, 0x40, 0x70, 0x8c, 0xa2, 0xce, 0xf0, 0xe9, 0xce, 0xa2,
+    0x8c, 070,  0x40, 0x20, 0x10, 0x10, 0x20, 0x40, 0x70, 0x8c, 0xa2,
+    0xce, 0xf0, 0xe9, 0xce, 0xa2, 0x8c, 070,  0x40, 0x20, 0x10};
+
+static short fir_input_0[FIR_INPUT_SIZE];
+static short fir_output[FIR_OUTPUT_SIZE];
+
+static double time_filter(FirFilterFunc filter) {
+  const short* input = fir_input_0 + FIR_KERNEL_SIZE / 2;
+  double best = 1e9;
+  int run, count;
+  for (run = 0; run < 5; run++) {
+    double t0 = now_ms();
+    for (count = FIR_ITERATIONS; count > 0; count--) {
+      filter(fir_output, input, fir_kernel, FIR_OUTPUT_SIZE, FIR_KERNEL_SIZE);
+    }
+    t0 = now_ms() - t0;
+    if (t0 < best) best = t0;
+  }
+  return best;
+}
+
+static void print_time(const char* name, double time, double time_c) {
+  printf("%-22s %8.2f ms %6.2f ns/output  x%.1f\n", name, time,
+         time * 1e6 / ((double)FIR_ITERATIONS * FIR_OUTPUT_SIZE),
+         time_c / time);
+}
+
+int main(int argc, char* argv[]) {
+  int backend, failures = 0, nn;
+  double time_c;
+
+  if (argc == 3 && !strcmp(argv[1], "--seed")) {
+    rng_state = strtoul(argv[2], NULL, 0);
+  } else if (argc != 1) {
+    fprintf(stderr, "usage: %s [--seed 1]\n", argv[0]);
+    return 2;
+  }
+
+  for (backend = 0; backend < FIR_BACKEND_COUNT; backend++) {
+    if (!fir_backend_filter((FirBackend)backend)) {
+      printf("%-8s not available\n", fir_backend_name((FirBackend)backend));
+      continue;
+    }
+    failures += !check_backend((FirBackend)backend);
+  }
+  printf("fir_filter() uses %s\n\n", fir_backend_name(fir_best_backend()));
+
+  for (nn = 0; nn < FIR_INPUT_SIZE; nn++) {
+    fir_input_0[nn] = (5 * nn) & 255;
+  }
+  time_c = time_filter(fir_filter_c);
+  print_time("fir_filter_c", time_c, time_c);
+  print_time("fir_filter_neon_intr.", time_filter(fir_filter_neon_intrinsics),
+             time_c);
+  for (backend = 0; backend < FIR_BACKEND_COUNT; backend++) {
+    FirFilterFunc filter = fir_backend_filter((FirBackend)backend);
+    if (filter) {
+      print_time(fir_backend_name((FirBackend)backend), time_filter(filter),
+                 time_c);
+    }
+  }
+  return failures ? 1 : 0;
+}
@@ -0,0 +1,64 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#ifndef HELLO_OBOE_LOCKFREEQUEUE_H
+#define HELLO_OBOE_LOCKFREEQUEUE_H
+
+#include <atomic>
+#include <cstdint>
+
+/*
+ * A fixed size queue for one producer thread and one consumer thread. Neither
+ * side ever blocks or allocates, so the consumer can be the audio callback.
+ * kCapacity must be a power of 2.
+ */
+template <typename T, uint32_t kCapacity>
+class LockFreeQueue {
+  static_assert(kCapacity && !(kCapacity & (kCapacity - 1)),
+                "kCapacity must be a power of 2");
+
+ public:
+  // Producer: returns false when the queue is full.
+  bool push(const T &item) {
+    uint32_t head = mHead.load(std::memory_order_relaxed);
+    if (head - mTail.load(std::memory_order_acquire) >= kCapacity) {
+      return false;
+    }
+    mItems[head & (kCapacity - 1)] = item;
+    mHead.store(head + 1, std::memory_order_release);
+    return true;
+  }
+
+  // Consumer: returns false when the queue is empty.
+  bool pop(T *item) {
+    uint32_t tail = mTail.load(std::memory_order_relaxed);
+    if (tail == mHead.load(std::memory_order_acquire)) {
+      return false;
+    }
+    *item = mItems[tail & (kCapacity - 1)];
+    mTail.store(tail + 1, std::memory_order_release);
+    return true;
+  }
+
+ private:
+  T mItems[kCapacity];
+  // both count up forever, and wrap around together
+  std::atomic<uint32_t> mHead{0};
+  std::atomic<uint32_t> mTail{0};
+};
+
+#endif  // HELLO_OBOE_LOCKFREEQUEUE_H
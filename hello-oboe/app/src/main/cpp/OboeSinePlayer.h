@@ -18,18 +18,18 @@
 #ifndef HELLO_OBOE_OBOESINEPLAYER_H
 #define HELLO_OBOE_OBOESINEPLAYER_H
 
-#include <math.h>
 #include <oboe/Oboe.h>
 
-#include <algorithm>
+#include <memory>
+
+#include "OscillatorBank.h"
 
 /*
  * This class is responsible for creating an audio stream and starting it.
  * It specifies a callback function onAudioReady which is called each time
  * the audio stream needs more data.
- * Inside this callback either silence is rendered or if the isOn variable
- * is true a sine wave will be rendered.
- * The sine wave's frequency is hardcoded to 440Hz inside kFrequency.
+ * Inside this callback an OscillatorBank renders all of its voices; enable()
+ * fades the first one, a sine wave at kFrequency (440Hz), in or out.
  */
 class OboeSinePlayer : public oboe::AudioStreamCallback {
  public:
@@ -44,7 +44,10 @@ class OboeSinePlayer : public oboe::AudioStreamCallback {
     // Typically, start the stream after querying some stream information, as
     // well as some input from the user
     channelCount = outStream->getChannelCount();
-    mPhaseIncrement = kFrequency * kTwoPi / outStream->getSampleRate();
+    int32_t sampleRate = outStream->getSampleRate();
+    mBank = std::make_unique<OscillatorBank>(sampleRate);
+    mRampFrames = sampleRate * kRampMs / 1000;
+    mBank->setFrequency(0, kFrequency, 0);
     outStream->requestStart();
   }
 
@@ -53,43 +56,28 @@ class OboeSinePlayer : public oboe::AudioStreamCallback {
   oboe::DataCallbackResult onAudioReady(oboe::AudioStream *oboeStream,
                                         void *audioData,
                                         int32_t numFrames) override {
-    float *floatData = static_cast<float *>(audioData);
-    if (isOn) {
-      // Generate sine wave values
-      for (int i = 0; i < numFrames; ++i) {
-        float sampleValue = kAmplitude * sinf(mPhase);
-        for (int j = 0; j < channelCount; j++) {
-          floatData[i * channelCount + j] = sampleValue;
-        }
-        mPhase += mPhaseIncrement;
-        if (mPhase >= kTwoPi) mPhase -= kTwoPi;
-      }
-    } else {
-      // This will output silence
-      std::fill_n(floatData, numFrames * channelCount, 0);
-    }
+    // Silent voices cost nothing, so with none on this outputs silence
+    mBank->render(static_cast<float *>(audioData), numFrames, channelCount);
     return oboe::DataCallbackResult::Continue;
   }
 
-  void enable(bool toEnable) { isOn.store(toEnable); }
+  // Ramp, rather than switch, the amplitude to avoid a click
+  void enable(bool toEnable) {
+    mBank->setAmplitude(0, toEnable ? kAmplitude : 0.0f, mRampFrames);
+  }
 
  private:
   // ManagedStream will release audio resources when destroyed.
   oboe::ManagedStream outStream;
 
-  std::atomic_bool isOn{false};
+  std::unique_ptr<OscillatorBank> mBank;
   int channelCount;
-  double mPhaseIncrement;
+  int32_t mRampFrames;
 
-  // Wave params, these could be instance variables in order to modify at
-  // runtime
+  // Wave params, OscillatorBank can change these for every voice at runtime
   static float constexpr kAmplitude = 0.5f;
   static float constexpr kFrequency = 440;
-
-  // Keeps track of where the wave is
-  float mPhase = 0.0;
-
-  static double constexpr kTwoPi = M_PI * 2;
+  static int32_t constexpr kRampMs = 5;
 };
 
 #endif  // HELLO_OBOE_OBOESINEPLAYER_H
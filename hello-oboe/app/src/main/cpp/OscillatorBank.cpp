@@ -0,0 +1,277 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include "OscillatorBank.h"
+
+#include <algorithm>
+#include <cstring>
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace {
+
+// Four voices in one register, and the few operations the sine needs.
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+typedef float32x4_t Float4;
+inline Float4 load4(const float *p) { return vld1q_f32(p); }
+inline void store4(float *p, Float4 v) { vst1q_f32(p, v); }
+inline Float4 set4(float x) { return vdupq_n_f32(x); }
+inline Float4 add4(Float4 a, Float4 b) { return vaddq_f32(a, b); }
+inline Float4 sub4(Float4 a, Float4 b) { return vsubq_f32(a, b); }
+inline Float4 mul4(Float4 a, Float4 b) { return vmulq_f32(a, b); }
+inline Float4 min4(Float4 a, Float4 b) { return vminq_f32(a, b); }
+inline Float4 abs4(Float4 a) { return vabsq_f32(a); }
+// magnitude of m ( not negative ), sign of s
+inline Float4 withSign4(Float4 m, Float4 s) {
+  return vbslq_f32(vdupq_n_u32(0x80000000u), s, m);
+}
+// a - 1 where a >= 1
+inline Float4 wrap4(Float4 a) {
+  uint32x4_t over = vcgeq_f32(a, vdupq_n_f32(1.0f));
+  return vsubq_f32(a, vreinterpretq_f32_u32(vandq_u32(
+                          over, vreinterpretq_u32_f32(vdupq_n_f32(1.0f)))));
+}
+#elif defined(__SSE2__)
+typedef __m128 Float4;
+inline Float4 load4(const float *p) { return _mm_load_ps(p); }
+inline void store4(float *p, Float4 v) { _mm_store_ps(p, v); }
+inline Float4 set4(float x) { return _mm_set1_ps(x); }
+inline Float4 add4(Float4 a, Float4 b) { return _mm_add_ps(a, b); }
+inline Float4 sub4(Float4 a, Float4 b) { return _mm_sub_ps(a, b); }
+inline Float4 mul4(Float4 a, Float4 b) { return _mm_mul_ps(a, b); }
+inline Float4 min4(Float4 a, Float4 b) { return _mm_min_ps(a, b); }
+inline Float4 abs4(Float4 a) { return _mm_andnot_ps(_mm_set1_ps(-0.0f), a); }
+inline Float4 withSign4(Float4 m, Float4 s) {
+  return _mm_or_ps(m, _mm_and_ps(_mm_set1_ps(-0.0f), s));
+}
+inline Float4 wrap4(Float4 a) {
+  Float4 one = _mm_set1_ps(1.0f);
+  return _mm_sub_ps(a, _mm_and_ps(_mm_cmpge_ps(a, one), one));
+}
+#else
+struct Float4 {
+  float v[4];
+};
+template <typename Op>
+inline Float4 map4(Float4 a, Float4 b, Op op) {
+  Float4 r;
+  for (int i = 0; i < 4; i++) r.v[i] = op(a.v[i], b.v[i]);
+  return r;
+}
+inline Float4 load4(const float *p) {
+  Float4 r;
+  memcpy(r.v, p, sizeof(r.v));
+  return r;
+}
+inline void store4(float *p, Float4 v) { memcpy(p, v.v, sizeof(v.v)); }
+inline Float4 set4(float x) { return Float4{{x, x, x, x}}; }
+inline Float4 add4(Float4 a, Float4 b) {
+  return map4(a, b, [](float x, float y) { return x + y; });
+}
+inline Float4 sub4(Float4 a, Float4 b) {
+  return map4(a, b, [](float x, float y) { return x - y; });
+}
+inline Float4 mul4(Float4 a, Float4 b) {
+  return map4(a, b, [](float x, float y) { return x * y; });
+}
+inline Float4 min4(Float4 a, Float4 b) {
+  return map4(a, b, [](float x, float y) { return std::min(x, y); });
+}
+inline Float4 abs4(Float4 a) {
+  return map4(a, a, [](float x, float) { return x < 0 ? -x : x; });
+}
+inline Float4 withSign4(Float4 m, Float4 s) {
+  return map4(m, s, [](float x, float y) { return y < 0 ? -x : x; });
+}
+inline Float4 wrap4(Float4 a) {
+  return map4(a, a, [](float x, float) { return x >= 1.0f ? x - 1.0f : x; });
+}
+#endif
+
+/*
+ * sin(2 * pi * phase), for phase in [0, 1), to within 4e-6.
+ * sin(2 pi p) = sin(2 pi x) with x = 0.5 - p in (-0.5, 0.5]; by symmetry it
+ * is the sine of r = min(|x|, 0.5 - |x|) in [0, 0.25] with the sign of x,
+ * and a degree 9 Taylor polynomial is that accurate up to pi / 2.
+ */
+inline Float4 sin2Pi4(Float4 phase) {
+  Float4 x = sub4(set4(0.5f), phase);
+  Float4 a = abs4(x);
+  Float4 y = mul4(min4(a, sub4(set4(0.5f), a)), set4(6.2831853f));
+  Float4 y2 = mul4(y, y);
+  Float4 p = add4(set4(-1.0f / 5040), mul4(y2, set4(1.0f / 362880)));
+  p = add4(set4(1.0f / 120), mul4(y2, p));
+  p = add4(set4(-1.0f / 6), mul4(y2, p));
+  p = add4(set4(1.0f), mul4(y2, p));
+  return withSign4(mul4(y, p), x);
+}
+
+}  // namespace
+
+OscillatorBank::OscillatorBank(int32_t sampleRate) : mSampleRate(sampleRate) {}
+
+bool OscillatorBank::setFrequency(int32_t voice, float frequency,
+                                  int32_t rampFrames) {
+  if (voice < 0 || voice >= kMaxVoices) return false;
+  return mCommands.push({Param::kFrequency, voice, frequency, rampFrames});
+}
+
+bool OscillatorBank::setAmplitude(int32_t voice, float amplitude,
+                                  int32_t rampFrames) {
+  if (voice < 0 || voice >= kMaxVoices) return false;
+  return mCommands.push({Param::kAmplitude, voice, amplitude, rampFrames});
+}
+
+void OscillatorBank::applyCommands() {
+  Command command;
+  while (mCommands.pop(&command)) {
+    int32_t v = command.voice;
+    float *value, *step, *target;
+    int32_t *left;
+    if (command.param == Param::kFrequency) {
+      value = &mPhaseIncrement[v];
+      step = &mPhaseIncrementStep[v];
+      target = &mPhaseIncrementTarget[v];
+      left = &mFrequencyRampLeft[v];
+      // in cycles per frame, up to the Nyquist frequency
+      *target = std::min(std::max(command.target / mSampleRate, 0.0f), 0.5f);
+    } else {
+      value = &mAmplitude[v];
+      step = &mAmplitudeStep[v];
+      target = &mAmplitudeTarget[v];
+      left = &mAmplitudeRampLeft[v];
+      *target = command.target;
+    }
+    if (command.rampFrames > 0) {
+      *step = (*target - *value) / command.rampFrames;
+      *left = command.rampFrames;
+    } else {
+      *value = *target;
+      *step = 0.0f;
+      *left = 0;
+    }
+    if (v >= mVoiceEnd) mVoiceEnd = (v / kLanes + 1) * kLanes;
+  }
+}
+
+// Frames until the next ramp ends, at most frames.
+int32_t OscillatorBank::rampFramesLeft(int32_t frames) const {
+  for (int32_t v = 0; v < mVoiceEnd; v++) {
+    if (mFrequencyRampLeft[v]) frames = std::min(frames, mFrequencyRampLeft[v]);
+    if (mAmplitudeRampLeft[v]) frames = std::min(frames, mAmplitudeRampLeft[v]);
+  }
+  return frames;
+}
+
+void OscillatorBank::renderBlock(int32_t frames) {
+  memset(mLaneMix, 0, frames * kLanes * sizeof(float));
+  for (int32_t v = 0; v < mVoiceEnd; v += kLanes) {
+    bool silent = true;
+    for (int32_t lane = v; lane < v + kLanes; lane++) {
+      silent = silent && mAmplitude[lane] == 0.0f &&
+               mAmplitudeStep[lane] == 0.0f &&
+               mPhaseIncrementStep[lane] == 0.0f;
+    }
+    if (silent) continue;
+
+    Float4 phase = load4(mPhase + v);
+    Float4 increment = load4(mPhaseIncrement + v);
+    Float4 incrementStep = load4(mPhaseIncrementStep + v);
+    Float4 amplitude = load4(mAmplitude + v);
+    Float4 amplitudeStep = load4(mAmplitudeStep + v);
+    for (int32_t i = 0; i < frames; i++) {
+      float *mix = mLaneMix + i * kLanes;
+      store4(mix, add4(load4(mix), mul4(sin2Pi4(phase), amplitude)));
+      phase = wrap4(add4(phase, increment));
+      increment = add4(increment, incrementStep);
+      amplitude = add4(amplitude, amplitudeStep);
+    }
+    store4(mPhase + v, phase);
+    store4(mPhaseIncrement + v, increment);
+    store4(mAmplitude + v, amplitude);
+  }
+  for (int32_t i = 0; i < frames; i++) {
+    const float *mix = mLaneMix + i * kLanes;
+    mMix[i] = (mix[0] + mix[1]) + (mix[2] + mix[3]);
+  }
+}
+
+// Count the frames off the ramps; those that end land on their target.
+void OscillatorBank::endRamps(int32_t frames) {
+  int32_t end = 0;
+  mActiveVoices = 0;
+  for (int32_t v = 0; v < mVoiceEnd; v++) {
+    if (mFrequencyRampLeft[v] && !(mFrequencyRampLeft[v] -= frames)) {
+      mPhaseIncrement[v] = mPhaseIncrementTarget[v];
+      mPhaseIncrementStep[v] = 0.0f;
+    }
+    if (mAmplitudeRampLeft[v] && !(mAmplitudeRampLeft[v] -= frames)) {
+      mAmplitude[v] = mAmplitudeTarget[v];
+      mAmplitudeStep[v] = 0.0f;
+    }
+    if (mAmplitude[v] != 0.0f || mAmplitudeRampLeft[v]) mActiveVoices++;
+    if (mAmplitude[v] != 0.0f || mAmplitudeRampLeft[v] ||
+        mFrequencyRampLeft[v]) {
+      end = v + 1;
+    }
+  }
+  mVoiceEnd = (end + kLanes - 1) / kLanes * kLanes;
+}
+
+void OscillatorBank::render(float *audioData, int32_t numFrames,
+                            int32_t channelCount) {
+  applyCommands();
+  int32_t done = 0;
+  while (done < numFrames) {
+    // stop where a ramp ends, so that it ends on the exact frame
+    int32_t frames =
+        rampFramesLeft(std::min(numFrames - done, kBlockFrames));
+    renderBlock(frames);
+    endRamps(frames);
+
+    float *out = audioData + done * channelCount;
+    if (channelCount == 1) {
+      memcpy(out, mMix, frames * sizeof(float));
+    } else if (channelCount == 2) {
+      int32_t i = 0;
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+      for (; i + 4 <= frames; i += 4) {
+        float32x4_t mix = vld1q_f32(mMix + i);
+        vst2q_f32(out + i * 2, (float32x4x2_t{{mix, mix}}));
+      }
+#elif defined(__SSE2__)
+      for (; i + 4 <= frames; i += 4) {
+        __m128 mix = _mm_loadu_ps(mMix + i);
+        _mm_storeu_ps(out + i * 2, _mm_unpacklo_ps(mix, mix));
+        _mm_storeu_ps(out + i * 2 + 4, _mm_unpackhi_ps(mix, mix));
+      }
+#endif
+      for (; i < frames; i++) {
+        out[i * 2] = out[i * 2 + 1] = mMix[i];
+      }
+    } else {
+      for (int32_t i = 0; i < frames; i++) {
+        std::fill_n(out + i * channelCount, channelCount, mMix[i]);
+      }
+    }
+    done += frames;
+  }
+}
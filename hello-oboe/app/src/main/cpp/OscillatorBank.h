@@ -0,0 +1,104 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#ifndef HELLO_OBOE_OSCILLATORBANK_H
+#define HELLO_OBOE_OSCILLATORBANK_H
+
+#include <cstdint>
+
+#include "LockFreeQueue.h"
+
+/*
+ * A bank of sine oscillators, summed into one signal. The state of every
+ * voice is kept in arrays, one per parameter, so that render() computes four
+ * voices at once with NEON or SSE2: a polynomial sine of each phase, scaled
+ * by the amplitude.
+ *
+ * Frequency and amplitude glide linearly to a new value over a number of
+ * frames, and reach it exactly on the last one.
+ *
+ * Changes are made from any one control thread, and reach the audio thread
+ * through a lock-free queue: they take effect at the start of the next
+ * render(). Nothing here depends on Oboe, so it also builds on the host.
+ */
+class OscillatorBank {
+ public:
+  static constexpr int32_t kMaxVoices = 64;
+
+  explicit OscillatorBank(int32_t sampleRate);
+
+  /*
+   * Control thread. Each returns false, and changes nothing, when too many
+   * changes are waiting for the audio thread already.
+   * frequency is in Hz, up to half the sample rate; amplitude is linear;
+   * with rampFrames 0 the new value holds from the next frame.
+   */
+  bool setFrequency(int32_t voice, float frequency, int32_t rampFrames);
+  bool setAmplitude(int32_t voice, float amplitude, int32_t rampFrames);
+
+  /*
+   * Audio thread: renders numFrames of the sum of all voices, the same into
+   * each of channelCount interleaved channels.
+   */
+  void render(float *audioData, int32_t numFrames, int32_t channelCount);
+
+  // Audio thread: voices that are not silent, after the last render().
+  int32_t getActiveVoiceCount() const { return mActiveVoices; }
+
+ private:
+  enum class Param : int32_t { kFrequency, kAmplitude };
+  struct Command {
+    Param param;
+    int32_t voice;
+    float target;
+    int32_t rampFrames;
+  };
+
+  // frames rendered into mMix at a time
+  static constexpr int32_t kBlockFrames = 256;
+  static constexpr int32_t kLanes = 4;
+
+  void applyCommands();
+  int32_t rampFramesLeft(int32_t frames) const;
+  void renderBlock(int32_t frames);
+  void endRamps(int32_t frames);
+
+  int32_t mSampleRate;
+  LockFreeQueue<Command, 256> mCommands;
+
+  // One entry per voice. Phases are in cycles, [0, 1); a ramp adds its step
+  // every frame, for rampLeft more frames.
+  alignas(16) float mPhase[kMaxVoices] = {};
+  alignas(16) float mPhaseIncrement[kMaxVoices] = {};
+  alignas(16) float mPhaseIncrementStep[kMaxVoices] = {};
+  alignas(16) float mAmplitude[kMaxVoices] = {};
+  alignas(16) float mAmplitudeStep[kMaxVoices] = {};
+  float mPhaseIncrementTarget[kMaxVoices] = {};
+  float mAmplitudeTarget[kMaxVoices] = {};
+  int32_t mFrequencyRampLeft[kMaxVoices] = {};
+  int32_t mAmplitudeRampLeft[kMaxVoices] = {};
+
+  // voices from here on are silent, a multiple of kLanes
+  int32_t mVoiceEnd = 0;
+  int32_t mActiveVoices = 0;
+
+  // each frame's four lanes, summed into mMix
+  alignas(16) float mLaneMix[kBlockFrames * kLanes];
+  float mMix[kBlockFrames];
+};
+
+#endif  // HELLO_OBOE_OSCILLATORBANK_H
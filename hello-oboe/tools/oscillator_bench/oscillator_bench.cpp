@@ -0,0 +1,174 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+/*
+ * Host check and benchmark for OscillatorBank.
+ *   build: SRC=../../app/src/main/cpp
+ *          c++ -std=c++17 -O2 -I$SRC oscillator_bench.cpp \
+ *              $SRC/OscillatorBank.cpp -o oscillator_bench
+ *   usage: ./oscillator_bench [--rate 48000] [--frames 192] [--seconds 10]
+ * It checks that
+ *   - a full scale tone is within 1e-5 of sin()
+ *   - an amplitude ramp rises linearly across callbacks, and reaches its
+ *     target on its last frame
+ * then renders --seconds of stereo audio, --frames per callback, with 1 to
+ * 64 voices playing, and prints the cost of a voice against one sinf() per
+ * frame, as the sample used to render its one voice. Voices per core is how
+ * many voices one core could render in real time at that cost.
+ * Exits with 1 when a check fails.
+ */
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#include "OscillatorBank.h"
+
+static double nowSeconds() {
+  return std::chrono::duration<double>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+// largest difference from sin(), of one voice at full scale for a second
+static double toneError(int32_t rate) {
+  const float kFrequency = 997.0f;
+  OscillatorBank bank(rate);
+  bank.setFrequency(0, kFrequency, 0);
+  bank.setAmplitude(0, 1.0f, 0);
+  std::vector<float> out(rate);
+  bank.render(out.data(), rate, 1);
+  // step the phase in floats as the bank does, to see the sine's error alone
+  float increment = kFrequency / rate, phase = 0.0f;
+  double error = 0.0;
+  for (int32_t i = 0; i < rate; i++) {
+    error = std::max(error, fabs(out[i] - sin(2.0 * M_PI * phase)));
+    phase += increment;
+    if (phase >= 1.0f) phase -= 1.0f;
+  }
+  return error;
+}
+
+/*
+ * Ramp the amplitude from 0 to 1 over 1000 frames, of a tone at a quarter
+ * of the rate: every 4th frame, from the 2nd, is the amplitude itself.
+ * Returns the largest difference from the ideal ramp.
+ */
+static double rampError(int32_t rate, int32_t callbackFrames) {
+  const int32_t kRampFrames = 1000;
+  OscillatorBank bank(rate);
+  bank.setFrequency(0, rate / 4.0f, 0);
+  bank.setAmplitude(0, 1.0f, kRampFrames);
+  std::vector<float> out(kRampFrames * 2);
+  for (int32_t done = 0; done < kRampFrames * 2; done += callbackFrames) {
+    int32_t frames = std::min(callbackFrames, kRampFrames * 2 - done);
+    bank.render(out.data() + done, frames, 1);
+  }
+  double error = 0.0;
+  for (int32_t i = 1; i < kRampFrames * 2; i += 4) {
+    double expected = std::min(1.0, static_cast<double>(i) / kRampFrames);
+    error = std::max(error, fabs(out[i] - expected));
+  }
+  return error;
+}
+
+// The sample's old callback, for as many voices: sinf() per voice and frame
+static void renderSinf(float *out, int32_t frames, int32_t channels,
+                       std::vector<float> &phase,
+                       const std::vector<float> &increment, float amplitude) {
+  const float kTwoPi = static_cast<float>(2 * M_PI);
+  for (int32_t i = 0; i < frames; i++) {
+    float sample = 0.0f;
+    for (size_t v = 0; v < phase.size(); v++) {
+      sample += amplitude * sinf(phase[v]);
+      phase[v] += increment[v];
+      if (phase[v] >= kTwoPi) phase[v] -= kTwoPi;
+    }
+    for (int32_t c = 0; c < channels; c++) out[i * channels + c] = sample;
+  }
+}
+
+int main(int argc, char *argv[]) {
+  int32_t rate = 48000, callbackFrames = 192;
+  double seconds = 10.0;
+  for (int idx = 1; idx < argc; idx++) {
+    const char *arg = argv[idx];
+    if (idx + 1 < argc && !strcmp(arg, "--rate")) {
+      rate = atoi(argv[++idx]);
+    } else if (idx + 1 < argc && !strcmp(arg, "--frames")) {
+      callbackFrames = atoi(argv[++idx]);
+    } else if (idx + 1 < argc && !strcmp(arg, "--seconds")) {
+      seconds = atof(argv[++idx]);
+    } else {
+      fprintf(stderr, "usage: %s [--rate 48000] [--frames 192] "
+              "[--seconds 10]\n", argv[0]);
+      return 2;
+    }
+  }
+  if (rate <= 0 || callbackFrames <= 0 || seconds <= 0) return 2;
+
+  int failures = 0;
+  double toneErr = toneError(rate);
+  double rampErr = rampError(rate, callbackFrames);
+  printf("tone error %.2e, ramp error %.2e%s\n", toneErr, rampErr,
+         toneErr > 1e-5 || rampErr > 1e-5 ? "  FAIL" : "");
+  failures += toneErr > 1e-5 || rampErr > 1e-5;
+
+  const int32_t kChannels = 2;
+  int64_t totalFrames = static_cast<int64_t>(seconds * rate);
+  std::vector<float> out(callbackFrames * kChannels);
+  double framePeriod = 1e9 / rate;
+  printf("%d Hz, %d frames per callback, stereo, %.0f s of audio\n", rate,
+         callbackFrames, seconds);
+  printf("%6s %14s %14s %16s %16s %8s\n", "voices", "us/callback",
+         "ns/voice-frame", "voices per core", "sinf voices/core", "speedup");
+  const int32_t kVoiceCounts[] = {1, 4, 16, OscillatorBank::kMaxVoices};
+  for (int32_t voices : kVoiceCounts) {
+    OscillatorBank bank(rate);
+    std::vector<float> phase(voices, 0.0f), increment(voices);
+    srand(1);
+    for (int32_t v = 0; v < voices; v++) {
+      float frequency = 100.0f + rand() % 3900;
+      bank.setFrequency(v, frequency, 0);
+      bank.setAmplitude(v, 1.0f / voices, 0);
+      increment[v] = static_cast<float>(2 * M_PI * frequency / rate);
+    }
+
+    double start = nowSeconds();
+    for (int64_t done = 0; done < totalFrames; done += callbackFrames) {
+      bank.render(out.data(), callbackFrames, kChannels);
+    }
+    double bankNs = (nowSeconds() - start) * 1e9;
+    start = nowSeconds();
+    for (int64_t done = 0; done < totalFrames; done += callbackFrames) {
+      renderSinf(out.data(), callbackFrames, kChannels, phase, increment,
+                 1.0f / voices);
+    }
+    double sinfNs = (nowSeconds() - start) * 1e9;
+
+    double callbacks = static_cast<double>(totalFrames) / callbackFrames;
+    double voiceFrameNs = bankNs / totalFrames / voices;
+    double sinfVoiceFrameNs = sinfNs / totalFrames / voices;
+    printf("%6d %14.2f %14.3f %16.0f %16.0f %7.1fx\n", voices,
+           bankNs / callbacks / 1000, voiceFrameNs,
+           framePeriod / voiceFrameNs, framePeriod / sinfVoiceFrameNs,
+           sinfNs / bankNs);
+  }
+  return failures ? 1 : 0;
+}
@@ -0,0 +1,272 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+#include "audio_resampler.h"
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define RESAMPLER_HAVE_NEON 1
+#elif defined(__SSE__)
+#include <xmmintrin.h>
+#define RESAMPLER_HAVE_SSE 1
+#endif
+
+// input frames converted to float at a time, past the filter's own history
+#define HISTORY_BLOCK 512
+// a phase's coefficients, 16 byte aligned, taps a multiple of 8
+#define COEF_ALIGN 16
+#define TAP_MULTIPLE 8
+
+/*
+ * Output frame n is the dot product of one phase of the filter with the
+ * taps input frames up to history[pos]; then phase advances by step,
+ * carrying into pos every phases: the output rate is phases / step times
+ * the input rate.
+ */
+struct Resampler {
+  uint32_t phases;  // L: output rate / gcd
+  uint32_t step;    // M: input rate / gcd
+  uint32_t taps;    // per phase
+  float* coefs;     // phases * taps, oldest input first
+  float* history;   // taps - 1 + HISTORY_BLOCK input frames
+  uint32_t historyLen;
+  uint32_t pos;  // newest input frame of the next output, in history
+  uint32_t phase;
+};
+
+static const struct {
+  uint32_t taps;  // at the lower of the two rates
+  double beta;    // Kaiser window
+} kPresets[] = {
+    {16, 5.0},   // RESAMPLER_QUALITY_LOW
+    {32, 8.0},   // RESAMPLER_QUALITY_MEDIUM
+    {64, 10.0},  // RESAMPLER_QUALITY_HIGH
+};
+
+static uint32_t gcd(uint32_t a, uint32_t b) {
+  while (b) {
+    uint32_t r = a % b;
+    a = b;
+    b = r;
+  }
+  return a;
+}
+
+// zeroth order modified Bessel function of the first kind
+static double besselI0(double x) {
+  double sum = 1.0, term = 1.0;
+  int k;
+  for (k = 1; k < 50 && term > 1e-12 * sum; k++) {
+    term *= (x / (2.0 * k)) * (x / (2.0 * k));
+    sum += term;
+  }
+  return sum;
+}
+
+/*
+ * The prototype low pass runs at phases times the input rate. The cutoff is
+ * placed so the Kaiser transition band ends at the Nyquist frequency of the
+ * lower rate: nothing aliases, the top of the band rolls off instead.
+ */
+static void designFilter(Resampler* r, uint32_t presetTaps, double beta) {
+  uint32_t length = r->phases * r->taps;
+  double center = (length - 1) / 2.0;
+  double attenuation = beta / 0.1102 + 8.7;
+  double width = (attenuation - 7.95) / (14.36 * presetTaps);
+  // cycles per sample of the lower rate, then of the upsampled grid
+  double cutoff = 0.5 - width / 2.0;
+  if (r->step > r->phases) cutoff *= (double)r->phases / r->step;
+  cutoff /= r->phases;
+
+  double i0Beta = besselI0(beta);
+  uint32_t p, k;
+  for (p = 0; p < r->phases; p++) {
+    float* coefs = r->coefs + p * r->taps;
+    double sum = 0.0;
+    for (k = 0; k < r->taps; k++) {
+      // tap k of phase p weighs input frame pos - k
+      double t = p + (double)k * r->phases - center;
+      double x = 2.0 * cutoff * t;
+      double sinc = fabs(x) < 1e-12 ? 1.0 : sin(M_PI * x) / (M_PI * x);
+      double ratio = t / (center + 1.0);
+      double window = besselI0(beta * sqrt(fmax(0.0, 1.0 - ratio * ratio))) /
+                      i0Beta;
+      double tap = 2.0 * cutoff * sinc * window;
+      coefs[r->taps - 1 - k] = (float)tap;
+      sum += tap;
+    }
+    // unity gain at DC for every phase: no ripple from phase to phase
+    for (k = 0; k < r->taps; k++) {
+      coefs[k] = (float)(coefs[k] / sum);
+    }
+  }
+}
+
+Resampler* createResampler(uint32_t inRate, uint32_t outRate,
+                           ResamplerQuality quality) {
+  if (!inRate || !outRate || quality > RESAMPLER_QUALITY_HIGH) return NULL;
+  uint32_t divisor = gcd(inRate, outRate);
+  uint32_t phases = outRate / divisor;
+  uint32_t step = inRate / divisor;
+  if (phases > RESAMPLER_MAX_PHASES || step / phases >= HISTORY_BLOCK) {
+    return NULL;
+  }
+
+  Resampler* r = (Resampler*)calloc(1, sizeof(Resampler));
+  if (!r) return NULL;
+  r->phases = phases;
+  r->step = step;
+  // downsampling stretches the filter, to keep its quality at the output
+  uint32_t taps = kPresets[quality].taps;
+  if (step > phases) taps = (taps * step + phases - 1) / phases;
+  r->taps = (taps + TAP_MULTIPLE - 1) & ~(TAP_MULTIPLE - 1);
+
+  void* coefs = NULL;
+  if (posix_memalign(&coefs, COEF_ALIGN,
+                     (size_t)phases * r->taps * sizeof(float))) {
+    free(r);
+    return NULL;
+  }
+  r->coefs = (float*)coefs;
+  r->history = (float*)malloc((r->taps - 1 + HISTORY_BLOCK) * sizeof(float));
+  if (!r->history) {
+    destroyResampler(r);
+    return NULL;
+  }
+  designFilter(r, kPresets[quality].taps, kPresets[quality].beta);
+  resetResampler(r);
+  return r;
+}
+
+void destroyResampler(Resampler* r) {
+  if (!r) return;
+  free(r->coefs);
+  free(r->history);
+  free(r);
+}
+
+void resetResampler(Resampler* r) {
+  memset(r->history, 0, (r->taps - 1) * sizeof(float));
+  r->historyLen = r->taps - 1;
+  r->pos = r->taps - 1;
+  r->phase = 0;
+}
+
+uint32_t getResamplerLatency(const Resampler* r) { return r->taps / 2; }
+
+#if defined(RESAMPLER_HAVE_NEON)
+static inline float dotProduct(const float* coefs, const float* x,
+                               uint32_t taps) {
+  float32x4_t acc0 = vdupq_n_f32(0.0f), acc1 = vdupq_n_f32(0.0f);
+  uint32_t k;
+  for (k = 0; k < taps; k += 8) {
+    acc0 = vmlaq_f32(acc0, vld1q_f32(coefs + k), vld1q_f32(x + k));
+    acc1 = vmlaq_f32(acc1, vld1q_f32(coefs + k + 4), vld1q_f32(x + k + 4));
+  }
+  float32x4_t acc = vaddq_f32(acc0, acc1);
+  float32x2_t sum = vadd_f32(vget_low_f32(acc), vget_high_f32(acc));
+  return vget_lane_f32(vpadd_f32(sum, sum), 0);
+}
+
+const char* getResamplerKernelName(void) { return "neon"; }
+#elif defined(RESAMPLER_HAVE_SSE)
+static inline float dotProduct(const float* coefs, const float* x,
+                               uint32_t taps) {
+  __m128 acc0 = _mm_setzero_ps(), acc1 = _mm_setzero_ps();
+  uint32_t k;
+  for (k = 0; k < taps; k += 8) {
+    acc0 = _mm_add_ps(acc0,
+                      _mm_mul_ps(_mm_load_ps(coefs + k), _mm_loadu_ps(x + k)));
+    acc1 = _mm_add_ps(acc1, _mm_mul_ps(_mm_load_ps(coefs + k + 4),
+                                       _mm_loadu_ps(x + k + 4)));
+  }
+  __m128 acc = _mm_add_ps(acc0, acc1);
+  acc = _mm_add_ps(acc, _mm_movehl_ps(acc, acc));
+  acc = _mm_add_ss(acc, _mm_shuffle_ps(acc, acc, 1));
+  return _mm_cvtss_f32(acc);
+}
+
+const char* getResamplerKernelName(void) { return "sse"; }
+#else
+static inline float dotProduct(const float* coefs, const float* x,
+                               uint32_t taps) {
+  float acc[4] = {0.0f, 0.0f, 0.0f, 0.0f};
+  uint32_t k;
+  for (k = 0; k < taps; k += 4) {
+    acc[0] += coefs[k] * x[k];
+    acc[1] += coefs[k + 1] * x[k + 1];
+    acc[2] += coefs[k + 2] * x[k + 2];
+    acc[3] += coefs[k + 3] * x[k + 3];
+  }
+  return (acc[0] + acc[1]) + (acc[2] + acc[3]);
+}
+
+const char* getResamplerKernelName(void) { return "scalar"; }
+#endif
+
+static inline short toShort(float sample) {
+  long value = lrintf(sample);
+  if (value > 32767) return 32767;
+  if (value < -32768) return -32768;
+  return (short)value;
+}
+
+/*
+ * Pull input into history only when the next output needs it, after
+ * dropping the frames no output needs any more.
+ */
+static uint32_t fillHistory(Resampler* r, const short* in, uint32_t frames) {
+  uint32_t oldest = r->pos - (r->taps - 1);
+  uint32_t drop = oldest < r->historyLen ? oldest : r->historyLen;
+  memmove(r->history, r->history + drop,
+          (r->historyLen - drop) * sizeof(float));
+  r->historyLen -= drop;
+  r->pos -= drop;
+
+  uint32_t room = r->taps - 1 + HISTORY_BLOCK - r->historyLen;
+  uint32_t count = frames < room ? frames : room;
+  float* dst = r->history + r->historyLen;
+  uint32_t idx;
+  for (idx = 0; idx < count; idx++) {
+    dst[idx] = in[idx];
+  }
+  r->historyLen += count;
+  return count;
+}
+
+uint32_t resample(Resampler* r, const short* in, uint32_t* inFrames,
+                  short* out, uint32_t outFrames) {
+  uint32_t consumed = 0, produced = 0;
+  while (produced < outFrames) {
+    if (r->pos >= r->historyLen) {
+      if (consumed == *inFrames) break;
+      consumed += fillHistory(r, in + consumed, *inFrames - consumed);
+      continue;
+    }
+    out[produced++] =
+        toShort(dotProduct(r->coefs + r->phase * r->taps,
+                           r->history + r->pos - (r->taps - 1), r->taps));
+    r->phase += r->step;
+    r->pos += r->phase / r->phases;
+    r->phase %= r->phases;
+  }
+  *inFrames = consumed;
+  return produced;
+}
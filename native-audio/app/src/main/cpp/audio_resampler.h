@@ -0,0 +1,54 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+#ifndef NATIVE_AUDIO_AUDIO_RESAMPLER_H
+#define NATIVE_AUDIO_AUDIO_RESAMPLER_H
+
+#include <stdint.h>
+
+// Streaming sample rate converter for mono 16 bit audio: polyphase
+// Kaiser windowed sinc, any ratio of two rates whose reduced fraction has
+// no more than RESAMPLER_MAX_PHASES in the numerator ( every pair of the
+// usual 8 kHz .. 192 kHz rates ). The tables are built by createResampler();
+// resample() does not allocate or lock, so it can run in the callbacks.
+
+#define RESAMPLER_MAX_PHASES 1024
+
+typedef enum {
+  RESAMPLER_QUALITY_LOW,     // 16 taps per phase, ~55 dB stopband
+  RESAMPLER_QUALITY_MEDIUM,  // 32 taps per phase, ~80 dB stopband
+  RESAMPLER_QUALITY_HIGH,    // 64 taps per phase, ~100 dB stopband
+} ResamplerQuality;
+
+typedef struct Resampler Resampler;
+
+// rates in Hz; NULL when the ratio needs too many phases, or out of memory
+Resampler* createResampler(uint32_t inRate, uint32_t outRate,
+                           ResamplerQuality quality);
+void destroyResampler(Resampler* resampler);
+// forget the audio so far, as if just created
+void resetResampler(Resampler* resampler);
+// input frames the output lags behind; feed that many zeros to flush
+uint32_t getResamplerLatency(const Resampler* resampler);
+const char* getResamplerKernelName(void);
+
+// converts up to *inFrames of in into at most outFrames of out; returns the
+// frames written, *inFrames is set to the frames consumed. Input that is
+// not consumed must be passed again.
+uint32_t resample(Resampler* resampler, const short* in, uint32_t* inFrames,
+                  short* out, uint32_t outFrames);
+
+#endif  // NATIVE_AUDIO_AUDIO_RESAMPLER_H
@@ -0,0 +1,538 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+#define _GNU_SOURCE
+#include "audio_stream_recorder.h"
+
+#include <android/log.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdalign.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "audio_resampler.h"
+
+#define LOG_TAG "native-audio"
+#define LOGI(...) __android_log_print(ANDROID_LOG_INFO, LOG_TAG, __VA_ARGS__)
+#define LOGE(...) __android_log_print(ANDROID_LOG_ERROR, LOG_TAG, __VA_ARGS__)
+
+#define WRITER_POLL_MS 10
+#define WAV_HEADER_BYTES 44
+// well under the 4 GB of the RIFF sizes, and what signed 32 bit readers take
+#define MAX_FILE_DATA_BYTES 0x7ff00000u
+// file writes are gathered into blocks of at least this size
+#define STAGING_BYTES (64 * 1024)
+#define MAX_CHANNELS 2
+
+/*
+ * Single producer, single consumer queue of buffer indices; each counter
+ * only moves forward and is written by one side.
+ */
+typedef struct {
+  alignas(64) atomic_uint head;  // producer
+  alignas(64) atomic_uint tail;  // consumer
+  uint32_t mask;
+  uint32_t* slots;
+} IndexQueue;
+
+struct StreamRecorder {
+  StreamRecorderConfig config;
+  uint32_t channelsOut;
+  uint32_t bufferCount;
+  short* arena;  // bufferCount buffers of bufferFrames * channelCount
+
+  IndexQueue fullQueue;  // callback -> writer
+  IndexQueue freeQueue;  // writer -> callback
+
+  // callback thread only: the buffers in the recorder's queue, oldest first
+  uint32_t* inFlight;
+  uint32_t inFlightHead, inFlightTail, inFlightMask;
+  uint32_t spare;  // a dropped buffer to record into again, or UINT32_MAX
+
+  // writer thread only
+  pthread_t writer;
+  int writerStarted;
+  atomic_int stopping;
+  int fd;
+  int openFailing;  // the last open failed: retried on every flush
+  uint32_t fileIndex;
+  uint32_t dataBytes;
+  char* pathPrefix;
+  Resampler* resamplers[MAX_CHANNELS];
+  short* planar[MAX_CHANNELS];     // bufferFrames each, the writer's input
+  short* converted[MAX_CHANNELS];  // convertedFrames each
+  uint32_t convertedFrames;
+  uint32_t delayFrames;  // of the resamplers, still to leave out of the file
+  uint8_t* staging;
+  uint32_t stagingBytes, stagingUsed;
+
+  // written by one thread each, read by any
+  atomic_ullong captured;
+  atomic_ullong written;
+  atomic_ullong dropped;
+  atomic_ullong framesWritten;
+  atomic_uint backlogPeak;
+  atomic_uint files;
+  atomic_uint writeErrors;
+  atomic_uint writeMaxUs;
+};
+
+static inline void bump(atomic_ullong* counter) {
+  atomic_store_explicit(
+      counter, atomic_load_explicit(counter, memory_order_relaxed) + 1,
+      memory_order_relaxed);
+}
+
+static uint32_t roundUpPowerOf2(uint32_t value) {
+  uint32_t power = 1;
+  while (power < value) power <<= 1;
+  return power;
+}
+
+static int initQueue(IndexQueue* queue, uint32_t capacity) {
+  capacity = roundUpPowerOf2(capacity);
+  queue->slots = (uint32_t*)malloc(capacity * sizeof(uint32_t));
+  queue->mask = capacity - 1;
+  atomic_init(&queue->head, 0);
+  atomic_init(&queue->tail, 0);
+  return queue->slots != NULL;
+}
+
+// never full: it holds no more than all the buffers, and was sized for that
+static void pushIndex(IndexQueue* queue, uint32_t index) {
+  uint32_t head = atomic_load_explicit(&queue->head, memory_order_relaxed);
+  queue->slots[head & queue->mask] = index;
+  atomic_store_explicit(&queue->head, head + 1, memory_order_release);
+}
+
+static int popIndex(IndexQueue* queue, uint32_t* index) {
+  uint32_t tail = atomic_load_explicit(&queue->tail, memory_order_relaxed);
+  if (tail == atomic_load_explicit(&queue->head, memory_order_acquire)) {
+    return 0;
+  }
+  *index = queue->slots[tail & queue->mask];
+  atomic_store_explicit(&queue->tail, tail + 1, memory_order_release);
+  return 1;
+}
+
+static uint32_t queueSize(IndexQueue* queue) {
+  return atomic_load_explicit(&queue->head, memory_order_acquire) -
+         atomic_load_explicit(&queue->tail, memory_order_acquire);
+}
+
+static inline short* getBuffer(StreamRecorder* r, uint32_t index) {
+  return r->arena + (size_t)index * r->config.bufferFrames *
+                        r->config.channelCount;
+}
+
+static uint64_t nowUs(void) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (uint64_t)now.tv_sec * 1000000 + now.tv_nsec / 1000;
+}
+
+/*
+ * Canonical 44 byte header of a 16 bit PCM file; the sizes are patched in
+ * as the data grows
+ */
+static void makeWavHeader(const StreamRecorder* r, uint32_t dataBytes,
+                          uint8_t* header) {
+  uint32_t rate = r->config.fileRate;
+  uint32_t blockAlign = r->channelsOut * sizeof(short);
+  uint32_t fields[] = {0x46464952,  // "RIFF"
+                       36 + dataBytes,
+                       0x45564157,  // "WAVE"
+                       0x20746d66,  // "fmt "
+                       16,
+                       1 | (r->channelsOut << 16),  // PCM, channels
+                       rate,
+                       rate * blockAlign,
+                       blockAlign | (16 << 16),  // bits per sample
+                       0x61746164,               // "data"
+                       dataBytes};
+  // little endian, like the samples
+  memcpy(header, fields, sizeof(fields));
+}
+
+static void updateWavHeader(StreamRecorder* r) {
+  uint8_t header[WAV_HEADER_BYTES];
+  makeWavHeader(r, r->dataBytes, header);
+  if (pwrite(r->fd, header, sizeof(header), 0) != sizeof(header)) {
+    atomic_fetch_add_explicit(&r->writeErrors, 1, memory_order_relaxed);
+  }
+}
+
+static void closeFile(StreamRecorder* r) {
+  if (r->fd < 0) return;
+  updateWavHeader(r);
+  close(r->fd);
+  r->fd = -1;
+}
+
+/*
+ * A failed open counts as a write error and leaves fd at -1; the file
+ * keeps its index, so the next try creates the same one
+ */
+static int openNextFile(StreamRecorder* r) {
+  closeFile(r);
+  char path[PATH_MAX];
+  snprintf(path, sizeof(path), "%s_%03u.wav", r->pathPrefix, r->fileIndex);
+  r->fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  if (r->fd < 0) {
+    atomic_fetch_add_explicit(&r->writeErrors, 1, memory_order_relaxed);
+    // once per failing streak, the retries would flood the log
+    if (!r->openFailing) {
+      LOGE("cannot create %s ( errno %d )", path, errno);
+    }
+    r->openFailing = 1;
+    return 0;
+  }
+  r->openFailing = 0;
+  r->fileIndex++;
+  r->dataBytes = 0;
+  uint8_t header[WAV_HEADER_BYTES];
+  makeWavHeader(r, 0, header);
+  if (write(r->fd, header, sizeof(header)) != sizeof(header)) {
+    atomic_fetch_add_explicit(&r->writeErrors, 1, memory_order_relaxed);
+  }
+  atomic_fetch_add_explicit(&r->files, 1, memory_order_relaxed);
+  return 1;
+}
+
+static void flushStaging(StreamRecorder* r) {
+  if (!r->stagingUsed) return;
+  if (r->fd < 0 ||
+      (r->dataBytes && r->dataBytes + r->stagingUsed > r->config.fileBytes)) {
+    // a failed open is retried here; until one works the audio is lost,
+    // counted in writeErrors by openNextFile()
+    openNextFile(r);
+  }
+  uint32_t done = 0;
+  while (r->fd >= 0 && done < r->stagingUsed) {
+    ssize_t count = write(r->fd, r->staging + done, r->stagingUsed - done);
+    if (count < 0 && errno == EINTR) continue;
+    if (count <= 0) {
+      // the audio is lost, the counts stay right for what is in the file
+      if (!atomic_fetch_add_explicit(&r->writeErrors, 1,
+                                     memory_order_relaxed)) {
+        LOGE("stream recorder write failed ( errno %d )", errno);
+      }
+      break;
+    }
+    done += count;
+  }
+  r->dataBytes += done;
+  atomic_store_explicit(
+      &r->framesWritten,
+      atomic_load_explicit(&r->framesWritten, memory_order_relaxed) +
+          done / (r->channelsOut * sizeof(short)),
+      memory_order_relaxed);
+  r->stagingUsed = 0;
+}
+
+static void stage(StreamRecorder* r, short* const* channels,
+                  uint32_t frames) {
+  uint32_t bytes = frames * r->channelsOut * sizeof(short);
+  if (r->stagingUsed + bytes > r->stagingBytes) flushStaging(r);
+  short* dst = (short*)(r->staging + r->stagingUsed);
+  uint32_t frame, channel;
+  for (frame = 0; frame < frames; frame++) {
+    for (channel = 0; channel < r->channelsOut; channel++) {
+      *dst++ = channels[channel][frame];
+    }
+  }
+  r->stagingUsed += bytes;
+}
+
+/*
+ * Resample the planar input of every output channel in step: they all
+ * consume and produce the same frames, their filters see the same lengths
+ */
+static void convertAndStage(StreamRecorder* r, short* const* in,
+                            uint32_t frames) {
+  uint32_t pos = 0;
+  for (;;) {
+    uint32_t used = 0, produced = 0, channel;
+    for (channel = 0; channel < r->channelsOut; channel++) {
+      used = frames - pos;
+      produced = resample(r->resamplers[channel], in[channel] + pos, &used,
+                          r->converted[channel], r->convertedFrames);
+    }
+    uint32_t skip = produced < r->delayFrames ? produced : r->delayFrames;
+    r->delayFrames -= skip;
+    if (produced > skip) {
+      short* converted[MAX_CHANNELS];
+      for (channel = 0; channel < r->channelsOut; channel++) {
+        converted[channel] = r->converted[channel] + skip;
+      }
+      stage(r, converted, produced - skip);
+    }
+    pos += used;
+    if (!produced && !used) break;
+  }
+}
+
+static void writeBuffer(StreamRecorder* r, const short* buf) {
+  uint32_t frames = r->config.bufferFrames;
+  uint32_t idx;
+  if (r->config.channelCount == 1) {
+    memcpy(r->planar[0], buf, frames * sizeof(short));
+  } else if (r->channelsOut == 1) {
+    for (idx = 0; idx < frames; idx++) {
+      r->planar[0][idx] = (short)((buf[2 * idx] + buf[2 * idx + 1]) >> 1);
+    }
+  } else {
+    for (idx = 0; idx < frames; idx++) {
+      r->planar[0][idx] = buf[2 * idx];
+      r->planar[1][idx] = buf[2 * idx + 1];
+    }
+  }
+  if (r->resamplers[0]) {
+    convertAndStage(r, r->planar, frames);
+  } else {
+    stage(r, r->planar, frames);
+  }
+}
+
+// the resamplers' tails, so the file is as long as what was recorded
+static void flushResamplers(StreamRecorder* r) {
+  if (!r->resamplers[0]) return;
+  short* zeros = r->planar[0];
+  memset(zeros, 0, r->config.bufferFrames * sizeof(short));
+  short* in[MAX_CHANNELS] = {zeros, zeros};
+  uint32_t left = getResamplerLatency(r->resamplers[0]);
+  while (left) {
+    uint32_t frames =
+        left < r->config.bufferFrames ? left : r->config.bufferFrames;
+    convertAndStage(r, in, frames);
+    left -= frames;
+  }
+}
+
+static void* writerLoop(void* context) {
+  StreamRecorder* r = (StreamRecorder*)context;
+  const struct timespec poll = {0, WRITER_POLL_MS * 1000000L};
+  for (;;) {
+    // read before draining: once set, nothing more comes in
+    int stopping = atomic_load_explicit(&r->stopping, memory_order_acquire);
+    uint64_t start = nowUs();
+    uint32_t index, count = 0;
+    while (popIndex(&r->fullQueue, &index)) {
+      writeBuffer(r, getBuffer(r, index));
+      pushIndex(&r->freeQueue, index);
+      bump(&r->written);
+      count++;
+    }
+    if (stopping) break;
+    if (count) {
+      flushStaging(r);
+      if (r->fd >= 0) updateWavHeader(r);
+      uint32_t elapsed = (uint32_t)(nowUs() - start);
+      if (elapsed >
+          atomic_load_explicit(&r->writeMaxUs, memory_order_relaxed)) {
+        atomic_store_explicit(&r->writeMaxUs, elapsed, memory_order_relaxed);
+      }
+    }
+    nanosleep(&poll, NULL);
+  }
+  flushResamplers(r);
+  flushStaging(r);
+  closeFile(r);
+  return NULL;
+}
+
+StreamRecorder* createStreamRecorder(const StreamRecorderConfig* config,
+                                     const char* pathPrefix) {
+  if (!config->sampleRate || !config->bufferFrames ||
+      !config->channelCount || config->channelCount > MAX_CHANNELS ||
+      config->queuedBuffers < 2) {
+    return NULL;
+  }
+  StreamRecorder* r = (StreamRecorder*)calloc(1, sizeof(StreamRecorder));
+  if (!r) return NULL;
+  r->config = *config;
+  if (!r->config.fileRate) r->config.fileRate = config->sampleRate;
+  if (!r->config.fileBytes || r->config.fileBytes > MAX_FILE_DATA_BYTES) {
+    r->config.fileBytes = MAX_FILE_DATA_BYTES;
+  }
+  r->channelsOut = config->downmix ? 1 : config->channelCount;
+  r->fd = -1;
+  r->spare = UINT32_MAX;
+  atomic_init(&r->stopping, 0);
+
+  uint64_t backlogFrames = (uint64_t)config->backlogMs * config->sampleRate /
+                           1000;
+  r->bufferCount =
+      config->queuedBuffers +
+      (uint32_t)((backlogFrames + config->bufferFrames - 1) /
+                 config->bufferFrames);
+  r->arena = (short*)malloc((size_t)r->bufferCount * config->bufferFrames *
+                            config->channelCount * sizeof(short));
+  r->inFlightMask = roundUpPowerOf2(config->queuedBuffers) - 1;
+  r->inFlight = (uint32_t*)malloc((r->inFlightMask + 1) * sizeof(uint32_t));
+  r->pathPrefix = strdup(pathPrefix);
+  int ok = r->arena && r->inFlight && r->pathPrefix &&
+           initQueue(&r->fullQueue, r->bufferCount) &&
+           initQueue(&r->freeQueue, r->bufferCount);
+
+  uint32_t channel;
+  r->convertedFrames = (uint32_t)((uint64_t)config->bufferFrames *
+                                  r->config.fileRate / config->sampleRate) +
+                       16;
+  for (channel = 0; ok && channel < r->channelsOut; channel++) {
+    r->planar[channel] =
+        (short*)malloc(config->bufferFrames * sizeof(short));
+    ok = r->planar[channel] != NULL;
+    if (ok && r->config.fileRate != config->sampleRate) {
+      r->resamplers[channel] =
+          createResampler(config->sampleRate, r->config.fileRate,
+                          RESAMPLER_QUALITY_MEDIUM);
+      r->converted[channel] =
+          (short*)malloc(r->convertedFrames * sizeof(short));
+      ok = r->resamplers[channel] && r->converted[channel];
+    }
+  }
+  if (r->resamplers[0]) {
+    // the file starts with the first frame recorded, not the filter's delay
+    r->delayFrames = (uint32_t)(
+        ((uint64_t)getResamplerLatency(r->resamplers[0]) * r->config.fileRate +
+         config->sampleRate / 2) /
+        config->sampleRate);
+  }
+  uint32_t frameBytes = r->channelsOut * sizeof(short);
+  uint32_t largest =
+      (r->convertedFrames > config->bufferFrames ? r->convertedFrames
+                                                 : config->bufferFrames) *
+      frameBytes;
+  r->stagingBytes = largest > STAGING_BYTES ? largest : STAGING_BYTES;
+  r->staging = ok ? (uint8_t*)malloc(r->stagingBytes) : NULL;
+  ok = ok && r->staging && openNextFile(r);
+  if (!ok) {
+    destroyStreamRecorder(r);
+    return NULL;
+  }
+
+  // the pool is touched now, not in the first callbacks
+  memset(r->arena, 0, (size_t)r->bufferCount * config->bufferFrames *
+                          config->channelCount * sizeof(short));
+  uint32_t index;
+  for (index = 0; index < r->bufferCount; index++) {
+    pushIndex(&r->freeQueue, index);
+  }
+  if (pthread_create(&r->writer, NULL, writerLoop, r)) {
+    destroyStreamRecorder(r);
+    return NULL;
+  }
+  r->writerStarted = 1;
+  pthread_setname_np(r->writer, "stream_writer");
+  LOGI("stream recorder: %u Hz x %u -> %u Hz x %u, %u buffers of %u frames",
+       config->sampleRate, config->channelCount, r->config.fileRate,
+       r->channelsOut, r->bufferCount, config->bufferFrames);
+  return r;
+}
+
+void finishStreamRecorder(StreamRecorder* r) {
+  if (r->writerStarted) {
+    atomic_store_explicit(&r->stopping, 1, memory_order_release);
+    pthread_join(r->writer, NULL);
+    r->writerStarted = 0;
+    StreamRecorderStats stats;
+    getStreamRecorderStats(r, &stats);
+    LOGI("stream recorder: captured %llu, written %llu, dropped %llu, "
+         "backlog peak %u of %u, %u write errors",
+         (unsigned long long)stats.captured,
+         (unsigned long long)stats.written,
+         (unsigned long long)stats.dropped, stats.backlogPeak,
+         stats.backlogCapacity, stats.writeErrors);
+  }
+  closeFile(r);
+}
+
+void destroyStreamRecorder(StreamRecorder* r) {
+  if (!r) return;
+  finishStreamRecorder(r);
+  uint32_t channel;
+  for (channel = 0; channel < MAX_CHANNELS; channel++) {
+    destroyResampler(r->resamplers[channel]);
+    free(r->planar[channel]);
+    free(r->converted[channel]);
+  }
+  free(r->staging);
+  free(r->fullQueue.slots);
+  free(r->freeQueue.slots);
+  free(r->inFlight);
+  free(r->arena);
+  free(r->pathPrefix);
+  free(r);
+}
+
+uint32_t getStreamRecorderBufferBytes(const StreamRecorder* r) {
+  return r->config.bufferFrames * r->config.channelCount * sizeof(short);
+}
+
+short* nextStreamRecorderBuffer(StreamRecorder* r) {
+  uint32_t index = r->spare;
+  r->spare = UINT32_MAX;
+  if (index == UINT32_MAX && !popIndex(&r->freeQueue, &index)) {
+    // only when primed with more than queuedBuffers
+    return NULL;
+  }
+  r->inFlight[r->inFlightHead++ & r->inFlightMask] = index;
+  return getBuffer(r, index);
+}
+
+void onStreamRecorderBuffer(StreamRecorder* r) {
+  uint32_t index = r->inFlight[r->inFlightTail++ & r->inFlightMask];
+  bump(&r->captured);
+  if (!queueSize(&r->freeQueue)) {
+    // the writer fell behind by the whole pool: record over this one
+    r->spare = index;
+    bump(&r->dropped);
+    return;
+  }
+  pushIndex(&r->fullQueue, index);
+  uint32_t backlog = queueSize(&r->fullQueue);
+  if (backlog > atomic_load_explicit(&r->backlogPeak, memory_order_relaxed)) {
+    atomic_store_explicit(&r->backlogPeak, backlog, memory_order_relaxed);
+  }
+}
+
+void getStreamRecorderStats(const StreamRecorder* r,
+                            StreamRecorderStats* stats) {
+  stats->captured =
+      atomic_load_explicit(&r->captured, memory_order_relaxed);
+  stats->written =
+      atomic_load_explicit(&r->written, memory_order_relaxed);
+  stats->dropped =
+      atomic_load_explicit(&r->dropped, memory_order_relaxed);
+  stats->framesWritten =
+      atomic_load_explicit(&r->framesWritten, memory_order_relaxed);
+  stats->backlogPeak =
+      atomic_load_explicit(&r->backlogPeak, memory_order_relaxed);
+  stats->backlogCapacity = r->bufferCount - r->config.queuedBuffers;
+  stats->files = atomic_load_explicit(&r->files, memory_order_relaxed);
+  stats->writeErrors =
+      atomic_load_explicit(&r->writeErrors, memory_order_relaxed);
+  stats->writeMaxUs =
+      atomic_load_explicit(&r->writeMaxUs, memory_order_relaxed);
+}
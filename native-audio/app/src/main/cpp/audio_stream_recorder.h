@@ -0,0 +1,76 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+#ifndef NATIVE_AUDIO_AUDIO_STREAM_RECORDER_H
+#define NATIVE_AUDIO_AUDIO_STREAM_RECORDER_H
+
+#include <stdint.h>
+
+// Unbounded recording to WAV files. The recorder's buffer queue cycles
+// through a pool of buffers: the callback hands each full one to a writer
+// thread over a lock-free queue and takes a free one back over another,
+// so it never blocks. Downmix to mono and sample rate conversion happen on
+// the writer thread. When the writer falls behind by the whole pool, the
+// callback records over the buffer it just got instead, and counts it as
+// dropped: captured == written + dropped ( + queued while running ).
+
+typedef struct {
+  uint32_t sampleRate;     // Hz, of the recorder
+  uint32_t channelCount;   // 1 or 2, interleaved 16 bit
+  uint32_t bufferFrames;   // per buffer queue buffer
+  uint32_t queuedBuffers;  // kept in the recorder's buffer queue
+  uint32_t backlogMs;      // audio the writer may fall behind by
+  int downmix;             // stereo to mono in the file
+  uint32_t fileRate;       // Hz of the file, 0 for sampleRate
+  uint32_t fileBytes;      // audio per file, 0 for 2 GB
+} StreamRecorderConfig;
+
+typedef struct {
+  uint64_t captured;       // buffers the recorder filled
+  uint64_t written;        // buffers in the files
+  uint64_t dropped;        // buffers lost, the writer fell behind
+  uint64_t framesWritten;  // at the file's rate
+  uint32_t backlogPeak;    // most full buffers waiting for the writer
+  uint32_t backlogCapacity;
+  uint32_t files;
+  uint32_t writeErrors;    // failed creates and writes: audio not in a file
+  uint32_t writeMaxUs;  // longest drain of the queue
+} StreamRecorderStats;
+
+typedef struct StreamRecorder StreamRecorder;
+
+// pathPrefix gets "_000.wav", "_001.wav", ... a file every fileBytes; NULL
+// when the config is not supported, or the first file cannot be opened
+StreamRecorder* createStreamRecorder(const StreamRecorderConfig* config,
+                                     const char* pathPrefix);
+// stops the writer, after it wrote everything queued, and closes the file:
+// the stats are final. The recorder must be stopped ( its object destroyed )
+// first
+void finishStreamRecorder(StreamRecorder* recorder);
+// finishes it if need be, and frees all
+void destroyStreamRecorder(StreamRecorder* recorder);
+
+uint32_t getStreamRecorderBufferBytes(const StreamRecorder* recorder);
+// a buffer for the recorder's queue: call queuedBuffers times to prime it
+// before recording starts, then once in every callback
+short* nextStreamRecorderBuffer(StreamRecorder* recorder);
+// recorder callback: the oldest buffer in the queue is full
+void onStreamRecorderBuffer(StreamRecorder* recorder);
+
+void getStreamRecorderStats(const StreamRecorder* recorder,
+                            StreamRecorderStats* stats);
+
+#endif  // NATIVE_AUDIO_AUDIO_STREAM_RECORDER_H
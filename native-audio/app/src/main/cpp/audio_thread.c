@@ -0,0 +1,121 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+#define _GNU_SOURCE
+#include "audio_thread.h"
+
+#include <alloca.h>
+#include <android/log.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <unistd.h>
+
+#define LOG_TAG "native-audio"
+#define LOGI(...) __android_log_print(ANDROID_LOG_INFO, LOG_TAG, __VA_ARGS__)
+#define LOGW(...) __android_log_print(ANDROID_LOG_WARN, LOG_TAG, __VA_ARGS__)
+
+// below the fast mixer ( 3 ), like the fast tracks' own callback threads
+#define AUDIO_FIFO_PRIORITY 2
+#define URGENT_AUDIO_NICE (-19)
+#define PREFAULT_STACK_BYTES (32 * 1024)
+#define MAX_CPUS 64
+
+// the cores with the highest cpuinfo_max_freq, 0 when they are all alike
+static uint64_t getFastCpuMask(void) {
+  uint64_t fastest = 0, slowest = UINT64_MAX, mask = 0;
+  int cpu;
+  for (cpu = 0; cpu < MAX_CPUS; cpu++) {
+    char path[80];
+    snprintf(path, sizeof(path),
+             "/sys/devices/system/cpu/cpu%d/cpufreq/cpuinfo_max_freq", cpu);
+    FILE* file = fopen(path, "r");
+    if (!file) continue;
+    unsigned long long freq = 0;
+    int read = fscanf(file, "%llu", &freq);
+    fclose(file);
+    if (read != 1 || !freq) continue;
+    if (freq < slowest) slowest = freq;
+    if (freq > fastest) {
+      fastest = freq;
+      mask = 0;
+    }
+    if (freq == fastest) mask |= 1ULL << cpu;
+  }
+  return fastest > slowest ? mask : 0;
+}
+
+__attribute__((noinline)) static void prefaultStack(size_t bytes) {
+  volatile uint8_t* stack = alloca(bytes);
+  size_t offset;
+  for (offset = 0; offset < bytes; offset += 256) {
+    stack[offset] = 0;
+  }
+}
+
+void prepareAudioThread(void) {
+  static __thread int prepared = 0;
+  if (prepared) return;
+  prepared = 1;
+
+  const char* sched = "SCHED_FIFO";
+  int policy;
+  struct sched_param param;
+  if (pthread_getschedparam(pthread_self(), &policy, &param) ||
+      (policy != SCHED_FIFO && policy != SCHED_RR)) {
+    param.sched_priority = AUDIO_FIFO_PRIORITY;
+    int err = pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+    if (err) {
+      // on Linux this only changes the calling thread
+      sched = setpriority(PRIO_PROCESS, 0, URGENT_AUDIO_NICE) ? "unchanged"
+                                                              : "niced";
+      LOGW("SCHED_FIFO refused ( errno %d ), %s", err, sched);
+    }
+  }
+
+  uint64_t mask = getFastCpuMask();
+  if (mask) {
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    int cpu;
+    for (cpu = 0; cpu < MAX_CPUS; cpu++) {
+      if (mask & (1ULL << cpu)) CPU_SET(cpu, &set);
+    }
+    if (sched_setaffinity(0, sizeof(set), &set)) {
+      LOGW("affinity 0x%llx refused ( errno %d )", (unsigned long long)mask,
+           errno);
+      mask = 0;
+    }
+  }
+  prefaultStack(PREFAULT_STACK_BYTES);
+  LOGI("audio thread %d: %s%s", gettid(), sched, mask ? ", pinned" : "");
+}
+
+int lockAudioMemory(void) {
+  int flags = MCL_CURRENT | MCL_FUTURE;
+#ifdef MCL_ONFAULT
+  flags |= MCL_ONFAULT;
+#endif
+  if (mlockall(flags)) {
+    LOGW("mlockall refused ( errno %d )", errno);
+    return 0;
+  }
+  return 1;
+}
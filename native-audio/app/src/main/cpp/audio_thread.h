@@ -0,0 +1,32 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+#ifndef NATIVE_AUDIO_AUDIO_THREAD_H
+#define NATIVE_AUDIO_AUDIO_THREAD_H
+
+// Scheduling for the OpenSL ES callback threads; the C side of audio-echo's
+// audio_thread.h, without the wakeup probe. Each call falls back quietly
+// ( with a log ) when the system refuses.
+
+// SCHED_FIFO, else nice -19 ( THREAD_PRIORITY_URGENT_AUDIO ), pinned to the
+// big cores and with its stack prefaulted; only the first call on a thread
+// does anything, so every callback can call it
+void prepareAudioThread(void);
+
+// mlockall() of the process; returns 0 when the system refused
+int lockAudioMemory(void);
+
+#endif  // NATIVE_AUDIO_AUDIO_THREAD_H
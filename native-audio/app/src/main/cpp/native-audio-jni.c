@@ -39,6 +39,10 @@
 #include <android/asset_manager_jni.h>
 #include <sys/types.h>
 
+#include "audio_resampler.h"
+#include "audio_stream_recorder.h"
+#include "audio_thread.h"
+
 // pre-recorded sound clips, both are 8 kHz mono 16-bit signed little endian
 static const char hello[] =
 #include "hello_clip.h"
@@ -65,7 +69,6 @@ static SLMuteSoloItf bqPlayerMuteSolo;
 static SLVolumeItf bqPlayerVolume;
 static SLmilliHertz bqPlayerSampleRate = 0;
 static jint bqPlayerBufSize = 0;
-static short* resampleBuf = NULL;
 // a mutext to guard against re-entrance to record & playback
 // as well as make recording and playing back to be mutually exclusive
 // this is to avoid crash at situations like:
@@ -98,6 +101,18 @@ static SLObjectItf recorderObject = NULL;
 static SLRecordItf recorderRecord;
 static SLAndroidSimpleBufferQueueItf recorderBufferQueue;
 
+// streaming recorder interfaces: a recorder of its own, at the rate and
+// channels asked for, writing to files until stopped
+static SLObjectItf streamRecorderObject = NULL;
+static SLRecordItf streamRecorderRecord;
+static SLAndroidSimpleBufferQueueItf streamRecorderBufferQueue;
+static StreamRecorder* streamRecorder = NULL;
+// what the last one did, once it stopped
+static StreamRecorderStats streamRecorderStats;
+#define STREAM_RECORDER_BUFFER_MS 20
+#define STREAM_RECORDER_QUEUED_BUFFERS 4
+#define STREAM_RECORDER_BACKLOG_MS 2000
+
 // synthesized sawtooth clip
 #define SAWTOOTH_FRAMES 8000
 static short sawtoothBuffer[SAWTOOTH_FRAMES];
@@ -113,6 +128,24 @@ static short* nextBuffer;
 static unsigned nextSize;
 static int nextCount;
 
+// clips that are not at the player's rate are converted a buffer at a time
+// in bqPlayerCallback, into two buffers taking turns in the queue
+#define PLAYER_RESAMPLER_QUALITY RESAMPLER_QUALITY_MEDIUM
+// frames per stream buffer when the device's buffer size is not known
+#define STREAM_BUFFER_FRAMES 1024
+static Resampler* resampler = NULL;
+static uint32_t resamplerInRate = 0;
+static uint32_t resamplerOutRate = 0;
+static short* streamBuffers[2] = {NULL, NULL};
+static uint32_t streamBufferFrames = 0;
+static unsigned streamNextBuffer;
+static int streamQueued;  // 0 when not streaming
+static const short* streamSrc;
+static uint32_t streamSrcFrames;
+static uint32_t streamSrcPos;
+static int streamLoops;  // plays of the clip left, this one included
+static uint32_t streamFlushFrames;  // zeros to push the filter's tail out
+
 // synthesize a mono sawtooth wave and place it into a buffer (called
 // automatically on load)
 __attribute__((constructor)) static void onDlOpen(void) {
@@ -122,84 +155,128 @@ __attribute__((constructor)) static void onDlOpen(void) {
   }
 }
 
-void releaseResampleBuf(void) {
-  if (0 == bqPlayerSampleRate) {
-    /*
-     * we are not using fast path, so we were not creating buffers, nothing to
-     * do
-     */
-    return;
+/*
+ * Convert the next piece of the clip into buf: loops over the clip as many
+ * times as asked, then flushes the resampler. Returns the frames written,
+ * 0 once everything was played.
+ */
+static uint32_t fillStreamBuffer(short* buf) {
+  static const short zeros[64];
+  uint32_t produced = 0;
+  while (produced < streamBufferFrames) {
+    const short* src;
+    uint32_t frames;
+    if (streamSrcPos < streamSrcFrames) {
+      src = streamSrc + streamSrcPos;
+      frames = streamSrcFrames - streamSrcPos;
+    } else if (streamLoops > 1) {
+      // no reset: the filter runs on from the end into the start
+      streamLoops--;
+      streamSrcPos = 0;
+      continue;
+    } else if (streamFlushFrames) {
+      src = zeros;
+      frames = streamFlushFrames < 64 ? streamFlushFrames : 64;
+    } else {
+      break;
+    }
+    uint32_t used = frames;
+    produced += resample(resampler, src, &used, buf + produced,
+                         streamBufferFrames - produced);
+    if (src == zeros) {
+      streamFlushFrames -= used;
+    } else {
+      streamSrcPos += used;
+    }
   }
+  return produced;
+}
 
-  free(resampleBuf);
-  resampleBuf = NULL;
+// fill and enqueue the next stream buffer; false when there is nothing left
+static SLboolean enqueueStreamBuffer(void) {
+  short* buf = streamBuffers[streamNextBuffer];
+  uint32_t frames = fillStreamBuffer(buf);
+  if (!frames) {
+    return SL_BOOLEAN_FALSE;
+  }
+  SLresult result = (*bqPlayerBufferQueue)
+                        ->Enqueue(bqPlayerBufferQueue, buf,
+                                  frames * sizeof(short));
+  if (SL_RESULT_SUCCESS != result) {
+    return SL_BOOLEAN_FALSE;
+  }
+  streamNextBuffer ^= 1;
+  streamQueued++;
+  return SL_BOOLEAN_TRUE;
 }
 
 /*
- * Only support up-sampling
+ * Set up streaming of the clip at srcRate to the player; false when it
+ * cannot be converted, or the stream buffers are missing
  */
-short* createResampledBuf(uint32_t idx, uint32_t srcRate, unsigned* size) {
-  short* src = NULL;
-  short* workBuf;
-  int upSampleRate;
-  int32_t srcSampleCount = 0;
-
-  if (0 == bqPlayerSampleRate) {
-    return NULL;
-  }
-  if (bqPlayerSampleRate % srcRate) {
-    /*
-     * simple up-sampling, must be divisible
-     */
-    return NULL;
+static SLboolean startStream(const short* src, uint32_t frames,
+                             uint32_t srcRate, uint32_t playerRate,
+                             int count) {
+  if (NULL == streamBuffers[0] || NULL == streamBuffers[1]) {
+    return SL_BOOLEAN_FALSE;
   }
-  upSampleRate = bqPlayerSampleRate / srcRate;
-
-  switch (idx) {
-    case 0:
-      return NULL;
-    case 1:  // HELLO_CLIP
-      srcSampleCount = sizeof(hello) >> 1;
-      src = (short*)hello;
-      break;
-    case 2:  // ANDROID_CLIP
-      srcSampleCount = sizeof(android) >> 1;
-      src = (short*)android;
-      break;
-    case 3:  // SAWTOOTH_CLIP
-      srcSampleCount = SAWTOOTH_FRAMES;
-      src = sawtoothBuffer;
-      break;
-    case 4:  // captured frames
-      srcSampleCount = recorderSize / sizeof(short);
-      src = recorderBuffer;
-      break;
-    default:
-      assert(0);
-      return NULL;
+  if (resampler && resamplerInRate == srcRate &&
+      resamplerOutRate == playerRate) {
+    resetResampler(resampler);
+  } else {
+    // only while no clip is playing, the callback does not touch it then
+    destroyResampler(resampler);
+    resampler = createResampler(srcRate, playerRate, PLAYER_RESAMPLER_QUALITY);
+    resamplerInRate = resampler ? srcRate : 0;
+    resamplerOutRate = resampler ? playerRate : 0;
+    if (!resampler) {
+      return SL_BOOLEAN_FALSE;
+    }
   }
-
-  resampleBuf = (short*)malloc((srcSampleCount * upSampleRate) << 1);
-  if (resampleBuf == NULL) {
-    return resampleBuf;
+  streamSrc = src;
+  streamSrcFrames = frames;
+  streamSrcPos = 0;
+  streamLoops = count;
+  streamFlushFrames = getResamplerLatency(resampler);
+
+  // two buffers to start, one plays while the other is converted; both are
+  // counted before the first can finish and be seen by the callback
+  uint32_t filled[2];
+  filled[0] = fillStreamBuffer(streamBuffers[0]);
+  filled[1] = fillStreamBuffer(streamBuffers[1]);
+  if (!filled[0]) {
+    return SL_BOOLEAN_FALSE;
   }
-  workBuf = resampleBuf;
-  for (int sample = 0; sample < srcSampleCount; sample++) {
-    for (int dup = 0; dup < upSampleRate; dup++) {
-      *workBuf++ = src[sample];
+  streamNextBuffer = 0;
+  streamQueued = filled[1] ? 2 : 1;
+  unsigned idx;
+  for (idx = 0; idx < 2 && filled[idx]; idx++) {
+    SLresult result = (*bqPlayerBufferQueue)
+                          ->Enqueue(bqPlayerBufferQueue, streamBuffers[idx],
+                                    filled[idx] * sizeof(short));
+    if (SL_RESULT_SUCCESS != result) {
+      // the queue has room for both, this is a programming error
+      streamQueued = idx;
+      return idx ? SL_BOOLEAN_TRUE : SL_BOOLEAN_FALSE;
     }
   }
-
-  *size = (srcSampleCount * upSampleRate) << 1;  // sample format is 16 bit
-  return resampleBuf;
+  return SL_BOOLEAN_TRUE;
 }
 
 // this callback handler is called every time a buffer finishes playing
 void bqPlayerCallback(SLAndroidSimpleBufferQueueItf bq, void* context) {
   assert(bq == bqPlayerBufferQueue);
   assert(NULL == context);
-  // for streaming playback, replace this test by logic to find and fill the
-  // next buffer
+  prepareAudioThread();
+  if (streamQueued) {
+    // the buffer that finished is refilled with the next piece of the clip
+    streamQueued--;
+    enqueueStreamBuffer();
+    if (!streamQueued) {
+      pthread_mutex_unlock(&audioEngineLock);
+    }
+    return;
+  }
   if (--nextCount > 0 && NULL != nextBuffer && 0 != nextSize) {
     SLresult result;
     // enqueue another buffer
@@ -212,7 +289,6 @@ void bqPlayerCallback(SLAndroidSimpleBufferQueueItf bq, void* context) {
     }
     (void)result;
   } else {
-    releaseResampleBuf();
     pthread_mutex_unlock(&audioEngineLock);
   }
 }
@@ -221,6 +297,7 @@ void bqPlayerCallback(SLAndroidSimpleBufferQueueItf bq, void* context) {
 void bqRecorderCallback(SLAndroidSimpleBufferQueueItf bq, void* context) {
   assert(bq == recorderBufferQueue);
   assert(NULL == context);
+  prepareAudioThread();
   // for streaming recording, here we would call Enqueue to give recorder the
   // next buffer to fill but instead, this is a one-time buffer so we stop
   // recording
@@ -233,11 +310,29 @@ void bqRecorderCallback(SLAndroidSimpleBufferQueueItf bq, void* context) {
   pthread_mutex_unlock(&audioEngineLock);
 }
 
+// this callback handler is called every time a stream recorder buffer is full
+void bqStreamRecorderCallback(SLAndroidSimpleBufferQueueItf bq,
+                              void* context) {
+  assert(bq == streamRecorderBufferQueue);
+  assert(NULL == context);
+  prepareAudioThread();
+  onStreamRecorderBuffer(streamRecorder);
+  SLresult result =
+      (*bq)->Enqueue(bq, nextStreamRecorderBuffer(streamRecorder),
+                     getStreamRecorderBufferBytes(streamRecorder));
+  // a buffer just left the queue, so there is room for this one
+  assert(SL_RESULT_SUCCESS == result);
+  (void)result;
+}
+
 // create the engine and output mix objects
 JNIEXPORT void JNICALL Java_com_example_nativeaudio_NativeAudio_createEngine(
     JNIEnv* env, jclass clazz) {
   SLresult result;
 
+  // keep the callbacks from faulting pages back in, when the system lets us
+  lockAudioMemory();
+
   // create engine
   result = slCreateEngine(&engineObject, 0, NULL, 0, NULL, NULL);
   assert(SL_RESULT_SUCCESS == result);
@@ -293,11 +388,15 @@ Java_com_example_nativeaudio_NativeAudio_createBufferQueueAudioPlayer(
   if (sampleRate >= 0 && bufSize >= 0) {
     bqPlayerSampleRate = sampleRate * 1000;
     /*
-     * device native buffer size is another factor to minimize audio latency,
-     * not used in this sample: we only play one giant buffer here
+     * device native buffer size is another factor to minimize audio latency:
+     * clips that need converting are streamed in buffers of this size
      */
     bqPlayerBufSize = bufSize;
   }
+  streamBufferFrames =
+      bqPlayerBufSize ? (uint32_t)bqPlayerBufSize : STREAM_BUFFER_FRAMES;
+  streamBuffers[0] = (short*)malloc(streamBufferFrames * sizeof(short));
+  streamBuffers[1] = (short*)malloc(streamBufferFrames * sizeof(short));
 
   // configure audio source
   SLDataLocator_AndroidSimpleBufferQueue loc_bufq = {
@@ -657,45 +756,29 @@ JNIEXPORT jboolean JNICALL Java_com_example_nativeaudio_NativeAudio_selectClip(
     // should re-try
     return JNI_FALSE;
   }
+  uint32_t srcRate = 8000;
   switch (which) {
     case 0:  // CLIP_NONE
       nextBuffer = (short*)NULL;
       nextSize = 0;
       break;
     case 1:  // CLIP_HELLO
-      nextBuffer = createResampledBuf(1, SL_SAMPLINGRATE_8, &nextSize);
-      if (!nextBuffer) {
-        nextBuffer = (short*)hello;
-        nextSize = sizeof(hello);
-      }
+      nextBuffer = (short*)hello;
+      nextSize = sizeof(hello);
       break;
     case 2:  // CLIP_ANDROID
-      nextBuffer = createResampledBuf(2, SL_SAMPLINGRATE_8, &nextSize);
-      if (!nextBuffer) {
-        nextBuffer = (short*)android;
-        nextSize = sizeof(android);
-      }
+      nextBuffer = (short*)android;
+      nextSize = sizeof(android);
       break;
     case 3:  // CLIP_SAWTOOTH
-      nextBuffer = createResampledBuf(3, SL_SAMPLINGRATE_8, &nextSize);
-      if (!nextBuffer) {
-        nextBuffer = (short*)sawtoothBuffer;
-        nextSize = sizeof(sawtoothBuffer);
-      }
+      nextBuffer = (short*)sawtoothBuffer;
+      nextSize = sizeof(sawtoothBuffer);
       break;
     case 4:  // CLIP_PLAYBACK
-      nextBuffer = createResampledBuf(4, SL_SAMPLINGRATE_16, &nextSize);
-      // we recorded at 16 kHz, but are playing buffers at 8 Khz, so do a
-      // primitive down-sample
-      if (!nextBuffer) {
-        unsigned i;
-        for (i = 0; i < recorderSize; i += 2 * sizeof(short)) {
-          recorderBuffer[i >> 2] = recorderBuffer[i >> 1];
-        }
-        recorderSize >>= 1;
-        nextBuffer = recorderBuffer;
-        nextSize = recorderSize;
-      }
+      // we recorded at 16 kHz
+      nextBuffer = recorderBuffer;
+      nextSize = recorderSize;
+      srcRate = 16000;
       break;
     default:
       nextBuffer = NULL;
@@ -703,19 +786,27 @@ JNIEXPORT jboolean JNICALL Java_com_example_nativeaudio_NativeAudio_selectClip(
       break;
   }
   nextCount = count;
-  if (nextSize > 0) {
-    // here we only enqueue one buffer because it is a long clip,
-    // but for streaming playback we would typically enqueue at least 2 buffers
-    // to start
-    SLresult result;
-    result = (*bqPlayerBufferQueue)
-                 ->Enqueue(bqPlayerBufferQueue, nextBuffer, nextSize);
-    if (SL_RESULT_SUCCESS != result) {
-      pthread_mutex_unlock(&audioEngineLock);
-      return JNI_FALSE;
-    }
-  } else {
+  if (0 == nextSize) {
     pthread_mutex_unlock(&audioEngineLock);
+    return JNI_TRUE;
+  }
+
+  // the player runs at the device rate on the fast path, else at 8 kHz
+  uint32_t playerRate = bqPlayerSampleRate ? bqPlayerSampleRate / 1000 : 8000;
+  if (srcRate != playerRate &&
+      startStream(nextBuffer, nextSize / sizeof(short), srcRate, playerRate,
+                  count)) {
+    return JNI_TRUE;
+  }
+
+  // here we only enqueue one buffer because it is a long clip; when it could
+  // not be converted it plays at the wrong rate rather than not at all
+  SLresult result;
+  result = (*bqPlayerBufferQueue)
+               ->Enqueue(bqPlayerBufferQueue, nextBuffer, nextSize);
+  if (SL_RESULT_SUCCESS != result) {
+    pthread_mutex_unlock(&audioEngineLock);
+    return JNI_FALSE;
   }
 
   return JNI_TRUE;
@@ -929,6 +1020,152 @@ JNIEXPORT void JNICALL Java_com_example_nativeaudio_NativeAudio_startRecording(
   (void)result;
 }
 
+static void destroyStreamRecorderObject(void) {
+  if (streamRecorderObject != NULL) {
+    // no more callbacks once it is destroyed
+    (*streamRecorderObject)->Destroy(streamRecorderObject);
+    streamRecorderObject = NULL;
+    streamRecorderRecord = NULL;
+    streamRecorderBufferQueue = NULL;
+  }
+  if (streamRecorder != NULL) {
+    finishStreamRecorder(streamRecorder);
+    getStreamRecorderStats(streamRecorder, &streamRecorderStats);
+    destroyStreamRecorder(streamRecorder);
+    streamRecorder = NULL;
+  }
+}
+
+// start recording to pathPrefix_000.wav, pathPrefix_001.wav, ... until
+// stopStreamRecording(); the file is downmixed to mono and converted to
+// fileRate ( 0 to keep sampleRate ) on the writer thread
+JNIEXPORT jboolean JNICALL
+Java_com_example_nativeaudio_NativeAudio_startStreamRecording(
+    JNIEnv* env, jclass clazz, jstring pathPrefix, jint sampleRate,
+    jint channelCount, jboolean downmix, jint fileRate) {
+  if (streamRecorderObject != NULL || sampleRate <= 0 || channelCount < 1 ||
+      channelCount > 2 || fileRate < 0) {
+    return JNI_FALSE;
+  }
+  StreamRecorderConfig config;
+  memset(&config, 0, sizeof(config));
+  config.sampleRate = (uint32_t)sampleRate;
+  config.channelCount = (uint32_t)channelCount;
+  config.bufferFrames = config.sampleRate * STREAM_RECORDER_BUFFER_MS / 1000;
+  config.queuedBuffers = STREAM_RECORDER_QUEUED_BUFFERS;
+  config.backlogMs = STREAM_RECORDER_BACKLOG_MS;
+  config.downmix = channelCount == 2 && downmix;
+  config.fileRate = (uint32_t)fileRate;
+  const char* utf8 = (*env)->GetStringUTFChars(env, pathPrefix, NULL);
+  memset(&streamRecorderStats, 0, sizeof(streamRecorderStats));
+  streamRecorder = createStreamRecorder(&config, utf8);
+  (*env)->ReleaseStringUTFChars(env, pathPrefix, utf8);
+  if (streamRecorder == NULL) {
+    return JNI_FALSE;
+  }
+
+  // configure audio source
+  SLDataLocator_IODevice loc_dev = {SL_DATALOCATOR_IODEVICE,
+                                    SL_IODEVICE_AUDIOINPUT,
+                                    SL_DEFAULTDEVICEID_AUDIOINPUT, NULL};
+  SLDataSource audioSrc = {&loc_dev, NULL};
+
+  // configure audio sink
+  SLDataLocator_AndroidSimpleBufferQueue loc_bq = {
+      SL_DATALOCATOR_ANDROIDSIMPLEBUFFERQUEUE, STREAM_RECORDER_QUEUED_BUFFERS};
+  SLDataFormat_PCM format_pcm = {
+      SL_DATAFORMAT_PCM,
+      (SLuint32)channelCount,
+      (SLuint32)sampleRate * 1000,
+      SL_PCMSAMPLEFORMAT_FIXED_16,
+      SL_PCMSAMPLEFORMAT_FIXED_16,
+      channelCount == 2 ? SL_SPEAKER_FRONT_LEFT | SL_SPEAKER_FRONT_RIGHT
+                        : SL_SPEAKER_FRONT_CENTER,
+      SL_BYTEORDER_LITTLEENDIAN};
+  SLDataSink audioSnk = {&loc_bq, &format_pcm};
+
+  // create audio recorder
+  // (requires the RECORD_AUDIO permission)
+  const SLInterfaceID id[1] = {SL_IID_ANDROIDSIMPLEBUFFERQUEUE};
+  const SLboolean req[1] = {SL_BOOLEAN_TRUE};
+  SLresult result =
+      (*engineEngine)
+          ->CreateAudioRecorder(engineEngine, &streamRecorderObject,
+                                &audioSrc, &audioSnk, 1, id, req);
+  if (SL_RESULT_SUCCESS == result) {
+    result = (*streamRecorderObject)
+                 ->Realize(streamRecorderObject, SL_BOOLEAN_FALSE);
+  }
+  if (SL_RESULT_SUCCESS == result) {
+    result = (*streamRecorderObject)
+                 ->GetInterface(streamRecorderObject, SL_IID_RECORD,
+                                &streamRecorderRecord);
+  }
+  if (SL_RESULT_SUCCESS == result) {
+    result = (*streamRecorderObject)
+                 ->GetInterface(streamRecorderObject,
+                                SL_IID_ANDROIDSIMPLEBUFFERQUEUE,
+                                &streamRecorderBufferQueue);
+  }
+  if (SL_RESULT_SUCCESS == result) {
+    result = (*streamRecorderBufferQueue)
+                 ->RegisterCallback(streamRecorderBufferQueue,
+                                    bqStreamRecorderCallback, NULL);
+  }
+  // every buffer of the queue to start with, before the first callback
+  int idx;
+  for (idx = 0; SL_RESULT_SUCCESS == result &&
+                idx < STREAM_RECORDER_QUEUED_BUFFERS;
+       idx++) {
+    result = (*streamRecorderBufferQueue)
+                 ->Enqueue(streamRecorderBufferQueue,
+                           nextStreamRecorderBuffer(streamRecorder),
+                           getStreamRecorderBufferBytes(streamRecorder));
+  }
+  if (SL_RESULT_SUCCESS == result) {
+    result = (*streamRecorderRecord)
+                 ->SetRecordState(streamRecorderRecord,
+                                  SL_RECORDSTATE_RECORDING);
+  }
+  if (SL_RESULT_SUCCESS != result) {
+    destroyStreamRecorderObject();
+    return JNI_FALSE;
+  }
+  return JNI_TRUE;
+}
+
+// stop the stream recorder; returns after the files are complete
+JNIEXPORT void JNICALL
+Java_com_example_nativeaudio_NativeAudio_stopStreamRecording(JNIEnv* env,
+                                                             jclass clazz) {
+  if (streamRecorderRecord != NULL) {
+    (*streamRecorderRecord)
+        ->SetRecordState(streamRecorderRecord, SL_RECORDSTATE_STOPPED);
+  }
+  destroyStreamRecorderObject();
+}
+
+// {captured, written, dropped, backlog peak, backlog capacity, frames
+// written, files, write errors}: of the running recorder, else the last one
+JNIEXPORT jlongArray JNICALL
+Java_com_example_nativeaudio_NativeAudio_getStreamRecordingStats(
+    JNIEnv* env, jclass clazz) {
+  StreamRecorderStats stats = streamRecorderStats;
+  if (streamRecorder != NULL) {
+    getStreamRecorderStats(streamRecorder, &stats);
+  }
+  jlong values[] = {(jlong)stats.captured,    (jlong)stats.written,
+                    (jlong)stats.dropped,     stats.backlogPeak,
+                    stats.backlogCapacity,    (jlong)stats.framesWritten,
+                    stats.files,              stats.writeErrors};
+  jsize count = sizeof(values) / sizeof(values[0]);
+  jlongArray array = (*env)->NewLongArray(env, count);
+  if (array != NULL) {
+    (*env)->SetLongArrayRegion(env, array, 0, count, values);
+  }
+  return array;
+}
+
 // shut down the native audio system
 JNIEXPORT void JNICALL
 Java_com_example_nativeaudio_NativeAudio_shutdown(JNIEnv* env, jclass clazz) {
@@ -943,6 +1180,12 @@ Java_com_example_nativeaudio_NativeAudio_shutdown(JNIEnv* env, jclass clazz) {
     bqPlayerMuteSolo = NULL;
     bqPlayerVolume = NULL;
   }
+  free(streamBuffers[0]);
+  free(streamBuffers[1]);
+  streamBuffers[0] = streamBuffers[1] = NULL;
+  destroyResampler(resampler);
+  resampler = NULL;
+  resamplerInRate = resamplerOutRate = 0;
 
   // destroy file descriptor audio player object, and invalidate all associated
   // interfaces
@@ -965,6 +1208,9 @@ Java_com_example_nativeaudio_NativeAudio_shutdown(JNIEnv* env, jclass clazz) {
     uriPlayerVolume = NULL;
   }
 
+  // stop the stream recorder and complete its files
+  destroyStreamRecorderObject();
+
   // destroy audio recorder object, and invalidate all associated interfaces
   if (recorderObject != NULL) {
     (*recorderObject)->Destroy(recorderObject);
@@ -43,6 +43,7 @@ public class NativeAudio extends Activity
 
     //static final String TAG = "NativeAudio";
     private static final int AUDIO_ECHO_REQUEST = 0;
+    private static final int STREAM_RECORD_REQUEST = 1;
 
     static final int CLIP_NONE = 0;
     static final int CLIP_HELLO = 1;
@@ -58,6 +59,11 @@ public class NativeAudio extends Activity
 
     static int numChannelsUri = 0;
 
+    // streaming recorder: 48 kHz stereo from the microphone, kept as it is
+    static final int STREAM_RECORD_RATE = 48000;
+    static final int STREAM_RECORD_CHANNELS = 2;
+    static boolean isStreamRecording = false;
+
     /** Called when the activity is first created. */
     @Override
     @TargetApi(17)
@@ -309,6 +315,33 @@ public class NativeAudio extends Activity
             }
         });
 
+        ((Button) findViewById(R.id.stream_record)).setOnClickListener(new OnClickListener() {
+            public void onClick(View view) {
+                if (isStreamRecording) {
+                    stopStreamRecording();
+                    isStreamRecording = false;
+                    long[] stats = getStreamRecordingStats();
+                    Toast.makeText(getApplicationContext(),
+                            getString(R.string.stream_record_stats,
+                                      stats[0], stats[1], stats[2], stats[3], stats[4]),
+                            Toast.LENGTH_LONG)
+                            .show();
+                    ((Button) view).setText(R.string.stream_record);
+                    return;
+                }
+                int status = ActivityCompat.checkSelfPermission(NativeAudio.this,
+                        Manifest.permission.RECORD_AUDIO);
+                if (status != PackageManager.PERMISSION_GRANTED) {
+                    ActivityCompat.requestPermissions(
+                            NativeAudio.this,
+                            new String[]{Manifest.permission.RECORD_AUDIO},
+                            STREAM_RECORD_REQUEST);
+                    return;
+                }
+                streamRecordAudio();
+            }
+        });
+
     }
 
     // Single out recording for run-permission needs
@@ -322,6 +355,16 @@ public class NativeAudio extends Activity
         }
     }
 
+    // files go to the app's external files dir, stream_<time>_000.wav, ...
+    private void streamRecordAudio() {
+        String prefix = getExternalFilesDir(null) + "/stream_" + System.currentTimeMillis();
+        isStreamRecording = startStreamRecording(prefix, STREAM_RECORD_RATE,
+                STREAM_RECORD_CHANNELS, false, 0);
+        if (isStreamRecording) {
+            ((Button) findViewById(R.id.stream_record)).setText(R.string.stop_stream_record);
+        }
+    }
+
    /** Called when the activity is about to be destroyed. */
     @Override
     protected void onPause()
@@ -348,7 +391,7 @@ public class NativeAudio extends Activity
         /*
          * if any permission failed, the sample could not play
          */
-        if (AUDIO_ECHO_REQUEST != requestCode) {
+        if (AUDIO_ECHO_REQUEST != requestCode && STREAM_RECORD_REQUEST != requestCode) {
             super.onRequestPermissionsResult(requestCode, permissions, grantResults);
             return;
         }
@@ -371,7 +414,11 @@ public class NativeAudio extends Activity
         }
 
         // The callback runs on app's thread, so we are safe to resume the action
-        recordAudio();
+        if (STREAM_RECORD_REQUEST == requestCode) {
+            streamRecordAudio();
+        } else {
+            recordAudio();
+        }
     }
 
     /** Native methods, implemented in jni folder */
@@ -394,6 +441,11 @@ public class NativeAudio extends Activity
     public static native boolean enableReverb(boolean enabled);
     public static native boolean createAudioRecorder();
     public static native void startRecording();
+    public static native boolean startStreamRecording(String pathPrefix, int sampleRate,
+                                                      int channelCount, boolean downmix,
+                                                      int fileRate);
+    public static native void stopStreamRecording();
+    public static native long[] getStreamRecordingStats();
     public static native void shutdown();
 
     /** Load jni .so on initialization */
@@ -0,0 +1,229 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+/*
+ * Host accuracy test and benchmark for the native-audio resampler.
+ *   build: SRC=../../app/src/main/cpp
+ *          cc -std=gnu11 -O2 -I$SRC resampler_test.c $SRC/audio_resampler.c \
+ *             -lm -o resampler_test
+ *   usage: ./resampler_test [--seconds 10]
+ * For every quality preset and rate pair it checks:
+ *   - THD+N of a 997 Hz tone and of a tone at 35% of the lower rate
+ *     ( near the top of the passband, where the images and aliases are ),
+ *     -1 dBFS, against the preset's limit
+ *   - that feeding the input in random sized pieces gives the same output,
+ *     sample for sample, as feeding it all at once
+ * and times the conversion of --seconds of audio. Exits with 1 when a
+ * check fails.
+ */
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "audio_resampler.h"
+
+static const struct {
+  uint32_t in, out;
+} kRatePairs[] = {
+    {8000, 48000},  {16000, 48000}, {44100, 48000}, {48000, 44100},
+    {8000, 44100},  {16000, 8000},  {48000, 16000}, {22050, 96000},
+};
+
+static const char* kQualityNames[] = {"low", "medium", "high"};
+// THD+N limits, in dB; 16 bit output alone is about -98 dB
+static const double kLimitDb[] = {-45.0, -70.0, -85.0};
+
+static double nowSeconds(void) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return now.tv_sec + now.tv_nsec * 1e-9;
+}
+
+static short* makeTone(double freq, uint32_t rate, uint32_t frames) {
+  short* tone = (short*)malloc(frames * sizeof(short));
+  double amplitude = 32767.0 * pow(10.0, -1.0 / 20.0);
+  uint32_t n;
+  for (n = 0; n < frames; n++) {
+    tone[n] = (short)lrint(amplitude * sin(2.0 * M_PI * freq * n / rate));
+  }
+  return tone;
+}
+
+/*
+ * Convert in pieces of 1 .. maxPiece input frames ( all at once when
+ * maxPiece is 0 ) into at most outCap frames.
+ */
+static uint32_t convert(Resampler* r, const short* in, uint32_t inFrames,
+                        short* out, uint32_t outCap, uint32_t maxPiece) {
+  uint32_t pos = 0, produced = 0;
+  while (produced < outCap) {
+    uint32_t used = inFrames - pos;
+    if (maxPiece && used > maxPiece) used = 1 + rand() % maxPiece;
+    uint32_t room = outCap - produced;
+    if (maxPiece && room > maxPiece) room = 1 + rand() % maxPiece;
+    uint32_t count = resample(r, in + pos, &used, out + produced, room);
+    // done when the input is used up and nothing is left in the filter
+    if (!count && !used) break;
+    produced += count;
+    pos += used;
+  }
+  return produced;
+}
+
+/*
+ * THD+N: everything but the tone ( least squares fit of a sine, a cosine
+ * and DC at freq ) against the tone
+ */
+static double thdNoiseDb(const short* x, uint32_t frames, double freq,
+                         uint32_t rate) {
+  double ss = 0, cc = 0, sc = 0, s1 = 0, c1 = 0, xs = 0, xc = 0, x1 = 0;
+  uint32_t n;
+  for (n = 0; n < frames; n++) {
+    double w = 2.0 * M_PI * freq * n / rate;
+    double s = sin(w), c = cos(w);
+    ss += s * s, cc += c * c, sc += s * c, s1 += s, c1 += c;
+    xs += x[n] * s, xc += x[n] * c, x1 += x[n];
+  }
+  // solve the 3x3 normal equations by Cramer's rule
+  double m[3][3] = {{ss, sc, s1}, {sc, cc, c1}, {s1, c1, (double)frames}};
+  double v[3] = {xs, xc, x1};
+  double det = m[0][0] * (m[1][1] * m[2][2] - m[1][2] * m[2][1]) -
+               m[0][1] * (m[1][0] * m[2][2] - m[1][2] * m[2][0]) +
+               m[0][2] * (m[1][0] * m[2][1] - m[1][1] * m[2][0]);
+  double coef[3];
+  int col, row;
+  for (col = 0; col < 3; col++) {
+    double a[3][3];
+    memcpy(a, m, sizeof(a));
+    for (row = 0; row < 3; row++) a[row][col] = v[row];
+    coef[col] = (a[0][0] * (a[1][1] * a[2][2] - a[1][2] * a[2][1]) -
+                 a[0][1] * (a[1][0] * a[2][2] - a[1][2] * a[2][0]) +
+                 a[0][2] * (a[1][0] * a[2][1] - a[1][1] * a[2][0])) /
+                det;
+  }
+  double signal = 0, residual = 0;
+  for (n = 0; n < frames; n++) {
+    double w = 2.0 * M_PI * freq * n / rate;
+    double fit = coef[0] * sin(w) + coef[1] * cos(w);
+    double err = x[n] - fit - coef[2];
+    signal += fit * fit;
+    residual += err * err;
+  }
+  return 10.0 * log10(residual / signal);
+}
+
+static int checkTone(ResamplerQuality quality, uint32_t inRate,
+                     uint32_t outRate, double freq, double* thdDb) {
+  uint32_t inFrames = inRate;  // one second
+  uint32_t outCap = (uint32_t)((uint64_t)inFrames * outRate / inRate) + 64;
+  short* in = makeTone(freq, inRate, inFrames);
+  short* whole = (short*)malloc(outCap * sizeof(short));
+  short* pieces = (short*)malloc(outCap * sizeof(short));
+
+  Resampler* r = createResampler(inRate, outRate, quality);
+  uint32_t wholeFrames = convert(r, in, inFrames, whole, outCap, 0);
+  resetResampler(r);
+  uint32_t pieceFrames = convert(r, in, inFrames, pieces, outCap, 97);
+  int same = wholeFrames == pieceFrames &&
+             !memcmp(whole, pieces, wholeFrames * sizeof(short));
+
+  // skip the filter's start up, measure 0.5 s
+  uint32_t skip = (uint32_t)((uint64_t)getResamplerLatency(r) * 4 * outRate /
+                             inRate) + outRate / 10;
+  uint32_t frames = outRate / 2;
+  *thdDb = skip + frames <= wholeFrames
+               ? thdNoiseDb(whole + skip, frames, freq, outRate)
+               : 0.0;
+  destroyResampler(r);
+  free(in);
+  free(whole);
+  free(pieces);
+  return same;
+}
+
+static double benchmark(ResamplerQuality quality, uint32_t inRate,
+                        uint32_t outRate, uint32_t seconds) {
+  // a device buffer at a time, as the player callback converts it
+  const uint32_t kOutBuf = 192;
+  uint32_t inFrames = inRate * seconds;
+  short* in = makeTone(997.0, inRate, inFrames);
+  short out[192];
+  Resampler* r = createResampler(inRate, outRate, quality);
+  double start = nowSeconds();
+  uint32_t pos = 0;
+  while (pos < inFrames) {
+    uint32_t used = inFrames - pos;
+    resample(r, in + pos, &used, out, kOutBuf);
+    pos += used;
+  }
+  double elapsed = nowSeconds() - start;
+  destroyResampler(r);
+  free(in);
+  return seconds / elapsed;
+}
+
+int main(int argc, char* argv[]) {
+  uint32_t seconds = 10;
+  int idx;
+  for (idx = 1; idx < argc; idx++) {
+    if (!strcmp(argv[idx], "--seconds") && idx + 1 < argc) {
+      seconds = (uint32_t)strtoul(argv[++idx], NULL, 0);
+    } else {
+      fprintf(stderr, "usage: %s [--seconds 10]\n", argv[0]);
+      return 2;
+    }
+  }
+
+  printf("%s kernel\n", getResamplerKernelName());
+  printf("%-7s %6s %6s %6s %12s %12s %8s %10s\n", "quality", "in", "out",
+         "taps", "997 Hz dB", "top dB", "stream", "x realtime");
+  int failures = 0;
+  uint32_t quality, pair;
+  for (quality = RESAMPLER_QUALITY_LOW; quality <= RESAMPLER_QUALITY_HIGH;
+       quality++) {
+    for (pair = 0; pair < sizeof(kRatePairs) / sizeof(kRatePairs[0]);
+         pair++) {
+      uint32_t inRate = kRatePairs[pair].in, outRate = kRatePairs[pair].out;
+      uint32_t lowRate = inRate < outRate ? inRate : outRate;
+      Resampler* r = createResampler(inRate, outRate, quality);
+      if (!r) {
+        printf("%-7s %6u %6u: not supported\n", kQualityNames[quality],
+               inRate, outRate);
+        failures++;
+        continue;
+      }
+      uint32_t taps = 2 * getResamplerLatency(r);
+      destroyResampler(r);
+
+      double lowDb, topDb;
+      int same = checkTone(quality, inRate, outRate, 997.0, &lowDb);
+      same &= checkTone(quality, inRate, outRate, 0.35 * lowRate, &topDb);
+      double speed = benchmark(quality, inRate, outRate, seconds);
+      int pass = same && lowDb <= kLimitDb[quality] &&
+                 topDb <= kLimitDb[quality];
+      printf("%-7s %6u %6u %6u %12.1f %12.1f %8s %10.0f%s\n",
+             kQualityNames[quality], inRate, outRate, taps, lowDb, topDb,
+             same ? "same" : "DIFFERS", speed, pass ? "" : "  FAIL");
+      failures += !pass;
+    }
+  }
+  printf("( THD+N of -1 dBFS tones; limits %.0f / %.0f / %.0f dB )\n",
+         kLimitDb[0], kLimitDb[1], kLimitDb[2]);
+  return failures ? 1 : 0;
+}
@@ -0,0 +1,281 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+/*
+ * Host soak test of the native-audio streaming recorder.
+ *   build: SRC=../../app/src/main/cpp
+ *          cc -std=gnu11 -O2 -I. -I$SRC stream_recorder_test.c \
+ *             $SRC/audio_stream_recorder.c $SRC/audio_resampler.c \
+ *             -lm -lpthread -o stream_recorder_test
+ *   usage: ./stream_recorder_test [--hours 1] [--speed 10] [--rate 48000]
+ *              [--channels 2] [--downmix] [--file-rate 0] [--file-mb 64]
+ *              [--dir /tmp] [--keep] [--verbose]
+ * A thread stands in for the recorder callback: every buffer time divided
+ * by --speed it fills the oldest queued buffer with a frame counter and
+ * hands it over, exactly as bqStreamRecorderCallback() does. --speed 0
+ * does not wait at all, to overrun the writer on purpose.
+ * Then it reads the files back and checks that
+ *   - captured == written + dropped
+ *   - the files hold what the counters say, with sizes in their headers
+ *   - without conversion: the frame counter runs on sample by sample,
+ *     except for whole buffers, as many as were dropped
+ * Exits with 1 when a check fails.
+ */
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "audio_stream_recorder.h"
+
+static int verbose = 0;
+
+int __android_log_print(int prio, const char* tag, const char* fmt, ...) {
+  if (!verbose) return 0;
+  va_list args;
+  va_start(args, fmt);
+  fprintf(stderr, "%s: ", tag);
+  int count = vfprintf(stderr, fmt, args);
+  fputc('\n', stderr);
+  va_end(args);
+  return count;
+}
+
+static double nowSeconds(void) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return now.tv_sec + now.tv_nsec * 1e-9;
+}
+
+static void sleepUntil(double deadline) {
+  double left = deadline - nowSeconds();
+  if (left <= 0) return;
+  struct timespec wait = {(time_t)left, (long)((left - (time_t)left) * 1e9)};
+  nanosleep(&wait, NULL);
+}
+
+// what frame f of the recording holds in channel c: the frame counter, its
+// low half on the left, the high half on the right
+static inline short pattern(uint64_t frame, uint32_t channel) {
+  return (short)(channel ? frame >> 16 : frame);
+}
+
+/*
+ * Reads the files back; returns the frames in them, or -1 on a bad file.
+ * With check set, also counts the buffers missing from the frame counter
+ * of the captured frames.
+ */
+static long long readBack(const char* prefix, uint32_t files,
+                          uint32_t channels, uint32_t bufferFrames,
+                          uint64_t captured, int check, uint64_t* missing,
+                          int keep) {
+  long long total = 0;
+  uint64_t expected = 0;
+  uint32_t index;
+  *missing = 0;
+  for (index = 0; index < files; index++) {
+    char path[512];
+    snprintf(path, sizeof(path), "%s_%03u.wav", prefix, index);
+    FILE* file = fopen(path, "rb");
+    if (!file) {
+      printf("%s: missing\n", path);
+      return -1;
+    }
+    uint32_t header[11];
+    fseek(file, 0, SEEK_END);
+    long size = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    if (fread(header, sizeof(header), 1, file) != 1 ||
+        header[0] != 0x46464952 || header[10] != (uint32_t)size - 44 ||
+        header[1] != (uint32_t)size - 8 ||
+        (header[5] >> 16) != channels) {
+      printf("%s: bad header\n", path);
+      fclose(file);
+      return -1;
+    }
+    short frame[2];
+    while (fread(frame, channels * sizeof(short), 1, file) == 1) {
+      if (check) {
+        uint32_t counter = (uint16_t)frame[0];
+        if (channels > 1) counter |= (uint32_t)(uint16_t)frame[1] << 16;
+        if (counter != (uint32_t)expected) {
+          // a gap of whole buffers, where the writer fell behind; mono
+          // only sees it modulo 65536 frames
+          uint64_t skip = channels > 1
+                              ? (uint32_t)(counter - (uint32_t)expected)
+                              : (uint16_t)(counter - (uint32_t)expected);
+          if (skip % bufferFrames) {
+            printf("%s: frame %lld is off by %llu\n", path, total,
+                   (unsigned long long)skip);
+            fclose(file);
+            return -1;
+          }
+          *missing += skip / bufferFrames;
+          expected += skip;
+        }
+        expected++;
+      }
+      total++;
+    }
+    fclose(file);
+    if (!keep) unlink(path);
+  }
+  // the last buffers may be dropped too, with nothing after them
+  if (check) *missing += (captured - expected) / bufferFrames;
+  return total;
+}
+
+int main(int argc, char* argv[]) {
+  double hours = 1.0, speed = 10.0;
+  StreamRecorderConfig config = {48000, 2, 0, 4, 2000, 0, 0, 64 << 20};
+  const char* dir = "/tmp";
+  int keep = 0, idx;
+  for (idx = 1; idx < argc; idx++) {
+    const char* arg = argv[idx];
+    const char* value = idx + 1 < argc ? argv[idx + 1] : NULL;
+    if (!strcmp(arg, "--downmix")) {
+      config.downmix = 1;
+    } else if (!strcmp(arg, "--verbose")) {
+      verbose = 1;
+    } else if (!strcmp(arg, "--keep")) {
+      keep = 1;
+    } else if (value && !strcmp(arg, "--hours")) {
+      hours = atof(argv[++idx]);
+    } else if (value && !strcmp(arg, "--speed")) {
+      speed = atof(argv[++idx]);
+    } else if (value && !strcmp(arg, "--rate")) {
+      config.sampleRate = (uint32_t)atoi(argv[++idx]);
+    } else if (value && !strcmp(arg, "--channels")) {
+      config.channelCount = (uint32_t)atoi(argv[++idx]);
+    } else if (value && !strcmp(arg, "--file-rate")) {
+      config.fileRate = (uint32_t)atoi(argv[++idx]);
+    } else if (value && !strcmp(arg, "--file-mb")) {
+      config.fileBytes = (uint32_t)atoi(argv[++idx]) << 20;
+    } else if (value && !strcmp(arg, "--dir")) {
+      dir = argv[++idx];
+    } else {
+      fprintf(stderr,
+              "usage: %s [--hours 1] [--speed 10] [--rate 48000] "
+              "[--channels 2] [--downmix] [--file-rate 0] [--file-mb 64] "
+              "[--dir /tmp] [--keep] [--verbose]\n",
+              argv[0]);
+      return 2;
+    }
+  }
+  // 20 ms buffers, as native-audio-jni.c uses
+  config.bufferFrames = config.sampleRate / 50;
+  char prefix[400];
+  snprintf(prefix, sizeof(prefix), "%s/stream_recorder_test_%d", dir,
+           (int)getpid());
+
+  StreamRecorder* recorder = createStreamRecorder(&config, prefix);
+  if (!recorder) {
+    printf("config not supported, or %s not writable\n", dir);
+    return 1;
+  }
+  // the recorder's buffer queue, oldest first
+  short* queue[64];
+  uint32_t head = 0, tail = 0;
+  for (idx = 0; idx < (int)config.queuedBuffers; idx++) {
+    queue[head++ % 64] = nextStreamRecorderBuffer(recorder);
+  }
+
+  uint64_t buffers =
+      (uint64_t)(hours * 3600.0 * config.sampleRate / config.bufferFrames);
+  double period = speed > 0 ? config.bufferFrames /
+                                  (double)config.sampleRate / speed
+                            : 0.0;
+  double start = nowSeconds(), callbackMax = 0.0;
+  uint64_t n, frame = 0;
+  for (n = 0; n < buffers; n++) {
+    if (period > 0) sleepUntil(start + (n + 1) * period);
+    double begin = nowSeconds();
+    short* buf = queue[tail++ % 64];
+    uint32_t i, c;
+    for (i = 0; i < config.bufferFrames; i++, frame++) {
+      for (c = 0; c < config.channelCount; c++) {
+        buf[i * config.channelCount + c] = pattern(frame, c);
+      }
+    }
+    onStreamRecorderBuffer(recorder);
+    queue[head++ % 64] = nextStreamRecorderBuffer(recorder);
+    double took = nowSeconds() - begin;
+    if (took > callbackMax) callbackMax = took;
+  }
+  double elapsed = nowSeconds() - start;
+
+  StreamRecorderStats stats;
+  finishStreamRecorder(recorder);
+  getStreamRecorderStats(recorder, &stats);
+  destroyStreamRecorder(recorder);
+
+  uint32_t channelsOut = config.downmix ? 1 : config.channelCount;
+  int check = !config.downmix &&
+              (!config.fileRate || config.fileRate == config.sampleRate);
+  uint64_t missing = 0;
+  long long frames =
+      readBack(prefix, stats.files, channelsOut, config.bufferFrames,
+               stats.captured * config.bufferFrames, check, &missing, keep);
+
+  uint32_t fileRate = config.fileRate ? config.fileRate : config.sampleRate;
+  printf("%.2f h of %u Hz x %u -> %u Hz x %u in %.1f s, %u files\n", hours,
+         config.sampleRate, config.channelCount, fileRate, channelsOut,
+         elapsed, stats.files);
+  printf("captured %llu, dropped %llu, backlog peak %u of %u buffers, "
+         "longest drain %u us, longest callback %.1f us\n",
+         (unsigned long long)stats.captured,
+         (unsigned long long)stats.dropped, stats.backlogPeak,
+         stats.backlogCapacity, stats.writeMaxUs, callbackMax * 1e6);
+
+  int failures = 0;
+  if (stats.captured != buffers ||
+      stats.captured != stats.written + stats.dropped) {
+    printf("FAIL: captured %llu of %llu buffers, written %llu\n",
+           (unsigned long long)stats.captured, (unsigned long long)buffers,
+           (unsigned long long)stats.written);
+    failures++;
+  }
+  if (frames >= 0 && (uint64_t)frames != stats.framesWritten) {
+    printf("FAIL: %lld frames in the files, %llu counted\n", frames,
+           (unsigned long long)stats.framesWritten);
+    failures++;
+  }
+  uint64_t expectFrames = stats.written * config.bufferFrames;
+  if (frames < 0) {
+    failures++;
+  } else if (check && ((uint64_t)frames != expectFrames ||
+                       missing != stats.dropped)) {
+    printf("FAIL: %lld frames in the files, %llu buffers missing; "
+           "counted %llu dropped\n",
+           frames, (unsigned long long)missing,
+           (unsigned long long)stats.dropped);
+    failures++;
+  } else if (!check) {
+    // converted: as long as the input, give or take the filter's rounding
+    double expect = (double)stats.captured * config.bufferFrames *
+                    fileRate / config.sampleRate;
+    if (!stats.dropped && (frames < expect - 2 || frames > expect + 2)) {
+      printf("FAIL: %lld frames in the files, expected %.0f\n", frames,
+             expect);
+      failures++;
+    }
+  }
+  printf("%s\n", failures ? "FAIL" : "PASS");
+  return failures ? 1 : 0;
+}
@@ -18,7 +18,6 @@
 #include <jni.h>
 #include <pthread.h>
 #include <stdio.h>
-#include <unistd.h>
 
 #include <atomic>
 #include <string>
@@ -27,6 +26,10 @@
 #include <amidi/AMidi.h>
 
 #include "AndroidDebug.h"
+#include "MidiBatchBuffer.h"
+#include "MidiEventRing.h"
+#include "MidiParser.h"
+#include "MidiReceiveLoop.h"
 #include "MidiSpec.h"
 
 static AMidiDevice* sNativeReceiveDevice = NULL;
@@ -39,24 +42,39 @@ static AMidiInputPort* sMidiInputPort = NULL;
 static pthread_t sReadThread;
 static std::atomic<bool> sReading(false);
 
+// Everything received, timestamped, for a native audio render thread
+static MidiEventRing sReceivedEvents;
+
+MidiEventRing* getReceivedMidiEvents() { return &sReceivedEvents; }
+
+// Splits what the port sends into whole messages; read thread only
+static uint8_t sSysExBuffer[kMaxMidiEventBytes];
+static MidiParser sParser(sSysExBuffer, sizeof(sSysExBuffer));
+
 // The Data Callback
 extern JavaVM* theJvm;           // Need this for allocating data buffer for...
 extern jobject dataCallbackObj;  // This is the (Java) object that implements...
 extern jmethodID midDataCallback;  // ...this callback routine
+extern void* theReceiveBuffer;  // ...which reads the data from here
+extern jlong theReceiveBufferCapacity;
 
-static void SendTheReceivedData(uint8_t* data, int numBytes) {
-  JNIEnv* env;
-  theJvm->AttachCurrentThread(&env, NULL);
-  if (env == NULL) {
-    LOGE("Error retrieving JNI Env");
-  }
-
-  // Allocate the Java array and fill with received data
-  jbyteArray ret = env->NewByteArray(numBytes);
-  env->SetByteArrayRegion(ret, 0, numBytes, (jbyte*)data);
+// Messages for the Java callback, in theReceiveBuffer; read thread only
+static MidiBatchBuffer sBatch;
 
-  // send it to the (Java) callback
-  env->CallVoidMethod(dataCallbackObj, midDataCallback, ret);
+/**
+ * Hands the batch of messages to the (Java) callback, which reads them out
+ * of the shared buffer before it returns, so it can be refilled right away.
+ * Does nothing when the batch is empty.
+ * @param   env   The read thread's JNI Env.
+ */
+static void SendTheReceivedData(JNIEnv* env) {
+  if (sBatch.count() == 0) return;
+  env->CallVoidMethod(dataCallbackObj, midDataCallback, (jint)sBatch.size());
+  if (env->ExceptionCheck()) {
+    LOGE("Exception in the MIDI data callback");
+    env->ExceptionClear();
+  }
+  sBatch.clear();
 }
 
 #if 0
@@ -84,49 +102,99 @@ static void logMidiBuffer(int64_t timestamp, uint8_t* dataBytes, size_t numDataB
 /*
  * Receiving API
  */
+static ssize_t receiveFromPort(void* port, int32_t* opcode, uint8_t* buffer,
+                               size_t maxBytes, size_t* numBytesReceived,
+                               int64_t* timestamp) {
+  return AMidiOutputPort_receive(static_cast<AMidiOutputPort*>(port), opcode,
+                                 buffer, maxBytes, numBytesReceived,
+                                 timestamp);
+}
+
+/**
+ * Passes on one whole message, or piece of SysEx: all of them to
+ * sReceivedEvents, channel messages also to Java.
+ * @param   env   The read thread's JNI Env.
+ */
+static void dispatchMidiEvent(JNIEnv* env, const MidiParsedEvent& event) {
+  sReceivedEvents.push(event.data(), event.numBytes, event.timestamp);
+  if (event.kind == kMidiParsed_Channel && sBatch.isAttached() &&
+      !sBatch.append(event.data(), event.numBytes, event.timestamp)) {
+    // no room left: send what there is, and start the next batch
+    SendTheReceivedData(env);
+    sBatch.append(event.data(), event.numBytes, event.timestamp);
+  }
+}
+
+// context is the read thread's JNI Env
+static void onMidiMessage(void* context, int32_t opcode, const uint8_t* data,
+                          size_t numBytes, int64_t timestamp) {
+  if (opcode == AMIDI_OPCODE_DATA) {
+    // (optionally) Dump to log
+    // logMidiBuffer(timestamp, data, numBytes);
+    MidiParsedEvent events[32];
+    while (numBytes > 0) {
+      size_t numBytesUsed;
+      size_t numEvents = sParser.parse(data, numBytes, timestamp, events,
+                                       sizeof(events) / sizeof(events[0]),
+                                       &numBytesUsed);
+      for (size_t idx = 0; idx < numEvents; idx++) {
+        dispatchMidiEvent(static_cast<JNIEnv*>(context), events[idx]);
+      }
+      data += numBytesUsed;
+      numBytes -= numBytesUsed;
+    }
+  } else if (opcode == AMIDI_OPCODE_FLUSH) {
+    // what was under way will not be finished
+    sParser.reset();
+  }
+}
+
+// context is the read thread's JNI Env
+static int64_t onMidiPollEnd(void* context, int64_t nowNs) {
+  if (sBatch.isDue(nowNs)) {
+    SendTheReceivedData(static_cast<JNIEnv*>(context));
+  }
+  return sBatch.count() ? sBatch.dueNs() : 0;
+}
+
 /**
  * This routine polls the input port and dispatches received data to the
- * application-provided (Java) callback.
+ * application-provided (Java) callback, and to sReceivedEvents. There is no
+ * blocking receive, so MidiReceiveLoop polls: continuously right after a
+ * message, with ever longer sleeps, up to 2 ms, while the port is quiet.
+ * The data is parsed into whole messages, running status filled in, and
+ * the messages go to Java in batches: one call once the shared buffer is
+ * mostly full, or MidiBatchBuffer::kMaxDelayNs after the first message.
  */
 static void* readThreadRoutine(void* context) {
   (void)context;  // unused
 
-  sReading = true;
-  // AMidiOutputPort* outputPort = sMidiOutputPort.load();
-  AMidiOutputPort* outputPort = sMidiOutputPort;
-
-  const size_t MAX_BYTES_TO_RECEIVE = 128;
-  uint8_t incomingMessage[MAX_BYTES_TO_RECEIVE];
-
-  while (sReading) {
-    // AMidiOutputPort_receive is non-blocking, so let's not burn up the CPU
-    // unnecessarily
-    usleep(2000);
-
-    int32_t opcode;
-    size_t numBytesReceived;
-    int64_t timestamp;
-    ssize_t numMessagesReceived = AMidiOutputPort_receive(
-        outputPort, &opcode, incomingMessage, MAX_BYTES_TO_RECEIVE,
-        &numBytesReceived, &timestamp);
-
-    if (numMessagesReceived < 0) {
-      LOGW("Failure receiving MIDI data %zd", numMessagesReceived);
-      // Exit the thread
-      sReading = false;
-    }
-    if (numMessagesReceived > 0 && numBytesReceived >= 0) {
-      if (opcode == AMIDI_OPCODE_DATA &&
-          (incomingMessage[0] & kMIDISysCmdChan) != kMIDISysCmdChan) {
-        // (optionally) Dump to log
-        // logMidiBuffer(timestamp, incomingMessage, numBytesReceived);
-        SendTheReceivedData(incomingMessage, numBytesReceived);
-      } else if (opcode == AMIDI_OPCODE_FLUSH) {
-        // ignore
-      }
-    }
-  }  // end while(sReading)
+  // Attach once, for the life of the thread
+  JNIEnv* env = NULL;
+  theJvm->AttachCurrentThread(&env, NULL);
+  if (env == NULL) {
+    LOGE("Error retrieving JNI Env");
+    sReading = false;
+    return NULL;
+  }
+  sBatch.attach(static_cast<uint8_t*>(theReceiveBuffer),
+                theReceiveBufferCapacity > 0 ? theReceiveBufferCapacity : 0);
+  sParser.reset();
+
+  // The thread only reads sMidiOutputPort, so no special protection is
+  // required.
+  MidiReceiveLoop loop(receiveFromPort, sMidiOutputPort, onMidiMessage, env);
+  loop.setOnPollEnd(onMidiPollEnd);
+  ssize_t result = loop.run(sReading);
+  // what is left of the last batch
+  SendTheReceivedData(env);
+  if (result < 0) {
+    LOGW("Failure receiving MIDI data %zd", result);
+    // Exit the thread
+    sReading = false;
+  }
 
+  theJvm->DetachCurrentThread();
   return NULL;
 }
 
@@ -155,8 +223,9 @@ void Java_com_example_nativemidi_AppMidiManager_startReadingMidi(
   // sMidiOutputPort.store(outputPort);
   sMidiOutputPort = outputPort;
 
-  // Start read thread
+  // Start read thread; set sReading first, so that an early stop() sees it
   // pthread_init(true);
+  sReading = true;
   /*int pthread_result =*/pthread_create(&sReadThread, NULL, readThreadRoutine,
                                          NULL);
 }
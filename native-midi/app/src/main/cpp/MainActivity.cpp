@@ -22,13 +22,19 @@ extern "C" {
 JavaVM* theJvm;
 jobject dataCallbackObj;
 jmethodID midDataCallback;
+// The direct ByteBuffer received messages are passed in
+jobject receiveBufferObj;
+void* theReceiveBuffer;
+jlong theReceiveBufferCapacity;
 
 /**
  * Initializes JNI interface stuff, specifically the info needed to call back
  * into the Java layer when MIDI data is received.
+ * @param   receiveBuffer   A direct ByteBuffer, that native code fills with
+ *                          received messages before each callback.
  */
 JNICALL void Java_com_example_nativemidi_MainActivity_initNative(
-    JNIEnv* env, jobject instance) {
+    JNIEnv* env, jobject instance, jobject receiveBuffer) {
   env->GetJavaVM(&theJvm);
 
   // Setup the receive data callback (into Java)
@@ -36,7 +42,12 @@ JNICALL void Java_com_example_nativemidi_MainActivity_initNative(
       env->FindClass("com/example/nativemidi/MainActivity");
   dataCallbackObj = env->NewGlobalRef(instance);
   midDataCallback =
-      env->GetMethodID(clsMainActivity, "onNativeMessageReceive", "([B)V");
+      env->GetMethodID(clsMainActivity, "onNativeMessagesReceived", "(I)V");
+
+  // Keep the buffer alive as long as native code may write to it
+  receiveBufferObj = env->NewGlobalRef(receiveBuffer);
+  theReceiveBuffer = env->GetDirectBufferAddress(receiveBuffer);
+  theReceiveBufferCapacity = env->GetDirectBufferCapacity(receiveBuffer);
 }
 
 }  // extern "C"
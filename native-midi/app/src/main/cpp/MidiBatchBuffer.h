@@ -0,0 +1,93 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+#ifndef NATIVEMIDI_MIDIBATCHBUFFER_H
+#define NATIVEMIDI_MIDIBATCHBUFFER_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+/**
+ * Received MIDI messages, packed back to back into a buffer shared with
+ * Java ( a direct ByteBuffer ), so that a whole batch crosses JNI in one
+ * call. Each record is
+ *   int64_t  timestamp, CLOCK_MONOTONIC nanoseconds, in native byte order
+ *   uint8_t  numBytes
+ *   uint8_t  bytes[numBytes]
+ * MainActivity.onNativeMessagesReceived() reads this format.
+ * A batch is worth sending once it is mostly full, or kMaxDelayNs after the
+ * timestamp of its first message ( isDue() ): a dense stream then crosses
+ * JNI in a few calls per kMaxDelayNs, not one per poll of the port.
+ */
+class MidiBatchBuffer {
+ public:
+  static const size_t kHeaderBytes = sizeof(int64_t) + 1;
+  static const size_t kMaxMessageBytes = 255;
+  static const int64_t kMaxDelayNs = 2000000;
+
+  MidiBatchBuffer()
+      : mData(NULL), mCapacity(0), mSize(0), mCount(0), mFirstTimestamp(0) {}
+
+  void attach(uint8_t* data, size_t capacity) {
+    mData = data;
+    mCapacity = capacity;
+    clear();
+  }
+
+  /**
+   * Adds a message, cut to kMaxMessageBytes.
+   * @return false when it does not fit: send the batch, clear() and retry
+   */
+  bool append(const uint8_t* data, size_t numBytes, int64_t timestamp) {
+    if (numBytes > kMaxMessageBytes) numBytes = kMaxMessageBytes;
+    if (mSize + kHeaderBytes + numBytes > mCapacity) return false;
+    if (mCount == 0) mFirstTimestamp = timestamp;
+    uint8_t* record = mData + mSize;
+    memcpy(record, &timestamp, sizeof(timestamp));
+    record[sizeof(timestamp)] = (uint8_t)numBytes;
+    memcpy(record + kHeaderBytes, data, numBytes);
+    mSize += kHeaderBytes + numBytes;
+    mCount++;
+    return true;
+  }
+
+  void clear() {
+    mSize = 0;
+    mCount = 0;
+  }
+
+  bool isAttached() const { return mData != NULL; }
+  size_t size() const { return mSize; }  // in bytes
+  size_t count() const { return mCount; }
+
+  // When the batch has to be sent by, at the latest; only if count() > 0.
+  int64_t dueNs() const { return mFirstTimestamp + kMaxDelayNs; }
+
+  // Whether to send the batch now: three quarters full, or dueNs() passed.
+  bool isDue(int64_t nowNs) const {
+    return mCount > 0 && (mSize >= mCapacity / 4 * 3 || nowNs >= dueNs());
+  }
+
+ private:
+  uint8_t* mData;
+  size_t mCapacity;
+  size_t mSize;
+  size_t mCount;
+  int64_t mFirstTimestamp;  // of the first message in the batch
+};
+
+#endif  // NATIVEMIDI_MIDIBATCHBUFFER_H
@@ -0,0 +1,118 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+#ifndef NATIVEMIDI_MIDIEVENTRING_H
+#define NATIVEMIDI_MIDIEVENTRING_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <atomic>
+
+// The most bytes AMidiOutputPort_receive() is asked for at a time
+static const size_t kMaxMidiEventBytes = 128;
+
+/**
+ * MIDI data as received, with the time it arrived: CLOCK_MONOTONIC
+ * nanoseconds, as AMidiOutputPort_receive() stamps it.
+ */
+struct MidiEvent {
+  int64_t timestamp;
+  uint32_t numBytes;
+  uint8_t data[kMaxMidiEventBytes];
+};
+
+/**
+ * A ring of received MIDI events, from the MIDI read thread to an audio
+ * render thread. Neither side blocks or allocates. When the consumer falls
+ * behind by the whole ring, new events are dropped, and counted.
+ *
+ * A render callback plays each event at the frame its timestamp maps to,
+ * pushed back by a fixed delay of at least the worst delivery latency, so
+ * that every event lands on time and the jitter of delivery disappears:
+ *
+ *   while (const MidiEvent* event = ring.front()) {
+ *     int64_t frame = midiEventFrame(event->timestamp + delayNs,
+ *                                    bufferStartNs, sampleRate);
+ *     if (frame >= numFrames) break;  // for a later buffer
+ *     play(event, frame < 0 ? 0 : frame);
+ *     ring.pop();
+ *   }
+ */
+class MidiEventRing {
+ public:
+  static const uint32_t kCapacity = 256;  // a power of 2
+
+  // Read thread: false, and the event dropped, when the ring is full.
+  bool push(const uint8_t* data, size_t numBytes, int64_t timestamp) {
+    uint32_t head = mHead.load(std::memory_order_relaxed);
+    if (head - mTail.load(std::memory_order_acquire) >= kCapacity) {
+      mDropped.fetch_add(1, std::memory_order_relaxed);
+      return false;
+    }
+    MidiEvent& event = mEvents[head & (kCapacity - 1)];
+    if (numBytes > kMaxMidiEventBytes) numBytes = kMaxMidiEventBytes;
+    event.timestamp = timestamp;
+    event.numBytes = (uint32_t)numBytes;
+    memcpy(event.data, data, numBytes);
+    mHead.store(head + 1, std::memory_order_release);
+    return true;
+  }
+
+  // Render thread: the oldest event, NULL when there is none. It stays
+  // valid until pop().
+  const MidiEvent* front() const {
+    uint32_t tail = mTail.load(std::memory_order_relaxed);
+    if (tail == mHead.load(std::memory_order_acquire)) return NULL;
+    return &mEvents[tail & (kCapacity - 1)];
+  }
+
+  // Render thread: done with front().
+  void pop() {
+    mTail.store(mTail.load(std::memory_order_relaxed) + 1,
+                std::memory_order_release);
+  }
+
+  uint64_t getDropped() const {
+    return mDropped.load(std::memory_order_relaxed);
+  }
+
+ private:
+  MidiEvent mEvents[kCapacity];
+  // both count up forever, and wrap around together
+  std::atomic<uint32_t> mHead{0};
+  std::atomic<uint32_t> mTail{0};
+  std::atomic<uint64_t> mDropped{0};
+};
+
+/**
+ * The frame, counted from the first frame of a buffer that plays at
+ * bufferStartNs, that plays at timeNs; negative when that has passed.
+ * Rounds to the nearest frame.
+ */
+inline int64_t midiEventFrame(int64_t timeNs, int64_t bufferStartNs,
+                              int32_t sampleRate) {
+  int64_t ns = timeNs - bufferStartNs;
+  int64_t half = ns < 0 ? -500000000LL : 500000000LL;
+  return (ns * sampleRate + half) / 1000000000LL;
+}
+
+// What the app's MIDI read thread receives ( AppMidiManager.cpp ), for one
+// native audio render thread to consume
+MidiEventRing* getReceivedMidiEvents();
+
+#endif  // NATIVEMIDI_MIDIEVENTRING_H
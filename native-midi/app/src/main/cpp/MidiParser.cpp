@@ -0,0 +1,187 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+#include "MidiParser.h"
+
+#include "MidiSpec.h"
+
+// Data bytes after a channel status byte, by its high nibble, from 0x8n
+static const uint8_t kChannelDataBytes[7] = {
+    2,  // kMIDIChanCmd_NoteOff
+    2,  // kMIDIChanCmd_NoteOn
+    2,  // kMIDIChanCmd_PolyPress
+    2,  // kMIDIChanCmd_Control
+    1,  // kMIDIChanCmd_ProgramChange
+    1,  // kMIDIChanCmd_ChannelPress
+    2,  // kMIDIChanCmd_PitchWheel
+};
+
+// Data bytes after 0xFn, by n; -1 for the undefined ones. 0xF0 and 0xF7,
+// SysEx, are parsed apart.
+static const int8_t kSystemDataBytes[16] = {
+    -1, 1, 2, 1, -1, -1, 0, -1,  // system common
+    0,  -1, 0, 0, 0, -1, 0, 0,   // real-time
+};
+
+static void setShortEvent(MidiParsedEvent* event, MidiParsedKind kind,
+                          uint8_t status, const uint8_t* data,
+                          uint8_t numData, int64_t timestamp) {
+  event->timestamp = timestamp;
+  event->sysEx = NULL;
+  event->numBytes = 1 + numData;
+  event->kind = kind;
+  event->sysExFlags = 0;
+  event->bytes[0] = status;
+  for (uint8_t idx = 0; idx < numData; idx++) {
+    event->bytes[1 + idx] = data[idx];
+  }
+}
+
+MidiParser::MidiParser(uint8_t* sysExBuffer, size_t sysExCapacity)
+    : mSysEx(sysExBuffer), mSysExCapacity(sysExCapacity), mDiscarded(0) {
+  reset();
+}
+
+void MidiParser::reset() {
+  mSysExSize = 0;
+  mInSysEx = false;
+  mSysExStarted = false;
+  mSysExHandedOn = false;
+  mStatus = 0;
+  mNumNeeded = 0;
+  mNumData = 0;
+}
+
+size_t MidiParser::parse(const uint8_t* data, size_t numBytes,
+                         int64_t timestamp, MidiParsedEvent* events,
+                         size_t maxEvents, size_t* numBytesUsed) {
+  if (mSysExHandedOn) {
+    mSysExSize = 0;
+    mSysExStarted = false;
+    mSysExHandedOn = false;
+  }
+
+  size_t numEvents = 0;
+  size_t pos = 0;
+  while (pos < numBytes && numEvents < maxEvents) {
+    uint8_t byte = data[pos++];
+
+    if (byte >= kMIDISysCmd_RealTime) {
+      // whatever it interrupts carries on after it
+      if (kSystemDataBytes[byte & 0x0F] < 0) {
+        mDiscarded++;
+      } else {
+        setShortEvent(&events[numEvents++], kMidiParsed_RealTime, byte, NULL,
+                      0, timestamp);
+      }
+      continue;
+    }
+
+    if (mInSysEx) {
+      bool isData = (byte & kMIDIStatusBit) == 0;
+      bool isEnd = byte == kMIDISysCmd_EndOfSysEx;
+      bool fits = mSysExSize < mSysExCapacity;
+      if (isData && fits) {
+        mSysEx[mSysExSize++] = byte;
+        continue;
+      }
+      if (mSysExCapacity == 0) {
+        if (isData || isEnd) {
+          mDiscarded++;
+        } else {
+          pos--;  // the start of the next message
+        }
+        mInSysEx = isData;
+        continue;
+      }
+
+      MidiParsedEvent* event = &events[numEvents++];
+      if (!fits) {
+        // hand on what there is, then come back to this byte
+        pos--;
+        event->sysExFlags = 0;
+      } else {
+        // any other status byte ends the message, then starts its own: next
+        // time, as the buffer is handed on now
+        mInSysEx = false;
+        if (isEnd) {
+          mSysEx[mSysExSize++] = byte;
+        } else {
+          pos--;
+        }
+        event->sysExFlags = isEnd ? kMidiSysEx_End
+                                  : kMidiSysEx_End | kMidiSysEx_Cut;
+      }
+      if (mSysExStarted) event->sysExFlags |= kMidiSysEx_Start;
+      event->timestamp = timestamp;
+      event->sysEx = mSysEx;
+      event->numBytes = (uint32_t)mSysExSize;
+      event->kind = kMidiParsed_SysEx;
+      mSysExHandedOn = true;
+      break;
+    }
+
+    if (byte & kMIDIStatusBit) {
+      // a new message, so whatever came before it is not going to finish
+      mDiscarded += mNumData;
+      mNumData = 0;
+      mStatus = 0;
+      if (byte < kMIDISysCmdChan) {
+        mStatus = byte;
+        mNumNeeded = kChannelDataBytes[(byte >> 4) - 8];
+      } else if (byte == kMIDISysCmd_SysEx) {
+        mInSysEx = true;
+        mSysExStarted = true;
+        mSysExSize = 0;
+        if (mSysExCapacity == 0) {
+          mDiscarded++;
+        } else {
+          mSysEx[mSysExSize++] = byte;
+        }
+      } else if (kSystemDataBytes[byte & 0x0F] < 0) {
+        mDiscarded++;  // undefined, or a 0xF7 outside SysEx
+      } else if (kSystemDataBytes[byte & 0x0F] == 0) {
+        setShortEvent(&events[numEvents++], kMidiParsed_SystemCommon, byte,
+                      NULL, 0, timestamp);
+      } else {
+        mStatus = byte;
+        mNumNeeded = (uint8_t)kSystemDataBytes[byte & 0x0F];
+      }
+      continue;
+    }
+
+    // a data byte
+    if (mStatus == 0) {
+      mDiscarded++;
+      continue;
+    }
+    mData[mNumData++] = byte;
+    if (mNumData < mNumNeeded) continue;
+    mNumData = 0;
+    if (mStatus < kMIDISysCmdChan) {
+      // mStatus keeps running, for the next data bytes
+      setShortEvent(&events[numEvents++], kMidiParsed_Channel, mStatus, mData,
+                    mNumNeeded, timestamp);
+    } else {
+      setShortEvent(&events[numEvents++], kMidiParsed_SystemCommon, mStatus,
+                    mData, mNumNeeded, timestamp);
+      mStatus = 0;
+    }
+  }
+
+  *numBytesUsed = pos;
+  return numEvents;
+}
@@ -0,0 +1,118 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+#ifndef NATIVEMIDI_MIDIPARSER_H
+#define NATIVEMIDI_MIDIPARSER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// What a MidiParsedEvent holds
+enum MidiParsedKind : uint8_t {
+  kMidiParsed_Channel,       // 0x80 - 0xEF, and its data bytes
+  kMidiParsed_SystemCommon,  // 0xF1 - 0xF6, and its data bytes
+  kMidiParsed_RealTime,      // 0xF8 - 0xFF, alone
+  kMidiParsed_SysEx,         // some or all of 0xF0 ... 0xF7
+};
+
+// MidiParsedEvent::sysExFlags
+static const uint8_t kMidiSysEx_Start = 1;  // it begins with the 0xF0
+static const uint8_t kMidiSysEx_End = 2;    // the message is over...
+static const uint8_t kMidiSysEx_Cut = 4;    // ...without a 0xF7
+
+/**
+ * One complete MIDI message, or a piece of a SysEx message, as parsed.
+ */
+struct MidiParsedEvent {
+  int64_t timestamp;  // of the data its last byte came in
+  // kMidiParsed_SysEx: the bytes, in the parser's SysEx buffer; they stay
+  // there until the next MidiParser::parse()
+  const uint8_t* sysEx;
+  uint32_t numBytes;  // in bytes[], or at sysEx
+  MidiParsedKind kind;
+  uint8_t sysExFlags;
+  // the other kinds: the status byte, running status or not, then the data
+  uint8_t bytes[3];
+
+  const uint8_t* data() const {
+    return kind == kMidiParsed_SysEx ? sysEx : bytes;
+  }
+};
+
+/**
+ * Turns the MIDI 1.0 byte stream of a port, in whatever pieces it arrives,
+ * into complete messages. It
+ *  - restores running status: the status byte a channel message left out,
+ *  - passes on real-time bytes at once, wherever they fall, even inside
+ *    another message, which goes on around them,
+ *  - gathers a SysEx message, across any number of pieces, into a buffer
+ *    that the caller provides, handing it on each time the buffer fills up,
+ *    and when the message ends ( at a 0xF7, or at any other status byte ),
+ *  - drops, and counts, data bytes with no status to go with them, and
+ *    undefined status bytes.
+ * It never allocates, and it keeps the state between calls, so that a
+ * message may be split at any byte.
+ */
+class MidiParser {
+ public:
+  // sysExBuffer holds SysEx data until it is handed on; SysEx is dropped
+  // when sysExCapacity is 0.
+  MidiParser(uint8_t* sysExBuffer, size_t sysExCapacity);
+
+  /**
+   * Parses the bytes, up to where maxEvents events are found, or a SysEx
+   * event is, as the next call reuses the SysEx buffer. Call again with the
+   * rest, until none is left:
+   *
+   *   while (numBytes > 0) {
+   *     size_t used;
+   *     size_t count = parser.parse(data, numBytes, timestamp, events,
+   *                                 kMaxEvents, &used);
+   *     handle(events, count);
+   *     data += used;
+   *     numBytes -= used;
+   *   }
+   *
+   * @param timestamp       for the events that these bytes complete
+   * @param numBytesUsed    gets how many of the bytes were parsed
+   * @return the number of events put in events[]
+   */
+  size_t parse(const uint8_t* data, size_t numBytes, int64_t timestamp,
+               MidiParsedEvent* events, size_t maxEvents,
+               size_t* numBytesUsed);
+
+  // Forgets any message under way, as for a new connection.
+  void reset();
+
+  // Bytes dropped so far: stray data, undefined status, cut off messages.
+  uint64_t getDiscarded() const { return mDiscarded; }
+
+ private:
+  uint8_t* mSysEx;
+  size_t mSysExCapacity;
+  size_t mSysExSize;
+  bool mInSysEx;
+  bool mSysExStarted;  // the buffer holds the 0xF0
+  bool mSysExHandedOn;  // by the last parse(): empty it, before the next
+  // the running status, or the system common message under way; 0 for none
+  uint8_t mStatus;
+  uint8_t mNumNeeded;  // data bytes mStatus takes...
+  uint8_t mNumData;    // ...and those of them so far
+  uint8_t mData[2];
+  uint64_t mDiscarded;
+};
+
+#endif  // NATIVEMIDI_MIDIPARSER_H
@@ -0,0 +1,90 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+#include "MidiReceiveLoop.h"
+
+#include <sched.h>
+#include <time.h>
+
+#include "MidiEventRing.h"
+
+const MidiPollConfig kDefaultMidiPollConfig = {50000, 100, 2000};
+
+static int64_t monotonicNs() {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return now.tv_sec * 1000000000LL + now.tv_nsec;
+}
+
+MidiReceiveLoop::MidiReceiveLoop(MidiReceiveFunc receive, void* port,
+                                 MidiMessageFunc onMessage, void* context,
+                                 const MidiPollConfig& config)
+    : mReceive(receive),
+      mPort(port),
+      mOnMessage(onMessage),
+      mOnPollEnd(NULL),
+      mContext(context),
+      mConfig(config),
+      mStats() {}
+
+ssize_t MidiReceiveLoop::run(const std::atomic<bool>& keepRunning) {
+  uint8_t incomingMessage[kMaxMidiEventBytes];
+  // as if the last message came long ago: start out sleeping
+  int64_t lastMessageNs = monotonicNs() - mConfig.spinNs;
+  int32_t sleepUs = mConfig.minSleepUs;
+
+  while (keepRunning) {
+    // drain everything that is waiting
+    bool received = false;
+    for (;;) {
+      int32_t opcode;
+      size_t numBytesReceived;
+      int64_t timestamp;
+      mStats.polls++;
+      ssize_t numMessagesReceived =
+          mReceive(mPort, &opcode, incomingMessage, sizeof(incomingMessage),
+                   &numBytesReceived, &timestamp);
+      if (numMessagesReceived < 0) return numMessagesReceived;
+      if (numMessagesReceived == 0) break;
+      mStats.messages++;
+      received = true;
+      mOnMessage(mContext, opcode, incomingMessage, numBytesReceived,
+                 timestamp);
+    }
+
+    int64_t now = monotonicNs();
+    int64_t wakeNs = mOnPollEnd ? mOnPollEnd(mContext, now) : 0;
+    if (received) {
+      lastMessageNs = now;
+      sleepUs = mConfig.minSleepUs;
+    } else if (now - lastMessageNs < mConfig.spinNs) {
+      // more is likely to follow soon; stay on the CPU, but let others run
+      sched_yield();
+    } else {
+      // no later than onPollEnd asked to be called again
+      int64_t sleepNs = sleepUs * 1000LL;
+      if (wakeNs && wakeNs - now < sleepNs) {
+        sleepNs = wakeNs > now ? wakeNs - now : 0;
+      }
+      struct timespec sleep = {0, (long)sleepNs};
+      clock_nanosleep(CLOCK_MONOTONIC, 0, &sleep, NULL);
+      mStats.sleeps++;
+      sleepUs = sleepUs * 2 < mConfig.maxSleepUs ? sleepUs * 2
+                                                 : mConfig.maxSleepUs;
+    }
+  }
+  return 0;
+}
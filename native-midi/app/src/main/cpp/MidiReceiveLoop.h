@@ -0,0 +1,105 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+#ifndef NATIVEMIDI_MIDIRECEIVELOOP_H
+#define NATIVEMIDI_MIDIRECEIVELOOP_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#include <atomic>
+
+/**
+ * Reads one message from a port, as AMidiOutputPort_receive() does: returns
+ * 1 with the message, 0 when none is waiting, negative on an error.
+ */
+typedef ssize_t (*MidiReceiveFunc)(void* port, int32_t* opcode,
+                                   uint8_t* buffer, size_t maxBytes,
+                                   size_t* numBytesReceived,
+                                   int64_t* timestamp);
+
+/**
+ * Gets every message received, on the loop's thread.
+ */
+typedef void (*MidiMessageFunc)(void* context, int32_t opcode,
+                                const uint8_t* data, size_t numBytes,
+                                int64_t timestamp);
+
+/**
+ * Gets called after every poll of the port, whether it read messages or
+ * not, with the CLOCK_MONOTONIC time. Returns the time by which it wants to
+ * be called again, or 0 when it does not mind how long the loop sleeps.
+ */
+typedef int64_t (*MidiPollEndFunc)(void* context, int64_t nowNs);
+
+/**
+ * How the loop waits for a port that can only be polled.
+ */
+struct MidiPollConfig {
+  // keep polling, without sleeping, this long after the last message
+  int64_t spinNs;
+  // the first sleep after that; every sleep in a row doubles it...
+  int32_t minSleepUs;
+  // ...up to this, which bounds the delay of a message after a quiet spell
+  int32_t maxSleepUs;
+};
+
+// 50 us of spinning, then sleeps of 100 us doubling up to 2 ms
+extern const MidiPollConfig kDefaultMidiPollConfig;
+
+struct MidiReceiveStats {
+  uint64_t messages;
+  uint64_t polls;   // calls to the receive function
+  uint64_t sleeps;  // thread wakeups from a sleep
+};
+
+/**
+ * Polls a MIDI port on the calling thread. Every time it wakes it reads all
+ * the messages waiting. Right after a message it keeps polling without
+ * sleeping, as more usually follow; once the port has been quiet for a
+ * while, it sleeps longer and longer, so that an idle port costs few
+ * wakeups.
+ */
+class MidiReceiveLoop {
+ public:
+  MidiReceiveLoop(MidiReceiveFunc receive, void* port,
+                  MidiMessageFunc onMessage, void* context,
+                  const MidiPollConfig& config = kDefaultMidiPollConfig);
+
+  // Before run(): also call onPollEnd, with the same context as onMessage.
+  void setOnPollEnd(MidiPollEndFunc onPollEnd) { mOnPollEnd = onPollEnd; }
+
+  /**
+   * Polls until keepRunning is false, or the port fails.
+   * @return 0, or the negative result of the receive function
+   */
+  ssize_t run(const std::atomic<bool>& keepRunning);
+
+  // Counts so far; only while run() is not running.
+  const MidiReceiveStats& getStats() const { return mStats; }
+
+ private:
+  MidiReceiveFunc mReceive;
+  void* mPort;
+  MidiMessageFunc mOnMessage;
+  MidiPollEndFunc mOnPollEnd;
+  void* mContext;
+  MidiPollConfig mConfig;
+  MidiReceiveStats mStats;
+};
+
+#endif  // NATIVEMIDI_MIDIRECEIVELOOP_H
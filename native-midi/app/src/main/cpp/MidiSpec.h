@@ -20,7 +20,11 @@
 //
 // MIDI Messages
 //
-// Channel Commands
+// Status bytes have the top bit set, data bytes do not
+static const uint8_t kMIDIStatusBit = 0x80;
+
+// Channel Commands, in the high nibble of the status byte, the channel in the
+// low one
 static const uint8_t kMIDIChanCmd_NoteOff = 8;
 static const uint8_t kMIDIChanCmd_NoteOn = 9;
 static const uint8_t kMIDIChanCmd_PolyPress = 10;
@@ -31,7 +35,17 @@ static const uint8_t kMIDIChanCmd_PitchWheel = 14;
 // System Commands
 static const uint8_t kMIDISysCmdChan = 0xF0;
 static const uint8_t kMIDISysCmd_SysEx = 0xF0;
+static const uint8_t kMIDISysCmd_TimeCode = 0xF1;
+static const uint8_t kMIDISysCmd_SongPosition = 0xF2;
+static const uint8_t kMIDISysCmd_SongSelect = 0xF3;
+static const uint8_t kMIDISysCmd_TuneRequest = 0xF6;
 static const uint8_t kMIDISysCmd_EndOfSysEx = 0xF7;
+// System Real-Time Commands, which may come between the bytes of any other
+static const uint8_t kMIDISysCmd_RealTime = 0xF8;  // and up
+static const uint8_t kMIDISysCmd_Clock = 0xF8;
+static const uint8_t kMIDISysCmd_Start = 0xFA;
+static const uint8_t kMIDISysCmd_Continue = 0xFB;
+static const uint8_t kMIDISysCmd_Stop = 0xFC;
 static const uint8_t kMIDISysCmd_ActiveSensing = 0xFE;
 static const uint8_t kMIDISysCmd_Reset = 0xFF;
 
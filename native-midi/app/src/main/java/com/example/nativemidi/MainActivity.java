@@ -37,6 +37,8 @@ import android.widget.TextView;
 
 import android.os.Handler;
 
+import java.nio.ByteBuffer;
+import java.nio.ByteOrder;
 import java.util.ArrayList;
 
 /**
@@ -68,6 +70,25 @@ public class MainActivity extends Activity
     Spinner mInputDevicesSpinner;
     TextView mReceiveMessageTx;
 
+    // Received messages, filled by the native read thread before each
+    // onNativeMessagesReceived() call. The layout of each is in MidiBatchBuffer.h
+    private static final int RECEIVE_BUFFER_SIZE = 4096;
+    private static final int RECEIVE_HEADER_SIZE = 9; // timestamp and length
+    private final ByteBuffer mReceiveBuffer =
+            ByteBuffer.allocateDirect(RECEIVE_BUFFER_SIZE).order(ByteOrder.nativeOrder());
+
+    // The last note message received, and the one shown; guarded by mLastNote
+    private final byte[] mLastNote = new byte[3];
+    private final byte[] mShownNote = new byte[3];
+    private final Runnable mShowLastNote = new Runnable() {
+        public void run() {
+            synchronized (mLastNote) {
+                System.arraycopy(mLastNote, 0, mShownNote, 0, mLastNote.length);
+            }
+            showReceivedMessage(mShownNote);
+        }
+    };
+
     // Force to load the native library
     static {
         AppMidiManager.loadNativeAPI();
@@ -81,7 +102,7 @@ public class MainActivity extends Activity
         //
         // Init JNI for data receive callback
         //
-        initNative();
+        initNative(mReceiveBuffer);
 
         //
         // Setup UI
@@ -306,19 +327,37 @@ public class MainActivity extends Activity
     //
     // Native Interface methods
     //
-    private native void initNative();
+    private native void initNative(ByteBuffer receiveBuffer);
 
     /**
-     * Called from the native code when MIDI messages are received.
-     * @param message
+     * Called from the native code with the MIDI messages received in one go,
+     * in mReceiveBuffer. They are only there until this returns. Allocates
+     * nothing, however many messages arrive.
+     * @param numBytes  The size of the messages in mReceiveBuffer.
      */
-    private void onNativeMessageReceive(final byte[] message) {
-        // Messages are received on some other thread, so switch to the UI thread
-        // before attempting to access the UI
-        runOnUiThread(new Runnable() {
-            public void run() {
-                showReceivedMessage(message);
+    private void onNativeMessagesReceived(int numBytes) {
+        boolean gotNote = false;
+        synchronized (mLastNote) {
+            int pos = 0;
+            while (pos + RECEIVE_HEADER_SIZE <= numBytes) {
+                // mReceiveBuffer.getLong(pos) is the timestamp
+                int length = mReceiveBuffer.get(pos + RECEIVE_HEADER_SIZE - 1) & 0xFF;
+                int message = pos + RECEIVE_HEADER_SIZE;
+                int code = (mReceiveBuffer.get(message) & 0xF0) >> 4;
+                if (length >= mLastNote.length &&
+                        (code == MidiSpec.MIDICODE_NOTEON || code == MidiSpec.MIDICODE_NOTEOFF)) {
+                    for (int i = 0; i < mLastNote.length; i++) {
+                        mLastNote[i] = mReceiveBuffer.get(message + i);
+                    }
+                    gotNote = true;
+                }
+                pos = message + length;
             }
-        });
+        }
+        // Messages are received on some other thread, so switch to the UI thread
+        // before attempting to access the UI; only the last note is shown anyway
+        if (gotNote) {
+            runOnUiThread(mShowLastNote);
+        }
     }
 }
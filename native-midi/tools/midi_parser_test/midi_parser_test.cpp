@@ -0,0 +1,519 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+/*
+ * Host fuzz test and benchmark of MidiParser.
+ *   build: SRC=../../app/src/main/cpp
+ *          c++ -std=c++17 -O2 -I$SRC midi_parser_test.cpp \
+ *              $SRC/MidiParser.cpp -o midi_parser_test
+ *          ( add -g -fsanitize=address,undefined to fuzz under sanitizers )
+ *   usage: ./midi_parser_test [--iterations 20000] [--seed 1] [--bench]
+ * Fuzzing, each iteration
+ *  - writes random messages as a port could send them: running status,
+ *    real-time bytes between any two bytes of a message, SysEx up to 600
+ *    bytes, some of it ended by the next status byte rather than 0xF7,
+ *  - parses that in random pieces, with a random SysEx buffer size and a
+ *    random number of events per call, and checks it gets the messages
+ *    back, in order, SysEx pieces reassembled,
+ *  - parses random bytes, all at once and in random pieces, and checks the
+ *    two give the same events, each of them well formed.
+ * The benchmark parses 8 MB streams in 128-byte pieces, the most
+ * AMidiOutputPort_receive() is asked for, and prints the throughput.
+ * Exits with 1 on the first mismatch.
+ */
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <algorithm>
+#include <random>
+#include <vector>
+
+#include "MidiParser.h"
+#include "MidiSpec.h"
+
+typedef std::vector<uint8_t> Bytes;
+
+// A message as it should come out, SysEx reassembled
+struct Expected {
+  Bytes bytes;
+  bool cut;  // SysEx ended by a status byte
+
+  bool operator==(const Expected& other) const {
+    return bytes == other.bytes && cut == other.cut;
+  }
+};
+
+static const uint8_t kRealTime[] = {0xF8, 0xFA, 0xFB, 0xFC, 0xFE, 0xFF};
+
+static int dataBytesFor(uint8_t status) {
+  switch (status >> 4) {
+    case kMIDIChanCmd_ProgramChange:
+    case kMIDIChanCmd_ChannelPress:
+      return 1;
+    case 0xF:
+      return status == kMIDISysCmd_SongPosition ? 2
+             : status == kMIDISysCmd_TuneRequest ? 0
+                                                 : 1;
+    default:
+      return 2;
+  }
+}
+
+/*
+ * Appends random messages to stream, and what should be parsed out of it
+ * to expected.
+ */
+static void makeStream(std::mt19937* rng, size_t numMessages, Bytes* stream,
+                       std::vector<Expected>* expected) {
+  std::uniform_int_distribution<int> percent(0, 99);
+  std::uniform_int_distribution<int> dataByte(0, 0x7F);
+  uint8_t runningStatus = 0;
+  bool sysExOpen = false;  // cut, waiting for the next status byte
+
+  // real-time bytes may come before any byte, but the first
+  auto maybeRealTime = [&]() {
+    while (percent(*rng) < 10) {
+      uint8_t byte = kRealTime[percent(*rng) % sizeof(kRealTime)];
+      stream->push_back(byte);
+      expected->push_back({Bytes(1, byte), false});
+    }
+  };
+
+  for (size_t count = 0; count < numMessages || sysExOpen; count++) {
+    int kind = percent(*rng);
+    // a cut SysEx is handed on at the status byte after it, so that a
+    // real-time byte in between would come out first: none there
+    if (sysExOpen && kind >= 80) kind = 70;
+    if (kind < 70) {
+      uint8_t status = (uint8_t)(0x80 + (percent(*rng) % 0x70));
+      if (status == runningStatus && !sysExOpen && percent(*rng) < 50) {
+        // left out
+      } else {
+        stream->push_back(status);
+      }
+      runningStatus = status;
+      Expected message = {Bytes(1, status), false};
+      for (int idx = dataBytesFor(status); idx > 0; idx--) {
+        maybeRealTime();
+        uint8_t byte = (uint8_t)dataByte(*rng);
+        stream->push_back(byte);
+        message.bytes.push_back(byte);
+      }
+      expected->push_back(message);
+      sysExOpen = false;
+    } else if (kind < 80) {
+      static const uint8_t kCommon[] = {0xF1, 0xF2, 0xF3, 0xF6};
+      uint8_t status = kCommon[percent(*rng) % 4];
+      stream->push_back(status);
+      runningStatus = 0;
+      Expected message = {Bytes(1, status), false};
+      for (int idx = dataBytesFor(status); idx > 0; idx--) {
+        maybeRealTime();
+        uint8_t byte = (uint8_t)dataByte(*rng);
+        stream->push_back(byte);
+        message.bytes.push_back(byte);
+      }
+      expected->push_back(message);
+      sysExOpen = false;
+    } else if (kind < 95) {
+      stream->push_back(kMIDISysCmd_SysEx);
+      runningStatus = 0;
+      Expected message = {Bytes(1, kMIDISysCmd_SysEx), false};
+      int length = percent(*rng) < 80 ? percent(*rng) : percent(*rng) * 6;
+      for (int idx = 0; idx < length; idx++) {
+        maybeRealTime();
+        uint8_t byte = (uint8_t)dataByte(*rng);
+        stream->push_back(byte);
+        message.bytes.push_back(byte);
+      }
+      maybeRealTime();
+      if (percent(*rng) < 10) {
+        message.cut = true;  // by whatever comes next
+        sysExOpen = true;
+      } else {
+        stream->push_back(kMIDISysCmd_EndOfSysEx);
+        message.bytes.push_back(kMIDISysCmd_EndOfSysEx);
+      }
+      expected->push_back(message);
+    } else {
+      uint8_t byte = kRealTime[percent(*rng) % sizeof(kRealTime)];
+      stream->push_back(byte);
+      expected->push_back({Bytes(1, byte), false});
+    }
+  }
+}
+
+static bool isWellFormed(const MidiParsedEvent& event, size_t sysExCapacity) {
+  if (event.kind == kMidiParsed_SysEx) {
+    if (event.numBytes > sysExCapacity) return false;
+    if (!(event.sysExFlags & kMidiSysEx_End) &&
+        event.numBytes != sysExCapacity) {
+      return false;  // pieces are only handed on full
+    }
+    if ((event.sysExFlags & kMidiSysEx_Start) &&
+        (event.numBytes == 0 || event.sysEx[0] != kMIDISysCmd_SysEx)) {
+      return false;
+    }
+    for (uint32_t idx = 0; idx < event.numBytes; idx++) {
+      uint8_t byte = event.sysEx[idx];
+      bool edge = (idx == 0 && (event.sysExFlags & kMidiSysEx_Start)) ||
+                  (idx + 1 == event.numBytes && byte == 0xF7 &&
+                   (event.sysExFlags & kMidiSysEx_End) &&
+                   !(event.sysExFlags & kMidiSysEx_Cut));
+      if ((byte & kMIDIStatusBit) && !edge) return false;
+    }
+    return true;
+  }
+  uint8_t status = event.bytes[0];
+  if (!(status & kMIDIStatusBit) || status == kMIDISysCmd_SysEx ||
+      status == kMIDISysCmd_EndOfSysEx) {
+    return false;
+  }
+  bool realTime = status >= kMIDISysCmd_RealTime;
+  if (realTime != (event.kind == kMidiParsed_RealTime)) return false;
+  if ((status < kMIDISysCmdChan) != (event.kind == kMidiParsed_Channel)) {
+    return false;
+  }
+  int numData = realTime ? 0 : dataBytesFor(status);
+  if (event.numBytes != (uint32_t)(1 + numData)) return false;
+  for (int idx = 1; idx <= numData; idx++) {
+    if (event.bytes[idx] & kMIDIStatusBit) return false;
+  }
+  return true;
+}
+
+// One event, its data copied out of the parser
+struct Parsed {
+  Bytes bytes;
+  uint8_t kind;
+  uint8_t sysExFlags;
+
+  bool operator==(const Parsed& other) const {
+    return bytes == other.bytes && kind == other.kind &&
+           sysExFlags == other.sysExFlags;
+  }
+};
+
+/*
+ * Parses stream in pieces of up to maxPiece bytes, maxEvents at a time;
+ * false when an event is malformed.
+ */
+static bool parseAll(std::mt19937* rng, const Bytes& stream, size_t maxPiece,
+                     size_t maxEvents, size_t sysExCapacity,
+                     std::vector<Parsed>* parsed, uint64_t* discarded) {
+  std::vector<uint8_t> sysExBuffer(sysExCapacity + 1);
+  MidiParser parser(sysExBuffer.data(), sysExCapacity);
+  std::vector<MidiParsedEvent> events(maxEvents);
+  std::uniform_int_distribution<size_t> pieceSize(1, maxPiece);
+  size_t pos = 0;
+  int64_t pieceIndex = 0;
+  while (pos < stream.size()) {
+    size_t numBytes = std::min(pieceSize(*rng), stream.size() - pos);
+    // a copy, so that reading past it shows up under ASan
+    Bytes piece(stream.begin() + pos, stream.begin() + pos + numBytes);
+    const uint8_t* data = piece.data();
+    pos += numBytes;
+    pieceIndex++;
+    while (numBytes > 0) {
+      size_t used;
+      size_t count = parser.parse(data, numBytes, pieceIndex, events.data(),
+                                  maxEvents, &used);
+      if (count == 0 && used == 0) {
+        printf("no progress\n");
+        return false;
+      }
+      for (size_t idx = 0; idx < count; idx++) {
+        const MidiParsedEvent& event = events[idx];
+        if (!isWellFormed(event, sysExCapacity) ||
+            event.timestamp != pieceIndex) {
+          printf("malformed event, kind %d, %u bytes\n", event.kind,
+                 event.numBytes);
+          return false;
+        }
+        parsed->push_back({Bytes(event.data(), event.data() + event.numBytes),
+                           event.kind, event.sysExFlags});
+      }
+      data += used;
+      numBytes -= used;
+    }
+  }
+  *discarded = parser.getDiscarded();
+  return true;
+}
+
+// Joins up the SysEx pieces; false when they do not fit together.
+static bool reassemble(const std::vector<Parsed>& parsed,
+                       std::vector<Expected>* messages) {
+  Bytes sysEx;
+  bool inSysEx = false;
+  for (const Parsed& event : parsed) {
+    if (event.kind != kMidiParsed_SysEx) {
+      messages->push_back({event.bytes, false});
+      continue;
+    }
+    if ((event.sysExFlags & kMidiSysEx_Start) == inSysEx) return false;
+    if (event.sysExFlags & kMidiSysEx_Start) sysEx.clear();
+    sysEx.insert(sysEx.end(), event.bytes.begin(), event.bytes.end());
+    inSysEx = true;
+    if (event.sysExFlags & kMidiSysEx_End) {
+      messages->push_back({sysEx, (event.sysExFlags & kMidiSysEx_Cut) != 0});
+      inSysEx = false;
+    }
+  }
+  return !inSysEx;
+}
+
+static bool fuzzMessages(std::mt19937* rng) {
+  static const size_t kCapacities[] = {1, 2, 7, 128, 4096};
+  static const size_t kPieces[] = {1, 3, 128, 1024};
+  std::uniform_int_distribution<int> pick(0, 1 << 16);
+  size_t sysExCapacity = kCapacities[pick(*rng) % 5];
+  size_t maxPiece = kPieces[pick(*rng) % 4];
+  size_t maxEvents = pick(*rng) % 2 ? 32 : 1 + pick(*rng) % 4;
+
+  Bytes stream;
+  std::vector<Expected> expected;
+  makeStream(rng, 1 + pick(*rng) % 200, &stream, &expected);
+
+  std::vector<Parsed> parsed;
+  std::vector<Expected> messages;
+  uint64_t discarded;
+  if (!parseAll(rng, stream, maxPiece, maxEvents, sysExCapacity, &parsed,
+                &discarded) ||
+      !reassemble(parsed, &messages)) {
+    return false;
+  }
+  if (messages != expected || discarded != 0) {
+    size_t idx = 0;
+    while (idx < messages.size() && idx < expected.size() &&
+           messages[idx] == expected[idx]) {
+      idx++;
+    }
+    printf("messages differ at %zu of %zu ( %zu parsed ), %" PRIu64
+           " bytes discarded; SysEx buffer %zu, pieces of %zu, %zu events\n",
+           idx, expected.size(), messages.size(), discarded, sysExCapacity,
+           maxPiece, maxEvents);
+    return false;
+  }
+  return true;
+}
+
+static bool fuzzBytes(std::mt19937* rng) {
+  std::uniform_int_distribution<int> pick(0, 1 << 16);
+  Bytes stream(pick(*rng) % 2000);
+  int statusPercent = pick(*rng) % 50;
+  for (uint8_t& byte : stream) {
+    byte = (uint8_t)(pick(*rng) % 100 < statusPercent ? 0x80 | pick(*rng)
+                                                       : pick(*rng) & 0x7F);
+  }
+  static const size_t kCapacities[] = {0, 1, 2, 16, 128};
+  size_t sysExCapacity = kCapacities[pick(*rng) % 5];
+
+  std::vector<Parsed> whole, pieces;
+  uint64_t discardedWhole, discardedPieces;
+  if (!parseAll(rng, stream, stream.size() + 1, 1 << 16, sysExCapacity,
+                &whole, &discardedWhole) ||
+      !parseAll(rng, stream, 1 + pick(*rng) % 8, 1 + pick(*rng) % 3,
+                sysExCapacity, &pieces, &discardedPieces)) {
+    return false;
+  }
+  if (whole != pieces || discardedWhole != discardedPieces) {
+    printf("random bytes parse differently in pieces\n");
+    return false;
+  }
+  return true;
+}
+
+// A few cases spelled out, for what the fuzzing only checks for consistency
+static bool checkCases() {
+  struct Case {
+    const char* name;
+    Bytes input;
+    std::vector<Expected> output;
+    uint64_t discarded;
+  } cases[] = {
+      {"running status",
+       {0x90, 60, 100, 62, 100, 60, 0},
+       {{{0x90, 60, 100}, false},
+        {{0x90, 62, 100}, false},
+        {{0x90, 60, 0}, false}},
+       0},
+      {"real-time inside a message",
+       {0x90, 0xF8, 60, 0xFE, 100, 0xF8, 61, 100},
+       {{{0xF8}, false},
+        {{0xFE}, false},
+        {{0x90, 60, 100}, false},
+        {{0xF8}, false},
+        {{0x90, 61, 100}, false}},
+       0},
+      {"real-time inside SysEx",
+       {0xF0, 1, 0xF8, 2, 0xF7},
+       {{{0xF8}, false}, {{0xF0, 1, 2, 0xF7}, false}},
+       0},
+      {"SysEx cut by a status byte",
+       {0xF0, 1, 2, 0xC0, 5},
+       {{{0xF0, 1, 2}, true}, {{0xC0, 5}, false}},
+       0},
+      {"system common ends running status",
+       {0xB0, 7, 100, 0xF3, 4, 7, 90},
+       {{{0xB0, 7, 100}, false}, {{0xF3, 4}, false}},
+       2},
+      {"stray and undefined bytes",
+       {5, 0xF7, 0xF4, 0xF9, 0x90, 60, 0xE0, 1, 2},
+       {{{0xE0, 1, 2}, false}},
+       5},
+  };
+
+  bool ok = true;
+  for (const Case& test : cases) {
+    for (size_t piece = 1; piece <= test.input.size(); piece++) {
+      std::mt19937 rng(1);
+      std::vector<Parsed> parsed;
+      std::vector<Expected> messages;
+      uint64_t discarded;
+      if (!parseAll(&rng, test.input, piece, 32, 2, &parsed, &discarded) ||
+          !reassemble(parsed, &messages) || messages != test.output ||
+          discarded != test.discarded) {
+        printf("FAIL: %s, in pieces of up to %zu\n", test.name, piece);
+        ok = false;
+        break;
+      }
+    }
+  }
+  return ok;
+}
+
+static double nowSeconds() {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return now.tv_sec + now.tv_nsec * 1e-9;
+}
+
+static void bench(const char* name, const Bytes& stream) {
+  static const size_t kPiece = 128;
+  uint8_t sysExBuffer[128];
+  MidiParsedEvent events[32];
+  double best = 1e9;
+  uint64_t numEvents = 0;
+  uint32_t checksum = 0;
+  for (int run = 0; run < 5; run++) {
+    MidiParser parser(sysExBuffer, sizeof(sysExBuffer));
+    numEvents = 0;
+    double start = nowSeconds();
+    for (size_t pos = 0; pos < stream.size(); pos += kPiece) {
+      const uint8_t* data = stream.data() + pos;
+      size_t numBytes = std::min(kPiece, stream.size() - pos);
+      while (numBytes > 0) {
+        size_t used;
+        size_t count =
+            parser.parse(data, numBytes, (int64_t)pos, events, 32, &used);
+        for (size_t idx = 0; idx < count; idx++) {
+          checksum += events[idx].data()[events[idx].numBytes - 1];
+        }
+        numEvents += count;
+        data += used;
+        numBytes -= used;
+      }
+    }
+    best = std::min(best, nowSeconds() - start);
+  }
+  printf("%-10s %8.0f %10.1f %8.1f   (%u)\n", name,
+         stream.size() / best / 1e6, numEvents / best / 1e6,
+         best * 1e9 / stream.size(), checksum & 0xFF);
+}
+
+static void runBenchmarks() {
+  static const size_t kBytes = 8 << 20;
+  std::mt19937 rng(1);
+  std::uniform_int_distribution<int> dataByte(0, 0x7F);
+
+  Bytes notes;  // a sequencer: running status, and the clock
+  while (notes.size() < kBytes) {
+    notes.push_back(0x90 | (notes.size() & 0x0F));
+    for (int idx = 0; idx < 8; idx++) {
+      notes.push_back((uint8_t)dataByte(rng));
+      notes.push_back(idx & 1 ? 0 : 100);
+    }
+    notes.push_back(0xF8);
+  }
+
+  Bytes sweep;  // controller changes, all with their status
+  while (sweep.size() < kBytes) {
+    sweep.push_back(0xB0);
+    sweep.push_back(1);
+    sweep.push_back((uint8_t)dataByte(rng));
+  }
+
+  Bytes clock(kBytes, 0xF8);  // real-time only
+
+  Bytes sysEx;  // 4 KB dumps, handed on 128 bytes at a time
+  while (sysEx.size() < kBytes) {
+    sysEx.push_back(0xF0);
+    for (int idx = 0; idx < 4096; idx++) {
+      sysEx.push_back((uint8_t)dataByte(rng));
+    }
+    sysEx.push_back(0xF7);
+  }
+
+  Bytes mixed;
+  std::vector<Expected> unused;
+  while (mixed.size() < kBytes) makeStream(&rng, 1000, &mixed, &unused);
+
+  printf("%-10s %8s %10s %8s   %s\n", "stream", "MB/s", "Mevents/s", "ns/byte",
+         "(checksum)");
+  bench("notes", notes);
+  bench("sweep", sweep);
+  bench("clock", clock);
+  bench("sysex", sysEx);
+  bench("mixed", mixed);
+}
+
+int main(int argc, char* argv[]) {
+  long iterations = 20000;
+  unsigned seed = 1;
+  bool benchmark = false;
+  for (int idx = 1; idx < argc; idx++) {
+    const char* arg = argv[idx];
+    if (idx + 1 < argc && !strcmp(arg, "--iterations")) {
+      iterations = atol(argv[++idx]);
+    } else if (idx + 1 < argc && !strcmp(arg, "--seed")) {
+      seed = (unsigned)atol(argv[++idx]);
+    } else if (!strcmp(arg, "--bench")) {
+      benchmark = true;
+    } else {
+      fprintf(stderr, "usage: %s [--iterations 20000] [--seed 1] [--bench]\n",
+              argv[0]);
+      return 2;
+    }
+  }
+
+  if (!checkCases()) return 1;
+  std::mt19937 rng(seed);
+  for (long iteration = 0; iteration < iterations; iteration++) {
+    if (!fuzzMessages(&rng) || !fuzzBytes(&rng)) {
+      printf("FAIL: iteration %ld, seed %u\n", iteration, seed);
+      return 1;
+    }
+  }
+  printf("%ld iterations passed\n", iterations);
+
+  if (benchmark) runBenchmarks();
+  return 0;
+}
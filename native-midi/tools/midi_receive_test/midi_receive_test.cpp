@@ -0,0 +1,397 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+/*
+ * Host test of the native-midi receive path, against a fake port.
+ *   build: SRC=../../app/src/main/cpp
+ *          c++ -std=c++17 -O2 -I$SRC midi_receive_test.cpp \
+ *              $SRC/MidiReceiveLoop.cpp -pthread -o midi_receive_test
+ *   usage: ./midi_receive_test [--seconds 3] [--capture file] [--speed 1]
+ * A thread replays MIDI into the fake port, stamping each message as it
+ * sends it, the way AMidi does:
+ *   notes   a note on or off every 100 ms
+ *   chords  four messages 250 us apart, every 125 ms
+ *   sweep   a controller change every 1 ms
+ *   idle    nothing
+ *   capture the --capture file, at --speed times its pace: lines of a hex
+ *           nanosecond timestamp and hex bytes, as logMidiBuffer() logs them
+ * Each is received by the old loop ( one receive every 2 ms ) and by
+ * MidiReceiveLoop, which also feeds a MidiEventRing that a simulated audio
+ * thread drains every 4 ms ( 192 frames at 48 kHz ), playing each event
+ * 10 ms after its timestamp, and packs them into a 4 KB MidiBatchBuffer
+ * handed on when it is due, as to Java. It prints the delivery latency,
+ * wakeups and CPU time of the receiving thread, the calls it would make into
+ * Java and the longest a message waited in a batch for one ( hold ), and
+ * the events that reached the audio thread too late for their frame.
+ * Exits with 1 when MidiReceiveLoop loses or reorders a message, or one
+ * misses its batch.
+ */
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "MidiBatchBuffer.h"
+#include "MidiEventRing.h"
+#include "MidiReceiveLoop.h"
+
+static const int32_t kOpcodeData = 1;  // AMIDI_OPCODE_DATA
+static const int32_t kSampleRate = 48000;
+static const int32_t kBufferFrames = 192;
+static const int64_t kPlayDelayNs = 10000000;
+
+static int64_t monotonicNs() {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return now.tv_sec * 1000000000LL + now.tv_nsec;
+}
+
+static void sleepUntilNs(int64_t deadline) {
+  struct timespec when = {(time_t)(deadline / 1000000000LL),
+                          (long)(deadline % 1000000000LL)};
+  while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &when, NULL)) {
+  }
+}
+
+static int64_t threadCpuNs() {
+  struct timespec now;
+  clock_gettime(CLOCK_THREAD_CPUTIME_ID, &now);
+  return now.tv_sec * 1000000000LL + now.tv_nsec;
+}
+
+struct Message {
+  int64_t atNs;  // from the start of the replay
+  uint8_t numBytes;
+  uint8_t data[3];
+};
+
+/*
+ * Stands in for an AMidiOutputPort: messages wait in a queue until they are
+ * received, one per call.
+ */
+struct FakePort {
+  struct Packet {
+    int64_t timestamp;
+    Message message;
+  };
+  std::mutex lock;
+  std::deque<Packet> packets;
+
+  void send(const Message& message) {
+    std::lock_guard<std::mutex> guard(lock);
+    packets.push_back({monotonicNs(), message});
+  }
+};
+
+static ssize_t fakeReceive(void* port, int32_t* opcode, uint8_t* buffer,
+                           size_t maxBytes, size_t* numBytesReceived,
+                           int64_t* timestamp) {
+  FakePort* fake = static_cast<FakePort*>(port);
+  std::lock_guard<std::mutex> guard(fake->lock);
+  if (fake->packets.empty()) return 0;
+  const FakePort::Packet& packet = fake->packets.front();
+  *opcode = kOpcodeData;
+  *numBytesReceived = std::min<size_t>(packet.message.numBytes, maxBytes);
+  memcpy(buffer, packet.message.data, *numBytesReceived);
+  *timestamp = packet.timestamp;
+  fake->packets.pop_front();
+  return 1;
+}
+
+struct Receiver {
+  std::vector<int64_t> latencyNs;  // of each message, in order received
+  std::vector<int64_t> timestamps;
+  MidiEventRing ring;
+  bool useRing = false;
+  // stands in for the direct ByteBuffer and onNativeMessagesReceived()
+  uint8_t batchData[4096];
+  MidiBatchBuffer batch;
+  uint64_t javaCalls = 0;
+  uint64_t batchedMessages = 0;
+  int64_t firstBatchedNs = 0;  // timestamp of the first message batched
+  int64_t maxHoldNs = 0;
+};
+
+static void sendBatch(Receiver* receiver) {
+  if (receiver->batch.count() == 0) return;
+  receiver->javaCalls++;
+  receiver->batchedMessages += receiver->batch.count();
+  receiver->maxHoldNs = std::max(receiver->maxHoldNs,
+                                 monotonicNs() - receiver->firstBatchedNs);
+  receiver->batch.clear();
+}
+
+// as onMidiPollEnd() in AppMidiManager.cpp
+static int64_t onPollEnd(void* context, int64_t nowNs) {
+  Receiver* receiver = static_cast<Receiver*>(context);
+  if (receiver->batch.isDue(nowNs)) sendBatch(receiver);
+  return receiver->batch.count() ? receiver->batch.dueNs() : 0;
+}
+
+static void onMessage(void* context, int32_t opcode, const uint8_t* data,
+                      size_t numBytes, int64_t timestamp) {
+  Receiver* receiver = static_cast<Receiver*>(context);
+  if (opcode != kOpcodeData) return;
+  receiver->latencyNs.push_back(monotonicNs() - timestamp);
+  receiver->timestamps.push_back(timestamp);
+  if (!receiver->useRing) {
+    receiver->javaCalls++;  // one per message
+    return;
+  }
+  receiver->ring.push(data, numBytes, timestamp);
+  if (receiver->batch.count() == 0) receiver->firstBatchedNs = timestamp;
+  if (!receiver->batch.append(data, numBytes, timestamp)) {
+    sendBatch(receiver);
+    receiver->firstBatchedNs = timestamp;
+    receiver->batch.append(data, numBytes, timestamp);
+  }
+}
+
+// The loop readThreadRoutine() used to run
+static void legacyLoop(FakePort* port, Receiver* receiver,
+                       const std::atomic<bool>& keepRunning,
+                       MidiReceiveStats* stats) {
+  uint8_t incomingMessage[kMaxMidiEventBytes];
+  while (keepRunning) {
+    usleep(2000);
+    stats->sleeps++;
+    int32_t opcode;
+    size_t numBytesReceived;
+    int64_t timestamp;
+    stats->polls++;
+    if (fakeReceive(port, &opcode, incomingMessage, sizeof(incomingMessage),
+                    &numBytesReceived, &timestamp) > 0) {
+      stats->messages++;
+      onMessage(receiver, opcode, incomingMessage, numBytesReceived,
+                timestamp);
+    }
+  }
+}
+
+/*
+ * Drains the ring every buffer period, rendering a buffer ahead, as an
+ * audio callback would; counts the events whose frame had already passed.
+ */
+static void audioThread(MidiEventRing* ring,
+                        const std::atomic<bool>& keepRunning,
+                        uint64_t* played, uint64_t* late) {
+  const int64_t periodNs = 1000000000LL * kBufferFrames / kSampleRate;
+  int64_t next = monotonicNs();
+  while (keepRunning) {
+    next += periodNs;
+    sleepUntilNs(next);
+    // the buffer rendered now starts playing a period from now
+    int64_t bufferStart = next + periodNs;
+    while (const MidiEvent* event = ring->front()) {
+      int64_t frame = midiEventFrame(event->timestamp + kPlayDelayNs,
+                                     bufferStart, kSampleRate);
+      if (frame >= kBufferFrames) break;
+      if (frame < 0) (*late)++;
+      (*played)++;
+      ring->pop();
+    }
+  }
+}
+
+static std::vector<Message> makeScenario(const char* name, double seconds) {
+  std::vector<Message> messages;
+  int64_t end = (int64_t)(seconds * 1e9);
+  if (!strcmp(name, "notes")) {
+    for (int64_t t = 0, n = 0; t < end; t += 100000000, n++) {
+      uint8_t note = 60 + n / 2 % 12;
+      messages.push_back({t, 3, {(uint8_t)(n % 2 ? 0x80 : 0x90), note, 100}});
+    }
+  } else if (!strcmp(name, "chords")) {
+    for (int64_t t = 0, n = 0; t < end; t += 125000000, n++) {
+      for (int i = 0; i < 4; i++) {
+        messages.push_back({t + i * 250000, 3,
+                            {(uint8_t)(n % 2 ? 0x80 : 0x90),
+                             (uint8_t)(48 + i * 4), 90}});
+      }
+    }
+  } else if (!strcmp(name, "sweep")) {
+    for (int64_t t = 0, n = 0; t < end; t += 1000000, n++) {
+      messages.push_back({t, 3, {0xB0, 74, (uint8_t)(n % 128)}});
+    }
+  }
+  return messages;
+}
+
+static std::vector<Message> loadCapture(const char* path, double speed) {
+  std::vector<Message> messages;
+  FILE* file = fopen(path, "r");
+  if (!file) return messages;
+  char line[1024];
+  int64_t first = -1;
+  while (fgets(line, sizeof(line), file)) {
+    char* pos = line;
+    char* after;
+    uint64_t timestamp = strtoull(pos, &after, 16);
+    if (after == pos) continue;
+    if (first < 0) first = (int64_t)timestamp;
+    Message message = {(int64_t)(((int64_t)timestamp - first) / speed), 0, {}};
+    // one message per line, of up to three bytes, as the sample receives
+    for (pos = after; message.numBytes < 3; pos = after) {
+      unsigned long byte = strtoul(pos, &after, 16);
+      if (after == pos) break;
+      message.data[message.numBytes++] = (uint8_t)byte;
+    }
+    if (message.numBytes) messages.push_back(message);
+  }
+  fclose(file);
+  return messages;
+}
+
+static int64_t percentile(std::vector<int64_t> values, double p) {
+  if (values.empty()) return 0;
+  std::sort(values.begin(), values.end());
+  size_t index = (size_t)(p * (values.size() - 1) + 0.5);
+  return values[index];
+}
+
+/*
+ * Replays messages through one loop; returns false when a message is lost
+ * or out of order.
+ */
+static bool run(const char* name, const std::vector<Message>& messages,
+                double seconds, bool legacy) {
+  FakePort port;
+  Receiver receiver;
+  receiver.latencyNs.reserve(messages.size());
+  receiver.timestamps.reserve(messages.size());
+  receiver.useRing = !legacy;
+  receiver.batch.attach(receiver.batchData, sizeof(receiver.batchData));
+  std::atomic<bool> keepRunning(true);
+  MidiReceiveStats stats = {};
+  int64_t cpuNs = 0;
+  uint64_t played = 0, late = 0;
+
+  std::thread reader([&] {
+    int64_t cpuStart = threadCpuNs();
+    if (legacy) {
+      legacyLoop(&port, &receiver, keepRunning, &stats);
+    } else {
+      MidiReceiveLoop loop(fakeReceive, &port, onMessage, &receiver);
+      loop.setOnPollEnd(onPollEnd);
+      loop.run(keepRunning);
+      sendBatch(&receiver);
+      stats = loop.getStats();
+    }
+    cpuNs = threadCpuNs() - cpuStart;
+  });
+  std::thread audio;
+  if (!legacy) {
+    audio = std::thread(audioThread, &receiver.ring, std::cref(keepRunning),
+                        &played, &late);
+  }
+
+  int64_t start = monotonicNs() + 10000000;
+  for (const Message& message : messages) {
+    sleepUntilNs(start + message.atNs);
+    port.send(message);
+  }
+  int64_t end = start + (int64_t)(seconds * 1e9);
+  if (!messages.empty()) end = std::max(end, start + messages.back().atNs);
+  // let the last messages through
+  sleepUntilNs(end + 50000000);
+  keepRunning = false;
+  reader.join();
+  if (audio.joinable()) audio.join();
+
+  double elapsed = (monotonicNs() - start) / 1e9;
+  std::vector<int64_t>& latency = receiver.latencyNs;
+  printf("%-8s %-6s %6zu %8.0f %8.0f %8.0f %9.0f %7.2f%% %6" PRIu64, name,
+         legacy ? "old" : "new", latency.size(),
+         percentile(latency, 0.5) / 1e3, percentile(latency, 0.99) / 1e3,
+         latency.empty() ? 0.0
+                         : *std::max_element(latency.begin(), latency.end()) /
+                               1e3,
+         stats.sleeps / elapsed, 100.0 * cpuNs / (elapsed * 1e9),
+         receiver.javaCalls);
+  if (!legacy) {
+    printf(" %7.0f %6" PRIu64 " of %" PRIu64, receiver.maxHoldNs / 1e3, late,
+           played);
+  }
+  printf("\n");
+
+  bool ok = std::is_sorted(receiver.timestamps.begin(),
+                           receiver.timestamps.end());
+  if (!legacy && (latency.size() != messages.size() || !ok)) {
+    printf("FAIL: received %zu of %zu messages%s\n", latency.size(),
+           messages.size(), ok ? "" : ", out of order");
+    return false;
+  }
+  if (!legacy && receiver.batchedMessages != messages.size()) {
+    printf("FAIL: batched %" PRIu64 " of %zu messages\n",
+           receiver.batchedMessages, messages.size());
+    return false;
+  }
+  return true;
+}
+
+int main(int argc, char* argv[]) {
+  double seconds = 3.0, speed = 1.0;
+  const char* capture = NULL;
+  for (int idx = 1; idx < argc; idx++) {
+    const char* arg = argv[idx];
+    if (idx + 1 < argc && !strcmp(arg, "--seconds")) {
+      seconds = atof(argv[++idx]);
+    } else if (idx + 1 < argc && !strcmp(arg, "--capture")) {
+      capture = argv[++idx];
+    } else if (idx + 1 < argc && !strcmp(arg, "--speed")) {
+      speed = atof(argv[++idx]);
+    } else {
+      fprintf(stderr,
+              "usage: %s [--seconds 3] [--capture file] [--speed 1]\n",
+              argv[0]);
+      return 2;
+    }
+  }
+  if (seconds <= 0 || speed <= 0) return 2;
+
+  printf("%-8s %-6s %6s %8s %8s %8s %9s %8s %6s %7s %s\n", "replay", "loop",
+         "msgs", "p50 us", "p99 us", "max us", "wakeups/s", "cpu", "java",
+         "hold us", "late events");
+  int failures = 0;
+  const char* kScenarios[] = {"notes", "chords", "sweep", "idle"};
+  for (const char* name : kScenarios) {
+    std::vector<Message> messages = makeScenario(name, seconds);
+    run(name, messages, seconds, true);
+    failures += !run(name, messages, seconds, false);
+  }
+  if (capture) {
+    std::vector<Message> messages = loadCapture(capture, speed);
+    if (messages.empty()) {
+      printf("%s: no messages\n", capture);
+      failures++;
+    } else {
+      run("capture", messages, 0, true);
+      failures += !run("capture", messages, 0, false);
+    }
+  }
+  return failures ? 1 : 0;
+}